@@ -0,0 +1,367 @@
+#ifndef BATCH_KERNELS_H
+#define BATCH_KERNELS_H
+
+#include <Eigen/Eigen>
+#include <Eigen/StdVector>
+#include <vector>
+
+using namespace std;
+using namespace Eigen;
+
+/*!
+ * \brief Symmetric matrix (covariance), only its upper half is stored : packed column by
+ * column as the symmetric lane batches below, so that the top left corners are prefixes,
+ * 21 scalars instead of 36 in 6D. Assigned from dense matrices (their upper half is read),
+ * dense() and corner() are expressions which expand it on the fly
+ */
+template <typename T>
+class SymmetricMatrixT
+{
+    public:
+        typedef Matrix<T, Dynamic, Dynamic> MatrixXT;
+        typedef Matrix<T, Dynamic, 1>       VectorXT;
+
+        // Coefficient (i,j) of the packed storage, for the dense expressions
+        struct Coefficients
+        {
+                T operator()(Index i, Index j) const
+                {
+                    return m_packed[SymmetricMatrixT::index(i, j)];
+                }
+
+                T const * m_packed;
+        };
+
+        typedef CwiseNullaryOp<Coefficients, MatrixXT> DenseExpression;
+
+        SymmetricMatrixT():
+            m_dim(0)
+        {
+        }
+
+        explicit SymmetricMatrixT(int dim)
+        {
+            setZero(dim);
+        }
+
+        template <typename Derived>
+        SymmetricMatrixT(MatrixBase<Derived> const & dense):
+            m_dim(0)
+        {
+            *this = dense;
+        }
+
+        // Plain matrices, maps and blocks are read in place, other expressions evaluated first
+        template <typename Derived>
+        SymmetricMatrixT & operator=(MatrixBase<Derived> const & dense)
+        {
+            Ref<MatrixXT const> const upper(dense);
+            resize(upper.rows());
+
+            for (int j = 0; j < m_dim; ++j)
+            {
+                for (int i = 0; i <= j; ++i)
+                {
+                    m_packed(index(i, j)) = upper(i, j);
+                }
+            }
+
+            return *this;
+        }
+
+        // From a packed upper half, dim (dim + 1) / 2 scalars
+        void setPacked(int dim, T const * packed)
+        {
+            resize(dim);
+            m_packed = Map<VectorXT const>(packed, m_packed.size());
+        }
+
+        // Memory is kept when the size does not change
+        void resize(int dim)
+        {
+            m_dim = dim;
+            m_packed.resize(packedSize(dim));
+        }
+
+        void setZero(int dim)
+        {
+            resize(dim);
+            m_packed.setZero();
+        }
+
+        void setIdentity(int dim)
+        {
+            setZero(dim);
+
+            for (int i = 0; i < dim; ++i)
+            {
+                m_packed(index(i, i)) = T(1);
+            }
+        }
+
+        int rows() const { return m_dim; }
+        int cols() const { return m_dim; }
+
+        // (i,j) and (j,i) are the same coefficient
+        T & operator()(int i, int j)       { return m_packed(index(i, j)); }
+        T   operator()(int i, int j) const { return m_packed(index(i, j)); }
+
+        T * data()             { return m_packed.data(); }
+        T const * data() const { return m_packed.data(); }
+
+        VectorXT const & packed() const { return m_packed; }
+
+        DenseExpression dense() const
+        {
+            return corner(m_dim);
+        }
+
+        // Top left dim x dim corner
+        DenseExpression corner(int dim) const
+        {
+            Coefficients const coefficients = {m_packed.data()};
+            return MatrixXT::NullaryExpr(dim, dim, coefficients);
+        }
+
+        SymmetricMatrixT & operator*=(T scale)
+        {
+            m_packed *= scale;
+            return *this;
+        }
+
+        bool operator==(SymmetricMatrixT const & rhs) const
+        {
+            return m_dim == rhs.m_dim && m_packed == rhs.m_packed;
+        }
+
+        bool operator!=(SymmetricMatrixT const & rhs) const
+        {
+            return !(*this == rhs);
+        }
+
+        static Index packedSize(int dim)
+        {
+            return Index(dim) * (dim + 1) / 2;
+        }
+
+        static Index index(Index i, Index j)
+        {
+            return i <= j ? j * (j + 1) / 2 + i : i * (i + 1) / 2 + j;
+        }
+
+    private:
+        int      m_dim;
+        VectorXT m_packed;
+};
+
+typedef SymmetricMatrixT<float>  SymmetricMatrix;
+typedef SymmetricMatrixT<double> SymmetricMatrixd;
+
+/*!
+ * \brief A batch of small matrices, stored as structure-of-arrays :
+ * coefficient (i,j) of every matrix is a contiguous run of lanes, one lane per matrix.
+ * The kernels below then process all the lanes at once, one per SIMD slot.
+ * Symmetric batches (covariances) only store the runs of their upper half, packed
+ * column by column : (i,j) and (j,i) are the same run, 21 runs instead of 36 in 6D.
+ */
+template <typename T>
+class LaneMatrices
+{
+    public:
+        // Lane runs are padded to this many scalars, so that every ISA works on full registers
+        static int const LANE_BLOCK = 16;
+
+        LaneMatrices():
+            m_rows(0),
+            m_cols(0),
+            m_count(0),
+            m_stride(0),
+            m_symmetric(false)
+        {
+        }
+
+        // Memory is kept when shrinking, to avoid reallocations from frame to frame
+        void resize(int rows, int cols, int count)
+        {
+            allocate(rows, cols, count, false);
+        }
+
+        // dim x dim symmetric matrices, only the upper half is stored
+        void resizeSymmetric(int dim, int count)
+        {
+            allocate(dim, dim, count, true);
+        }
+
+        int rows() const   { return m_rows; }
+        int cols() const   { return m_cols; }
+        int count() const  { return m_count; }
+        int stride() const { return m_stride; }
+        bool symmetric() const { return m_symmetric; }
+
+        T * lanes(int i, int j)
+        {
+            return &m_data[run(i, j) * m_stride];
+        }
+
+        T const * lanes(int i, int j) const
+        {
+            return &m_data[run(i, j) * m_stride];
+        }
+
+        // Symmetric batches only read the upper half of mat
+        template <typename Derived>
+        void set(int lane, MatrixBase<Derived> const & mat)
+        {
+            for (int j = 0; j < m_cols; ++j)
+            {
+                for (int i = 0; i < (m_symmetric ? j + 1 : m_rows); ++i)
+                {
+                    lanes(i, j)[lane] = mat(i, j);
+                }
+            }
+        }
+
+        // Always dense, symmetric batches are expanded
+        template <typename Derived>
+        void get(int lane, MatrixBase<Derived> & mat) const
+        {
+            for (int j = 0; j < m_cols; ++j)
+            {
+                for (int i = 0; i < m_rows; ++i)
+                {
+                    mat(i, j) = lanes(i, j)[lane];
+                }
+            }
+        }
+
+        // Packed matrices go run by run, symmetric batches only
+        void set(int lane, SymmetricMatrixT<T> const & mat)
+        {
+            T const * in = mat.data();
+
+            for (size_t r = 0; r < runs(); ++r)
+            {
+                m_data[r * m_stride + lane] = in[r];
+            }
+        }
+
+        void get(int lane, SymmetricMatrixT<T> & mat) const
+        {
+            mat.resize(m_rows);
+            T * __restrict out = mat.data();
+
+            for (size_t r = 0; r < runs(); ++r)
+            {
+                out[r] = m_data[r * m_stride + lane];
+            }
+        }
+
+        // Plain matrices are written through their storage, following the runs
+        void get(int lane, Matrix<T, Dynamic, Dynamic> & mat) const
+        {
+            mat.resize(m_rows, m_cols);
+
+            T * __restrict out = mat.data();
+            T const * in = &m_data[lane];
+
+            for (int j = 0; j < m_cols; ++j)
+            {
+                for (int i = 0; i < (m_symmetric ? j + 1 : m_rows); ++i, in += m_stride)
+                {
+                    out[j * m_rows + i] = *in;
+
+                    if (m_symmetric)
+                    {
+                        out[i * m_rows + j] = *in;
+                    }
+                }
+            }
+        }
+
+    private:
+        void allocate(int rows, int cols, int count, bool symmetric)
+        {
+            m_rows = rows;
+            m_cols = cols;
+            m_count = count;
+            m_stride = (count + LANE_BLOCK - 1) / LANE_BLOCK * LANE_BLOCK;
+            m_symmetric = symmetric;
+
+            if (m_data.size() < runs() * m_stride)
+            {
+                m_data.resize(runs() * m_stride, T(0));
+            }
+        }
+
+        size_t runs() const
+        {
+            return m_symmetric ? size_t(m_rows) * (m_rows + 1) / 2 : size_t(m_rows) * m_cols;
+        }
+
+        size_t run(int i, int j) const
+        {
+            if (!m_symmetric)
+            {
+                return size_t(j) * m_rows + i;
+            }
+
+            return i <= j ? size_t(j) * (j + 1) / 2 + i : size_t(i) * (i + 1) / 2 + j;
+        }
+
+        int  m_rows;
+        int  m_cols;
+        int  m_count;
+        int  m_stride;
+        bool m_symmetric;
+
+        vector<T, aligned_allocator<T> > m_data;
+};
+
+/*!
+ * \brief Batched algebra on gaussian components, all matrices are small (typically 4x4 or 6x6).
+ * Shared operands (A, H, offsets, noise, measurement) are dense column-major arrays.
+ * One implementation per instruction set, picked at runtime, see batchKernels().
+ */
+template <typename T>
+struct BatchKernels
+{
+    // out = A.x (+ offset), A is rows x cols, offset can be NULL
+    void (*affine)(T const * A, int rows, int cols, T const * offset,
+                   LaneMatrices<T> const & x, LaneMatrices<T> & out);
+
+    // out = A.P.A^t (+ Q), A is rows x cols, Q can be NULL. out is symmetric (packed)
+    void (*sandwich)(T const * A, int rows, int cols, T const * Q,
+                     LaneMatrices<T> const & P, LaneMatrices<T> & scratch, LaneMatrices<T> & out);
+
+    // From the predicted covariances P and innovation covariances S = H.P.H^t + R :
+    // S^-1 and log(det(S)) (Cholesky), gain K = P.H^t.S^-1 and updated covariance P - K.H.P,
+    // S^-1 and P - K.H.P being symmetric (packed)
+    // valid is cleared for the lanes where S is not positive definite
+    void (*gain)(T const * H, int dim_meas, int dim_state,
+                 LaneMatrices<T> const & P, LaneMatrices<T> const & S,
+                 LaneMatrices<T> & S_inv, T * log_det, unsigned char * valid,
+                 LaneMatrices<T> & K, LaneMatrices<T> & P_upd, LaneMatrices<T> & scratch);
+
+    // out = x + K.(z - Hx), the measurement z being shared by all lanes
+    void (*updateMeans)(LaneMatrices<T> const & K, LaneMatrices<T> const & x,
+                        LaneMatrices<T> const & Hx, T const * z, LaneMatrices<T> & out);
+
+    // Moment matching of the first count lanes, weighted by w :
+    // mean = sum(w.x) / sum(w), cov = sum(w.(P + (x - mean)(x - mean)^t)) / sum(w),
+    // cov being packed (upper half, see SymmetricMatrixT)
+    void (*momentMatch)(LaneMatrices<T> const & x, LaneMatrices<T> const & P, T const * w,
+                        T * mean, T * cov);
+
+    char const * m_isa;
+};
+
+// Best implementation for this CPU, chosen once.
+// GMPHD_KERNELS=scalar|sse4|avx2|avx512 restricts the choice (testing, benchmarking)
+template <typename T>
+BatchKernels<T> const & batchKernels();
+
+// Every implementation this CPU can run, the scalar one first (testing)
+template <typename T>
+vector<BatchKernels<T> > availableBatchKernels();
+
+#endif // BATCH_KERNELS_H
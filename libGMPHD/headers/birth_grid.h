@@ -0,0 +1,87 @@
+#ifndef BIRTH_GRID_H
+#define BIRTH_GRID_H
+
+#include "gaussian_mixture.h"
+#include "mapped_file.h"
+#include <stdint.h>
+#include <string>
+
+/*!
+ * Birth model file, used in place by GMPHD::setBirthGrid().
+ *
+ * Layout (native endianness) : BirthGridHeader, then the raw scalar arrays, each aligned
+ * on BIRTH_GRID_ALIGNMENT bytes and referenced by their offset from the file start :
+ * [weights (n)] [means (dim x n)] [covariances (dim x dim, n times)], column-major,
+ * the same as a mixture in a snapshot (see gmphd_snapshot.h)
+ */
+#define BIRTH_GRID_MAGIC     "GMPHDBRT"
+#define BIRTH_GRID_VERSION   1
+#define BIRTH_GRID_ALIGNMENT 64
+#define BIRTH_GRID_MAX_DIM   64
+
+struct BirthGridHeader {
+    char     m_magic[8];
+    uint32_t m_version;
+    uint32_t m_scalarSize;
+    uint64_t m_fileSize;
+
+    uint64_t m_weights;
+    uint64_t m_means;
+    uint64_t m_covariances;
+    uint32_t m_count;
+    uint32_t m_dim;
+};
+
+/*!
+ * \brief Read-only view on a birth model file, either mapped or a buffer owned by the caller
+ */
+template <typename T>
+class BirthGridT
+{
+    public:
+        typedef Matrix<T, Dynamic, Dynamic> MatrixXT;
+        typedef Matrix<T, Dynamic, 1>       VectorXT;
+        typedef GaussianModelT<T>           Model;
+
+        BirthGridT();
+
+        // Writes aside and renames, a concurrent reader never sees a partial file
+        static bool save(std::string const & path, vector<Model> const & births);
+
+        bool open(std::string const & path);
+
+        bool map(char const * data, size_t size);
+
+        void close();
+
+        bool isOpen() const;
+
+        int  dim() const;
+
+        size_t size() const;
+
+        // Zero-copy access to the stored arrays
+        Map<VectorXT const> weights() const;
+
+        Map<MatrixXT const> means() const;
+
+        Map<MatrixXT const> covariance(int i) const;
+
+    private:
+        bool  validate();
+
+        bool  inBounds(uint64_t offset, uint64_t n_scalars) const;
+
+        BirthGridHeader const & header() const;
+
+        T const * scalars(uint64_t offset) const;
+
+        MappedFile   m_file;
+        char const * m_data;
+        size_t       m_size;
+};
+
+typedef BirthGridT<float>  BirthGrid;
+typedef BirthGridT<double> BirthGridd;
+
+#endif // BIRTH_GRID_H
@@ -0,0 +1,76 @@
+#ifndef COMPACT_MIXTURE_H
+#define COMPACT_MIXTURE_H
+
+#include "gaussian_mixture.h"
+#include <stdint.h>
+
+// Author : Benjamin Lefaudeux (blefaudeux@github)
+
+/*!
+ * \brief Encoding of the compact covariances : IEEE half precision (11 bits of mantissa,
+ * values up to 65504) or bfloat16 (8 bits of mantissa, full single precision range)
+ */
+enum CompactFormat {
+    COMPACT_FLOAT16 = 0,
+    COMPACT_BFLOAT16
+};
+
+/*!
+ * \brief Gaussians stored out of a mixture in a compact form, for the low weight
+ * components which only wait for a measurement.
+ *
+ * Weights and means stay in full precision (half precision can not hold scene sized
+ * positions), covariances are kept as their packed lower triangular Cholesky factor,
+ * in 16 bits : decoded back as L.L^T, they remain symmetric positive definite.
+ * Components which can not be encoded (not positive definite, out of range) stay in the mixture
+ */
+template <typename T>
+class CompactMixtureT {
+    public :
+        typedef Matrix<T, Dynamic, Dynamic> MatrixXT;
+        typedef GaussianModelT<T> Model;
+
+        CompactMixtureT(int dim, CompactFormat format = COMPACT_FLOAT16);
+
+        // Moves the gaussians lighter than threshold out of the mixture, the others keep their order
+        void compact(GaussianMixtureT<T> & mixture, T threshold);
+
+        // Appends all the stored gaussians to the mixture, and empties the store
+        void expand(GaussianMixtureT<T> & mixture);
+
+        // Appends the stored gaussians to the mixture, the store is kept
+        void decode(GaussianMixtureT<T> & mixture) const;
+
+        void clear();
+
+        size_t size() const;
+
+        CompactFormat format() const;
+
+        // Bytes of the stored components (the buffers keep the largest size seen)
+        size_t memoryUsage() const;
+
+    private:
+        bool encode(Model const & model);
+
+        void decode(size_t index, Model & model) const;
+
+    public:
+        int m_dim;
+
+    private:
+        CompactFormat m_format;
+        size_t m_nPacked;     // Packed factor size, dim * (dim + 1) / 2
+
+        vector<T> m_weights;
+        vector<T> m_means;
+        vector<uint16_t> m_factors;
+
+        LLT<MatrixXT> m_llt;
+};
+
+// Single and double precision flavours, both instantiated in the library
+typedef CompactMixtureT<float>  CompactMixture;
+typedef CompactMixtureT<double> CompactMixtured;
+
+#endif // COMPACT_MIXTURE_H
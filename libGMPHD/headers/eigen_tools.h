@@ -13,24 +13,46 @@
 
 using namespace std;
 
-float pseudo_inv(Eigen::MatrixXf const &mat_in,
-                 Eigen::MatrixXf & mat_out);
+// Instantiated for float and double
+// Returns the product of the singular values, log_pdet (if not NULL) is set to
+// the log of the pseudo-determinant (product of the non-zero singular values)
+template <typename T>
+T pseudo_inv(Eigen::Matrix <T, Eigen::Dynamic, Eigen::Dynamic> const &mat_in,
+             Eigen::Matrix <T, Eigen::Dynamic, Eigen::Dynamic> & mat_out,
+             T * log_pdet = NULL);
 
-template <size_t size>
-float pseudo_inv(Eigen::Matrix <float, size,size> const & mat_in,
-                 Eigen::Matrix <float, size,size> & mat_out)
+// Symmetric positive definite matrices (covariances) : Cholesky factorization,
+// closed form inverses up to 4x4. When the factorization fails, these fall back
+// on the pseudo-inverse and return false
+template <typename T>
+bool spd_inverse(Eigen::Matrix <T, Eigen::Dynamic, Eigen::Dynamic> const &mat_in,
+                 Eigen::Matrix <T, Eigen::Dynamic, Eigen::Dynamic> & mat_out,
+                 T * log_det = NULL);
+
+template <typename T>
+bool spd_solve(Eigen::Matrix <T, Eigen::Dynamic, Eigen::Dynamic> const &mat_in,
+               Eigen::Matrix <T, Eigen::Dynamic, Eigen::Dynamic> const &rhs,
+               Eigen::Matrix <T, Eigen::Dynamic, Eigen::Dynamic> & solution);
+
+// Log-pseudo-determinant when the matrix is not positive definite
+template <typename T>
+T spd_log_det(Eigen::Matrix <T, Eigen::Dynamic, Eigen::Dynamic> const &mat_in);
+
+template <typename T, int size>
+T pseudo_inv(Eigen::Matrix <T, size,size> const & mat_in,
+             Eigen::Matrix <T, size,size> & mat_out)
 {
-    Eigen::Matrix <float, size,size> U;
-    Eigen::Matrix <float, size,1> eig_val;
-    Eigen::Matrix <float, size,size> eig_val_inv;
-    Eigen::Matrix <float, size,size> V;
-    float det;
+    Eigen::Matrix <T, size,size> U;
+    Eigen::Matrix <T, size,1> eig_val;
+    Eigen::Matrix <T, size,size> eig_val_inv;
+    Eigen::Matrix <T, size,size> V;
+    T det;
 
-    eig_val_inv = Eigen::MatrixXf::Identity(size,size);
+    eig_val_inv = Eigen::Matrix <T, size,size>::Identity(size,size);
 
     // Compute the SVD decomposition
-    Eigen::JacobiSVD<Eigen::MatrixXf> svd(*mat_in,
-                                          Eigen::ComputeThinU | Eigen::ComputeThinV);
+    Eigen::JacobiSVD<Eigen::Matrix <T, size,size> > svd(mat_in,
+                                          Eigen::ComputeFullU | Eigen::ComputeFullV);
 
     eig_val = svd.singularValues();
     U = svd.matrixU();
@@ -39,16 +61,16 @@ float pseudo_inv(Eigen::Matrix <float, size,size> const & mat_in,
     // Compute pseudo-inverse
     // - quick'n'dirty inversion of eigen matrix
     for (int i = 0; i<size; ++i) {
-        if (eig_val(i,0) != 0.f)
-            eig_val_inv(i,i) = 1.f / eig_val(i,0);
+        if (eig_val(i,0) != 0)
+            eig_val_inv(i,i) = 1 / eig_val(i,0);
         else
-            eig_val_inv(i,i) = 0.f;
+            eig_val_inv(i,i) = 0;
     }
 
-    *mat_out = V.transpose() * eig_val_inv * U.transpose();
+    mat_out = V * eig_val_inv * U.transpose();
 
     // Compute determinant from eigenvalues..
-    det = 1.f;
+    det = 1;
     for (int i=0; i<size; ++i) {
         det *= eig_val(i,0);
     }
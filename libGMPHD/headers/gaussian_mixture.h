@@ -4,9 +4,11 @@
 // Author : Benjamin Lefaudeux (blefaudeux@github)
 
 
+#include "batch_kernels.h"
 #include "eigen_tools.h"
 #include <list>
 #include <algorithm>
+#include <stdint.h>
 
 using namespace std;
 using namespace Eigen;
@@ -19,15 +21,48 @@ struct index_w {
         int   m_index;
 };
 
-struct GaussianModel
+template <typename T>
+struct GaussianModelT
 {
-        GaussianModel(int dim=4): //Ben - fixme, define this as a template argument !
+        typedef Matrix<T, Dynamic, Dynamic> MatrixXT;
+
+        GaussianModelT(int dim=4): //Ben - fixme, define this as a template argument !
             m_dim(dim)
         {
             clear();
         }
 
-        GaussianModel & operator=(const GaussianModel & rhs)
+        GaussianModelT(const GaussianModelT & rhs):
+            m_dim(rhs.m_dim),
+            m_weight(rhs.m_weight),
+            m_mean(rhs.m_mean),
+            m_cov(rhs.m_cov)
+        {
+        }
+
+        // Moves hand the matrices over, no allocation (sorting, pools)
+        GaussianModelT(GaussianModelT && rhs):
+            m_dim(rhs.m_dim),
+            m_weight(rhs.m_weight),
+            m_mean(std::move(rhs.m_mean)),
+            m_cov(std::move(rhs.m_cov))
+        {
+        }
+
+        GaussianModelT & operator=(GaussianModelT && rhs)
+        {
+            if( this != &rhs )
+            {
+                m_mean = std::move(rhs.m_mean);
+                m_cov = std::move(rhs.m_cov);
+                m_dim = rhs.m_dim;
+                m_weight = rhs.m_weight;
+            }
+
+            return *this;
+        }
+
+        GaussianModelT & operator=(const GaussianModelT & rhs)
         {
             if( this != &rhs )
             {
@@ -42,54 +77,140 @@ struct GaussianModel
 
         void clear()
         {
-            m_mean = MatrixXf::Zero(m_dim,1);
-            m_cov  = MatrixXf::Identity( m_dim, m_dim);
-            m_weight = 0.f;
+            m_mean = MatrixXT::Zero(m_dim,1);
+            m_cov.setIdentity(m_dim);
+            m_weight = 0;
+        }
+
+        // Dense copy of the covariance
+        MatrixXT covariance() const
+        {
+            return m_cov.dense();
         }
 
         int m_dim;
-        float m_weight;
+        T   m_weight;
 
-        MatrixXf m_mean;
-        MatrixXf m_cov;
+        MatrixXT m_mean;
+
+        // Packed upper half, see SymmetricMatrixT : m_cov.dense() or covariance() expand it
+        SymmetricMatrixT<T> m_cov;
 };
 
 /*!
  * \brief The gaussian_mixture is a sum of gaussian models,
  *  with according weights. Everything is public, no need to get/set...
  */
-class GaussianMixture {
+template <typename T>
+class GaussianMixtureT {
     public :
-        GaussianMixture(int dim);
+        typedef Matrix<T, Dynamic, Dynamic> MatrixXT;
+        typedef GaussianModelT<T> Model;
+
+        GaussianMixtureT(int dim);
 
-        GaussianMixture( GaussianMixture const & source);
+        GaussianMixtureT( GaussianMixtureT const & source);
 
-        GaussianMixture( vector<GaussianModel> const & source );
+        GaussianMixtureT( vector<Model> const & source );
 
-        GaussianMixture operator=(const GaussianMixture &source);
+        GaussianMixtureT operator=(const GaussianMixtureT &source);
 
-        GaussianModel mergeGaussians(vector<int> &i_gaussians_to_merge, bool b_remove_from_mixture);
+        Model mergeGaussians(vector<int> &i_gaussians_to_merge, bool b_remove_from_mixture);
 
 
-        void  normalize(float linear_offset);
-        void  normalize(float linear_offset, int start_pos, int stop_pos, int step);
+        void  normalize(T linear_offset);
+        void  normalize(T linear_offset, int start_pos, int stop_pos, int step);
 
         void print();
 
-        void prune(float  trunc_threshold, float  merge_threshold, unsigned int max_gaussians);
+        // Pool of capacity preallocated gaussians : resize() then moves gaussians
+        // in and out of the pool instead of allocating, up to the capacity.
+        // The pruning scratch is sized for n_threads merging threads
+        void reserve(size_t capacity, unsigned int n_threads = 1);
+
+        void resize(size_t size);
+
+        size_t capacity() const;
+
+        // Closeness is measured on the positions, the first dim_pos coordinates of the states.
+        // n_threads > 1 : neighbours are searched on a spatial grid, cells spread over threads.
+        // Same result as the serial greedy merging, which is the fallback for degenerate covariances
+        void prune(T  trunc_threshold, T  merge_threshold, unsigned int max_gaussians,
+                   int dim_pos, unsigned int n_threads = 1);
 
         void sort();
 
-        void selectCloseGaussians(int i_ref, float threshold, vector<int> & close_gaussians);
+        void selectCloseGaussians(int i_ref, T threshold, int dim_pos, vector<int> & close_gaussians);
 
         int selectBestGaussian();
 
-        void changeReferential(const Matrix4f & transform);
+        void changeReferential(const MatrixXT & transform);
+
+        // Only the gaussians [begin, end)
+        void changeReferential(const MatrixXT & transform, size_t begin, size_t end);
+
+    private:
+        void mergeModels(int const * i_gaussians_to_merge, int n_merged, LaneMatrices<T> & means,
+                         LaneMatrices<T> & covs, vector<T> & weights, Model & merged) const;
+
+        bool pruneParallel(T trunc_threshold, T merge_threshold, unsigned int max_gaussians,
+                           int dim_pos, unsigned int n_threads);
 
     public:
-        vector <GaussianModel> m_gaussians;
+        vector <Model> m_gaussians;
         int m_dim;
 
+    private:
+        // Scratch buffers for the batched operations, kept to avoid reallocations
+        MatrixXT m_batchIn;
+        MatrixXT m_batchOut;
+
+        LaneMatrices<T> m_laneMeans;
+        LaneMatrices<T> m_laneCovs;
+        vector<T> m_laneWeights;
+
+        // Parallel pruning : position inverses, grid cells, neighbours of every candidate,
+        // and the merged groups as runs of m_groupMembers
+        typedef Matrix<T, Dynamic, Dynamic, 0, 3, 3> MatrixPosT;
+
+        static int const NEIGHBOURS_RESERVE = 16;
+
+        struct MergeScratch
+        {
+                LaneMatrices<T> m_means;
+                LaneMatrices<T> m_covs;
+                vector<T>       m_weights;
+        };
+
+        vector<MatrixPosT>                  m_inverses;
+        vector<char>                        m_factorized;
+        vector< std::pair<uint64_t, int> >  m_cells;
+        vector<int>                         m_coords;
+        vector<int>                         m_cellStarts;
+        vector< vector<int> >               m_neighbours;
+        vector<int>                         m_groupMembers;
+        vector<int>                         m_groupStarts;
+        vector<Model>                       m_prunedModels;
+        vector<MergeScratch>                m_mergeScratch;
+
+        // Serial pruning scratch
+        vector<char> m_merged;
+        vector<int>  m_closeGaussians;
+        MatrixXT     m_refCov;
+        MatrixXT     m_refInverse;
+        MatrixXT     m_diff;
+        MatrixXT     m_solved;
+        Model        m_mergedModel;
+
+        vector <Model> m_pool;
+        bool           m_pooled;
 };
 
+// Single and double precision flavours, both instantiated in the library
+typedef GaussianModelT<float>    GaussianModel;
+typedef GaussianModelT<double>   GaussianModeld;
+
+typedef GaussianMixtureT<float>  GaussianMixture;
+typedef GaussianMixtureT<double> GaussianMixtured;
+
 #endif // GAUSSIAN_MIXTURE_H
@@ -4,82 +4,358 @@
 // Author : Benjamin Lefaudeux (blefaudeux@github)
 
 
+#include "batch_kernels.h"
+#include "birth_grid.h"
+#include "compact_mixture.h"
 #include "gaussian_mixture.h"
+#include "gmphd_smoother.h"
+#include "measurement_clustering.h"
+#include <chrono>
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <string>
 
 using namespace std;
 using namespace Eigen;
 
+template <typename T> class GMPHDRecorderT;
+template <typename T> class GMPHDSnapshotT;
+
 /*!
  * \brief The spawning_model struct
  */
-struct SpawningModel {
+template <typename T>
+struct SpawningModelT {
+  typedef Matrix<T, Dynamic, Dynamic> MatrixXT;
 
-  SpawningModel(int dim = 2):
+  SpawningModelT(int dim = 2):
     m_dim(dim)
   {
     m_state = m_dim * 2;
-    m_trans = MatrixXf::Ones(m_state, m_state);
-    m_cov = MatrixXf::Ones(m_state, m_state);
-    m_offset = MatrixXf::Zero(m_state,1);
-    m_weight = 0.1f;
+    m_trans = MatrixXT::Ones(m_state, m_state);
+    m_cov = MatrixXT::Ones(m_state, m_state);
+    m_offset = MatrixXT::Zero(m_state,1);
+    m_weight = T(0.1);
   }
 
   int m_dim;
   int m_state;
 
-  float m_weight;
+  T m_weight;
+
+  MatrixXT m_trans;
+  MatrixXT m_cov;
+  MatrixXT m_offset;
+};
+
+/*!
+ * \brief Observation model of one sensor, for the sequential corrections (see GMPHD::correct()).
+ * Same meaning as the parameters of GMPHD::setObservationModel()
+ */
+template <typename T>
+struct SensorModelT {
+  SensorModelT(T p_detection = T(0.9), T noise_pose = T(1), T noise_speed = T(1),
+               T noise_background = T(1)):
+    m_pDetection(p_detection),
+    m_measNoisePose(noise_pose),
+    m_measNoiseSpeed(noise_speed),
+    m_measNoiseBackground(noise_background)
+  {
+  }
 
-  MatrixXf m_trans;
-  MatrixXf m_cov;
-  MatrixXf m_offset;
+  T m_pDetection;
+  T m_measNoisePose;
+  T m_measNoiseSpeed;
+  T m_measNoiseBackground;
+};
+
+/*!
+ * \brief Nonlinear measurement model (range / bearing radars..), see GMPHD::setMeasurementModel().
+ * The measurements keep the layout of the linear case (positions, then speeds with the motion
+ * model), the function maps states to them. Both functions work on batches, one column per
+ * state : m_function fills measures (state size x n), m_jacobian the n Jacobians side by side
+ * (state size x (state size * n)), only needed for the extended update.
+ * Measurements which wrap around (bearings..) also need m_difference, lhs - rhs column by
+ * column, and m_mean, the weighted mean of the columns of points (weights : one per column),
+ * used by the unscented update. Without them both are the plain vector operations
+ */
+template <typename T>
+struct MeasurementModelT {
+  typedef Matrix<T, Dynamic, Dynamic> MatrixXT;
+  typedef std::function<void(Map<MatrixXT const> const & states, Map<MatrixXT> measures)> Function;
+  typedef std::function<void(Map<MatrixXT const> const & lhs, Map<MatrixXT const> const & rhs,
+                             Map<MatrixXT> difference)> Difference;
+  typedef std::function<void(Map<MatrixXT const> const & points, Map<MatrixXT const> const & weights,
+                             Map<MatrixXT> mean)> Mean;
+
+  MeasurementModelT(Function function = Function(), Function jacobian = Function(),
+                    Difference difference = Difference(), Mean mean = Mean()):
+    m_function(function),
+    m_jacobian(jacobian),
+    m_difference(difference),
+    m_mean(mean),
+    m_alpha(T(1)),
+    m_beta(T(2)),
+    m_kappa(T(0))
+  {
+  }
+
+  Function m_function;
+  Function m_jacobian;
+  Difference m_difference;
+  Mean m_mean;
+
+  // Measurement noise covariance (state size square), when the noises of setObservationModel()
+  // do not fit the measurement units. Empty : those are used
+  MatrixXT m_noise;
+
+  // Sigma points spread and weights of the unscented update
+  T m_alpha;
+  T m_beta;
+  T m_kappa;
+};
+
+enum NonlinearUpdate {
+  UPDATE_UNSCENTED = 0,
+  UPDATE_EXTENDED
 };
 
 typedef uint uint;
 
+/*!
+ * \brief Capacity of every stage of the filter, for the bounded memory mode :
+ * everything is allocated up front, and each stage keeps its heaviest components
+ * when it would overflow
+ */
+struct GMPHDCapacity {
+  GMPHDCapacity(uint max_targets = 100, uint max_measurements = 1000,
+                uint max_births = 100, uint max_spawns = 100):
+    m_maxTargets(max_targets),
+    m_maxMeasurements(max_measurements),
+    m_maxBirths(max_births),
+    m_maxSpawns(max_spawns),
+    m_maxPredictions(max_targets + max_births + max_spawns),
+    m_maxCandidates(4 * max_targets)
+  {
+  }
+
+  uint m_maxTargets;      // After pruning
+  uint m_maxMeasurements; // Per frame, the extra ones are ignored
+  uint m_maxBirths;       // Size of the birth model
+  uint m_maxSpawns;       // Spawned per frame
+  uint m_maxPredictions;  // Survivors + births + spawns
+  uint m_maxCandidates;   // Out of the update, before pruning
+};
+
+/*!
+ * \brief What the bounded stages had to drop, since the filter was created
+ */
+struct CapacityStats {
+  size_t m_droppedMeasurements = 0;
+  size_t m_droppedSpawns = 0;
+  size_t m_droppedCandidates = 0;
+};
+
+/*!
+ * \brief Cost of the last propagate() with a time budget, and what was degraded to fit it
+ * (see GMPHD::setFrameBudget()). Durations in seconds
+ */
+struct FrameStats {
+  double m_budget = 0;
+  double m_estimated = 0;             // Before any degradation, 0 until the cost model is known
+  double m_elapsed = 0;
+
+  size_t m_gatedMeasurements = 0;     // Outside the gate of every target
+  size_t m_droppedSpawns = 0;
+  size_t m_truncatedTargets = 0;
+  double m_truncationThreshold = 0;   // Heaviest truncated weight, 0 if none
+  size_t m_subsampledMeasurements = 0;
+
+  // Since the filter was created
+  size_t m_degradedFrames = 0;
+  size_t m_overruns = 0;              // Over budget all the same
+};
+
 /*!
  * \brief The gmphd_filter class
  */
-class GMPHD
+template <typename T>
+class GMPHDT
 {
 public:
-  GMPHD(int max_gaussians, int dimension,
+  typedef Matrix<T, Dynamic, Dynamic> MatrixXT;
+  typedef GaussianModelT<T>   GaussianModel;
+  typedef GaussianMixtureT<T> GaussianMixture;
+  typedef CompactMixtureT<T>  CompactMixture;
+  typedef GMPHDSmootherT<T>   Smoother;
+  typedef MeasurementClusteringT<T> MeasurementClustering;
+  typedef BirthGridT<T>       BirthGrid;
+  typedef SpawningModelT<T>   SpawningModel;
+  typedef SensorModelT<T>     SensorModel;
+  typedef MeasurementModelT<T> MeasurementModel;
+  typedef GMPHDRecorderT<T>   GMPHDRecorder;
+  typedef GMPHDSnapshotT<T>   GMPHDSnapshot;
+
+  GMPHDT(int max_gaussians, int dimension,
+        bool motion_model = false, bool verbose = false);
+
+  // Bounded memory mode : no allocation once warm, see GMPHDCapacity.
+  // The update always keeps the best candidates (fused pruning)
+  GMPHDT(GMPHDCapacity const & capacity, int dimension,
         bool motion_model = false, bool verbose = false);
 
   bool isInitialized();
 
-  // Input: raw measurements and possible ref change
-  void  setNewReferential( Matrix4f const & transform);
+  bool isBounded() const;
+
+  CapacityStats const & capacityStats() const;
 
-  void  setNewMeasurements( vector<float> const & position, vector<float> const & speed);
+  // Time budget of propagate() (seconds, 0 : none). The cost of a frame is estimated from the
+  // number of predictions and measurements, with a cost per association learned from the
+  // previous frames. A frame over budget is degraded, each step as far as needed : the
+  // lightest spawns are dropped, then the measurements outside the gate of every target,
+  // then the lightest survivors (raised truncation threshold, never above 0.5), then the
+  // measurements are subsampled. frameStats() reports what was degraded. A given cost per
+  // association (seconds) replaces the learned one, the degradation is then deterministic
+  void  setFrameBudget(double seconds, double association_cost = 0);
+
+  FrameStats const & frameStats() const;
+
+  // Input: raw measurements and possible ref change. The change is composed with the next
+  // prediction, the extracted targets and snapshots are transformed copies meanwhile.
+  // Within a frame (after predict()), the prediction or posterior of the next correction
+  // is transformed right away
+  void  setNewReferential( MatrixXT const & transform);
+
+  void  setNewMeasurements( vector<T> const & position, vector<T> const & speed);
+
+  // Dense sensors : the measurements of a voxel (positions, voxel_size wide) are fused into
+  // their centroid before the update, see measurement_clustering.h. The covariance of each
+  // centroid is added to the innovation of the predictions it updates (not of the mapped
+  // births, whose update terms stay cached). Applies to setNewMeasurements() and correct(),
+  // 0 disables it
+  void  setMeasurementClustering(T voxel_size);
+
+  // Measurements before and after clustering, since it was enabled
+  ClusteringStats clusteringStats() const;
 
   // Output
-  void  getTrackedTargets( vector<float> & position, vector<float> & speed, vector<float> & weight,
-                           float const & extract_thld );
+  void  getTrackedTargets( vector<T> & position, vector<T> & speed, vector<T> & weight,
+                           T const & extract_thld );
+
+  // Smoothed output, for the frame smoothingDelay() frames ago (see setSmoothing()).
+  // In the referential of that frame
+  void  getSmoothedTargets( vector<T> & position, vector<T> & speed, vector<T> & weight,
+                            T const & extract_thld ) const;
+
+  uint  smoothingDelay() const;
 
   // Parameters to set before use
-  void  setDynamicsModel( float sampling, float processNoise );
+  void  setDynamicsModel( T sampling, T processNoise );
 
-  void  setDynamicsModel( MatrixXf const & tgt_dyn_transitions, MatrixXf const & tgt_dyn_covariance);
+  // Custom motion model, propagate(timestamp) then uses it whatever the interval
+  void  setDynamicsModel( MatrixXT const & tgt_dyn_transitions, MatrixXT const & tgt_dyn_covariance);
 
-  void  setSurvivalProbability(float _prob_survival);
+  // Intervals closer than quantum (seconds) share the same motion model, 1ms by default
+  void  setTimeQuantum(double quantum);
 
-  void  setObservationModel(float probDetectionOverall, float m_measNoisePose,
-                            float m_measNoiseSpeed, float m_measNoiseBackground );
+  void  setSurvivalProbability(T _prob_survival);
 
-  void  setPruningParameters(float  prune_trunc_thld, float  prune_merge_thld,
+  void  setObservationModel(T probDetectionOverall, T m_measNoisePose,
+                            T m_measNoiseSpeed, T m_measNoiseBackground );
+
+  // Nonlinear measurements : the update pushes the predictions through model.m_function
+  // (unscented, or extended with model.m_jacobian) instead of the linear observation matrix.
+  // The noises of setObservationModel() (or of the SensorModel) apply, unless model.m_noise is set.
+  // Not part of the snapshots, like the recorder
+  void  setMeasurementModel(MeasurementModel const & model, NonlinearUpdate update = UPDATE_UNSCENTED);
+
+  void  clearMeasurementModel();
+
+  void  setPruningParameters(T  prune_trunc_thld, T  prune_merge_thld,
                              int    prune_max_nb);
 
+  // Keep at most candidate_factor * prune_max_nb components out of the update
+  void  setFusedPruning(bool enable, uint candidate_factor = 4);
+
+  // Merge the gaussians over n_threads threads when pruning (1 : serial)
+  void  setParallelMerging(uint n_threads);
+
+  // Run the prediction stages (births, spawns, survivals) concurrently, and the per component
+  // loops of the prediction and update over n_threads threads (1 : serial), on the pool shared
+  // with the merging. Small frames stay on the calling thread
+  void  setThreads(uint n_threads);
+
+  // Compact tier : after pruning, the components lighter than weight_threshold are kept out of
+  // the posterior with a 16 bits covariance (see compact_mixture.h), and decoded back at the
+  // next prediction, before they take part in the update and merging. 0 (default) disables it.
+  // Keep it below the extraction threshold, the compact components are not reported.
+  // Not available in bounded mode, whose memory is preallocated anyway
+  void  setCompactStorage(T weight_threshold, CompactFormat format = COMPACT_FLOAT16);
+
+  // Stored as is : a pending referential change only applies at the next prediction
+  CompactMixture const & compactTargets() const;
+
+  // Fixed-lag smoothing : the pruned posteriors of the last lag frames are kept, and every
+  // frame smooths the oldest one with a backward pass over them (see gmphd_smoother.h).
+  // Allocated here, for the maximum number of gaussians of the pruning. 0 (default) disables it
+  void  setSmoothing(uint lag);
+
   void  setBirthModel(vector<GaussianModel> & m_birthModel);
 
+  // Births mapped from a file (see birth_grid.h), on top of setBirthModel() : used in place,
+  // never copied into the predictions, their update terms are computed once per observation
+  // noise and cached. The grid is not owned and has to outlive the filter (NULL unsets it).
+  // Not part of the snapshots, like the recorder
+  void  setBirthGrid(BirthGrid const * grid);
+
   void  setSpawnModel(vector<SpawningModel> & spawnModels);
 
+  // Persistence : binary snapshot of the whole filter state, see gmphd_snapshot.h
+  bool  saveState(std::string const & path) const;
+
+  void  saveState(vector<char> & buffer) const;
+
+  // A bounded filter rejects the snapshots which exceed its capacity, and is then left untouched
+  bool  loadState(std::string const & path);
+
+  bool  loadState(GMPHDSnapshot const & snapshot);
+
+  // Record every input call (measurements, referential, propagate), see gmphd_recorder.h
+  // The recorder is not owned, NULL stops recording
+  void  setRecorder(GMPHDRecorder * recorder);
+
   // Auxiliary functions
   void  print() const;
 
   void  propagate();
 
+  // Propagate up to timestamp (seconds) : the motion model is built for the elapsed time
+  // (white noise acceleration, with the process noise of setDynamicsModel() as intensity)
+  // and cached per quantized interval. The first call uses the sampling period
+  void  propagate(double timestamp);
+
+  // Several sensors per frame : one prediction, one correction per measurement set,
+  // each with its own observation model, then a single pruning. propagate() is the same
+  // as predict(), a correction with setNewMeasurements() and setObservationModel(), prune()
+  void  predict();
+
+  void  predict(double timestamp);
+
+  void  correct(vector<T> const & position, vector<T> const & speed, SensorModel const & sensor);
+
+  void  prune();
+
+  // Composite filters (see gmphd_tiled.h) : the pending prediction, and the current posterior
+  GaussianMixture const & predictedTargets() const;
+
+  GaussianMixture & currentTargets();
+
+  // Components predicted by another filter, added to the prediction of the next correction
+  // only (after predict()) : like the births, they get no missed detection term
+  void  addExternalPredictions(vector<GaussianModel> const & predictions);
+
   void  reset();
 
 private:
@@ -89,22 +365,123 @@ private:
      */
   vector <SpawningModel, aligned_allocator <SpawningModel> > m_spawnModels;
 
-  void  buildUpdate();
+  void  gatherPredictions();
+
+  void  appendGridBirths(GaussianMixture & mixture) const;
+
+  void  cacheGridUpdate(MatrixXT const & obs_cov);
+
+  void  buildUpdate(MatrixXT const & obs_cov);
 
-  void  extractTargets(float threshold);
+  void  buildNonlinearUpdate(MatrixXT const & obs_cov);
+
+  void  buildLikelihoods(T p_detection);
+
+  void  extractTargets(T threshold);
 
   void  predictBirth();
 
-  void  predictTargets();
+  void  predictSpawns();
+
+  void  predictTargets(MatrixXT const & trans, T const * offset, MatrixXT const & cov);
+
+  void  changePredictionsReferential(MatrixXT const & transform);
+
+  void  applyReferential();
+
+  void  referentialState(MatrixXT const & transform);
+
+  void  smootherReferential(MatrixXT const & transform);
+
+  void  predictWith(MatrixXT const & trans, MatrixXT const & cov);
+
+  void  predictAt(double timestamp);
+
+  void  correctWith(MatrixXT const & obs_cov, T p_detection, T background);
+
+  void  capPredictions();
+
+  void  finishFrame();
+
+  void  fitFrameBudget(MatrixXT const & obs_cov);
+
+  void  endFrameBudget(std::chrono::steady_clock::time_point const & start);
+
+  void  loadMeasurements(vector<T> const & position, vector<T> const & speed);
 
   void  pruneGaussians();
 
-  void  update();
+  void  update(T p_detection, T background);
+
+  void  updateBounded(T p_detection, T background);
+
+  void  offerCandidate(T weight, uint i_meas, uint i_target);
+
+  // A clustered measurement of several members, which carries its own covariance
+  bool  isCluster(GaussianModel const & measure) const;
+
+  // The measurement model has its own difference : the residuals come from m_residuals
+  bool  hasResidualHook() const;
+
+  // Residual z - h(x) of a measurement and a prediction, in m_innovation
+  void  residual(uint i_meas, uint i_target);
+
+  void  updateWithCluster(uint i_target, uint i_meas, GaussianModel & updated);
+
+  void  toLanes(vector<GaussianModel> const & gaussians,
+                LaneMatrices<T> & means, LaneMatrices<T> & covs) const;
+
+  template <typename Task>
+  void  forComponents(int n_components, Task const & task) const;
+
+  /*!
+   * \brief One (measurement, prediction) association kept by the bounded update
+   * m_meas is 0 for a missed detection, n+1 for the n-th measurement
+   */
+  struct UpdateCandidate {
+    T     m_weight;
+    uint  m_meas;
+    uint  m_target;
+  };
+
+  /*!
+   * \brief Motion model for one quantized interval, see propagate(timestamp)
+   */
+  struct CachedDynamics {
+    long long     m_key;
+    unsigned long m_lastUse;
+    MatrixXT      m_trans;
+    MatrixXT      m_cov;
+  };
+
+  CachedDynamics const & dynamicsFor(double interval);
 
 
 private:
   bool  m_motionModel;
   bool  m_bVerbose;
+  bool  m_fusedPruning;
+  bool  m_bounded;
+
+  GMPHDCapacity m_capacity;
+  CapacityStats m_capacityStats;
+
+  // Time budget : seconds per association unit (0 until measured), units of the current frame
+  double     m_frameBudget;
+  double     m_budgetRate;
+  bool       m_budgetFixed;  // m_budgetRate given, not learned
+  double     m_frameUnits;
+  FrameStats m_frameStats;
+  vector <char> m_inGate;
+  vector< std::pair<T, int> > m_gateOrder;
+  MatrixXT   m_gateCov;
+  MatrixXT   m_gateInverse;
+  MatrixXT   m_gateDiff;
+  MatrixXT   m_gateSolved;
+  MatrixXT   m_gateClusterCov;
+  MatrixXT   m_gateClusterInverse;
+
+  GMPHDRecorder * m_recorder;
 
   uint   m_maxGaussians;
   uint   m_dimMeasures;
@@ -112,34 +489,152 @@ private:
   uint   m_nPredTargets;
   uint   m_nCurrentTargets;
   uint   m_nMaxPrune;
+  uint   m_candidateFactor;
+  uint   m_maxCandidates;
+  uint   m_mergeThreads;
+  uint   m_threads;
 
-  float m_pSurvival;
-  float m_pDetection;
+  T m_pSurvival;
+  T m_pDetection;
 
-  float m_samplingPeriod;
-  float m_processNoise;
+  T m_samplingPeriod;
+  T m_processNoise;
 
-  float m_pruneMergeThld;
-  float m_pruneTruncThld;
+  T m_pruneMergeThld;
+  T m_pruneTruncThld;
 
-  float m_measNoisePose;
-  float m_measNoiseSpeed;
-  float m_measNoiseBackground; // Background detection "noise", other models are possible..
+  T m_measNoisePose;
+  T m_measNoiseSpeed;
+  T m_measNoiseBackground; // Background detection "noise", other models are possible..
 
   vector<uint> m_iBirthTargets;
 
-  MatrixXf  m_tgtDynTrans;
-  MatrixXf  m_tgtDynCov;
-
-  MatrixXf  m_obsMat;
-  MatrixXf  m_obsMatT;
-  MatrixXf  m_obsCov;
-
-  // Temporary matrices, used for the update process
-  vector <MatrixXf, aligned_allocator <MatrixXf> > m_covariance;
-  vector <MatrixXf, aligned_allocator <MatrixXf> > m_expMeasure;
-  vector <MatrixXf, aligned_allocator <MatrixXf> > m_expDisp;
-  vector <MatrixXf, aligned_allocator <MatrixXf> > m_uncertainty;
+  MatrixXT  m_tgtDynTrans;
+  MatrixXT  m_tgtDynCov;
+
+  // Timestamped propagation : motion models of the last intervals, least recently used replaced
+  vector <CachedDynamics> m_dynamicsCache;
+  unsigned long m_dynamicsClock;
+  double m_timeQuantum;
+  double m_lastTimestamp;
+  bool   m_hasTimestamp;
+  bool   m_customDynamics;
+
+  // Sequential corrections : prediction pending, and the corrections applied since
+  bool   m_predicted;
+
+  // Referential change waiting for the next prediction (see setNewReferential()),
+  // applied on the spot if the current targets are handed out in between
+  bool      m_pendingReferential;
+  MatrixXT  m_referential;
+  MatrixXT  m_referentialScratch;
+  MatrixXT  m_refState;
+  MatrixXT  m_refOffset;
+  MatrixXT  m_predTrans;
+  MatrixXT  m_predOffset;
+  MatrixXT  m_spawnTrans;
+  MatrixXT  m_spawnOffset;
+  uint   m_nCorrections;
+  MatrixXT  m_sensorCov;
+
+  // Measurement clustering, and the update of a prediction with a cluster
+  // (see updateWithCluster())
+  std::unique_ptr<MeasurementClustering> m_clustering;
+  vector<int> m_clusterRows;
+  MatrixXT  m_clusterCross;
+  MatrixXT  m_clusterInnov;
+  MatrixXT  m_clusterGainT;
+  LLT<MatrixXT> m_clusterLLT;
+
+  MatrixXT  m_obsMat;
+  MatrixXT  m_obsMatT;
+  MatrixXT  m_obsCov;
+
+  // Nonlinear measurements : the model, and the batches pushed through it
+  bool  m_nonlinear;
+  NonlinearUpdate   m_nonlinearUpdate;
+  MeasurementModel  m_measurementModel;
+  vector <T> m_sigmaStates;
+  vector <T> m_sigmaMeasures;
+  vector <T> m_jacobians;
+  LLT<MatrixXT> m_sigmaLLT;
+  MatrixXT  m_sigmaSqrt;
+  MatrixXT  m_sigmaWeights;
+  MatrixXT  m_stateDeviations;
+  MatrixXT  m_measureDeviations;
+  vector <T> m_sigmaExpected;
+  MatrixXT  m_sigmaMeanWeights;
+  MatrixXT  m_crossCov;
+  MatrixXT  m_innovInverse;
+  MatrixXT  m_updatedCov;
+
+  // Measurement residuals z - h(x) of all the (measurement, prediction) pairs, when the model
+  // has its own difference : n_meas columns per prediction, see buildLikelihoods()
+  vector <T> m_residualLhs;
+  vector <T> m_residualRhs;
+  vector <T> m_residuals;
+  LaneMatrices<T> m_laneResiduals;
+  MatrixXT  m_zeroMeasure;
+
+  // Mapped births : they follow the predictions in the update (m_nGridBirths of them in the
+  // current correction), with their update terms cached for m_gridObsCov
+  BirthGrid const * m_birthGrid;
+  uint      m_nGridBirths;
+  bool      m_gridCached;
+  MatrixXT  m_gridObsCov;
+  MatrixXT  m_gridInnov;
+  MatrixXT  m_gridMeasure;
+  MatrixXT  m_gridGainMatrix;
+  LaneMatrices<T> m_gridMeans;
+  LaneMatrices<T> m_gridMeasures;
+  LaneMatrices<T> m_gridGain;
+  LaneMatrices<T> m_gridCovUpdate;
+  LaneMatrices<T> m_gridQuadratic;
+  LaneMatrices<T> m_gridOutMeans;
+
+  // Temporary matrices, used for the update process. The updated covariances
+  // stay packed in m_laneCovUpdate, and are only expanded into the new components
+  vector <MatrixXT, aligned_allocator <MatrixXT> > m_expMeasure;
+  vector <MatrixXT, aligned_allocator <MatrixXT> > m_expDisp;
+  vector <MatrixXT, aligned_allocator <MatrixXT> > m_uncertainty;
+
+  // Batched computations, one lane per gaussian (see batch_kernels.h)
+  LaneMatrices<T> m_laneMeans;
+  LaneMatrices<T> m_laneCovs;
+  LaneMatrices<T> m_laneOutMeans;
+  LaneMatrices<T> m_laneOutCovs;
+  LaneMatrices<T> m_spawnOutMeans;
+  LaneMatrices<T> m_spawnOutCovs;
+  LaneMatrices<T> m_spawnScratch;
+  LaneMatrices<T> m_laneMeasures;
+  LaneMatrices<T> m_laneInnov;
+  LaneMatrices<T> m_laneInnovInv;
+  LaneMatrices<T> m_laneGain;
+  LaneMatrices<T> m_laneCovUpdate;
+  LaneMatrices<T> m_laneScratch;
+  vector <T> m_laneLogDet;
+  vector <unsigned char> m_laneValid;
+
+  // Matching factors of all the (measurement, prediction) pairs, M x N,
+  // and the features they are computed from, see buildLikelihoods()
+  // (storage kept from frame to frame, mapped with the current dimensions)
+  vector <T> m_likelihoods;
+  vector <T> m_measFeatures;
+  vector <T> m_predFeatures;
+  MatrixXT  m_likelihoodOrigin;
+  MatrixXT  m_centered;
+  MatrixXT  m_positionDisp;
+  MatrixXT  m_whitening;
+  MatrixXT  m_whitened;
+  MatrixXT  m_quadratic;
+  MatrixXT  m_innovation;
+
+  // Spawn selection when over capacity : (weight, index) and destination slots
+  vector <std::pair<T, uint> > m_spawnOrder;
+  vector <int> m_spawnSlots;
+
+  // Bounded update : min-heap of the best candidates
+  vector <UpdateCandidate> m_candidates;
 
   std::unique_ptr<GaussianMixture> m_birthModel;
 
@@ -149,61 +644,53 @@ private:
   std::unique_ptr<GaussianMixture> m_extractedTargets;
   std::unique_ptr<GaussianMixture> m_measTargets;
   std::unique_ptr<GaussianMixture> m_spawnTargets;
+  std::unique_ptr<GaussianMixture> m_externalTargets;
 
-private:
-
-  template <size_t D>
-  float mahalanobis(const Matrix <float, D,1> &point,
-                    const Matrix <float, D,1> &mean,
-                    const Matrix <float, D,D> &cov)
-  {
-      int ps = point.rows();
-      MatrixXf x_cen = point-mean;
-      MatrixXf b = MatrixXf::Identity(ps,ps);
-
-      // TODO: Ben - cov needs to be normalized !
-      cov.ldlt().solveInPlace(b);
-      x_cen = b*x_cen;
-      MatrixXf res = x_cen.transpose() * x_cen;
-      return res.sum();
-  }
+  // Low weight components between two frames, see setCompactStorage()
+  std::unique_ptr<CompactMixture> m_compactTargets;
+  T m_compactThld;
 
-  template <size_t D>
-  float   gaussDensity(const Matrix <float, D,1> &point,
-                       const Matrix <float, D,1> &mean,
-                       const Matrix <float, D,D> &cov) const
-  {
-    float det, res;
+  std::unique_ptr<Smoother> m_smoother;
 
-    Matrix <float, D, D> cov_inverse;
-    Matrix <float, D, 1> mismatch;
+private:
 
-    det = cov.determinant();
-    cov_inverse = cov.inverse();
+  template <int D>
+  T   gaussDensity(const Matrix <T, D,1> &point,
+                   const Matrix <T, D,1> &mean,
+                   const Matrix <T, D,D> &cov) const
+  {
+    T log_det;
 
-    mismatch = point - mean;
+    MatrixXT cov_inverse;
+    MatrixXT mismatch = point - mean;
 
-    Matrix <float, 1, 1> distance = mismatch.transpose() * cov_inverse * mismatch;
+    spd_inverse<T>(cov, cov_inverse, &log_det);
 
-    distance /= -2.f;
+    T const distance = (mismatch.transpose() * cov_inverse * mismatch)(0,0);
 
     // Deal with faulty determinant case
-    if (det == 0.f)
-    {
-      return 0.f;
-    }
-
-    res = 1.f/sqrt(pow(2*M_PI, D) * fabs(det)) * exp(distance.coeff (0,0));
-
-    if (isinf(det))
+    if (isinf(log_det) || isnan(log_det))
     {
-      printf("Problem in multivariate gaussian\n distance : %f - det %f\n", distance.coeff (0,0), det);
+      printf("Problem in multivariate gaussian\n distance : %f - log det %f\n", distance, log_det);
       cout << "Cov \n" << cov << endl << "Cov inverse \n" << cov_inverse << endl;
-      return 0.f;
+      return 0;
     }
 
-    return res;
+    return exp(T(-0.5) * (distance + log_det + mismatch.rows() * log(2*M_PI)));
   }
 };
 
+// Single and double precision flavours, both instantiated in the library
+typedef SpawningModelT<float>  SpawningModel;
+typedef SpawningModelT<double> SpawningModeld;
+
+typedef SensorModelT<float>  SensorModel;
+typedef SensorModelT<double> SensorModeld;
+
+typedef MeasurementModelT<float>  MeasurementModel;
+typedef MeasurementModelT<double> MeasurementModeld;
+
+typedef GMPHDT<float>  GMPHD;
+typedef GMPHDT<double> GMPHDd;
+
 #endif // GMPHD_FILTER_H
@@ -0,0 +1,145 @@
+#ifndef GMPHD_RECORDER_H
+#define GMPHD_RECORDER_H
+
+#include "gmphd_snapshot.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+/*!
+ * Binary log of the inputs of a GMPHD filter, to replay them exactly.
+ *
+ * Layout (native endianness) : RecordHeader, the snapshot of the filter when the
+ * recording started (padded to SNAPSHOT_ALIGNMENT), then a sequence of records.
+ * Each record is a RecordEntry followed by its scalar payload :
+ * - RECORD_MEASUREMENTS : m_rows positions then m_cols speeds
+ * - RECORD_REFERENTIAL  : m_rows x m_cols transform, column-major
+ * - RECORD_PROPAGATE    : no payload
+ * - RECORD_PROPAGATE_AT : the timestamp, one double whatever the scalar type
+ * - RECORD_PREDICT      : no payload
+ * - RECORD_PREDICT_AT   : the timestamp, one double
+ * - RECORD_CORRECT      : m_rows positions, m_cols speeds, then the 4 sensor model scalars
+ *                         (detection probability, pose, speed and background noises)
+ * - RECORD_PRUNE        : no payload
+ */
+#define RECORD_MAGIC   "GMPHDREC"
+#define RECORD_VERSION 1
+
+enum RecordType {
+    RECORD_MEASUREMENTS = 1,
+    RECORD_REFERENTIAL  = 2,
+    RECORD_PROPAGATE    = 3,
+    RECORD_PROPAGATE_AT = 4,
+    RECORD_PREDICT      = 5,
+    RECORD_PREDICT_AT   = 6,
+    RECORD_CORRECT      = 7,
+    RECORD_PRUNE        = 8
+};
+
+struct RecordHeader {
+    char     m_magic[8];
+    uint32_t m_version;
+    uint32_t m_scalarSize;
+    uint64_t m_snapshotSize;
+};
+
+struct RecordEntry {
+    uint32_t m_type;
+    uint32_t m_rows;
+    uint32_t m_cols;
+    uint32_t m_reserved;
+};
+
+/*!
+ * \brief Writes the calls made on a GMPHD filter, see GMPHD::setRecorder()
+ */
+template <typename T>
+class GMPHDRecorderT
+{
+    public:
+        typedef Matrix<T, Dynamic, Dynamic> MatrixXT;
+
+        GMPHDRecorderT();
+
+        ~GMPHDRecorderT();
+
+        // Start a new log, beginning with the current state of the filter
+        bool open(std::string const & path, GMPHDT<T> const & filter);
+
+        void close();
+
+        bool isOpen() const;
+
+        void recordMeasurements(vector<T> const & position, vector<T> const & speed);
+
+        void recordReferential(MatrixXT const & transform);
+
+        void recordPropagate();
+
+        void recordPropagate(double timestamp);
+
+        void recordPredict();
+
+        void recordPredict(double timestamp);
+
+        void recordCorrect(vector<T> const & position, vector<T> const & speed,
+                           SensorModelT<T> const & sensor);
+
+        void recordPrune();
+
+    private:
+        GMPHDRecorderT(GMPHDRecorderT const &);
+        GMPHDRecorderT & operator=(GMPHDRecorderT const &);
+
+        void write(RecordType type, uint32_t rows, uint32_t cols,
+                   void const * payload, size_t payload_size);
+
+        // Rest of the payload of the last record
+        void append(void const * payload, size_t payload_size);
+
+        FILE * m_file;
+};
+
+/*!
+ * \brief Reads back a log written by GMPHDRecorder, from a memory mapping
+ */
+template <typename T>
+class GMPHDReplayerT
+{
+    public:
+        typedef Matrix<T, Dynamic, Dynamic> MatrixXT;
+
+        GMPHDReplayerT();
+
+        bool open(std::string const & path);
+
+        // State of the filter when the recording started
+        GMPHDSnapshotT<T> const & initialState() const;
+
+        // Apply the next recorded call to the filter, false once the log is exhausted
+        bool step(GMPHDT<T> & filter, RecordType & type);
+
+        void rewind();
+
+    private:
+        MappedFile    m_file;
+        GMPHDSnapshotT<T> m_snapshot;
+        size_t        m_begin;
+        size_t        m_position;
+
+        // Scratch, to avoid reallocations while replaying
+        vector<T> m_positionBuffer;
+        vector<T> m_speedBuffer;
+        MatrixXT      m_transform;
+};
+
+typedef GMPHDRecorderT<float>  GMPHDRecorder;
+typedef GMPHDRecorderT<double> GMPHDRecorderd;
+
+typedef GMPHDReplayerT<float>  GMPHDReplayer;
+typedef GMPHDReplayerT<double> GMPHDReplayerd;
+
+// Scalar size of a recorded log (sizeof(float) or sizeof(double)), 0 if not a GMPHD log
+uint32_t recordScalarSize(std::string const & path);
+
+#endif // GMPHD_RECORDER_H
@@ -0,0 +1,114 @@
+#ifndef GMPHD_SMOOTHER_H
+#define GMPHD_SMOOTHER_H
+
+#include "gaussian_mixture.h"
+#include <memory>
+
+// Author : Benjamin Lefaudeux (blefaudeux@github)
+
+/*!
+ * \brief Fixed-lag forward-backward smoother, fed by GMPHD (see GMPHD::setSmoothing()).
+ *
+ * Keeps the pruned posteriors of the last lag + 1 frames in a ring buffer, with the
+ * motion model which predicted each of them to the next frame. Every new posterior runs
+ * a backward pass over the window, the smoothed intensity of the oldest frame being
+ * D(x) [(1 - pS) + pS sum_j w_j N(m_j; F.x + o, ..) / D_pred(m_j)] :
+ * every (forward, smoothed) pair gives a Rauch-Tung-Striebel component, the predicted
+ * intensity D_pred (survivals and births) being evaluated at the smoothed means.
+ * Each backward step is pruned like the filter.
+ */
+template <typename T>
+class GMPHDSmootherT {
+    public :
+        typedef Matrix<T, Dynamic, Dynamic> MatrixXT;
+        typedef GaussianModelT<T>   Model;
+        typedef GaussianMixtureT<T> GaussianMixture;
+
+        // capacity : components per frame after pruning, the buffers are allocated up front.
+        // dim_pos : position dimension (the first coordinates of the states), for the merging
+        GMPHDSmootherT(int dim, int dim_pos, unsigned int lag, unsigned int capacity);
+
+        // Motion model from the newest frame to the next one, offset can be NULL
+        void addTransition(MatrixXT const & trans, T const * offset, MatrixXT const & cov,
+                           T p_survival);
+
+        // Referential change x -> state.x + offset of the newest frame, applied to the targets
+        // outside of the prediction : composed after its transition if there is one already
+        // (within a frame), else before the next one
+        void addReferential(MatrixXT const & state, MatrixXT const & offset);
+
+        // New frame : stores its posterior, then smooths the oldest frame of the window.
+        // births is the birth intensity of the predictions (can be NULL)
+        void addPosterior(GaussianMixture const & posterior, GaussianMixture const * births,
+                          T trunc_threshold, T merge_threshold, unsigned int max_gaussians);
+
+        // Smoothed intensity of the frame delay() frames ago
+        GaussianMixture const & smoothedTargets() const;
+
+        // Frames between the smoothed estimate and the newest one (lag, once the window is full)
+        unsigned int delay() const;
+
+        unsigned int lag() const;
+
+        void clear();
+
+    private:
+        struct Frame {
+            std::unique_ptr<GaussianMixture> m_posterior;
+            MatrixXT m_trans;
+            MatrixXT m_offset;
+            MatrixXT m_cov;
+            T        m_pSurvival;
+            bool     m_hasTransition;
+
+            // Referential change waiting for the transition
+            MatrixXT m_refState;
+            MatrixXT m_refOffset;
+            bool     m_hasReferential;
+        };
+
+        Frame & frame(unsigned int age);
+
+        void backwardStep(Frame const & frame, GaussianMixture const & next,
+                          GaussianMixture const * births, T trunc_threshold,
+                          GaussianMixture & smoothed);
+
+        int m_dim;
+        int m_dimPos;
+        unsigned int m_lag;
+
+        vector<Frame> m_frames;     // Ring buffer, m_newest is the last frame in
+        unsigned int  m_newest;
+        unsigned int  m_nFrames;
+        unsigned int  m_delay;
+
+        // Backward pass, the output of a step is the input of the next one
+        std::unique_ptr<GaussianMixture> m_smoothed;
+        std::unique_ptr<GaussianMixture> m_work;
+
+        // Per forward component : prediction, Cholesky of the predicted covariance,
+        // smoothing gain and normalization
+        vector<MatrixXT> m_predMeans;
+        vector<MatrixXT> m_predCovs;
+        vector<LLT<MatrixXT> > m_predLLT;
+        vector<MatrixXT> m_gains;
+        vector<T>        m_predNorms;
+        vector<char>     m_predValid;
+
+        vector<T>        m_likelihoods;    // N(m_j; F.m_i + o, Pp_i), one row of forward components per j
+        vector<T>        m_denominators;
+        LLT<MatrixXT>    m_birthLLT;
+        MatrixXT         m_diff;
+        MatrixXT         m_solved;
+        MatrixXT         m_transCov;
+        MatrixXT         m_covDiff;
+        MatrixXT         m_denseCov;
+        MatrixXT         m_composed;
+        MatrixXT         m_composedOffset;
+};
+
+// Single and double precision flavours, both instantiated in the library
+typedef GMPHDSmootherT<float>  GMPHDSmoother;
+typedef GMPHDSmootherT<double> GMPHDSmootherd;
+
+#endif // GMPHD_SMOOTHER_H
@@ -0,0 +1,170 @@
+#ifndef GMPHD_SNAPSHOT_H
+#define GMPHD_SNAPSHOT_H
+
+#include "gmphd_filter.h"
+#include "mapped_file.h"
+#include <stdint.h>
+#include <string>
+
+/*!
+ * Binary snapshot of a GMPHD filter state.
+ *
+ * Layout (native endianness) : SnapshotHeader, then raw scalar arrays, each aligned
+ * on SNAPSHOT_ALIGNMENT bytes and referenced by their offset from the file start.
+ * Everything can be used in place once the file is mapped, no parsing involved :
+ * - a mixture is [weights (n)] [means (dim x n)] [covariances (dim (dim + 1) / 2, n times)],
+ *   the covariances being packed upper halves, as GaussianModel stores them (SymmetricMatrixT)
+ * - matrices are stored column-major, as Eigen does
+ */
+#define SNAPSHOT_MAGIC     "GMPHDSNP"
+#define SNAPSHOT_VERSION   3
+#define SNAPSHOT_ALIGNMENT 64
+
+struct SnapshotMatrix {
+    uint64_t m_offset;
+    uint32_t m_rows;
+    uint32_t m_cols;
+};
+
+struct SnapshotMixture {
+    uint64_t m_weights;
+    uint64_t m_means;
+    uint64_t m_covariances;
+    uint32_t m_count;
+    uint32_t m_dim;
+};
+
+struct SnapshotSpawn {
+    uint64_t m_weights;
+    uint64_t m_transitions;
+    uint64_t m_covariances;
+    uint64_t m_offsets;
+    uint32_t m_count;
+    uint32_t m_dim;
+};
+
+struct SnapshotHeader {
+    char     m_magic[8];
+    uint32_t m_version;
+    uint32_t m_scalarSize;
+    uint64_t m_fileSize;
+
+    // Filter structure
+    uint32_t m_dimMeasures;
+    uint32_t m_dimState;
+    uint32_t m_motionModel;
+    uint32_t m_maxGaussians;
+
+    // Pruning
+    uint32_t m_nMaxPrune;
+    uint32_t m_fusedPruning;
+    uint32_t m_candidateFactor;
+    uint32_t m_reserved;
+
+    double   m_pruneTruncThld;
+    double   m_pruneMergeThld;
+
+    // Dynamics & observation
+    double   m_pSurvival;
+    double   m_pDetection;
+    double   m_samplingPeriod;
+    double   m_processNoise;
+    double   m_measNoisePose;
+    double   m_measNoiseSpeed;
+    double   m_measNoiseBackground;
+
+    // Clock of the timestamped propagation (see GMPHD::propagate(timestamp))
+    double   m_lastTimestamp;
+    double   m_timeQuantum;
+    uint32_t m_hasTimestamp;
+    uint32_t m_reservedClock;
+
+    SnapshotMatrix  m_tgtDynTrans;
+    SnapshotMatrix  m_tgtDynCov;
+    SnapshotMatrix  m_obsMat;
+    SnapshotMatrix  m_obsCov;
+
+    // Mixtures
+    SnapshotMixture m_currTargets;
+    SnapshotMixture m_birthModel;
+    SnapshotSpawn   m_spawnModels;
+};
+
+/*!
+ * \brief Builds a snapshot in memory, section after section
+ */
+template <typename T>
+class SnapshotWriterT
+{
+    public:
+        typedef Matrix<T, Dynamic, Dynamic> MatrixXT;
+
+        SnapshotWriterT();
+
+        SnapshotMatrix  addMatrix(MatrixXT const & mat);
+
+        SnapshotMixture addMixture(GaussianMixtureT<T> const & mixture);
+
+        SnapshotSpawn   addSpawnModels(vector<SpawningModelT<T>, aligned_allocator<SpawningModelT<T> > > const & models,
+                                       int dim_state);
+
+        // Seal the header (magic, version, size) and return the complete snapshot
+        vector<char> const & finish(SnapshotHeader & header);
+
+    private:
+        uint64_t  reserve(size_t bytes);
+
+        T *   scalars(uint64_t offset);
+
+        vector<char> m_buffer;
+};
+
+/*!
+ * \brief Read-only view on a snapshot, either a mapped file or a buffer owned by the caller
+ */
+template <typename T>
+class GMPHDSnapshotT
+{
+    public:
+        typedef Matrix<T, Dynamic, Dynamic> MatrixXT;
+        typedef Matrix<T, Dynamic, 1>       VectorXT;
+
+        GMPHDSnapshotT();
+
+        bool open(std::string const & path);
+
+        bool map(char const * data, size_t size);
+
+        SnapshotHeader const & header() const;
+
+        // Zero-copy access to the stored arrays
+        Map<MatrixXT const> matrix(SnapshotMatrix const & mat) const;
+
+        Map<VectorXT const> weights(SnapshotMixture const & mixture) const;
+
+        Map<MatrixXT const> means(SnapshotMixture const & mixture) const;
+
+        // Packed upper half of the covariance i
+        Map<VectorXT const> covariance(SnapshotMixture const & mixture, int i) const;
+
+        void copyMixture(SnapshotMixture const & mixture, GaussianMixtureT<T> & out) const;
+
+    private:
+        bool  validate();
+
+        bool  inBounds(uint64_t offset, uint64_t n_scalars) const;
+
+        T const * scalars(uint64_t offset) const;
+
+        MappedFile   m_file;
+        char const * m_data;
+        size_t       m_size;
+};
+
+typedef SnapshotWriterT<float>  SnapshotWriter;
+typedef SnapshotWriterT<double> SnapshotWriterd;
+
+typedef GMPHDSnapshotT<float>   GMPHDSnapshot;
+typedef GMPHDSnapshotT<double>  GMPHDSnapshotd;
+
+#endif // GMPHD_SNAPSHOT_H
@@ -0,0 +1,158 @@
+#ifndef GMPHD_TILED_H
+#define GMPHD_TILED_H
+
+// Author : Benjamin Lefaudeux (blefaudeux@github)
+
+
+#include "gmphd_filter.h"
+#include <functional>
+
+/*!
+ * \brief Regular grid over the positions, for the tiled filter.
+ * The border tiles extend to infinity, every position belongs to one tile
+ */
+template <typename T>
+struct TileGridT {
+  TileGridT(int dim = 2, int tiles_per_axis = 1, T tile_size = T(100), T overlap = T(10)):
+    m_origin(dim, T(0)),
+    m_tileSize(tile_size),
+    m_tiles(dim, tiles_per_axis),
+    m_overlap(overlap)
+  {
+  }
+
+  vector<T>   m_origin;   // Corner of the first tile
+  T           m_tileSize;
+  vector<int> m_tiles;    // Number of tiles, per axis
+  T           m_overlap;  // Components closer than this to a tile take part in its corrections
+};
+
+/*!
+ * \brief A GMPHD filter split in tiles over the positions, which run in parallel.
+ *
+ * Every tile owns the components whose mean lies on it, and corrects them with the
+ * measurements which fall on it. Before each correction, the components of the neighbours
+ * closer than the overlap are shared (like births : no missed detection term), so that the
+ * border measurements see the same components as with a single filter. The components
+ * which moved to another tile are then handed over to it.
+ * Same interface as GMPHD, getTrackedTargets() returns the union of the tiles
+ */
+template <typename T>
+class GMPHDTiledT
+{
+public:
+  typedef Matrix<T, Dynamic, Dynamic> MatrixXT;
+  typedef GMPHDT<T>           GMPHD;
+  typedef GaussianModelT<T>   GaussianModel;
+  typedef SpawningModelT<T>   SpawningModel;
+  typedef SensorModelT<T>     SensorModel;
+  typedef TileGridT<T>        TileGrid;
+
+  // max_gaussians : per tile
+  GMPHDTiledT(TileGrid const & grid, int max_gaussians, int dimension,
+              bool motion_model = false, bool verbose = false);
+
+  bool  isInitialized();
+
+  // Input: raw measurements and possible ref change
+  void  setNewReferential( MatrixXT const & transform);
+
+  void  setNewMeasurements( vector<T> const & position, vector<T> const & speed);
+
+  // Output
+  void  getTrackedTargets( vector<T> & position, vector<T> & speed, vector<T> & weight,
+                           T const & extract_thld );
+
+  // Parameters to set before use, forwarded to every tile
+  void  setDynamicsModel( T sampling, T processNoise );
+
+  void  setDynamicsModel( MatrixXT const & tgt_dyn_transitions, MatrixXT const & tgt_dyn_covariance);
+
+  void  setSurvivalProbability(T _prob_survival);
+
+  void  setObservationModel(T probDetectionOverall, T m_measNoisePose,
+                            T m_measNoiseSpeed, T m_measNoiseBackground );
+
+  void  setPruningParameters(T  prune_trunc_thld, T  prune_merge_thld,
+                             int    prune_max_nb);
+
+  void  setFusedPruning(bool enable, uint candidate_factor = 4);
+
+  void  setParallelMerging(uint n_threads);
+
+  // Every birth goes to the tile its mean lies on
+  void  setBirthModel(vector<GaussianModel> & birth_model);
+
+  void  setSpawnModel(vector<SpawningModel> & spawnModels);
+
+  // Tiles processed in parallel (1 : serial)
+  void  setThreads(uint n_threads);
+
+  void  propagate();
+
+  void  propagate(double timestamp);
+
+  // Several sensors per frame, see GMPHD::predict()
+  void  predict();
+
+  void  predict(double timestamp);
+
+  void  correct(vector<T> const & position, vector<T> const & speed, SensorModel const & sensor);
+
+  void  prune();
+
+  void  reset();
+
+  size_t  tileCount() const;
+
+  GMPHD & tile(size_t index);
+
+private:
+  // Tile owning a position (the first coordinates of a mean or a measurement)
+  int   tileOf(T const * position) const;
+
+  void  tileCoordinates(int index, vector<int> & coords) const;
+
+  // Position within the overlap of the tile at coords
+  bool  isNear(T const * position, int const * coords) const;
+
+  void  routeMeasurements(vector<T> const & position, vector<T> const & speed);
+
+  void  shareBorders();
+
+  void  handOff();
+
+  void  forEachTile(std::function<void(GMPHD &, int)> const & task);
+
+private:
+  TileGrid  m_grid;
+  uint      m_dimMeasures;
+  uint      m_threads;
+
+  bool      m_predicted;
+  uint      m_nCorrections;
+
+  SensorModel m_sensor;
+
+  vector <std::unique_ptr<GMPHD> > m_tiles;
+
+  // Measurements of the frame (setNewMeasurements()), and their split over the tiles
+  vector <T> m_measPosition;
+  vector <T> m_measSpeed;
+  vector <vector<T> > m_tilePositions;
+  vector <vector<T> > m_tileSpeeds;
+  vector <vector<GaussianModel> > m_shared;
+  vector <vector<GaussianModel> > m_handed;
+  vector <T> m_position;
+  vector <T> m_speed;
+  vector <T> m_weight;
+};
+
+// Single and double precision flavours, both instantiated in the library
+typedef TileGridT<float>  TileGrid;
+typedef TileGridT<double> TileGridd;
+
+typedef GMPHDTiledT<float>  GMPHDTiled;
+typedef GMPHDTiledT<double> GMPHDTiledd;
+
+#endif // GMPHD_TILED_H
@@ -0,0 +1,36 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <stddef.h>
+
+/*!
+ * \brief Read-only memory mapping of a whole file (POSIX mmap)
+ * The mapping is released on close() or destruction
+ */
+class MappedFile
+{
+    public:
+        MappedFile();
+
+        ~MappedFile();
+
+        bool open(std::string const & path);
+
+        void close();
+
+        bool isOpen() const;
+
+        char const * data() const;
+
+        size_t size() const;
+
+    private:
+        MappedFile(MappedFile const &);
+        MappedFile & operator=(MappedFile const &);
+
+        void * m_data;
+        size_t m_size;
+};
+
+#endif // MAPPED_FILE_H
@@ -0,0 +1,103 @@
+#ifndef MEASUREMENT_CLUSTERING_H
+#define MEASUREMENT_CLUSTERING_H
+
+#include "gaussian_mixture.h"
+#include <stdint.h>
+
+// Author : Benjamin Lefaudeux (blefaudeux@github)
+
+/*!
+ * \brief What the clustering did, since the filter was created
+ */
+struct ClusteringStats {
+    size_t m_measurements = 0;  // Before clustering
+    size_t m_clusters = 0;      // Handed to the update
+};
+
+/*!
+ * \brief Voxel grid clustering of the measurements, before the update (see
+ * GMPHD::setMeasurementClustering()), for the sensors which return several detections per target.
+ *
+ * The measurements falling in the same voxel (first dim_measures coordinates, the positions)
+ * are grouped, then neighbouring voxels whose centroids are closer than the voxel size are
+ * linked (DBSCAN like, so that a target across a voxel border stays in one piece), and every
+ * group is replaced by its centroid, speeds included. The voxels live in an open addressing
+ * table kept from frame to frame : linear time, no allocation once warm.
+ * Single linkage would chain a dense line of returns (or two close targets) into one long
+ * cluster : a link is refused if the centroids of the linked voxels would then span more
+ * than CLUSTER_EXTENT voxel sizes on any axis, a cluster is split instead.
+ * A cluster keeps the number of its measurements as weight, and when it has several its
+ * covariance is that of the centroid (scatter / (n.(n-1)), state size), which the update adds
+ * to the innovation of the predictions. Single measurements are left as they are (weight 1)
+ */
+template <typename T>
+class MeasurementClusteringT {
+    public :
+        typedef Matrix<T, Dynamic, Dynamic> MatrixXT;
+        typedef GaussianModelT<T> Model;
+
+        // Largest span of the voxel centroids of a cluster, per axis, in voxel sizes
+        static int const CLUSTER_EXTENT = 2;
+
+        MeasurementClusteringT(int dim_measures, int dim_state, T voxel_size);
+
+        // Buffers for up to n_measurements per frame
+        void reserve(size_t n_measurements);
+
+        // Clusters the measurements in place, in the order of their first member
+        void cluster(GaussianMixtureT<T> & measures);
+
+        // Whether a cluster of the last clustering has several measurements
+        bool hasSpread() const;
+
+        T voxelSize() const;
+
+        ClusteringStats const & stats() const;
+
+    private:
+        size_t slot(int64_t const * voxel) const;
+
+        int root(int cluster);
+
+        int m_dimMeasures;
+        int m_dimState;
+        T   m_voxelSize;
+
+        // Open addressing table (power of two size) : voxel coordinates and cluster of every slot
+        vector<int64_t> m_slotVoxels;
+        vector<int>     m_slotClusters;
+        size_t          m_slotMask;
+
+        // Per measurement voxel, per voxel size, first measurement, centroid, coordinates
+        // and link (union-find)
+        vector<int>     m_assignment;
+        vector<int>     m_counts;
+        vector<int>     m_firsts;
+        vector<T>       m_sums;
+        vector<int64_t> m_voxels;
+        vector<int>     m_parents;
+        vector<int64_t> m_voxel;
+
+        // Bounding box of the voxel centroids of every union-find root
+        vector<T>       m_lower;
+        vector<T>       m_upper;
+
+        // Linked voxels : cluster of every voxel, size, first measurement, centroid and scatter
+        // of every cluster
+        vector<int>     m_labels;
+        vector<int>     m_clusterCounts;
+        vector<int>     m_clusterFirsts;
+        vector<T>       m_clusterSums;
+        vector<T>       m_clusterScatters;
+
+        MatrixXT        m_deviation;
+        bool            m_hasSpread;
+
+        ClusteringStats m_stats;
+};
+
+// Single and double precision flavours, both instantiated in the library
+typedef MeasurementClusteringT<float>  MeasurementClustering;
+typedef MeasurementClusteringT<double> MeasurementClusteringd;
+
+#endif // MEASUREMENT_CLUSTERING_H
@@ -0,0 +1,19 @@
+#ifndef PARALLEL_FOR_H
+#define PARALLEL_FOR_H
+
+// Author : Benjamin Lefaudeux (blefaudeux@github)
+
+#include <functional>
+
+// Run task(0..n_tasks-1) over n_threads threads (the caller being one of them).
+// The other threads come from a pool shared by the whole process, calls can be nested
+void parallelFor(unsigned int n_threads, int n_tasks, std::function<void(int)> const & task);
+
+// Closures are wrapped by reference, copying the larger ones in a std::function would allocate
+template <typename Task>
+void parallelFor(unsigned int n_threads, int n_tasks, Task const & task)
+{
+    parallelFor(n_threads, n_tasks, std::function<void(int)>(std::cref(task)));
+}
+
+#endif // PARALLEL_FOR_H
@@ -0,0 +1,553 @@
+#include "batch_kernels.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string>
+
+// The kernels are written once, as plain loops over the lanes of a LaneMatrices,
+// and compiled once per instruction set below : the compiler vectorizes them
+// across components. This file is always built with optimizations (see CMakeLists).
+
+#if defined(__GNUC__)
+#define KERNEL_INLINE inline __attribute__((always_inline))
+#else
+#define KERNEL_INLINE inline
+#endif
+
+namespace {
+
+template <typename T>
+KERNEL_INLINE void affineImpl(T const * A, int rows, int cols, T const * offset,
+                              LaneMatrices<T> const & x, LaneMatrices<T> & out)
+{
+    out.resize(rows, 1, x.count());
+    int const n = x.stride();
+
+    for (int i = 0; i < rows; ++i)
+    {
+        T * __restrict o = out.lanes(i, 0);
+        T const init = offset != NULL ? offset[i] : T(0);
+
+        for (int k = 0; k < n; ++k)
+        {
+            o[k] = init;
+        }
+
+        for (int p = 0; p < cols; ++p)
+        {
+            T const a = A[p * rows + i];
+            if (a == T(0))
+            {
+                continue;
+            }
+
+            T const * __restrict in = x.lanes(p, 0);
+            for (int k = 0; k < n; ++k)
+            {
+                o[k] += a * in[k];
+            }
+        }
+    }
+}
+
+template <typename T>
+KERNEL_INLINE void sandwichImpl(T const * A, int rows, int cols, T const * Q,
+                                LaneMatrices<T> const & P, LaneMatrices<T> & scratch,
+                                LaneMatrices<T> & out)
+{
+    int const n = P.stride();
+
+    // scratch = A.P (rows x cols)
+    scratch.resize(rows, cols, P.count());
+
+    for (int j = 0; j < cols; ++j)
+    {
+        for (int i = 0; i < rows; ++i)
+        {
+            T * __restrict s = scratch.lanes(i, j);
+            for (int k = 0; k < n; ++k)
+            {
+                s[k] = T(0);
+            }
+
+            for (int p = 0; p < cols; ++p)
+            {
+                T const a = A[p * rows + i];
+                if (a == T(0))
+                {
+                    continue;
+                }
+
+                T const * __restrict in = P.lanes(p, j);
+                for (int k = 0; k < n; ++k)
+                {
+                    s[k] += a * in[k];
+                }
+            }
+        }
+    }
+
+    // out = scratch.A^t (+ Q), only the upper half is computed and stored
+    out.resizeSymmetric(rows, P.count());
+
+    for (int j = 0; j < rows; ++j)
+    {
+        for (int i = 0; i <= j; ++i)
+        {
+            T * __restrict o = out.lanes(i, j);
+            T const init = Q != NULL ? Q[j * rows + i] : T(0);
+
+            for (int k = 0; k < n; ++k)
+            {
+                o[k] = init;
+            }
+
+            for (int p = 0; p < cols; ++p)
+            {
+                T const a = A[p * rows + j];
+                if (a == T(0))
+                {
+                    continue;
+                }
+
+                T const * __restrict s = scratch.lanes(i, p);
+                for (int k = 0; k < n; ++k)
+                {
+                    o[k] += a * s[k];
+                }
+            }
+        }
+    }
+
+}
+
+template <typename T>
+KERNEL_INLINE void gainImpl(T const * H, int dim_meas, int dim_state,
+                            LaneMatrices<T> const & P, LaneMatrices<T> const & S,
+                            LaneMatrices<T> & S_inv, T * log_det, unsigned char * valid,
+                            LaneMatrices<T> & K, LaneMatrices<T> & P_upd,
+                            LaneMatrices<T> & scratch)
+{
+    int const n = P.stride();
+    int const m = dim_meas;
+
+    // Scratch layout : [P.H^t (dim_state x m) | L^-1 (m x m)]
+    scratch.resize(m > dim_state ? m : dim_state, 2 * m, P.count());
+    LaneMatrices<T> & work = scratch;
+
+    // - P.H^t
+    for (int j = 0; j < m; ++j)
+    {
+        for (int i = 0; i < dim_state; ++i)
+        {
+            T * __restrict o = work.lanes(i, j);
+            for (int k = 0; k < n; ++k)
+            {
+                o[k] = T(0);
+            }
+
+            for (int p = 0; p < dim_state; ++p)
+            {
+                T const h = H[p * m + j];
+                if (h == T(0))
+                {
+                    continue;
+                }
+
+                T const * __restrict in = P.lanes(i, p);
+                for (int k = 0; k < n; ++k)
+                {
+                    o[k] += h * in[k];
+                }
+            }
+        }
+    }
+
+    // - Cholesky factorization S = L.L^t, L stored in S_inv until S^-1 overwrites it
+    S_inv.resizeSymmetric(m, P.count());
+
+    for (int k = 0; k < n; ++k)
+    {
+        log_det[k] = T(0);
+        valid[k] = 1;
+    }
+
+    for (int j = 0; j < m; ++j)
+    {
+        T * __restrict l_jj = S_inv.lanes(j, j);
+        T const * __restrict s_jj = S.lanes(j, j);
+
+        for (int k = 0; k < n; ++k)
+        {
+            l_jj[k] = s_jj[k];
+        }
+
+        for (int p = 0; p < j; ++p)
+        {
+            T const * __restrict l_jp = S_inv.lanes(j, p);
+            for (int k = 0; k < n; ++k)
+            {
+                l_jj[k] -= l_jp[k] * l_jp[k];
+            }
+        }
+
+        for (int k = 0; k < n; ++k)
+        {
+            bool const positive = l_jj[k] > T(0);
+            valid[k] &= positive;
+            l_jj[k] = positive ? sqrt(l_jj[k]) : T(1);
+            log_det[k] += T(2) * log(l_jj[k]);
+        }
+
+        for (int i = j + 1; i < m; ++i)
+        {
+            T * __restrict l_ij = S_inv.lanes(i, j);
+            T const * __restrict s_ij = S.lanes(i, j);
+
+            for (int k = 0; k < n; ++k)
+            {
+                l_ij[k] = s_ij[k];
+            }
+
+            for (int p = 0; p < j; ++p)
+            {
+                T const * __restrict l_ip = S_inv.lanes(i, p);
+                T const * __restrict l_jp = S_inv.lanes(j, p);
+                for (int k = 0; k < n; ++k)
+                {
+                    l_ij[k] -= l_ip[k] * l_jp[k];
+                }
+            }
+
+            for (int k = 0; k < n; ++k)
+            {
+                l_ij[k] /= l_jj[k];
+            }
+        }
+    }
+
+    // - L^-1, lower triangular, stored after P.H^t in the scratch (rows 0..m)
+    for (int j = 0; j < m; ++j)
+    {
+        for (int i = 0; i < m; ++i)
+        {
+            T * __restrict x_ij = work.lanes(i, m + j);
+
+            if (i < j)
+            {
+                for (int k = 0; k < n; ++k)
+                {
+                    x_ij[k] = T(0);
+                }
+                continue;
+            }
+
+            T const * __restrict l_ii = S_inv.lanes(i, i);
+            for (int k = 0; k < n; ++k)
+            {
+                x_ij[k] = (i == j) ? T(1) : T(0);
+            }
+
+            for (int p = j; p < i; ++p)
+            {
+                T const * __restrict l_ip = S_inv.lanes(i, p);
+                T const * __restrict x_pj = work.lanes(p, m + j);
+                for (int k = 0; k < n; ++k)
+                {
+                    x_ij[k] -= l_ip[k] * x_pj[k];
+                }
+            }
+
+            for (int k = 0; k < n; ++k)
+            {
+                x_ij[k] /= l_ii[k];
+            }
+        }
+    }
+
+    // - S^-1 = L^-t.L^-1, symmetric, only reads L^-1
+    for (int j = 0; j < m; ++j)
+    {
+        for (int i = 0; i <= j; ++i)
+        {
+            T * __restrict o = S_inv.lanes(i, j);
+            for (int k = 0; k < n; ++k)
+            {
+                o[k] = T(0);
+            }
+
+            for (int p = j; p < m; ++p)
+            {
+                T const * __restrict x_pi = work.lanes(p, m + i);
+                T const * __restrict x_pj = work.lanes(p, m + j);
+                for (int k = 0; k < n; ++k)
+                {
+                    o[k] += x_pi[k] * x_pj[k];
+                }
+            }
+        }
+    }
+
+    // - K = P.H^t.S^-1
+    K.resize(dim_state, m, P.count());
+
+    for (int j = 0; j < m; ++j)
+    {
+        for (int i = 0; i < dim_state; ++i)
+        {
+            T * __restrict o = K.lanes(i, j);
+            for (int k = 0; k < n; ++k)
+            {
+                o[k] = T(0);
+            }
+
+            for (int p = 0; p < m; ++p)
+            {
+                T const * __restrict pht = work.lanes(i, p);
+                T const * __restrict s_inv = S_inv.lanes(p, j);
+                for (int k = 0; k < n; ++k)
+                {
+                    o[k] += pht[k] * s_inv[k];
+                }
+            }
+        }
+    }
+
+    // - P - K.(P.H^t)^t, symmetric
+    P_upd.resizeSymmetric(dim_state, P.count());
+
+    for (int j = 0; j < dim_state; ++j)
+    {
+        for (int i = 0; i <= j; ++i)
+        {
+            T * __restrict o = P_upd.lanes(i, j);
+            T const * __restrict p_ij = P.lanes(i, j);
+            for (int k = 0; k < n; ++k)
+            {
+                o[k] = p_ij[k];
+            }
+
+            for (int p = 0; p < m; ++p)
+            {
+                T const * __restrict k_ip = K.lanes(i, p);
+                T const * __restrict pht = work.lanes(j, p);
+                for (int k = 0; k < n; ++k)
+                {
+                    o[k] -= k_ip[k] * pht[k];
+                }
+            }
+        }
+    }
+}
+
+template <typename T>
+KERNEL_INLINE void updateMeansImpl(LaneMatrices<T> const & K, LaneMatrices<T> const & x,
+                                   LaneMatrices<T> const & Hx, T const * z, LaneMatrices<T> & out)
+{
+    int const dim_state = K.rows(), m = K.cols(), n = K.stride();
+    out.resize(dim_state, 1, K.count());
+
+    for (int i = 0; i < dim_state; ++i)
+    {
+        T * __restrict o = out.lanes(i, 0);
+        T const * __restrict x_i = x.lanes(i, 0);
+
+        for (int k = 0; k < n; ++k)
+        {
+            o[k] = x_i[k];
+        }
+
+        for (int p = 0; p < m; ++p)
+        {
+            T const * __restrict k_ip = K.lanes(i, p);
+            T const * __restrict hx_p = Hx.lanes(p, 0);
+            T const z_p = z[p];
+
+            for (int k = 0; k < n; ++k)
+            {
+                o[k] += k_ip[k] * (z_p - hx_p[k]);
+            }
+        }
+    }
+}
+
+template <typename T>
+KERNEL_INLINE void momentMatchImpl(LaneMatrices<T> const & x, LaneMatrices<T> const & P,
+                                   T const * w, T * mean, T * cov)
+{
+    int const dim = x.rows(), n = x.count();
+
+    T w_sum = T(0);
+    for (int k = 0; k < n; ++k)
+    {
+        w_sum += w[k];
+    }
+
+    T const w_norm = w_sum != T(0) ? T(1) / w_sum : T(0);
+
+    for (int i = 0; i < dim; ++i)
+    {
+        T const * __restrict x_i = x.lanes(i, 0);
+        T acc = T(0);
+        for (int k = 0; k < n; ++k)
+        {
+            acc += w[k] * x_i[k];
+        }
+        mean[i] = acc * w_norm;
+    }
+
+    for (int j = 0; j < dim; ++j)
+    {
+        for (int i = 0; i <= j; ++i)
+        {
+            T const * __restrict p_ij = P.lanes(i, j);
+            T const * __restrict x_i = x.lanes(i, 0);
+            T const * __restrict x_j = x.lanes(j, 0);
+            T const m_i = mean[i], m_j = mean[j];
+
+            T acc = T(0);
+            for (int k = 0; k < n; ++k)
+            {
+                acc += w[k] * (p_ij[k] + (x_i[k] - m_i) * (x_j[k] - m_j));
+            }
+
+            cov[j * (j + 1) / 2 + i] = acc * w_norm;
+        }
+    }
+}
+
+// One instantiation of every kernel per instruction set
+#define DEFINE_KERNELS(ISA, TARGET) \
+    template <typename T> TARGET void affine_##ISA(T const * A, int rows, int cols, T const * offset, \
+            LaneMatrices<T> const & x, LaneMatrices<T> & out) \
+    { affineImpl(A, rows, cols, offset, x, out); } \
+    template <typename T> TARGET void sandwich_##ISA(T const * A, int rows, int cols, T const * Q, \
+            LaneMatrices<T> const & P, LaneMatrices<T> & scratch, LaneMatrices<T> & out) \
+    { sandwichImpl(A, rows, cols, Q, P, scratch, out); } \
+    template <typename T> TARGET void gain_##ISA(T const * H, int dim_meas, int dim_state, \
+            LaneMatrices<T> const & P, LaneMatrices<T> const & S, LaneMatrices<T> & S_inv, \
+            T * log_det, unsigned char * valid, LaneMatrices<T> & K, LaneMatrices<T> & P_upd, \
+            LaneMatrices<T> & scratch) \
+    { gainImpl(H, dim_meas, dim_state, P, S, S_inv, log_det, valid, K, P_upd, scratch); } \
+    template <typename T> TARGET void updateMeans_##ISA(LaneMatrices<T> const & K, LaneMatrices<T> const & x, \
+            LaneMatrices<T> const & Hx, T const * z, LaneMatrices<T> & out) \
+    { updateMeansImpl(K, x, Hx, z, out); } \
+    template <typename T> TARGET void momentMatch_##ISA(LaneMatrices<T> const & x, LaneMatrices<T> const & P, \
+            T const * w, T * mean, T * cov) \
+    { momentMatchImpl(x, P, w, mean, cov); } \
+    template <typename T> BatchKernels<T> kernels_##ISA() \
+    { \
+        BatchKernels<T> kernels = {&affine_##ISA<T>, &sandwich_##ISA<T>, &gain_##ISA<T>, \
+                                   &updateMeans_##ISA<T>, &momentMatch_##ISA<T>, #ISA}; \
+        return kernels; \
+    }
+
+// Scalar fallback : no vectorization, whatever the build flags
+#if defined(__GNUC__) && !defined(__clang__)
+DEFINE_KERNELS(scalar, __attribute__((optimize("no-tree-vectorize"))))
+#else
+DEFINE_KERNELS(scalar, )
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KERNELS_X86
+DEFINE_KERNELS(sse4, __attribute__((target("sse4.2"))))
+DEFINE_KERNELS(avx2, __attribute__((target("avx2,fma"))))
+DEFINE_KERNELS(avx512, __attribute__((target("avx512f,avx512dq,avx512vl"))))
+#endif
+
+#ifdef KERNELS_X86
+struct CpuFeatures {
+    bool sse4;
+    bool avx2;
+    bool avx512;
+};
+
+CpuFeatures cpuFeatures()
+{
+    __builtin_cpu_init();
+
+    CpuFeatures features;
+    features.avx512 = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq") &&
+            __builtin_cpu_supports("avx512vl");
+    features.avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    features.sse4 = __builtin_cpu_supports("sse4.2");
+    return features;
+}
+#endif
+
+template <typename T>
+BatchKernels<T> selectKernels()
+{
+    // Optional cap on the instruction set
+    char const * env = getenv("GMPHD_KERNELS");
+    std::string const cap = env != NULL ? env : "";
+
+    if (cap == "scalar")
+    {
+        return kernels_scalar<T>();
+    }
+
+#ifdef KERNELS_X86
+    CpuFeatures const cpu = cpuFeatures();
+
+    if (cpu.avx512 && (cap.empty() || cap == "avx512"))
+    {
+        return kernels_avx512<T>();
+    }
+
+    if (cpu.avx2 && (cap.empty() || cap == "avx512" || cap == "avx2"))
+    {
+        return kernels_avx2<T>();
+    }
+
+    if (cpu.sse4)
+    {
+        return kernels_sse4<T>();
+    }
+#endif
+
+    return kernels_scalar<T>();
+}
+
+}
+
+template <typename T>
+BatchKernels<T> const & batchKernels()
+{
+    static BatchKernels<T> const kernels = selectKernels<T>();
+    return kernels;
+}
+
+template <typename T>
+vector<BatchKernels<T> > availableBatchKernels()
+{
+    vector<BatchKernels<T> > kernels(1, kernels_scalar<T>());
+
+#ifdef KERNELS_X86
+    CpuFeatures const cpu = cpuFeatures();
+
+    if (cpu.sse4)
+    {
+        kernels.push_back(kernels_sse4<T>());
+    }
+
+    if (cpu.avx2)
+    {
+        kernels.push_back(kernels_avx2<T>());
+    }
+
+    if (cpu.avx512)
+    {
+        kernels.push_back(kernels_avx512<T>());
+    }
+#endif
+
+    return kernels;
+}
+
+// Explicit instantiations, for both supported precisions
+template BatchKernels<float> const & batchKernels<float>();
+template BatchKernels<double> const & batchKernels<double>();
+
+template vector<BatchKernels<float> > availableBatchKernels<float>();
+template vector<BatchKernels<double> > availableBatchKernels<double>();
@@ -0,0 +1,226 @@
+#include "birth_grid.h"
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+    uint64_t alignedSize(uint64_t bytes)
+    {
+        return (bytes + BIRTH_GRID_ALIGNMENT - 1) / BIRTH_GRID_ALIGNMENT * BIRTH_GRID_ALIGNMENT;
+    }
+}
+
+template <typename T>
+BirthGridT<T>::BirthGridT():
+    m_data(NULL),
+    m_size(0)
+{
+}
+
+template <typename T>
+bool BirthGridT<T>::save(std::string const & path, vector<Model> const & births)
+{
+    BirthGridHeader header;
+    memset(&header, 0, sizeof(header));
+
+    uint64_t const n = births.size();
+    uint64_t const dim = births.empty() ? 0 : births[0].m_dim;
+
+    memcpy(header.m_magic, BIRTH_GRID_MAGIC, sizeof(header.m_magic));
+    header.m_version = BIRTH_GRID_VERSION;
+    header.m_scalarSize = sizeof(T);
+    header.m_count = n;
+    header.m_dim = dim;
+    header.m_weights = alignedSize(sizeof(BirthGridHeader));
+    header.m_means = header.m_weights + alignedSize(n * sizeof(T));
+    header.m_covariances = header.m_means + alignedSize(n * dim * sizeof(T));
+    header.m_fileSize = header.m_covariances + alignedSize(n * dim * dim * sizeof(T));
+
+    vector<char> buffer(header.m_fileSize, 0);
+    memcpy(&buffer[0], &header, sizeof(header));
+
+    T * weights = reinterpret_cast<T *>(&buffer[header.m_weights]);
+    T * means = reinterpret_cast<T *>(&buffer[header.m_means]);
+    T * covariances = reinterpret_cast<T *>(&buffer[header.m_covariances]);
+
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        if (births[i].m_dim != int(dim))
+        {
+            THROW_ERR("Birth models of different dimensions");
+        }
+
+        weights[i] = births[i].m_weight;
+        Map<MatrixXT>(means + i * dim, dim, 1) = births[i].m_mean;
+        Map<MatrixXT>(covariances + i * dim * dim, dim, dim) = births[i].m_cov.dense();
+    }
+
+    std::string const tmp_path = path + ".tmp";
+    FILE * file = fopen(tmp_path.c_str(), "wb");
+
+    if (file == NULL)
+    {
+        printf("[BirthGrid] - Could not open %s\n", tmp_path.c_str());
+        return false;
+    }
+
+    bool const written = fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+
+    if (fclose(file) != 0 || !written || rename(tmp_path.c_str(), path.c_str()) != 0)
+    {
+        printf("[BirthGrid] - Could not save the births to %s\n", path.c_str());
+        remove(tmp_path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+template <typename T>
+bool BirthGridT<T>::open(std::string const & path)
+{
+    close();
+
+    if (!m_file.open(path))
+    {
+        return false;
+    }
+
+    if (!map(m_file.data(), m_file.size()))
+    {
+        m_file.close();
+        return false;
+    }
+
+    return true;
+}
+
+template <typename T>
+bool BirthGridT<T>::map(char const * data, size_t size)
+{
+    m_data = data;
+    m_size = size;
+
+    if (!validate())
+    {
+        m_data = NULL;
+        m_size = 0;
+        return false;
+    }
+
+    return true;
+}
+
+template <typename T>
+void BirthGridT<T>::close()
+{
+    m_file.close();
+    m_data = NULL;
+    m_size = 0;
+}
+
+template <typename T>
+bool BirthGridT<T>::isOpen() const
+{
+    return m_data != NULL;
+}
+
+template <typename T>
+BirthGridHeader const & BirthGridT<T>::header() const
+{
+    return *reinterpret_cast<BirthGridHeader const *>(m_data);
+}
+
+template <typename T>
+bool BirthGridT<T>::inBounds(uint64_t offset, uint64_t n_scalars) const
+{
+    // Divided rather than multiplied, a corrupted count cannot wrap around
+    return (offset % BIRTH_GRID_ALIGNMENT) == 0 &&
+            offset <= m_size && n_scalars <= (m_size - offset) / sizeof(T);
+}
+
+template <typename T>
+bool BirthGridT<T>::validate()
+{
+    if (m_data == NULL || m_size < sizeof(BirthGridHeader) ||
+            (reinterpret_cast<uintptr_t>(m_data) % sizeof(uint64_t)) != 0)
+    {
+        printf("[BirthGrid] - Buffer too small or misaligned\n");
+        return false;
+    }
+
+    BirthGridHeader const & head = header();
+
+    if (memcmp(head.m_magic, BIRTH_GRID_MAGIC, sizeof(head.m_magic)) != 0)
+    {
+        printf("[BirthGrid] - Not a GMPHD birth model\n");
+        return false;
+    }
+
+    if (head.m_version != BIRTH_GRID_VERSION || head.m_scalarSize != sizeof(T))
+    {
+        printf("[BirthGrid] - Unsupported birth model version %u (scalar size %u)\n",
+               head.m_version, head.m_scalarSize);
+        return false;
+    }
+
+    uint64_t const n = head.m_count, dim = head.m_dim;
+
+    // Bounds n.dim^2 well below 2^64 (the count is 32 bits)
+    if (dim > BIRTH_GRID_MAX_DIM)
+    {
+        printf("[BirthGrid] - Unsupported state dimension %u\n", head.m_dim);
+        return false;
+    }
+
+    if (head.m_fileSize > m_size ||
+            !inBounds(head.m_weights, n) ||
+            !inBounds(head.m_means, n * dim) ||
+            !inBounds(head.m_covariances, n * dim * dim))
+    {
+        printf("[BirthGrid] - Truncated or corrupted birth model\n");
+        return false;
+    }
+
+    return true;
+}
+
+template <typename T>
+int BirthGridT<T>::dim() const
+{
+    return m_data ? header().m_dim : 0;
+}
+
+template <typename T>
+size_t BirthGridT<T>::size() const
+{
+    return m_data ? header().m_count : 0;
+}
+
+template <typename T>
+T const * BirthGridT<T>::scalars(uint64_t offset) const
+{
+    return reinterpret_cast<T const *>(m_data + offset);
+}
+
+template <typename T>
+Map<Matrix<T, Dynamic, 1> const> BirthGridT<T>::weights() const
+{
+    return Map<VectorXT const>(scalars(header().m_weights), header().m_count);
+}
+
+template <typename T>
+Map<Matrix<T, Dynamic, Dynamic> const> BirthGridT<T>::means() const
+{
+    return Map<MatrixXT const>(scalars(header().m_means), header().m_dim, header().m_count);
+}
+
+template <typename T>
+Map<Matrix<T, Dynamic, Dynamic> const> BirthGridT<T>::covariance(int i) const
+{
+    uint64_t const dim = header().m_dim;
+    return Map<MatrixXT const>(scalars(header().m_covariances) + i * dim * dim, dim, dim);
+}
+
+// Explicit instantiations, for both supported precisions
+template class BirthGridT<float>;
+template class BirthGridT<double>;
@@ -0,0 +1,260 @@
+#include "compact_mixture.h"
+#include <string.h>
+
+// Author : Benjamin Lefaudeux (blefaudeux@github)
+
+namespace {
+inline uint32_t floatBits(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+inline float bitsFloat(uint32_t bits)
+{
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Single to half precision, rounded to nearest even. Out of range values give infinities
+uint16_t toFloat16(float value)
+{
+    uint32_t bits = floatBits(value);
+    uint32_t const sign = (bits >> 16) & 0x8000;
+    bits &= 0x7fffffff;
+
+    uint32_t half;
+    if (bits >= 0x47800000)
+    {
+        // Larger than the half range, infinity or NaN
+        half = bits > 0x7f800000 ? 0x7e00 : 0x7c00;
+    }
+    else if (bits < 0x38800000)
+    {
+        // Subnormal half : let the FPU round, adding 0.5 aligns the mantissa
+        half = floatBits(bitsFloat(bits) + 0.5f) - 0x3f000000;
+    }
+    else
+    {
+        // Rebias the exponent, and round the 13 dropped bits
+        uint32_t const odd = (bits >> 13) & 1;
+        half = (bits + 0xc8000fff + odd) >> 13;
+    }
+
+    return uint16_t(sign | half);
+}
+
+float fromFloat16(uint16_t half)
+{
+    uint32_t bits = uint32_t(half & 0x7fff) << 13;
+    uint32_t const exponent = bits & 0x0f800000;
+    bits += 0x38000000;
+
+    if (exponent == 0x0f800000)
+    {
+        // Infinity or NaN
+        bits += 0x38000000;
+    }
+    else if (exponent == 0)
+    {
+        // Subnormal, renormalized by the FPU
+        bits = floatBits(bitsFloat(bits + 0x00800000) - bitsFloat(0x38800000));
+    }
+
+    return bitsFloat(bits | (uint32_t(half & 0x8000) << 16));
+}
+
+// Single precision truncated to its 16 upper bits, rounded to nearest even
+uint16_t toBFloat16(float value)
+{
+    uint32_t const bits = floatBits(value);
+
+    if ((bits & 0x7fffffff) > 0x7f800000)
+    {
+        return uint16_t((bits >> 16) | 0x0040);
+    }
+
+    return uint16_t((bits + 0x7fff + ((bits >> 16) & 1)) >> 16);
+}
+
+inline float fromBFloat16(uint16_t value)
+{
+    return bitsFloat(uint32_t(value) << 16);
+}
+
+inline bool isFinite16(uint16_t value, CompactFormat format)
+{
+    return format == COMPACT_FLOAT16 ? (value & 0x7c00) != 0x7c00
+                                     : (value & 0x7f80) != 0x7f80;
+}
+}
+
+
+template <typename T>
+CompactMixtureT<T>::CompactMixtureT(int dim, CompactFormat format):
+    m_dim(dim),
+    m_format(format),
+    m_nPacked(size_t(dim) * (dim + 1) / 2)
+{
+}
+
+template <typename T>
+bool CompactMixtureT<T>::encode(Model const & model)
+{
+    m_llt.compute(model.m_cov.dense());
+
+    if (m_llt.info() != Success)
+    {
+        return false;
+    }
+
+    MatrixXT const & factor = m_llt.matrixLLT();
+    size_t const start = m_factors.size();
+
+    for (int j = 0; j < m_dim; ++j)
+    {
+        for (int i = j; i < m_dim; ++i)
+        {
+            float const value = float(factor(i, j));
+            uint16_t const packed = m_format == COMPACT_FLOAT16 ? toFloat16(value) : toBFloat16(value);
+
+            if (!isFinite16(packed, m_format))
+            {
+                m_factors.resize(start);
+                return false;
+            }
+
+            m_factors.push_back(packed);
+        }
+    }
+
+    m_weights.push_back(model.m_weight);
+    m_means.insert(m_means.end(), model.m_mean.data(), model.m_mean.data() + m_dim);
+    return true;
+}
+
+template <typename T>
+void CompactMixtureT<T>::decode(size_t index, Model & model) const
+{
+    uint16_t const * packed = &m_factors[index * m_nPacked];
+
+    model.m_weight = m_weights[index];
+    model.m_mean = Map<MatrixXT const>(&m_means[index * m_dim], m_dim, 1);
+
+    // Column major packing : column j starts after the j previous (shrinking) columns.
+    // L(i,j) goes to the packed upper half as (j,i), that is L^t
+    SymmetricMatrixT<T> & cov = model.m_cov;
+    cov.resize(m_dim);
+
+    for (int j = 0, offset = 0; j < m_dim; offset += m_dim - j, ++j)
+    {
+        for (int i = j; i < m_dim; ++i)
+        {
+            uint16_t const value = packed[offset + i - j];
+            cov(j, i) = m_format == COMPACT_FLOAT16 ? fromFloat16(value) : fromBFloat16(value);
+        }
+    }
+
+    // In place L.L^T, (j,i) = sum L(i,k).L(j,k) over k <= j : the columns of L^t from the
+    // last one, each from the bottom, only overwrite coefficients which are not read anymore
+    T * upper = cov.data();
+
+    for (int i = m_dim - 1; i >= 0; --i)
+    {
+        for (int j = i; j >= 0; --j)
+        {
+            T sum = 0;
+            for (int k = 0; k <= j; ++k)
+            {
+                sum += upper[SymmetricMatrixT<T>::index(k, i)] * upper[SymmetricMatrixT<T>::index(k, j)];
+            }
+            upper[SymmetricMatrixT<T>::index(j, i)] = sum;
+        }
+    }
+}
+
+template <typename T>
+void CompactMixtureT<T>::compact(GaussianMixtureT<T> & mixture, T threshold)
+{
+    vector<Model> & gaussians = mixture.m_gaussians;
+    size_t n_kept = 0;
+
+    for (size_t i = 0; i < gaussians.size(); ++i)
+    {
+        if (gaussians[i].m_weight < threshold && encode(gaussians[i]))
+        {
+            continue;
+        }
+
+        if (n_kept != i)
+        {
+            std::swap(gaussians[n_kept], gaussians[i]);
+        }
+        ++n_kept;
+    }
+
+    mixture.resize(n_kept);
+}
+
+template <typename T>
+void CompactMixtureT<T>::expand(GaussianMixtureT<T> & mixture)
+{
+    if (m_weights.empty())
+    {
+        return;
+    }
+
+    size_t const start = mixture.m_gaussians.size();
+    mixture.resize(start + size());
+
+    for (size_t i = 0; i < size(); ++i)
+    {
+        decode(i, mixture.m_gaussians[start + i]);
+    }
+
+    clear();
+}
+
+template <typename T>
+void CompactMixtureT<T>::decode(GaussianMixtureT<T> & mixture) const
+{
+    for (size_t i = 0; i < size(); ++i)
+    {
+        Model model(m_dim);
+        decode(i, model);
+        mixture.m_gaussians.push_back(model);
+    }
+}
+
+template <typename T>
+void CompactMixtureT<T>::clear()
+{
+    m_weights.clear();
+    m_means.clear();
+    m_factors.clear();
+}
+
+template <typename T>
+size_t CompactMixtureT<T>::size() const
+{
+    return m_weights.size();
+}
+
+template <typename T>
+CompactFormat CompactMixtureT<T>::format() const
+{
+    return m_format;
+}
+
+template <typename T>
+size_t CompactMixtureT<T>::memoryUsage() const
+{
+    return m_weights.size() * sizeof(T) + m_means.size() * sizeof(T) +
+            m_factors.size() * sizeof(uint16_t);
+}
+
+// Explicit instantiations, for both supported precisions
+template class CompactMixtureT<float>;
+template class CompactMixtureT<double>;
@@ -1,8 +1,12 @@
 #include "eigen_tools.h"
 
 
-float pseudo_inv(Eigen::MatrixXf const & mat_in,
-                 Eigen::MatrixXf &mat_out) {
+template <typename T>
+T pseudo_inv(Eigen::Matrix <T, Eigen::Dynamic, Eigen::Dynamic> const & mat_in,
+             Eigen::Matrix <T, Eigen::Dynamic, Eigen::Dynamic> &mat_out,
+             T * log_pdet) {
+  typedef Eigen::Matrix <T, Eigen::Dynamic, Eigen::Dynamic> MatrixXT;
+
   int dim = 0;
 
   // Get matrices dimension :
@@ -14,35 +18,43 @@ float pseudo_inv(Eigen::MatrixXf const & mat_in,
 
   mat_out.resize (dim, dim);
 
-  Eigen::MatrixXf U (dim,dim);
-  Eigen::MatrixXf eig_val (dim, 1);
-  Eigen::MatrixXf eig_val_inv (dim, dim);
-  Eigen::MatrixXf V (dim, dim);
+  MatrixXT U (dim,dim);
+  MatrixXT eig_val (dim, 1);
+  MatrixXT eig_val_inv (dim, dim);
+  MatrixXT V (dim, dim);
 
-  float det;
+  T det;
 
-  eig_val_inv = Eigen::MatrixXf::Identity(dim,dim);
+  eig_val_inv = MatrixXT::Identity(dim,dim);
 
   // Compute the SVD decomposition
-  Eigen::JacobiSVD<Eigen::MatrixXf> svd(mat_in, Eigen::ComputeFullU | Eigen::ComputeFullV);
+  Eigen::JacobiSVD<MatrixXT> svd(mat_in, Eigen::ComputeFullU | Eigen::ComputeFullV);
 
   eig_val = svd.singularValues();
   U = svd.matrixU();
   V = svd.matrixV();
 
-  // Compute pseudo-inverse
-  // - quick'n'dirty inversion of eigen matrix
+  // Compute pseudo-inverse, singular values below the numerical precision are considered null
+  T const tolerance = dim > 0 ? dim * eig_val(0,0) * Eigen::NumTraits<T>::epsilon() : T(0);
+  T log_sum = 0;
+
   for (int i = 0; i<dim; ++i) {
-    if (eig_val(i,0) != 0.f)
-      eig_val_inv(i,i) = 1.f / eig_val(i,0);
-    else
-      eig_val_inv(i,i) = 0.f;
+    if (eig_val(i,0) > tolerance) {
+      eig_val_inv(i,i) = 1 / eig_val(i,0);
+      log_sum += log(eig_val(i,0));
+    } else {
+      eig_val_inv(i,i) = 0;
+    }
   }
 
-  mat_out = V.transpose() * eig_val_inv * U.transpose();
+  mat_out = V * eig_val_inv * U.transpose();
+
+  if (log_pdet != NULL) {
+    *log_pdet = log_sum;
+  }
 
   // Compute determinant from eigenvalues..
-  det = 1.f;
+  det = 1;
   for (int i=0; i<dim; ++i) {
     det *= eig_val(i,0);
   }
@@ -50,3 +62,156 @@ float pseudo_inv(Eigen::MatrixXf const & mat_in,
   return det;
 }
 
+namespace {
+// Fixed size Cholesky (unrolled by Eigen), and cofactor inverse for the small sizes
+template <typename T, int N>
+bool spd_inverse_fixed(Eigen::Matrix <T, Eigen::Dynamic, Eigen::Dynamic> const & mat_in,
+                       Eigen::Matrix <T, Eigen::Dynamic, Eigen::Dynamic> & mat_out,
+                       T * log_det) {
+  typedef Eigen::Matrix <T, N, N> MatrixNT;
+
+  MatrixNT const mat = mat_in;
+  Eigen::LLT<MatrixNT> const llt(mat);
+
+  if (llt.info() != Eigen::Success) {
+    return false;
+  }
+
+  mat_out = mat.inverse();
+
+  if (log_det != NULL) {
+    *log_det = 2 * llt.matrixLLT().diagonal().array().log().sum();
+  }
+
+  return true;
+}
+
+template <typename T>
+bool spd_inverse_cholesky(Eigen::Matrix <T, Eigen::Dynamic, Eigen::Dynamic> const & mat_in,
+                          Eigen::Matrix <T, Eigen::Dynamic, Eigen::Dynamic> & mat_out,
+                          T * log_det) {
+  typedef Eigen::Matrix <T, Eigen::Dynamic, Eigen::Dynamic> MatrixXT;
+
+  switch (mat_in.rows()) {
+    case 1:
+      if (!(mat_in(0,0) > 0)) {
+        return false;
+      }
+
+      mat_out.resize(1, 1);
+      mat_out(0,0) = 1 / mat_in(0,0);
+
+      if (log_det != NULL) {
+        *log_det = log(mat_in(0,0));
+      }
+      return true;
+
+    case 2:
+      return spd_inverse_fixed<T, 2>(mat_in, mat_out, log_det);
+
+    case 3:
+      return spd_inverse_fixed<T, 3>(mat_in, mat_out, log_det);
+
+    case 4:
+      return spd_inverse_fixed<T, 4>(mat_in, mat_out, log_det);
+
+    default:
+    {
+      Eigen::LLT<MatrixXT> const llt(mat_in);
+
+      if (llt.info() != Eigen::Success) {
+        return false;
+      }
+
+      mat_out = llt.solve(MatrixXT::Identity(mat_in.rows(), mat_in.cols()));
+
+      if (log_det != NULL) {
+        *log_det = 2 * llt.matrixLLT().diagonal().array().log().sum();
+      }
+      return true;
+    }
+  }
+}
+}
+
+template <typename T>
+bool spd_inverse(Eigen::Matrix <T, Eigen::Dynamic, Eigen::Dynamic> const & mat_in,
+                 Eigen::Matrix <T, Eigen::Dynamic, Eigen::Dynamic> & mat_out,
+                 T * log_det) {
+
+  if (mat_in.cols () != mat_in.rows ()) {
+    THROW_ERR("Cannot invert a non square covariance");
+  }
+
+  if (spd_inverse_cholesky(mat_in, mat_out, log_det)) {
+    return true;
+  }
+
+  // Not positive definite, degenerate covariance
+  pseudo_inv(mat_in, mat_out, log_det);
+  return false;
+}
+
+template <typename T>
+bool spd_solve(Eigen::Matrix <T, Eigen::Dynamic, Eigen::Dynamic> const & mat_in,
+               Eigen::Matrix <T, Eigen::Dynamic, Eigen::Dynamic> const & rhs,
+               Eigen::Matrix <T, Eigen::Dynamic, Eigen::Dynamic> & solution) {
+  typedef Eigen::Matrix <T, Eigen::Dynamic, Eigen::Dynamic> MatrixXT;
+
+  if (mat_in.cols () != mat_in.rows () || mat_in.cols () != rhs.rows ()) {
+    THROW_ERR("Cannot solve, dimensions mismatch");
+  }
+
+  // Small systems : closed form inverse, then product
+  if (mat_in.rows () <= 4) {
+    MatrixXT inverse;
+    bool const factorized = spd_inverse(mat_in, inverse);
+    solution.noalias() = inverse * rhs;
+    return factorized;
+  }
+
+  Eigen::LLT<MatrixXT> const llt(mat_in);
+
+  if (llt.info() == Eigen::Success) {
+    solution = llt.solve(rhs);
+    return true;
+  }
+
+  MatrixXT inverse;
+  pseudo_inv(mat_in, inverse);
+  solution.noalias() = inverse * rhs;
+  return false;
+}
+
+template <typename T>
+T spd_log_det(Eigen::Matrix <T, Eigen::Dynamic, Eigen::Dynamic> const & mat_in) {
+  typedef Eigen::Matrix <T, Eigen::Dynamic, Eigen::Dynamic> MatrixXT;
+
+  if (mat_in.cols () != mat_in.rows ()) {
+    THROW_ERR("Cannot compute the determinant of a non square matrix");
+  }
+
+  Eigen::LLT<MatrixXT> const llt(mat_in);
+
+  if (llt.info() == Eigen::Success) {
+    return 2 * llt.matrixLLT().diagonal().array().log().sum();
+  }
+
+  MatrixXT inverse;
+  T log_pdet = 0;
+  pseudo_inv(mat_in, inverse, &log_pdet);
+  return log_pdet;
+}
+
+// Explicit instantiations, for both supported precisions
+template float pseudo_inv(Eigen::MatrixXf const & mat_in, Eigen::MatrixXf & mat_out, float * log_pdet);
+template double pseudo_inv(Eigen::MatrixXd const & mat_in, Eigen::MatrixXd & mat_out, double * log_pdet);
+
+template bool spd_inverse(Eigen::MatrixXf const & mat_in, Eigen::MatrixXf & mat_out, float * log_det);
+template bool spd_inverse(Eigen::MatrixXd const & mat_in, Eigen::MatrixXd & mat_out, double * log_det);
+
+template bool spd_solve(Eigen::MatrixXf const & mat_in, Eigen::MatrixXf const & rhs, Eigen::MatrixXf & solution);
+template bool spd_solve(Eigen::MatrixXd const & mat_in, Eigen::MatrixXd const & rhs, Eigen::MatrixXd & solution);
+
+template float spd_log_det(Eigen::MatrixXf const & mat_in);
+template double spd_log_det(Eigen::MatrixXd const & mat_in);
@@ -1,25 +1,38 @@
 #include "gaussian_mixture.h"
+#include "parallel_for.h"
 #include <algorithm>
+#include <stdint.h>
 // Author : Benjamin Lefaudeux (blefaudeux@github)
 
-GaussianMixture::GaussianMixture( int dim)
+template <typename T>
+GaussianMixtureT<T>::GaussianMixtureT( int dim):
+    m_mergedModel(dim),
+    m_pooled(false)
 {
     m_dim = dim;
     m_gaussians.clear ();
 }
 
-GaussianMixture::GaussianMixture( vector<GaussianModel> const & source )
+template <typename T>
+GaussianMixtureT<T>::GaussianMixtureT( vector<Model> const & source ):
+    m_mergedModel(source[0].m_dim),
+    m_pooled(false)
 {
     m_gaussians = source;
     m_dim = source[0].m_dim;
 }
 
-GaussianMixture::GaussianMixture( GaussianMixture const & source)
+template <typename T>
+GaussianMixtureT<T>::GaussianMixtureT( GaussianMixtureT const & source):
+    m_mergedModel(source.m_dim),
+    m_pooled(false)
 {
     m_gaussians = source.m_gaussians;
+    m_dim = source.m_dim;
 }
 
-GaussianMixture GaussianMixture::operator = ( GaussianMixture const &source)
+template <typename T>
+GaussianMixtureT<T> GaussianMixtureT<T>::operator = ( GaussianMixtureT const &source)
 {
     // Skip assignment if same object
     if (this == &source)
@@ -30,18 +43,20 @@ GaussianMixture GaussianMixture::operator = ( GaussianMixture const &source)
     return *this;
 }
 
-void  GaussianMixture::sort () {
-    std::sort(m_gaussians.begin(), m_gaussians.end(), [](GaussianModel const & lhs, GaussianModel const & rhs)
+template <typename T>
+void  GaussianMixtureT<T>::sort () {
+    std::sort(m_gaussians.begin(), m_gaussians.end(), [](Model const & lhs, Model const & rhs)
     {
         return lhs.m_weight > rhs.m_weight;
     });
 }
 
 
-void  GaussianMixture::normalize (float linear_offset)
+template <typename T>
+void  GaussianMixtureT<T>::normalize (T linear_offset)
 {
 
-    float sum = 0.f;
+    T sum = 0;
 
     for ( auto const & gaussian : m_gaussians)
     {
@@ -57,13 +72,14 @@ void  GaussianMixture::normalize (float linear_offset)
     }
 }
 
-void  GaussianMixture::normalize (float linear_offset,
-                                  int start_pos,
-                                  int stop_pos,
-                                  int step)
+template <typename T>
+void  GaussianMixtureT<T>::normalize (T linear_offset,
+                                      int start_pos,
+                                      int stop_pos,
+                                      int step)
 {
 
-    float sum = 0.f;
+    T sum = 0;
 
     for (int i = start_pos; i< stop_pos; ++i)
     {
@@ -79,7 +95,8 @@ void  GaussianMixture::normalize (float linear_offset,
     }
 }
 
-void GaussianMixture::print()
+template <typename T>
+void GaussianMixtureT<T>::print()
 {
     if (m_gaussians.size () > 0)
     {
@@ -105,91 +122,185 @@ void GaussianMixture::print()
     }
 }
 
-void GaussianMixture::changeReferential( Matrix4f const & transform)
+template <typename T>
+void GaussianMixtureT<T>::reserve(size_t capacity, unsigned int n_threads)
 {
-    Matrix<float, 4,1> temp_vec;
-    Matrix<float, 4,1> temp_vec_new;
+    m_pooled = true;
+
+    m_gaussians.reserve(capacity);
+    m_pool.reserve(capacity);
+
+    // Pruning scratch, sized for the worst case
+    m_merged.reserve(capacity);
+    m_closeGaussians.reserve(capacity);
+    m_laneWeights.reserve(capacity);
+    m_laneMeans.resize(m_dim, 1, capacity);
+    m_laneCovs.resize(m_dim, m_dim, capacity);
+
+    // Parallel pruning scratch, positions are at most 3D (see pruneParallel())
+    m_inverses.resize(std::max(m_inverses.size(), capacity));
+    m_factorized.reserve(capacity);
+    m_cells.reserve(capacity);
+    m_coords.reserve(3 * capacity);
+    m_cellStarts.reserve(capacity + 1);
+    m_groupMembers.reserve(capacity);
+    m_groupStarts.reserve(capacity + 1);
+    m_prunedModels.resize(std::max(m_prunedModels.size(), capacity), Model(m_dim));
+
+    // Neighbour lists keep their capacity from frame to frame, start them with a few slots
+    m_neighbours.resize(std::max(m_neighbours.size(), capacity));
+    for (auto & neighbours : m_neighbours)
+    {
+        neighbours.reserve(NEIGHBOURS_RESERVE);
+    }
 
-    temp_vec(3,0) = 1.f;
+    if (n_threads > 1)
+    {
+        m_mergeScratch.resize(std::max<size_t>(m_mergeScratch.size(), n_threads));
+        for (auto & scratch : m_mergeScratch)
+        {
+            scratch.m_weights.reserve(capacity);
+            scratch.m_means.resize(m_dim, 1, capacity);
+            scratch.m_covs.resize(m_dim, m_dim, capacity);
+        }
+    }
 
-    // Gaussian model :
-    // - [x, y, z, dx/dt, dy/dt, dz/dt] m_mean values
-    // - 6x6 covariance
+    while (m_gaussians.size() + m_pool.size() < capacity)
+    {
+        m_pool.push_back(Model(m_dim));
+    }
+}
 
-    // For every gaussian model, change referential
-    for ( auto & gaussian : m_gaussians)
+template <typename T>
+void GaussianMixtureT<T>::resize(size_t size)
+{
+    if (!m_pooled)
     {
-        // Change positions
-        temp_vec.block(0,0, 3,1) = gaussian.m_mean.block(0,0,3,1);
+        // Only build the filler model when growing, it allocates
+        if (size < m_gaussians.size())
+        {
+            m_gaussians.erase(m_gaussians.begin() + size, m_gaussians.end());
+        }
+        else if (size > m_gaussians.size())
+        {
+            m_gaussians.resize(size, Model(m_dim));
+        }
+        return;
+    }
 
-        temp_vec_new = transform * temp_vec;
+    while (m_gaussians.size() > size)
+    {
+        m_pool.push_back(std::move(m_gaussians.back()));
+        m_gaussians.pop_back();
+    }
 
-        gaussian.m_mean.block(0,0,3,1) = temp_vec_new.block(0,0,3,1);
+    while (m_gaussians.size() < size)
+    {
+        if (m_pool.empty())
+        {
+            // Over capacity, allocate
+            m_gaussians.push_back(Model(m_dim));
+        }
+        else
+        {
+            m_gaussians.push_back(std::move(m_pool.back()));
+            m_pool.pop_back();
+        }
+    }
+}
 
-        // Change speeds referential
-        temp_vec.block(0,0, 3,1) = gaussian.m_mean.block(3,0,3,1);
+template <typename T>
+size_t GaussianMixtureT<T>::capacity() const
+{
+    return m_pooled ? m_gaussians.size() + m_pool.size() : m_gaussians.capacity();
+}
 
-        temp_vec_new = transform * temp_vec;
+template <typename T>
+void GaussianMixtureT<T>::changeReferential( MatrixXT const & transform)
+{
+    changeReferential(transform, 0, m_gaussians.size());
+}
 
-        gaussian.m_mean.block(3,0,3,1) = temp_vec_new.block(0,0,3,1);
+template <typename T>
+void GaussianMixtureT<T>::changeReferential( MatrixXT const & transform, size_t begin, size_t end)
+{
+    // Transform is homogeneous over the positions : [R t; 0 1]
+    // Gaussian model :
+    // - [positions, speeds, ..] m_mean values, in blocks of the position dimension
+    // - every block of the covariance is rotated, translation only applies to positions
+    int const dim_pos = transform.rows() - 1;
 
-        // Change covariance referential
-        //  (only take the rotation into account)
-        // TODO
+    if (transform.cols() != transform.rows() || dim_pos <= 0 || (m_dim % dim_pos) != 0)
+    {
+        THROW_ERR("Referential change does not match the state dimension");
     }
-}
 
+    if (begin >= end)
+    {
+        return;
+    }
 
-GaussianModel  GaussianMixture::mergeGaussians (vector<int> &i_gaussians_to_merge, bool b_remove_from_mixture)
-{
-    // TODO: Ben - rewrite this crap, could be half way long
+    int const n_gaussians = end - begin;
+    int const n_blocks = m_dim / dim_pos;
 
-    GaussianModel merged_model( m_gaussians[0].m_dim );
+    MatrixXT const rotation = transform.topLeftCorner(dim_pos, dim_pos);
 
-    MatrixXf diff(m_dim, 1);
+    // Change means referential, all at once :
+    // rotate every block, then translate the positions
+    m_batchIn.resize(m_dim, n_gaussians);
+    m_batchOut.resize(m_dim, n_gaussians);
 
-    if (i_gaussians_to_merge.size() > 1)
+    for (int i = 0; i < n_gaussians; ++i)
     {
-        // Reset the destination
-        merged_model.clear ();
+        m_batchIn.col(i) = m_gaussians[begin + i].m_mean;
+    }
 
-        // Build merged gaussian :
-        // - weight is the sum of all weights
-        for ( auto const & i_g : i_gaussians_to_merge)
-        {
-            merged_model.m_weight += m_gaussians[i_g].m_weight;
-        }
+    Map<MatrixXT> (m_batchOut.data(), dim_pos, n_blocks * n_gaussians).noalias() =
+            rotation * Map<MatrixXT> (m_batchIn.data(), dim_pos, n_blocks * n_gaussians);
 
-        // - gaussian center is the weighted m_mean of all centers
-        for (auto const & i_g : i_gaussians_to_merge)
-        {
-            merged_model.m_mean += m_gaussians[i_g].m_mean * m_gaussians[i_g].m_weight;
-        }
+    Map<MatrixXT, 0, OuterStride<> > (m_batchOut.data(), dim_pos, n_gaussians, OuterStride<>(m_dim)).colwise()
+            += transform.topRightCorner(dim_pos, 1).col(0);
 
-        if (merged_model.m_weight != 0.f) {
-            merged_model.m_mean /= merged_model.m_weight;
-        }
+    for (int i = 0; i < n_gaussians; ++i)
+    {
+        m_gaussians[begin + i].m_mean = m_batchOut.col(i);
+    }
 
-        // - covariance is related to initial gaussian model cov and the discrepancy
-        // from merged m_mean position and every merged gaussian pose
-        merged_model.m_cov.setZero(m_dim, m_dim);
-        for (auto const & i_g : i_gaussians_to_merge)
-        {
-            diff = merged_model.m_mean - m_gaussians[i_g].m_mean;
+    // Change covariances referential, T.P.T^t with T = diag(R, .., R) :
+    // - left product by R over every block of all the covariances
+    // - transpose each (T.P becomes P.T^t, covariances are symmetric)
+    // - left product by R again
+    m_batchIn.resize(m_dim, m_dim * n_gaussians);
+    m_batchOut.resize(m_dim, m_dim * n_gaussians);
 
-            merged_model.m_cov += m_gaussians[i_g].m_weight * (m_gaussians[i_g].m_cov + diff * diff.transpose());
-        }
+    for (int i = 0; i < n_gaussians; ++i)
+    {
+        m_batchIn.middleCols(m_dim * i, m_dim) = m_gaussians[begin + i].m_cov.dense();
+    }
 
-        if (merged_model.m_weight != 0.f)
-        {
-            merged_model.m_cov /= merged_model.m_weight;
-        }
+    Map<MatrixXT> (m_batchOut.data(), dim_pos, n_blocks * m_dim * n_gaussians).noalias() =
+            rotation * Map<MatrixXT> (m_batchIn.data(), dim_pos, n_blocks * m_dim * n_gaussians);
+
+    for (int i = 0; i < n_gaussians; ++i)
+    {
+        m_batchOut.middleCols(m_dim * i, m_dim).transposeInPlace();
     }
-    else
+
+    Map<MatrixXT> (m_batchIn.data(), dim_pos, n_blocks * m_dim * n_gaussians).noalias() =
+            rotation * Map<MatrixXT> (m_batchOut.data(), dim_pos, n_blocks * m_dim * n_gaussians);
+
+    for (int i = 0; i < n_gaussians; ++i)
     {
-        // Just return the initial single gaussian model :
-        merged_model = m_gaussians[i_gaussians_to_merge[0]];
+        m_gaussians[begin + i].m_cov = m_batchIn.middleCols(m_dim * i, m_dim);
     }
+}
+
+
+template <typename T>
+typename GaussianMixtureT<T>::Model  GaussianMixtureT<T>::mergeGaussians (vector<int> &i_gaussians_to_merge, bool b_remove_from_mixture)
+{
+    Model merged_model( m_gaussians[0].m_dim );
+    mergeModels(i_gaussians_to_merge.data(), i_gaussians_to_merge.size(), m_laneMeans, m_laneCovs, m_laneWeights, merged_model);
 
     if (b_remove_from_mixture)
     {
@@ -199,92 +310,398 @@ GaussianModel  GaussianMixture::mergeGaussians (vector<int> &i_gaussians_to_merg
                   i_gaussians_to_merge.end ());
 
         // - pop out the corresponding gaussians, in reverse
-        std::vector<GaussianModel>::iterator it = m_gaussians.begin ();
-
-        for (int i=i_gaussians_to_merge.size () -1; i>-1; ++i) {
-            m_gaussians.erase ( it + i);
+        for (int i=i_gaussians_to_merge.size () -1; i>-1; --i) {
+            m_gaussians.erase (m_gaussians.begin () + i_gaussians_to_merge[i]);
         }
     }
 
     return merged_model;
 }
 
-void  GaussianMixture::prune(float  trunc_threshold, float  merge_threshold, unsigned int max_gaussians)
+template <typename T>
+void  GaussianMixtureT<T>::mergeModels (int const * i_gaussians_to_merge,
+                                       int n_merged,
+                                       LaneMatrices<T> & means,
+                                       LaneMatrices<T> & covs,
+                                       vector<T> & weights,
+                                       Model & merged_model) const
+{
+    if (n_merged > 1)
+    {
+        // Build merged gaussian, moment matching over all the merged components :
+        // - weight is the sum of all weights
+        // - gaussian center is the weighted m_mean of all centers
+        // - covariance is related to initial gaussian model cov and the discrepancy
+        // from merged m_mean position and every merged gaussian pose
+        means.resize(m_dim, 1, n_merged);
+        covs.resizeSymmetric(m_dim, n_merged);
+        weights.resize(n_merged);
+
+        merged_model.m_dim = m_dim;
+        merged_model.m_weight = 0;
+
+        for (int i = 0; i < n_merged; ++i)
+        {
+            Model const & gaussian = m_gaussians[i_gaussians_to_merge[i]];
+
+            means.set(i, gaussian.m_mean);
+            covs.set(i, gaussian.m_cov);
+            weights[i] = gaussian.m_weight;
+            merged_model.m_weight += gaussian.m_weight;
+        }
+
+        merged_model.m_mean.resize(m_dim, 1);
+        merged_model.m_cov.resize(m_dim);
+
+        batchKernels<T>().momentMatch(means, covs, weights.data(),
+                                      merged_model.m_mean.data(), merged_model.m_cov.data());
+    }
+    else
+    {
+        // Just return the initial single gaussian model :
+        merged_model = m_gaussians[i_gaussians_to_merge[0]];
+    }
+}
+
+template <typename T>
+void  GaussianMixtureT<T>::prune(T  trunc_threshold, T  merge_threshold, unsigned int max_gaussians,
+                                 int dim_pos, unsigned int n_threads)
 {
+    if (dim_pos <= 0 || dim_pos > m_dim)
+    {
+        THROW_ERR("Position dimension does not match the mixture");
+    }
+
     // Sort the gaussians mixture, ascending order
     sort ();
 
-    int index, i_best;
+    if (n_threads > 1 && pruneParallel(trunc_threshold, merge_threshold, max_gaussians, dim_pos, n_threads))
+    {
+        return;
+    }
 
-    vector<int> i_close_to_best;
-    vector<GaussianModel>::iterator position;
+    // Greedy merging, heaviest first : every gaussian still available and close enough
+    // to the best one is merged with it. Done in place, without allocation once warm :
+    // the merged gaussians are written over the slots already consumed
+    int const n_gaussians = m_gaussians.size();
 
-    GaussianMixture pruned_targets(m_dim);
-    GaussianModel merged_gaussian(m_dim);
+    m_merged.assign(n_gaussians, 0);
+    m_refCov.resize(dim_pos, dim_pos);
+    m_diff.resize(dim_pos, 1);
+    m_solved.resize(dim_pos, 1);
 
-    merged_gaussian.clear();
-    pruned_targets.m_gaussians.clear();
+    unsigned int n_pruned = 0;
 
-    while ( !m_gaussians.empty()
-            && pruned_targets.m_gaussians.size () < max_gaussians )
+    for (int i_best = 0; i_best < n_gaussians && n_pruned < max_gaussians; ++i_best)
     {
-        // - Pick the bigger gaussian (based on weight)
-        i_best = selectBestGaussian ();
+        if (m_merged[i_best])
+        {
+            continue;
+        }
+
+        // - The mixture is sorted, the first gaussian left is the best one
+        Model const & best = m_gaussians[i_best];
 
-        if ( i_best == -1 || m_gaussians[i_best].m_weight < trunc_threshold)
+        if (!(best.m_weight > 0) || best.m_weight < trunc_threshold)
         {
             break;
         }
-        else
+
+        // - Select all the gaussians close enough (positions only), to merge if needed
+        m_refCov = best.m_cov.corner(dim_pos);
+        spd_inverse(m_refCov, m_refInverse);
+
+        m_closeGaussians.clear();
+
+        for (int i = i_best + 1; i < n_gaussians; ++i)
         {
-            // - Select all the gaussians close enough, to merge if needed
-            i_close_to_best.clear();
-            selectCloseGaussians (i_best, merge_threshold, i_close_to_best);
+            Model const & gaussian = m_gaussians[i];
 
-            // - Build a new merged gaussian
-            i_close_to_best.push_back (i_best); // Add the initial gaussian
+            if (m_merged[i] || gaussian.m_weight == 0.f)
+            {
+                continue;
+            }
+
+            m_diff = best.m_mean.topRows(dim_pos) - gaussian.m_mean.topRows(dim_pos);
+
+            m_solved.noalias() = m_refInverse * m_diff;
 
-            if (i_close_to_best.size() > 1)
+            if (m_diff.col(0).dot(m_solved.col(0)) < merge_threshold)
             {
-                merged_gaussian = mergeGaussians (i_close_to_best, false);
+                m_closeGaussians.push_back(i);
+                m_merged[i] = 1;
             }
-            else
+        }
+
+        m_closeGaussians.push_back(i_best); // Add the initial gaussian
+        m_merged[i_best] = 1;
+
+        // - Build the merged gaussian, and store it over a consumed slot
+        mergeModels(m_closeGaussians.data(), m_closeGaussians.size(), m_laneMeans, m_laneCovs, m_laneWeights, m_mergedModel);
+        std::swap(m_gaussians[n_pruned++], m_mergedModel);
+    }
+
+    resize(n_pruned);
+}
+
+template <typename T>
+bool  GaussianMixtureT<T>::pruneParallel(T  trunc_threshold, T  merge_threshold, unsigned int max_gaussians,
+                                         int dim_pos, unsigned int n_threads)
+{
+    // The mixture is sorted. The serial greedy merging is reproduced in three steps :
+    // - neighbours of every possible reference (weight above the truncation threshold),
+    //   searched in parallel over the cells of a grid, a reference only looking at its own
+    //   and adjacent cells (halo)
+    // - serial reconciliation : greedy selection in weight order, over the neighbour lists
+    // - merging of the selected groups, in parallel
+    // All the buffers are members, sized by reserve() : no allocation once warm
+    int const n_gaussians = m_gaussians.size();
+
+    if (dim_pos > 3)
+    {
+        // The cell keys hold 3 axes
+        return false;
+    }
+
+    int n_refs = 0;
+    while (n_refs < n_gaussians && m_gaussians[n_refs].m_weight > 0 &&
+           m_gaussians[n_refs].m_weight >= trunc_threshold)
+    {
+        ++n_refs;
+    }
+
+    // Position covariance inverses of the references (same as selectCloseGaussians),
+    // and the grid cell size : d < merge_threshold implies |dx|^2 < merge_threshold * trace(P)
+    if (m_inverses.size() < size_t(n_refs))
+    {
+        m_inverses.resize(n_refs);
+    }
+    m_factorized.resize(n_refs);
+
+    parallelFor(n_threads, n_refs, [&](int i)
+    {
+        // Fixed maximum size, the factorization stays on the stack
+        MatrixPosT const cov = m_gaussians[i].m_cov.corner(dim_pos);
+        LLT<MatrixPosT> const llt(cov);
+
+        m_factorized[i] = llt.info() == Success;
+        if (m_factorized[i])
+        {
+            m_inverses[i] = llt.solve(MatrixPosT::Identity(dim_pos, dim_pos));
+        }
+    });
+
+    double max_trace = 0.;
+    for (int i = 0; i < n_refs; ++i)
+    {
+        if (!m_factorized[i])
+        {
+            // Degenerate covariance, closeness is not bounded in space
+            return false;
+        }
+
+        max_trace = std::max(max_trace, double(m_gaussians[i].m_cov.corner(dim_pos).trace()));
+    }
+
+    double const cell = sqrt(std::max(double(merge_threshold), 0.) * max_trace);
+
+    // Grid : cell coordinates packed in a 64 bits key, 21 bits per axis
+    Matrix<double, Dynamic, 1, 0, 3, 1> origin = Matrix<double, Dynamic, 1, 0, 3, 1>::Constant(dim_pos, 1e300);
+    for (auto const & gaussian : m_gaussians)
+    {
+        origin = origin.cwiseMin(gaussian.m_mean.topRows(dim_pos).template cast<double>());
+    }
+
+    m_cells.resize(n_gaussians);
+    m_coords.resize(n_gaussians * dim_pos);
+
+    for (int i = 0; i < n_gaussians; ++i)
+    {
+        uint64_t key = 0;
+        for (int d = 0; d < dim_pos; ++d)
+        {
+            double const offset = cell > 0. ? (m_gaussians[i].m_mean(d, 0) - origin(d)) / cell : 0.;
+
+            if (!(offset < double(1 << 20)))
             {
-                merged_gaussian = m_gaussians[i_close_to_best[0]];
+                // Too fine a grid (or not a number), not worth it
+                return false;
             }
 
-            // - Append merged gaussian to the pruned_targets gaussian mixture
-            pruned_targets.m_gaussians.push_back (merged_gaussian);
+            m_coords[i * dim_pos + d] = int(offset);
+            key = (key << 21) | uint64_t(m_coords[i * dim_pos + d]);
+        }
+
+        m_cells[i] = std::make_pair(key, i);
+    }
+
+    std::sort(m_cells.begin(), m_cells.end());
 
-            // - Remove all the merged gaussians from current_targets :
-            // -- Sort the indexes
-            std::sort(i_close_to_best.begin(), i_close_to_best.end());
+    // Cell runs in the sorted keys
+    m_cellStarts.clear();
+    for (int i = 0; i < n_gaussians; ++i)
+    {
+        if (i == 0 || m_cells[i].first != m_cells[i-1].first)
+        {
+            m_cellStarts.push_back(i);
+        }
+    }
+    int const n_cells = m_cellStarts.size();
+    m_cellStarts.push_back(n_gaussians);
 
-            // -- Remove from the last one (to keep previous indexes unchanged)
-            while (!i_close_to_best.empty())
+    // - Neighbours, one task per cell. The lists keep their capacity
+    if (m_neighbours.size() < size_t(n_refs))
+    {
+        m_neighbours.resize(n_refs);
+    }
+
+    for (int i = 0; i < n_refs; ++i)
+    {
+        m_neighbours[i].clear();
+    }
+
+    int n_halo = 1;
+    for (int d = 0; d < dim_pos; ++d)
+    {
+        n_halo *= 3;
+    }
+
+    parallelFor(n_threads, n_cells, [&](int c)
+    {
+        Matrix<T, Dynamic, 1, 0, 3, 1> diff_vec(dim_pos);
+
+        for (int k = m_cellStarts[c]; k < m_cellStarts[c+1]; ++k)
+        {
+            int const i_ref = m_cells[k].second;
+            if (i_ref >= n_refs)
             {
-                index = i_close_to_best.back();
-                i_close_to_best.pop_back();
+                continue;
+            }
 
-                position = m_gaussians.erase(m_gaussians.begin() + index);
+            // Own cell and the adjacent ones
+            for (int h = 0; h < n_halo; ++h)
+            {
+                uint64_t key = 0;
+                bool inside = true;
+                int code = h;
+
+                for (int d = 0; d < dim_pos; ++d)
+                {
+                    int const coord = m_coords[i_ref * dim_pos + d] + code % 3 - 1;
+                    code /= 3;
+
+                    inside &= coord >= 0 && coord < (1 << 21);
+                    key = (key << 21) | uint64_t(coord & ((1 << 21) - 1));
+                }
+
+                if (!inside)
+                {
+                    continue;
+                }
+
+                auto run = std::lower_bound(m_cells.begin(), m_cells.end(), std::make_pair(key, -1));
+
+                for (; run != m_cells.end() && run->first == key; ++run)
+                {
+                    int const i = run->second;
+                    Model const & gaussian = m_gaussians[i];
+
+                    if (i == i_ref || gaussian.m_weight == 0.f)
+                    {
+                        continue;
+                    }
+
+                    diff_vec = m_gaussians[i_ref].m_mean.topRows(dim_pos) -
+                               gaussian.m_mean.topRows(dim_pos);
+
+                    T const gauss_distance = diff_vec.dot(m_inverses[i_ref] * diff_vec);
+
+                    if (gauss_distance < merge_threshold)
+                    {
+                        m_neighbours[i_ref].push_back(i);
+                    }
+                }
             }
+
+            std::sort(m_neighbours[i_ref].begin(), m_neighbours[i_ref].end());
+        }
+    });
+
+    // - Reconciliation : greedy, heaviest first, every gaussian merged once.
+    //   The groups are consecutive runs of m_groupMembers
+    m_merged.assign(n_gaussians, 0);
+    m_groupMembers.clear();
+    m_groupStarts.clear();
+
+    for (int i_best = 0; i_best < n_refs && m_groupStarts.size() < max_gaussians; ++i_best)
+    {
+        if (m_merged[i_best])
+        {
+            continue;
         }
+
+        m_groupStarts.push_back(m_groupMembers.size());
+
+        for (int i : m_neighbours[i_best])
+        {
+            if (!m_merged[i])
+            {
+                m_groupMembers.push_back(i);
+                m_merged[i] = 1;
+            }
+        }
+
+        m_groupMembers.push_back(i_best);
+        m_merged[i_best] = 1;
     }
 
-    m_gaussians = pruned_targets.m_gaussians;
-}
+    int const n_groups = m_groupStarts.size();
+    m_groupStarts.push_back(m_groupMembers.size());
+
+    // - Merge every group, in chunks of consecutive groups with their own scratch
+    if (m_prunedModels.size() < size_t(n_groups))
+    {
+        m_prunedModels.resize(n_groups, Model(m_dim));
+    }
+
+    int const n_chunks = std::min<int>(n_threads, n_groups);
+    if (m_mergeScratch.size() < size_t(n_chunks))
+    {
+        m_mergeScratch.resize(n_chunks);
+    }
+
+    parallelFor(n_threads, n_chunks, [&](int c)
+    {
+        MergeScratch & scratch = m_mergeScratch[c];
 
+        for (int g = c * n_groups / n_chunks; g < (c + 1) * n_groups / n_chunks; ++g)
+        {
+            mergeModels(&m_groupMembers[m_groupStarts[g]], m_groupStarts[g + 1] - m_groupStarts[g],
+                        scratch.m_means, scratch.m_covs, scratch.m_weights, m_prunedModels[g]);
+        }
+    });
+
+    // The merged gaussians take the place of the first ones, which go back to the scratch
+    for (int g = 0; g < n_groups; ++g)
+    {
+        std::swap(m_gaussians[g], m_prunedModels[g]);
+    }
 
-int   GaussianMixture::selectBestGaussian () {
+    resize(n_groups);
+    return true;
+}
+
+template <typename T>
+int   GaussianMixtureT<T>::selectBestGaussian () {
     // TODO: Ben - move this to a lambda and std::for_each
 
 
 
-    float best_weight = 0.f;
+    T   best_weight = 0;
     int   best_index = -1;
     int i= 0;
 
-    std::for_each(m_gaussians.begin(), m_gaussians.end(), [&](GaussianModel const & gaussian)
+    std::for_each(m_gaussians.begin(), m_gaussians.end(), [&](Model const & gaussian)
     {
         if( gaussian.m_weight > best_weight )
         {
@@ -297,31 +714,31 @@ int   GaussianMixture::selectBestGaussian () {
     return best_index;
 }
 
-void  GaussianMixture::selectCloseGaussians (int    i_ref, float  threshold,
-                                             vector<int> &close_gaussians) {
+template <typename T>
+void  GaussianMixtureT<T>::selectCloseGaussians (int    i_ref, T  threshold, int dim_pos,
+                                                 vector<int> &close_gaussians) {
 
     close_gaussians.clear ();
 
-    float gauss_distance;
+    T gauss_distance;
+
+    // We only take positions (the first dim_pos coordinates) into account there
 
-    Matrix<float, 3,1> diff_vec;
-    Matrix<float, 3,3> cov_inverse;
+    MatrixXT diff_vec(dim_pos, 1);
+    MatrixXT cov_inverse;
+
+    spd_inverse<T>(m_gaussians[i_ref].m_cov.corner(dim_pos), cov_inverse);
 
-    // We only take positions into account there
     int i= 0;
     for (auto const & gaussian : m_gaussians)
     {
         if (i != i_ref)
         {
             // Compute distance
-            diff_vec = m_gaussians[i_ref].m_mean.block(0,0,3,1) -
-                       gaussian.m_mean.block(0,0,3,1);
-
-            cov_inverse = (m_gaussians[i_ref].m_cov.block(0,0,3,3)).inverse();
+            diff_vec = m_gaussians[i_ref].m_mean.topRows(dim_pos) -
+                       gaussian.m_mean.topRows(dim_pos);
 
-            gauss_distance = diff_vec.transpose() *
-                             cov_inverse.block(0,0,3,3) *
-                             diff_vec;
+            gauss_distance = (diff_vec.transpose() * cov_inverse * diff_vec)(0,0);
 
             // Add to the set of close gaussians, if below threshold
             if ((gauss_distance < threshold) && (gaussian.m_weight != 0.f))
@@ -332,3 +749,7 @@ void  GaussianMixture::selectCloseGaussians (int    i_ref, float  threshold,
         ++i;
     }
 }
+
+// Explicit instantiations, for both supported precisions
+template class GaussianMixtureT<float>;
+template class GaussianMixtureT<double>;
@@ -1,19 +1,86 @@
 #include "gmphd_filter.h"
+#include "gmphd_recorder.h"
+#include "gmphd_snapshot.h"
+#include "parallel_for.h"
+#include <limits>
+#include <string.h>
 
 
 // Author : Benjamin Lefaudeux (blefaudeux@github)
 
+namespace {
+// Number of intervals whose motion model is kept, see propagate(timestamp)
+size_t const DYNAMICS_CACHE_SIZE = 8;
 
-GMPHD::GMPHD(int max_gaussians, int dimension, bool motion_model, bool verbose):
+// Per component loops are split in chunks of this many components, and frames with
+// fewer components than PARALLEL_MIN_COMPONENTS stay on the calling thread
+int const PARALLEL_CHUNK = 64;
+int const PARALLEL_MIN_COMPONENTS = 256;
+
+// Frames with a time budget (see setFrameBudget()) : gate (squared Mahalanobis distance on
+// the positions), highest raised truncation threshold, smoothing of the cost model
+double const BUDGET_GATE = 16.;
+double const BUDGET_MAX_TRUNCATION = 0.5;
+double const BUDGET_RATE_SMOOTHING = 0.25;
+
+// Map a (column major) matrix over a buffer, which only grows
+template <typename T>
+Map< Matrix<T, Dynamic, Dynamic> > mapBuffer(vector<T> & buffer, int rows, int cols)
+{
+    if (buffer.size() < size_t(rows) * cols)
+    {
+        buffer.resize(size_t(rows) * cols);
+    }
+
+    return Map< Matrix<T, Dynamic, Dynamic> >(buffer.data(), rows, cols);
+}
+}
+
+
+template <typename T>
+GMPHDT<T>::GMPHDT(int max_gaussians, int dimension, bool motion_model, bool verbose):
     m_motionModel(motion_model),
     m_bVerbose(verbose),
+    m_fusedPruning(false),
+    m_bounded(false),
+    m_frameBudget(0),
+    m_budgetRate(0),
+    m_budgetFixed(false),
+    m_frameUnits(0),
+    m_recorder(NULL),
     m_maxGaussians(max_gaussians),
-    m_dimMeasures(dimension)
+    m_dimMeasures(dimension),
+    m_nMaxPrune(max_gaussians),
+    m_candidateFactor(4),
+    m_maxCandidates(4 * max_gaussians),
+    m_mergeThreads(1),
+    m_threads(1)
 {
     m_dimState = motion_model ? 2 * m_dimMeasures : m_dimMeasures;
-    m_pruneTruncThld = 0.f;
-    m_pDetection = 0.f;
-    m_pSurvival = 0.f;
+    m_pruneTruncThld = 0;
+    m_pruneMergeThld = 0;
+    m_pDetection = 0;
+    m_pSurvival = 0;
+    m_samplingPeriod = 0;
+    m_processNoise = 0;
+    m_measNoisePose = 0;
+    m_measNoiseSpeed = 0;
+    m_measNoiseBackground = 0;
+
+    m_dynamicsCache.reserve(DYNAMICS_CACHE_SIZE);
+    m_dynamicsClock = 0;
+    m_timeQuantum = 1e-3;
+    m_lastTimestamp = 0;
+    m_hasTimestamp = false;
+    m_customDynamics = false;
+    m_predicted = false;
+    m_nCorrections = 0;
+    m_nonlinear = false;
+    m_nonlinearUpdate = UPDATE_UNSCENTED;
+    m_birthGrid = NULL;
+    m_nGridBirths = 0;
+    m_gridCached = false;
+    m_pendingReferential = false;
 
     // Initialize all gaussian mixtures, we know the dimension now
     m_measTargets.reset( new GaussianMixture(m_dimState) );
@@ -22,32 +89,94 @@ GMPHD::GMPHD(int max_gaussians, int dimension, bool motion_model, bool verbose):
     m_expTargets.reset( new GaussianMixture(m_dimState) );
     m_extractedTargets.reset( new GaussianMixture(m_dimState) );
     m_spawnTargets.reset( new GaussianMixture(m_dimState) );
+    m_externalTargets.reset( new GaussianMixture(m_dimState) );
+
+    m_compactTargets.reset( new CompactMixture(m_dimState) );
+    m_compactThld = 0;
 }
 
-void  GMPHD::buildUpdate ()
+template <typename T>
+GMPHDT<T>::GMPHDT(GMPHDCapacity const & capacity, int dimension, bool motion_model, bool verbose):
+    GMPHDT(capacity.m_maxTargets, dimension, motion_model, verbose)
 {
-    MatrixXf temp_matrix(m_dimState, m_dimState);
+    m_bounded = true;
+    m_capacity = capacity;
+    m_capacity.m_maxCandidates = std::max(m_capacity.m_maxCandidates, m_capacity.m_maxTargets);
+    m_capacity.m_maxPredictions = std::max(m_capacity.m_maxPredictions,
+                                           m_capacity.m_maxTargets + m_capacity.m_maxBirths);
+
+    m_fusedPruning = true;
+    m_maxCandidates = m_capacity.m_maxCandidates;
+
+    // The posterior of a sensor is the prediction of the next one (see correct())
+    uint const n_pred = std::max(m_capacity.m_maxPredictions, m_capacity.m_maxCandidates);
+    uint const n_meas = m_capacity.m_maxMeasurements;
+    uint const n_curr = m_capacity.m_maxCandidates;
+
+    // Gaussian pools
+    m_measTargets->reserve(n_meas);
+    m_birthTargets->reserve(m_capacity.m_maxBirths);
+    m_spawnTargets->reserve(m_capacity.m_maxSpawns);
+    m_expTargets->reserve(n_pred, m_mergeThreads);
+    m_currTargets->reserve(n_pred, m_mergeThreads);
+    m_extractedTargets->reserve(n_curr);
+
+    // Update components and scratch buffers
+    m_iBirthTargets.reserve(m_capacity.m_maxBirths);
+    m_candidates.reserve(n_curr);
+
+    m_expMeasure.resize(n_pred, MatrixXT::Zero(m_dimState, 1));
+    m_expDisp.resize(n_pred, MatrixXT::Zero(m_dimState, m_dimState));
+    m_uncertainty.resize(n_pred, MatrixXT::Zero(m_dimState, m_dimState));
+
+    m_laneMeans.resize(m_dimState, 1, n_pred);
+    m_laneCovs.resizeSymmetric(m_dimState, n_pred);
+    m_laneOutMeans.resize(m_dimState, 1, n_pred);
+    m_laneOutCovs.resizeSymmetric(m_dimState, n_pred);
+    m_spawnOutMeans.resize(m_dimState, 1, n_pred);
+    m_spawnOutCovs.resizeSymmetric(m_dimState, n_pred);
+    m_spawnScratch.resize(m_dimState, m_dimState, n_pred);
+    m_laneMeasures.resize(m_dimState, 1, n_pred);
+    m_laneInnov.resizeSymmetric(m_dimState, n_pred);
+    m_laneInnovInv.resizeSymmetric(m_dimState, n_pred);
+    m_laneGain.resize(m_dimState, m_dimState, n_pred);
+    m_laneCovUpdate.resizeSymmetric(m_dimState, n_pred);
+    m_laneScratch.resize(m_dimState, 2 * m_dimState, n_pred);
+    m_laneLogDet.resize(m_laneCovs.stride());
+    m_laneValid.resize(m_laneCovs.stride());
+
+    int const n_quad = m_dimMeasures * (m_dimMeasures + 1) / 2;
+    int const n_features = n_quad + m_dimMeasures + 1;
+
+    m_sensorCov.setIdentity(m_dimState, m_dimState);
+
+    m_likelihoods.resize(size_t(n_meas) * n_pred);
+    m_measFeatures.resize(size_t(n_meas) * n_features);
+    m_predFeatures.resize(size_t(n_features) * n_pred);
+}
 
-    // Concatenate all the wannabe targets :
+template <typename T>
+void  GMPHDT<T>::gatherPredictions ()
+{
+    // Concatenate all the wannabe targets, after the predicted ones :
     // - birth targets
+    // - spawned targets
+    size_t const n_curr = m_expTargets->m_gaussians.size ();
+    size_t const n_birth = m_birthTargets->m_gaussians.size ();
+    size_t const n_spawn = m_spawnTargets->m_gaussians.size ();
+
     m_iBirthTargets.clear();
+    m_expTargets->resize(n_curr + n_birth + n_spawn);
 
-    if(m_birthTargets->m_gaussians.size () > 0)
+    for (unsigned int i=0; i<n_birth; ++i)
     {
-        for (unsigned int i=0; i<m_birthTargets->m_gaussians.size (); ++i)
-        {
-            m_iBirthTargets.push_back( m_expTargets->m_gaussians.size () + i );
-        }
-
-        m_expTargets->m_gaussians.insert(m_expTargets->m_gaussians.end (), m_birthTargets->m_gaussians.begin (),
-                                         m_birthTargets->m_gaussians.begin () + m_birthTargets->m_gaussians.size ());
+        m_iBirthTargets.push_back( n_curr + i );
+        m_expTargets->m_gaussians[n_curr + i] = m_birthTargets->m_gaussians[i];
     }
 
-    // - spawned targets
-    if (m_spawnTargets->m_gaussians.size () > 0)
+    for (unsigned int i=0; i<n_spawn; ++i)
     {
-        m_expTargets->m_gaussians.insert( m_expTargets->m_gaussians.end (), m_spawnTargets->m_gaussians.begin (),
-                                          m_spawnTargets->m_gaussians.begin () + m_spawnTargets->m_gaussians.size ());
+        m_expTargets->m_gaussians[n_curr + n_birth + i] = m_spawnTargets->m_gaussians[i];
     }
 
     if (m_bVerbose)
@@ -63,309 +192,2307 @@ void  GMPHD::buildUpdate ()
         m_spawnTargets->print ();
     }
 
-    // Compute PHD update components (for every expected target)
     m_nPredTargets = m_expTargets->m_gaussians.size ();
+}
+
+template <typename T>
+void  GMPHDT<T>::appendGridBirths (GaussianMixture & mixture) const
+{
+    size_t const n_start = mixture.m_gaussians.size ();
+    size_t const n_grid = m_birthGrid->size ();
+
+    Map<MatrixXT const> const means = m_birthGrid->means();
+    mixture.resize(n_start + n_grid);
+
+    for (size_t i = 0; i < n_grid; ++i)
+    {
+        GaussianModel & birth = mixture.m_gaussians[n_start + i];
+
+        birth.m_weight = m_birthGrid->weights()(i);
+        birth.m_mean = means.col(i);
+        birth.m_cov = m_birthGrid->covariance(i);
+    }
+}
+
+template <typename T>
+void  GMPHDT<T>::cacheGridUpdate (MatrixXT const & obs_cov)
+{
+    // The mapped births never change : their update terms only depend on the observation model
+    if (m_gridCached && m_gridObsCov == obs_cov)
+    {
+        return;
+    }
+
+    BatchKernels<T> const & kernels = batchKernels<T>();
+    BirthGrid const & grid = *m_birthGrid;
+    int const n_grid = grid.size();
+    int const dim_meas = m_obsMat.rows();
+    int const dim = m_dimMeasures;
+
+    Map<MatrixXT const> const means = grid.means();
+
+    m_gridMeans.resize(m_dimState, 1, n_grid);
+    m_laneCovs.resizeSymmetric(m_dimState, n_grid);
+
+    for (int i = 0; i < n_grid; ++i)
+    {
+        m_gridMeans.set(i, means.col(i));
+        m_laneCovs.set(i, grid.covariance(i));
+    }
+
+    // Same terms as buildUpdate(), the prediction lanes are only scratch here
+    kernels.affine(m_obsMat.data(), dim_meas, m_dimState, NULL, m_gridMeans, m_gridMeasures);
+    kernels.sandwich(m_obsMat.data(), dim_meas, m_dimState, obs_cov.data(),
+                     m_laneCovs, m_laneScratch, m_laneInnov);
+
+    m_laneLogDet.resize(m_laneCovs.stride());
+    m_laneValid.resize(m_laneCovs.stride());
+
+    kernels.gain(m_obsMat.data(), dim_meas, m_dimState, m_laneCovs, m_laneInnov,
+                 m_laneInnovInv, m_laneLogDet.data(), m_laneValid.data(),
+                 m_gridGain, m_gridCovUpdate, m_laneScratch);
+
+    // Whitening of the positions, for the matching factors (see buildLikelihoods())
+    m_gridQuadratic.resizeSymmetric(dim, n_grid);
+
+    for (int i = 0; i < n_grid; ++i)
+    {
+        m_laneInnov.get(i, m_gridInnov);
+
+        if (!m_laneValid[i])
+        {
+            // Degenerate innovation, the batch Cholesky failed : pseudo-inverse
+            MatrixXT temp_matrix;
+
+            spd_inverse(m_gridInnov, temp_matrix);
+            m_gridGainMatrix = grid.covariance(i) * m_obsMatT * temp_matrix;
+            m_gridGain.set(i, m_gridGainMatrix);
+
+            temp_matrix = (MatrixXT::Identity(m_dimState, m_dimState) - m_gridGainMatrix * m_obsMat)
+                    * grid.covariance(i);
+            m_gridCovUpdate.set(i, temp_matrix);
+        }
+
+        m_positionDisp = m_gridInnov.topLeftCorner(dim, dim);
+        spd_inverse(m_positionDisp, m_whitening);
+
+        m_quadratic.noalias() = m_whitening.transpose() * m_whitening;
+        m_gridQuadratic.set(i, m_quadratic);
+    }
+
+    m_gridObsCov = obs_cov;
+    m_gridCached = true;
+}
+
+template <typename T>
+void  GMPHDT<T>::buildUpdate (MatrixXT const & obs_cov)
+{
+    if (m_nonlinear)
+    {
+        buildNonlinearUpdate(obs_cov);
+        return;
+    }
+
+    // First, as it borrows the prediction lanes
+    if (m_nGridBirths > 0)
+    {
+        cacheGridUpdate(obs_cov);
+    }
+
+    // Compute PHD update components (for every expected target), all at once
+    BatchKernels<T> const & kernels = batchKernels<T>();
+    int const dim_meas = m_obsMat.rows();
+
+    m_nPredTargets = m_expTargets->m_gaussians.size ();
+
+    toLanes(m_expTargets->m_gaussians, m_laneMeans, m_laneCovs);
+
+    kernels.affine(m_obsMat.data(), dim_meas, m_dimState, NULL, m_laneMeans, m_laneMeasures);
+    kernels.sandwich(m_obsMat.data(), dim_meas, m_dimState, obs_cov.data(),
+                     m_laneCovs, m_laneScratch, m_laneInnov);
+
+    m_laneLogDet.resize(m_laneCovs.stride());
+    m_laneValid.resize(m_laneCovs.stride());
+
+    kernels.gain(m_obsMat.data(), dim_meas, m_dimState, m_laneCovs, m_laneInnov,
+                 m_laneInnovInv, m_laneLogDet.data(), m_laneValid.data(),
+                 m_laneGain, m_laneCovUpdate, m_laneScratch);
+
+    // Grow only, the matrices are kept from frame to frame
+    if (m_expMeasure.size () < m_nPredTargets)
+    {
+        m_expMeasure.resize(m_nPredTargets);
+        m_expDisp.resize(m_nPredTargets);
+        m_uncertainty.resize(m_nPredTargets);
+    }
+
+    // Independent per prediction, the lanes and matrices of each are its own
+    forComponents(m_nPredTargets, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; ++i)
+        {
+            m_laneMeasures.get(i, m_expMeasure[i]);
+            m_laneInnov.get(i, m_expDisp[i]);
+
+            if (m_laneValid[i])
+            {
+                m_laneGain.get(i, m_uncertainty[i]);
+            }
+            else
+            {
+                // Degenerate innovation, the batch Cholesky failed : pseudo-inverse
+                GaussianModel const & tgt = m_expTargets->m_gaussians[i];
+                MatrixXT temp_matrix;
+
+                spd_inverse(m_expDisp[i], temp_matrix);
+                m_uncertainty[i] = tgt.m_cov.dense() * m_obsMatT * temp_matrix;
+
+                temp_matrix = (MatrixXT::Identity(m_dimState, m_dimState) - m_uncertainty[i]*m_obsMat)
+                        * tgt.m_cov.dense();
+                m_laneCovUpdate.set(i, temp_matrix);
+            }
+        }
+    });
+}
+
+template <typename T>
+void  GMPHDT<T>::buildNonlinearUpdate (MatrixXT const & sensor_cov)
+{
+    // Same update components as buildUpdate(), with the measurement function instead of
+    // the observation matrix. All the predictions go through it as a single batch : their
+    // sigma points (unscented) or their means (extended, with the Jacobians). What remains
+    // is a few small products per prediction, the (measurement, prediction) pairs are then
+    // handled by the same batched code as the linear case
+    bool const unscented = m_nonlinearUpdate == UPDATE_UNSCENTED;
+    MatrixXT const & obs_cov = m_measurementModel.m_noise.size() > 0 ? m_measurementModel.m_noise : sensor_cov;
+    int const n = m_dimState;
+    int const dim_meas = obs_cov.rows();
+    int const n_points = unscented ? 2 * n + 1 : 1;
+
+    m_nPredTargets = m_expTargets->m_gaussians.size ();
+    int const n_pred = m_nPredTargets;
+
+    toLanes(m_expTargets->m_gaussians, m_laneMeans, m_laneCovs);
+    m_laneMeasures.resize(dim_meas, 1, n_pred);
+    m_laneGain.resize(n, dim_meas, n_pred);
+    m_laneCovUpdate.resizeSymmetric(n, n_pred);
+    m_laneValid.assign(m_laneCovs.stride(), 1);
+
+    if (m_expMeasure.size () < m_nPredTargets)
+    {
+        m_expMeasure.resize(m_nPredTargets);
+        m_expDisp.resize(m_nPredTargets);
+        m_uncertainty.resize(m_nPredTargets);
+    }
+
+    // Unscented transform parameters, the deviations of sigma point k are +/- spread.sqrt(P)_k
+    T const alpha = m_measurementModel.m_alpha;
+    T const lambda = alpha * alpha * (n + m_measurementModel.m_kappa) - n;
+    T const spread = sqrt(n + lambda);
+
+    m_sigmaWeights.resize(2, n_points);
+    m_sigmaWeights.setConstant(T(1) / (2 * (n + lambda)));
+
+    if (unscented)
+    {
+        m_sigmaWeights(0, 0) = lambda / (n + lambda);
+        m_sigmaWeights(1, 0) = lambda / (n + lambda) + 1 - alpha * alpha + m_measurementModel.m_beta;
+    }
+    else
+    {
+        m_sigmaWeights.setOnes();
+    }
+
+    // All the states to evaluate, n_points consecutive columns per prediction
+    Map<MatrixXT> states = mapBuffer(m_sigmaStates, n, n_points * n_pred);
+    Map<MatrixXT> measures = mapBuffer(m_sigmaMeasures, dim_meas, n_points * n_pred);
+
+    for (int i = 0; i < n_pred; ++i)
+    {
+        GaussianModel const & tgt = m_expTargets->m_gaussians[i];
+        states.col(i * n_points) = tgt.m_mean;
+
+        if (!unscented)
+        {
+            continue;
+        }
+
+        m_sigmaLLT.compute(tgt.m_cov.dense());
+
+        if (m_sigmaLLT.info() == Success)
+        {
+            m_sigmaSqrt = m_sigmaLLT.matrixL();
+        }
+        else
+        {
+            // Not positive definite : square root of the non negative part
+            SelfAdjointEigenSolver<MatrixXT> eigen(tgt.m_cov.dense());
+            m_sigmaSqrt = eigen.eigenvectors() *
+                    eigen.eigenvalues().cwiseMax(T(0)).cwiseSqrt().asDiagonal();
+        }
+
+        m_sigmaSqrt *= spread;
+
+        states.block(0, i * n_points + 1, n, n) = m_sigmaSqrt.colwise() + tgt.m_mean.col(0);
+        states.block(0, i * n_points + 1 + n, n, n) = (-m_sigmaSqrt).colwise() + tgt.m_mean.col(0);
+    }
+
+    Map<MatrixXT const> const const_states(states.data(), n, n_points * n_pred);
+    m_measurementModel.m_function(const_states, measures);
+
+    Map<MatrixXT> jacobians = mapBuffer(m_jacobians, dim_meas, unscented ? 0 : n * n_pred);
+    if (!unscented)
+    {
+        m_measurementModel.m_jacobian(const_states, jacobians);
+    }
+
+    // Innovation statistics, per prediction
+    for (int i = 0; i < n_pred; ++i)
+    {
+        GaussianModel const & tgt = m_expTargets->m_gaussians[i];
+        MatrixXT & expected = m_expMeasure[i];
+        MatrixXT & innovation_cov = m_expDisp[i];
+
+        if (unscented)
+        {
+            Map<MatrixXT const> const points(measures.data() + size_t(i) * n_points * dim_meas,
+                                             dim_meas, n_points);
+            expected.resize(dim_meas, 1);
+
+            if (m_measurementModel.m_mean)
+            {
+                m_sigmaMeanWeights = m_sigmaWeights.row(0).transpose();
+                m_measurementModel.m_mean(points, Map<MatrixXT const>(m_sigmaMeanWeights.data(), n_points, 1),
+                                          Map<MatrixXT>(expected.data(), dim_meas, 1));
+            }
+            else
+            {
+                expected.noalias() = points * m_sigmaWeights.row(0).transpose();
+            }
+
+            if (m_measurementModel.m_difference)
+            {
+                Map<MatrixXT> centers = mapBuffer(m_sigmaExpected, dim_meas, n_points);
+                centers = expected.col(0).replicate(1, n_points);
+
+                m_measureDeviations.resize(dim_meas, n_points);
+                m_measurementModel.m_difference(points, Map<MatrixXT const>(centers.data(), dim_meas, n_points),
+                                                Map<MatrixXT>(m_measureDeviations.data(), dim_meas, n_points));
+            }
+            else
+            {
+                m_measureDeviations = points.colwise() - expected.col(0);
+            }
+            m_stateDeviations = states.middleCols(i * n_points, n_points).colwise() - tgt.m_mean.col(0);
+
+            innovation_cov = obs_cov;
+            innovation_cov.noalias() += m_measureDeviations * m_sigmaWeights.row(1).asDiagonal()
+                    * m_measureDeviations.transpose();
+            m_crossCov.noalias() = m_stateDeviations * m_sigmaWeights.row(1).asDiagonal()
+                    * m_measureDeviations.transpose();
+        }
+        else
+        {
+            auto const jacobian = jacobians.middleCols(i * n, n);
+
+            expected = measures.col(i);
+            m_crossCov.noalias() = tgt.m_cov.dense() * jacobian.transpose();
+
+            innovation_cov = obs_cov;
+            innovation_cov.noalias() += jacobian * m_crossCov;
+        }
+
+        // Gain and updated covariance : K = Pxz.S^-1, P - K.S.K^t
+        spd_inverse(innovation_cov, m_innovInverse);
+
+        m_uncertainty[i].noalias() = m_crossCov * m_innovInverse;
+        m_updatedCov = tgt.m_cov.dense();
+        m_updatedCov.noalias() -= m_uncertainty[i] * m_crossCov.transpose();
+
+        m_laneMeasures.set(i, expected);
+        m_laneGain.set(i, m_uncertainty[i]);
+        m_laneCovUpdate.set(i, m_updatedCov);
+    }
+}
 
-    m_expMeasure.clear();
-    m_expMeasure.reserve (m_nPredTargets);
+template <typename T>
+void  GMPHDT<T>::buildLikelihoods(T p_detection)
+{
+    // Matching factor of every (measurement, prediction) pair, on the positions :
+    // pD.w / |W.(z - H.x)|^2, W being the inverse of the innovation covariance.
+    // Expanding |W.z - W.H.x|^2 = z^t.W^t.W.z - 2.z^t.W^t.W.H.x + |W.H.x|^2, every term is
+    // the dot product of measurement features [z_i.z_j, z_i, 1] with prediction features
+    // [(W^t.W)_ij, -2.W^t.W.H.x, |W.H.x|^2], so that the whole M x N matrix is one
+    // (cache blocked) matrix product
+    int const n_meas = m_measTargets->m_gaussians.size ();
+    int const n_pred = m_nPredTargets;
+    int const n_total = n_pred + m_nGridBirths;
+    int const dim = m_dimMeasures;
+    int const n_quad = dim * (dim + 1) / 2;
+    int const n_features = n_quad + dim + 1;
+
+    // Center everything on the measurements, keeps the expansion well conditioned
+    m_likelihoodOrigin.setZero(dim, 1);
+
+    for (auto const & meas : m_measTargets->m_gaussians)
+    {
+        m_likelihoodOrigin += meas.m_mean.topRows(dim);
+    }
+
+    if (n_meas > 0)
+    {
+        m_likelihoodOrigin /= T(n_meas);
+    }
+
+    // Measurement features
+    Map<MatrixXT> meas_features = mapBuffer(m_measFeatures, n_meas, n_features);
+
+    for (int m = 0; m < n_meas; ++m)
+    {
+        m_centered = m_measTargets->m_gaussians[m].m_mean.topRows(dim) - m_likelihoodOrigin;
+
+        int f = 0;
+        for (int i = 0; i < dim; ++i)
+        {
+            for (int j = i; j < dim; ++j)
+            {
+                meas_features(m, f++) = m_centered(i) * m_centered(j);
+            }
+        }
+
+        meas_features.block(m, n_quad, 1, dim) = m_centered.transpose();
+        meas_features(m, n_features - 1) = 1;
+    }
+
+    // Prediction features, then the mapped births whose whitening is cached
+    Map<MatrixXT> pred_features = mapBuffer(m_predFeatures, n_features, n_total);
+
+    for (int n = 0; n < n_total; ++n)
+    {
+        T squared_norm;
+
+        if (n < n_pred)
+        {
+            m_positionDisp = m_expDisp[n].topLeftCorner(dim, dim);
+            spd_inverse(m_positionDisp, m_whitening);
+
+            m_quadratic.noalias() = m_whitening.transpose() * m_whitening;
+            m_centered = m_expMeasure[n].topRows(dim) - m_likelihoodOrigin;
+            m_whitened.noalias() = m_whitening * m_centered;
+            squared_norm = m_whitened.squaredNorm();
+        }
+        else
+        {
+            m_gridQuadratic.get(n - n_pred, m_quadratic);
+            m_gridMeasures.get(n - n_pred, m_gridMeasure);
+            m_centered = m_gridMeasure.topRows(dim) - m_likelihoodOrigin;
+            m_whitened.noalias() = m_quadratic * m_centered;
+            squared_norm = m_centered.col(0).dot(m_whitened.col(0));
+        }
+
+        int f = 0;
+        for (int i = 0; i < dim; ++i)
+        {
+            for (int j = i; j < dim; ++j)
+            {
+                pred_features(f++, n) = (i == j) ? m_quadratic(i, i) : 2 * m_quadratic(i, j);
+            }
+        }
+
+        pred_features.block(n_quad, n, dim, 1).noalias() = -2 * m_quadratic * m_centered;
+        pred_features(n_features - 1, n) = squared_norm;
+    }
+
+    // Squared distances, then matching factors
+    Map<MatrixXT> likelihoods = mapBuffer(m_likelihoods, n_meas, n_total);
+    likelihoods.noalias() = meas_features * pred_features;
+
+    // Residuals which wrap around (bearings..) are not z - h(x) : the expansion does not hold
+    // for the predictions, their distances come from the residuals of the model, one batch
+    // for all the pairs. They are kept for the updated means
+    if (hasResidualHook() && n_meas > 0 && n_pred > 0)
+    {
+        int const dim_meas = m_expMeasure[0].rows();
+        Map<MatrixXT> lhs = mapBuffer(m_residualLhs, dim_meas, n_meas * n_pred);
+        Map<MatrixXT> rhs = mapBuffer(m_residualRhs, dim_meas, n_meas * n_pred);
+        Map<MatrixXT> residuals = mapBuffer(m_residuals, dim_meas, n_meas * n_pred);
+
+        for (int n = 0; n < n_pred; ++n)
+        {
+            for (int m = 0; m < n_meas; ++m)
+            {
+                lhs.col(n * n_meas + m) = m_measTargets->m_gaussians[m].m_mean.topRows(dim_meas);
+                rhs.col(n * n_meas + m) = m_expMeasure[n];
+            }
+        }
+
+        m_measurementModel.m_difference(Map<MatrixXT const>(lhs.data(), dim_meas, n_meas * n_pred),
+                                        Map<MatrixXT const>(rhs.data(), dim_meas, n_meas * n_pred),
+                                        residuals);
+
+        for (int n = 0; n < n_pred; ++n)
+        {
+            m_positionDisp = m_expDisp[n].topLeftCorner(dim, dim);
+            spd_inverse(m_positionDisp, m_whitening);
+
+            for (int m = 0; m < n_meas; ++m)
+            {
+                m_whitened.noalias() = m_whitening * residuals.block(0, n * n_meas + m, dim, 1);
+                likelihoods(m, n) = m_whitened.squaredNorm();
+            }
+        }
+    }
+
+    // The clusters add their own covariance to the innovation of the predictions (not of
+    // the mapped births, see setMeasurementClustering()) : one small solve per pair
+    typedef Matrix<T, Dynamic, Dynamic, 0, 3, 3> MatrixPosT;
+    typedef Matrix<T, Dynamic, 1, 0, 3, 1> VectorPosT;
+
+    m_clusterRows.clear();
+
+    for (int m = 0; m < n_meas; ++m)
+    {
+        if (isCluster(m_measTargets->m_gaussians[m]))
+        {
+            m_clusterRows.push_back(m);
+        }
+    }
+
+    for (int n = 0; n < n_pred && !m_clusterRows.empty(); ++n)
+    {
+        MatrixPosT const disp = m_expDisp[n].topLeftCorner(dim, dim);
+
+        for (int m : m_clusterRows)
+        {
+            GaussianModel const & meas = m_measTargets->m_gaussians[m];
+            LLT<MatrixPosT> const llt(disp + meas.m_cov.corner(dim));
+
+            if (llt.info() == Success)
+            {
+                residual(m, n);
+                VectorPosT const solved = llt.solve(m_innovation.topRows(dim));
+                likelihoods(m, n) = solved.squaredNorm();
+            }
+        }
+    }
+
+    for (int n = 0; n < n_total; ++n)
+    {
+        T const weight = n < n_pred ? m_expTargets->m_gaussians[n].m_weight :
+                                      m_birthGrid->weights()(n - n_pred);
+        T const scale = p_detection * weight;
+
+        for (int m = 0; m < n_meas; ++m)
+        {
+            likelihoods(m, n) = scale / std::max(likelihoods(m, n), std::numeric_limits<T>::min());
+        }
+    }
+}
+
+template <typename T>
+bool GMPHDT<T>::isInitialized()
+{
+    if( m_tgtDynTrans.cols() != m_dimState)
+    {
+        printf("[GMPHD] - Motion model not set\n");
+        return false;
+    }
+
+    if( m_pruneTruncThld <= 0)
+    {
+        printf("[GMPHD] - Pruning parameters not set\n");
+        return false;
+    }
+
+    if( m_pDetection <= 0 || m_pSurvival <= 0 )
+    {
+        printf("[GMPHD] - Observation model not set\n");
+        return false;
+    }
+
+    return true;
+}
+
+template <typename T>
+bool GMPHDT<T>::isBounded() const
+{
+    return m_bounded;
+}
+
+template <typename T>
+CapacityStats const & GMPHDT<T>::capacityStats() const
+{
+    return m_capacityStats;
+}
+
+template <typename T>
+void  GMPHDT<T>::setFrameBudget(double seconds, double association_cost)
+{
+    m_frameBudget = std::max(0., seconds);
+    m_frameStats.m_budget = m_frameBudget;
+
+    // A given cost is kept, else it is learned again
+    if (association_cost > 0 || m_budgetFixed)
+    {
+        m_budgetRate = std::max(0., association_cost);
+    }
+    m_budgetFixed = association_cost > 0;
+
+    if (m_bounded)
+    {
+        m_inGate.reserve(m_capacity.m_maxMeasurements);
+        m_gateOrder.reserve(m_capacity.m_maxMeasurements);
+    }
+}
+
+template <typename T>
+FrameStats const & GMPHDT<T>::frameStats() const
+{
+    return m_frameStats;
+}
+
+template <typename T>
+void  GMPHDT<T>::fitFrameBudget(MatrixXT const & obs_cov)
+{
+    if (m_frameBudget <= 0)
+    {
+        return;
+    }
+
+    FrameStats & stats = m_frameStats;
+    stats.m_budget = m_frameBudget;
+    stats.m_estimated = 0;
+    stats.m_gatedMeasurements = 0;
+    stats.m_droppedSpawns = 0;
+    stats.m_truncatedTargets = 0;
+    stats.m_truncationThreshold = 0;
+    stats.m_subsampledMeasurements = 0;
+
+    // Predictions : survivors, then births and spawns (see gatherPredictions()), then the
+    // mapped births. The cost of a frame goes with the number of associations
+    vector<GaussianModel> & predictions = m_expTargets->m_gaussians;
+    vector<GaussianModel> & measures = m_measTargets->m_gaussians;
+
+    size_t const n_birth = m_birthTargets->m_gaussians.size ();
+    size_t const n_grid = m_birthGrid != NULL ? m_birthGrid->size () : 0;
+    size_t n_spawn = m_spawnTargets->m_gaussians.size ();
+    size_t n_surv = predictions.size () - n_birth - n_spawn;
+    size_t n_meas = measures.size ();
+
+    auto n_pred = [&]() { return n_surv + n_birth + n_spawn + n_grid; };
+    auto units = [&]() { return double(n_pred ()) * (n_meas + 2); };
+
+    if (m_budgetRate <= 0)
+    {
+        // No cost model yet, this frame calibrates it
+        m_frameUnits = units ();
+        return;
+    }
+
+    stats.m_estimated = m_budgetRate * units ();
+    double const max_units = m_frameBudget / m_budgetRate;
+
+    if (units () <= max_units)
+    {
+        m_frameUnits = units ();
+        return;
+    }
 
-    m_expDisp.clear();
-    m_expDisp.reserve (m_nPredTargets);
+    auto heavier = [](GaussianModel const & lhs, GaussianModel const & rhs)
+    {
+        return lhs.m_weight > rhs.m_weight;
+    };
+
+    // Largest number of predictions which fits, with these measurements
+    auto excess = [&]()
+    {
+        size_t const max_pred = size_t(max_units / (n_meas + 2));
+        return n_pred () > max_pred ? n_pred () - max_pred : 0;
+    };
+
+    // - Spawns, the lightest first
+    if (excess () > 0 && n_spawn > 0)
+    {
+        size_t const n_kept = n_spawn - std::min(n_spawn, excess ());
+        auto const first = predictions.begin () + n_surv + n_birth;
+
+        std::nth_element(first, first + n_kept, predictions.end (), heavier);
+        m_expTargets->resize(n_surv + n_birth + n_kept);
 
-    m_uncertainty.clear();
-    m_uncertainty.reserve (m_nPredTargets);
+        stats.m_droppedSpawns = n_spawn - n_kept;
+        n_spawn = n_kept;
+    }
 
-    m_covariance.clear();
-    m_covariance.reserve (m_nPredTargets);
+    // - Gate : the measurements close to a survivor or a spawn come first, the others
+    //   (which could only give births) only fill what is left of the budget, evenly spread
+    double const meas_room = n_pred () > 0 ? max_units / n_pred () - 2 : double(n_meas);
+    size_t const max_meas = meas_room > 0 ? std::min(n_meas, size_t(meas_room)) : 0;
 
-    for (auto const & tgt : m_expTargets->m_gaussians)
+    if (n_meas > max_meas)
     {
-        // Compute the expected measurement
-        m_expMeasure.push_back( m_obsMat * tgt.m_mean );
-        m_expDisp.push_back( m_obsCov + m_obsMat * tgt.m_cov * m_obsMatT );
+        int const dim = m_dimMeasures;
+        m_inGate.assign(n_meas, 0);
+
+        // Measurements sorted on the first axis : a prediction only tests the ones within its
+        // gate along that axis (d^2 >= dx^2 / S(0,0) for any covariance S), not all of them.
+        // The clusters widen the gate by their own covariance, the widest one bounds the run
+        m_gateOrder.resize(n_meas);
+        T max_spread = 0;
 
-        temp_matrix = m_expDisp.back().inverse();
+        for (size_t m = 0; m < n_meas; ++m)
+        {
+            m_gateOrder[m] = std::make_pair(measures[m].m_mean(0, 0), int(m));
+
+            if (isCluster(measures[m]))
+            {
+                max_spread = std::max(max_spread, measures[m].m_cov(0, 0));
+            }
+        }
+
+        std::sort(m_gateOrder.begin(), m_gateOrder.end());
 
-        m_uncertainty.push_back( tgt.m_cov * m_obsMatT * temp_matrix );
+        for (size_t i = 0; i < predictions.size (); ++i)
+        {
+            if (i >= n_surv && i < n_surv + n_birth)
+            {
+                continue;
+            }
+
+            GaussianModel const & prediction = predictions[i];
+            m_gateCov = prediction.m_cov.corner(dim);
+            m_gateCov += obs_cov.topLeftCorner(dim, dim);
+
+            if (!spd_inverse<T>(m_gateCov, m_gateInverse))
+            {
+                continue;
+            }
+
+            T const center = prediction.m_mean(0, 0);
+            T const half_width = sqrt(T(BUDGET_GATE) * (m_gateCov(0, 0) + max_spread));
+
+            auto run = std::lower_bound(m_gateOrder.begin(), m_gateOrder.end(),
+                                        std::make_pair(center - half_width, -1));
+
+            for (; run != m_gateOrder.end() && run->first <= center + half_width; ++run)
+            {
+                size_t const m = run->second;
+
+                if (m_inGate[m])
+                {
+                    continue;
+                }
+
+                m_gateDiff = measures[m].m_mean.topRows(dim) - prediction.m_mean.topRows(dim);
+
+                if (isCluster(measures[m]))
+                {
+                    m_gateClusterCov = m_gateCov;
+                    m_gateClusterCov += measures[m].m_cov.corner(dim);
+
+                    if (!spd_inverse<T>(m_gateClusterCov, m_gateClusterInverse))
+                    {
+                        continue;
+                    }
+
+                    m_gateSolved.noalias() = m_gateClusterInverse * m_gateDiff;
+                }
+                else
+                {
+                    m_gateSolved.noalias() = m_gateInverse * m_gateDiff;
+                }
+
+                m_inGate[m] = m_gateDiff.col(0).dot(m_gateSolved.col(0)) < T(BUDGET_GATE);
+            }
+        }
 
-        m_covariance.push_back( (MatrixXf::Identity(m_dimState, m_dimState) - m_uncertainty.back()*m_obsMat)
-                                * tgt.m_cov );
+        size_t const n_in = std::count(m_inGate.begin(), m_inGate.end(), 1);
+        size_t const n_out = n_meas - n_in;
+        size_t const n_room = max_meas > n_in ? std::min(n_out, max_meas - n_in) : 0;
+
+        size_t n_kept = 0, i_out = 0;
+        for (size_t m = 0; m < n_meas; ++m)
+        {
+            bool keep = m_inGate[m];
+
+            if (!keep)
+            {
+                // Out of the gate : n_room of the n_out
+                keep = (i_out * n_room) / n_out != ((i_out + 1) * n_room) / n_out;
+                ++i_out;
+            }
+
+            if (keep)
+            {
+                std::swap(measures[n_kept++], measures[m]);
+            }
+        }
+
+        m_measTargets->resize(n_kept);
+        stats.m_gatedMeasurements = n_meas - n_kept;
+        n_meas = n_kept;
+    }
+
+    // - Survivors, the lightest first, up to BUDGET_MAX_TRUNCATION. Births and spawns
+    //   move down over the truncated ones
+    if (excess () > 0 && n_surv > 0)
+    {
+        size_t n_kept = n_surv - std::min(n_surv, excess ());
+        auto const first = predictions.begin ();
+
+        std::nth_element(first, first + n_kept, first + n_surv, heavier);
+        n_kept = std::partition(first + n_kept, first + n_surv, [](GaussianModel const & gaussian)
+        {
+            return gaussian.m_weight > T(BUDGET_MAX_TRUNCATION);
+        }) - first;
+
+        if (n_kept < n_surv)
+        {
+            stats.m_truncationThreshold = std::max_element(first + n_kept, first + n_surv,
+                                                           [](GaussianModel const & lhs,
+                                                              GaussianModel const & rhs)
+            {
+                return lhs.m_weight < rhs.m_weight;
+            })->m_weight;
+
+            for (size_t i = n_surv; i < predictions.size (); ++i)
+            {
+                std::swap(predictions[n_kept + i - n_surv], predictions[i]);
+            }
+
+            m_expTargets->resize(predictions.size () - (n_surv - n_kept));
+
+            for (size_t b = 0; b < n_birth; ++b)
+            {
+                m_iBirthTargets[b] = n_kept + b;
+            }
+
+            stats.m_truncatedTargets = n_surv - n_kept;
+            n_surv = n_kept;
+        }
+    }
+
+    m_nPredTargets = predictions.size ();
+
+    // - Measurements, evenly subsampled : the middle one of n_kept equal strides, so that
+    //   neither end of the list is favoured. The picks only move down, in order
+    if (excess () > 0 && n_meas > 0)
+    {
+        double const max_meas = max_units / n_pred () - 2;
+        size_t const n_kept = max_meas > 0 ? std::min(n_meas, size_t(max_meas)) : 0;
+
+        for (size_t m = 0; m < n_kept; ++m)
+        {
+            std::swap(measures[m], measures[((2 * m + 1) * n_meas) / (2 * n_kept)]);
+        }
+
+        m_measTargets->resize(n_kept);
+        stats.m_subsampledMeasurements = n_meas - n_kept;
+        n_meas = n_kept;
+    }
+
+    if (stats.m_gatedMeasurements > 0 || stats.m_droppedSpawns > 0 ||
+            stats.m_truncatedTargets > 0 || stats.m_subsampledMeasurements > 0)
+    {
+        ++stats.m_degradedFrames;
+    }
+
+    m_frameUnits = units ();
+}
+
+template <typename T>
+void  GMPHDT<T>::endFrameBudget(std::chrono::steady_clock::time_point const & start)
+{
+    if (m_frameBudget <= 0)
+    {
+        return;
+    }
+
+    double const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    m_frameStats.m_elapsed = elapsed;
+
+    if (elapsed > m_frameBudget)
+    {
+        ++m_frameStats.m_overruns;
+    }
+
+    // Cost model : seconds per association, smoothed over the last frames
+    if (m_frameUnits > 0 && !m_budgetFixed)
+    {
+        double const rate = elapsed / m_frameUnits;
+        m_budgetRate = m_budgetRate > 0 ? m_budgetRate + BUDGET_RATE_SMOOTHING * (rate - m_budgetRate) :
+                                          rate;
+    }
+}
+
+template <typename T>
+void    GMPHDT<T>::extractTargets(T threshold)
+{
+    T const thld = std::max(threshold, T(0));
+
+    // Get trough every target, keep the ones whose weight is above threshold
+    size_t n_extracted = 0;
+
+    for ( auto const & current_target : m_currTargets->m_gaussians)
+    {
+        n_extracted += current_target.m_weight >= thld;
+    }
+
+    m_extractedTargets->resize(n_extracted);
+
+    n_extracted = 0;
+    for ( auto const & current_target : m_currTargets->m_gaussians)
+    {
+        if (current_target.m_weight >= thld)
+        {
+            m_extractedTargets->m_gaussians[n_extracted++] = current_target;
+        }
+    }
+
+    // A pending referential change stays pending, only the copy is transformed
+    if (m_pendingReferential)
+    {
+        m_extractedTargets->changeReferential(m_referential);
+    }
+}
+
+template <typename T>
+void GMPHDT<T>::getTrackedTargets(vector<T> & position,
+                              vector<T> & speed,
+                              vector<T> & weight,
+                              T const & extract_thld)
+{
+    // Fill in "extracted_targets" from the "current_targets"
+    extractTargets(extract_thld);
+
+    position.clear();
+    speed.clear();
+    weight.clear();
+
+    for (auto const & gaussian : m_extractedTargets->m_gaussians)
+    {
+        for (unsigned int j=0; j<m_dimMeasures; ++j)
+        {
+            position.push_back(gaussian.m_mean(j,0));
+            speed.push_back(gaussian.m_mean(m_dimMeasures + j,0));
+        }
+
+        weight.push_back(gaussian.m_weight);
+    }
+}
+
+template <typename T>
+template <typename Task>
+void  GMPHDT<T>::forComponents(int n_components, Task const & task) const
+{
+    // task(begin, end) on consecutive chunks, inline for the small frames
+    if (m_threads <= 1 || n_components < PARALLEL_MIN_COMPONENTS)
+    {
+        task(0, n_components);
+        return;
+    }
+
+    int const n_chunks = (n_components + PARALLEL_CHUNK - 1) / PARALLEL_CHUNK;
+
+    parallelFor(m_threads, n_chunks, [&](int c)
+    {
+        task(c * PARALLEL_CHUNK, std::min(n_components, (c + 1) * PARALLEL_CHUNK));
+    });
+}
+
+template <typename T>
+void  GMPHDT<T>::getSmoothedTargets(vector<T> & position, vector<T> & speed, vector<T> & weight,
+                                   T const & extract_thld) const
+{
+    position.clear();
+    speed.clear();
+    weight.clear();
+
+    if (!m_smoother)
+    {
+        return;
+    }
+
+    for (auto const & gaussian : m_smoother->smoothedTargets().m_gaussians)
+    {
+        if (gaussian.m_weight < extract_thld)
+        {
+            continue;
+        }
+
+        for (unsigned int j=0; j<m_dimMeasures; ++j)
+        {
+            position.push_back(gaussian.m_mean(j,0));
+            speed.push_back(gaussian.m_mean(m_dimMeasures + j,0));
+        }
+
+        weight.push_back(gaussian.m_weight);
+    }
+}
+
+template <typename T>
+uint  GMPHDT<T>::smoothingDelay() const
+{
+    return m_smoother ? m_smoother->delay() : 0;
+}
+
+template <typename T>
+void  GMPHDT<T>::predictBirth()
+{
+    // Spontaneous births
+    size_t const n_birth = m_birthModel ? m_birthModel->m_gaussians.size () : 0;
+
+    m_birthTargets->resize(n_birth);
+
+    for (size_t i = 0; i < n_birth; ++i)
+    {
+        m_birthTargets->m_gaussians[i] = m_birthModel->m_gaussians[i];
+    }
+}
+
+template <typename T>
+void  GMPHDT<T>::predictSpawns()
+{
+    // Spawned targets, one batch per spawning model (every existing target spawns
+    // with every model), from the lanes of the current targets (see predictWith())
+    size_t const n_birth = m_birthModel ? m_birthModel->m_gaussians.size () : 0;
+    unsigned int const n_curr = m_currTargets->m_gaussians.size ();
+    unsigned int const n_spawn = m_spawnModels.size ();
+    unsigned int const n_candidates = n_curr * n_spawn;
+
+    if (n_candidates == 0)
+    {
+        m_spawnTargets->resize(0);
+        return;
+    }
+
+    // Bounded mode : only keep the heaviest spawns which fit
+    unsigned int n_kept = n_candidates;
+
+    if (m_bounded)
+    {
+        unsigned int const n_births = n_birth + (m_birthGrid ? m_birthGrid->size() : 0);
+        unsigned int const room = m_capacity.m_maxPredictions > n_curr + n_births ?
+                    m_capacity.m_maxPredictions - n_curr - n_births : 0;
+
+        n_kept = std::min(n_candidates, std::min(m_capacity.m_maxSpawns, room));
+    }
+
+    m_spawnSlots.resize(n_candidates);
+
+    if (n_kept < n_candidates)
+    {
+        m_spawnOrder.resize(n_candidates);
+
+        for (unsigned int i = 0; i < n_curr; ++i)
+        {
+            for (unsigned int s = 0; s < n_spawn; ++s)
+            {
+                m_spawnOrder[i * n_spawn + s] = std::make_pair(m_currTargets->m_gaussians[i].m_weight *
+                                                               m_spawnModels[s].m_weight, i * n_spawn + s);
+            }
+        }
+
+        std::nth_element(m_spawnOrder.begin(), m_spawnOrder.begin() + n_kept, m_spawnOrder.end(),
+                         [](std::pair<T, uint> const & lhs, std::pair<T, uint> const & rhs)
+        {
+            return lhs.first > rhs.first;
+        });
+
+        std::fill(m_spawnSlots.begin(), m_spawnSlots.end(), -1);
+
+        for (unsigned int k = 0; k < n_kept; ++k)
+        {
+            m_spawnSlots[m_spawnOrder[k].second] = k;
+        }
+
+        m_capacityStats.m_droppedSpawns += n_candidates - n_kept;
+    }
+    else
+    {
+        for (unsigned int k = 0; k < n_candidates; ++k)
+        {
+            m_spawnSlots[k] = k;
+        }
+    }
+
+    BatchKernels<T> const & kernels = batchKernels<T>();
+
+    m_spawnTargets->resize(n_kept);
+
+    for (unsigned int s = 0; s < n_spawn; ++s)
+    {
+        SpawningModel const & spawn = m_spawnModels[s];
+        MatrixXT const * trans = &spawn.m_trans;
+        MatrixXT const * offset = &spawn.m_offset;
+
+        if (m_pendingReferential)
+        {
+            // Composed with the referential change, see predictWith()
+            m_spawnTrans.noalias() = spawn.m_trans * m_refState;
+            m_spawnOffset = spawn.m_offset;
+            m_spawnOffset.noalias() += spawn.m_trans * m_refOffset;
+
+            trans = &m_spawnTrans;
+            offset = &m_spawnOffset;
+        }
+
+        kernels.affine(trans->data(), trans->rows(), trans->cols(),
+                       offset->data(), m_laneMeans, m_spawnOutMeans);
+        kernels.sandwich(trans->data(), trans->rows(), trans->cols(),
+                         spawn.m_cov.data(), m_laneCovs, m_spawnScratch, m_spawnOutCovs);
+
+        forComponents(n_curr, [&](int begin, int end)
+        {
+            for (int i = begin; i < end; ++i)
+            {
+                int const slot = m_spawnSlots[i * n_spawn + s];
+                if (slot < 0)
+                {
+                    continue;
+                }
+
+                GaussianModel & new_spawn = m_spawnTargets->m_gaussians[slot];
+
+                new_spawn.m_weight = m_currTargets->m_gaussians[i].m_weight * spawn.m_weight;
+                m_spawnOutMeans.get(i, new_spawn.m_mean);
+                m_spawnOutCovs.get(i, new_spawn.m_cov);
+            }
+        });
+    }
+}
+
+template <typename T>
+void  GMPHDT<T>::predictTargets (MatrixXT const & trans, T const * offset, MatrixXT const & cov) {
+    // Propagate all the targets at once : F.x (+ offset) and F.P.F^t + Q,
+    // from the lanes of the current targets (see predictWith())
+    BatchKernels<T> const & kernels = batchKernels<T>();
+    unsigned int const n_curr = m_currTargets->m_gaussians.size ();
+
+    kernels.affine(trans.data(), m_dimState, m_dimState, offset, m_laneMeans, m_laneOutMeans);
+    kernels.sandwich(trans.data(), m_dimState, m_dimState, cov.data(),
+                     m_laneCovs, m_laneScratch, m_laneOutCovs);
+
+    m_expTargets->resize(n_curr);
+
+    forComponents(n_curr, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; ++i)
+        {
+            GaussianModel & new_target = m_expTargets->m_gaussians[i];
+
+            new_target.m_weight = m_pSurvival * m_currTargets->m_gaussians[i].m_weight;
+            m_laneOutMeans.get(i, new_target.m_mean);
+            m_laneOutCovs.get(i, new_target.m_cov);
+        }
+    });
+}
+
+template <typename T>
+void  GMPHDT<T>::toLanes(vector<GaussianModel> const & gaussians,
+                         LaneMatrices<T> & means, LaneMatrices<T> & covs) const
+{
+    int const n_gaussians = gaussians.size ();
+
+    means.resize(m_dimState, 1, n_gaussians);
+    covs.resizeSymmetric(m_dimState, n_gaussians);
+
+    for (int i = 0; i < n_gaussians; ++i)
+    {
+        means.set(i, gaussians[i].m_mean);
+        covs.set(i, gaussians[i].m_cov);
+    }
+}
+
+template <typename T>
+bool  GMPHDT<T>::loadState(std::string const & path)
+{
+    GMPHDSnapshot snapshot;
+
+    if (!snapshot.open(path))
+    {
+        printf("[GMPHD] - Could not load state from %s\n", path.c_str());
+        return false;
+    }
+
+    return loadState(snapshot);
+}
+
+template <typename T>
+bool  GMPHDT<T>::loadState(GMPHDSnapshot const & snapshot)
+{
+    SnapshotHeader const & header = snapshot.header();
+
+    if (header.m_dimMeasures != m_dimMeasures || header.m_dimState != m_dimState ||
+            (header.m_motionModel != 0) != m_motionModel)
+    {
+        printf("[GMPHD] - Snapshot dimensions (%u measures, %u states) do not match the filter\n",
+               header.m_dimMeasures, header.m_dimState);
+        return false;
+    }
+
+    // A bounded filter only loads what fits its pools, checked before anything changes
+    if (m_bounded)
+    {
+        if (header.m_birthModel.m_count > m_capacity.m_maxBirths)
+        {
+            printf("[GMPHD] - Snapshot birth model (%u gaussians) exceeds the filter capacity\n",
+                   unsigned(header.m_birthModel.m_count));
+            return false;
+        }
+
+        if (header.m_currTargets.m_count > m_capacity.m_maxTargets)
+        {
+            printf("[GMPHD] - Snapshot targets (%u gaussians) exceed the filter capacity\n",
+                   unsigned(header.m_currTargets.m_count));
+            return false;
+        }
+    }
+
+    // Parameters
+    m_nMaxPrune       = header.m_nMaxPrune;
+    m_fusedPruning    = header.m_fusedPruning != 0;
+    m_candidateFactor = std::max(1u, header.m_candidateFactor);
+    m_maxCandidates   = std::max(1u, m_candidateFactor * m_nMaxPrune);
+    m_pruneTruncThld  = header.m_pruneTruncThld;
+    m_pruneMergeThld  = header.m_pruneMergeThld;
+
+    if (m_bounded)
+    {
+        m_nMaxPrune     = std::min(m_nMaxPrune, m_capacity.m_maxTargets);
+        m_fusedPruning  = true;
+        m_maxCandidates = std::min(m_maxCandidates, m_capacity.m_maxCandidates);
+    }
+
+    m_pSurvival       = header.m_pSurvival;
+    m_pDetection      = header.m_pDetection;
+    m_samplingPeriod  = header.m_samplingPeriod;
+    m_processNoise    = header.m_processNoise;
+    m_measNoisePose   = header.m_measNoisePose;
+    m_measNoiseSpeed  = header.m_measNoiseSpeed;
+    m_measNoiseBackground = header.m_measNoiseBackground;
+
+    // Clock, so that the next timestamped propagation uses the real interval
+    m_lastTimestamp   = header.m_lastTimestamp;
+    m_timeQuantum     = header.m_timeQuantum > 0 ? header.m_timeQuantum : m_timeQuantum;
+    m_hasTimestamp    = header.m_hasTimestamp != 0;
+
+    // Models
+    m_tgtDynTrans = snapshot.matrix(header.m_tgtDynTrans);
+    m_tgtDynCov   = snapshot.matrix(header.m_tgtDynCov);
+
+    // Custom models are the ones which setDynamicsModel(sampling, noise) would not build
+    MatrixXT nominal_trans = MatrixXT::Identity(m_dimState, m_dimState);
+    for (unsigned int i = 0; m_motionModel && i < m_dimMeasures; ++i)
+    {
+        nominal_trans(i, m_dimMeasures + i) = m_samplingPeriod;
+    }
+
+    m_customDynamics = m_tgtDynTrans != nominal_trans ||
+            m_tgtDynCov != m_processNoise * m_processNoise * MatrixXT::Identity(m_dimState, m_dimState);
+    m_dynamicsCache.clear();
+    m_obsMat      = snapshot.matrix(header.m_obsMat);
+    m_obsMatT     = m_obsMat.transpose();
+    m_obsCov      = snapshot.matrix(header.m_obsCov);
+    m_gridCached  = false;
+
+    m_birthModel.reset( new GaussianMixture(m_dimState) );
+    snapshot.copyMixture(header.m_birthModel, *m_birthModel);
+
+    SnapshotSpawn const & spawn = header.m_spawnModels;
+    size_t const dim = spawn.m_dim;
+
+    Map<MatrixXT const> const spawn_weights = snapshot.matrix({spawn.m_weights, spawn.m_count, 1});
+    Map<MatrixXT const> const spawn_offsets = snapshot.matrix({spawn.m_offsets, spawn.m_dim, spawn.m_count});
+    Map<MatrixXT const> const spawn_trans = snapshot.matrix({spawn.m_transitions, spawn.m_dim, spawn.m_dim * spawn.m_count});
+    Map<MatrixXT const> const spawn_covs = snapshot.matrix({spawn.m_covariances, spawn.m_dim, spawn.m_dim * spawn.m_count});
+
+    m_spawnModels.clear();
+    for (unsigned int i = 0; i < spawn.m_count; ++i)
+    {
+        SpawningModel model(m_dimMeasures);
+        model.m_weight = spawn_weights(i);
+        model.m_trans  = spawn_trans.middleCols(i * dim, dim);
+        model.m_cov    = spawn_covs.middleCols(i * dim, dim);
+        model.m_offset = spawn_offsets.col(i);
+        m_spawnModels.push_back(model);
+    }
+
+    // Current state
+    snapshot.copyMixture(header.m_currTargets, *m_currTargets);
+    m_compactTargets->clear();
+    m_extractedTargets->resize(0);
+    m_predicted = false;
+    m_pendingReferential = false;
+    m_nCorrections = 0;
+
+    if (m_smoother)
+    {
+        m_smoother->clear();
+    }
+
+    return true;
+}
+
+template <typename T>
+void GMPHDT<T>::print() const
+{
+    // In the current referential, a pending change included
+    GaussianMixture targets(*m_currTargets);
+
+    if (m_pendingReferential)
+    {
+        targets.changeReferential(m_referential);
+    }
+
+    printf("Current gaussian mixture : \n");
+
+    int i = 0;
+    for (auto const & gauss : targets.m_gaussians )
+    {
+        printf("Gaussian %d - pos %.1f  %.1f %.1f - cov %.1f  %.1f %.1f - weight %.3f\n",
+               i++,
+               gauss.m_mean(0,0), gauss.m_mean(1,0), gauss.m_mean(2,0),
+               gauss.m_cov(0,0), gauss.m_cov(1,1), gauss.m_cov(2,2),
+               gauss.m_weight);
+    }
+    printf("\n");
+}
+
+template <typename T>
+void  GMPHDT<T>::propagate ()
+{
+    if (m_recorder != NULL)
+    {
+        m_recorder->recordPropagate();
+    }
+
+    auto const start = std::chrono::steady_clock::now();
+
+    predictWith(m_tgtDynTrans, m_tgtDynCov);
+    fitFrameBudget(m_obsCov);
+    correctWith(m_obsCov, m_pDetection, m_measNoiseBackground);
+    finishFrame();
+    endFrameBudget(start);
+}
+
+template <typename T>
+void  GMPHDT<T>::propagate (double timestamp)
+{
+    if (m_recorder != NULL)
+    {
+        m_recorder->recordPropagate(timestamp);
+    }
+
+    auto const start = std::chrono::steady_clock::now();
+
+    predictAt(timestamp);
+    fitFrameBudget(m_obsCov);
+    correctWith(m_obsCov, m_pDetection, m_measNoiseBackground);
+    finishFrame();
+    endFrameBudget(start);
+}
+
+template <typename T>
+void  GMPHDT<T>::predict ()
+{
+    if (m_recorder != NULL)
+    {
+        m_recorder->recordPredict();
+    }
+
+    predictWith(m_tgtDynTrans, m_tgtDynCov);
+}
+
+template <typename T>
+void  GMPHDT<T>::predict (double timestamp)
+{
+    if (m_recorder != NULL)
+    {
+        m_recorder->recordPredict(timestamp);
+    }
+
+    predictAt(timestamp);
+}
+
+template <typename T>
+void  GMPHDT<T>::correct (vector<T> const & position, vector<T> const & speed,
+                          SensorModel const & sensor)
+{
+    if (m_recorder != NULL)
+    {
+        m_recorder->recordCorrect(position, speed, sensor);
+    }
+
+    if (!m_predicted)
+    {
+        THROW_ERR("Correction without a prediction, call predict() first");
+    }
+
+    loadMeasurements(position, speed);
+
+    // Observation noise of this sensor, same model as setObservationModel()
+    m_sensorCov.setIdentity(m_dimState, m_dimState);
+    m_sensorCov.topLeftCorner(m_dimMeasures, m_dimMeasures) *= sensor.m_measNoisePose * sensor.m_measNoisePose;
+
+    if (m_motionModel)
+    {
+        m_sensorCov.bottomRightCorner(m_dimMeasures, m_dimMeasures) *= sensor.m_measNoiseSpeed * sensor.m_measNoiseSpeed;
+    }
+
+    correctWith(m_sensorCov, sensor.m_pDetection, sensor.m_measNoiseBackground);
+}
+
+template <typename T>
+void  GMPHDT<T>::prune ()
+{
+    if (m_recorder != NULL)
+    {
+        m_recorder->recordPrune();
+    }
+
+    finishFrame();
+}
+
+template <typename T>
+GaussianMixtureT<T> const & GMPHDT<T>::predictedTargets () const
+{
+    return *m_expTargets;
+}
+
+template <typename T>
+GaussianMixtureT<T> & GMPHDT<T>::currentTargets ()
+{
+    applyReferential();
+    return *m_currTargets;
+}
+
+template <typename T>
+void  GMPHDT<T>::addExternalPredictions (vector<GaussianModel> const & predictions)
+{
+    if (!m_predicted)
+    {
+        THROW_ERR("External predictions are only accepted after predict()");
+    }
+
+    size_t const n_external = m_externalTargets->m_gaussians.size ();
+    m_externalTargets->resize(n_external + predictions.size());
+
+    for (size_t i = 0; i < predictions.size(); ++i)
+    {
+        m_externalTargets->m_gaussians[n_external + i] = predictions[i];
+    }
+}
+
+template <typename T>
+void  GMPHDT<T>::predictAt (double timestamp)
+{
+    double interval = m_samplingPeriod;
+
+    if (m_hasTimestamp)
+    {
+        interval = timestamp - m_lastTimestamp;
+
+        if (interval < 0)
+        {
+            printf("[GMPHD] - Timestamp %f older than the previous one, no motion applied\n", timestamp);
+            interval = 0;
+        }
+    }
+
+    if (!m_hasTimestamp || timestamp > m_lastTimestamp)
+    {
+        m_lastTimestamp = timestamp;
+        m_hasTimestamp = true;
+    }
+
+    if (m_customDynamics)
+    {
+        predictWith(m_tgtDynTrans, m_tgtDynCov);
+        return;
+    }
+
+    CachedDynamics const & dynamics = dynamicsFor(interval);
+    predictWith(dynamics.m_trans, dynamics.m_cov);
+}
+
+template <typename T>
+typename GMPHDT<T>::CachedDynamics const & GMPHDT<T>::dynamicsFor(double interval)
+{
+    long long const key = llround(interval / m_timeQuantum);
+
+    ++m_dynamicsClock;
+
+    // Cached interval, or the least recently used slot
+    size_t i_slot = 0;
+
+    for (size_t i = 0; i < m_dynamicsCache.size(); ++i)
+    {
+        if (m_dynamicsCache[i].m_key == key)
+        {
+            m_dynamicsCache[i].m_lastUse = m_dynamicsClock;
+            return m_dynamicsCache[i];
+        }
+
+        if (m_dynamicsCache[i].m_lastUse < m_dynamicsCache[i_slot].m_lastUse)
+        {
+            i_slot = i;
+        }
+    }
+
+    if (m_dynamicsCache.size() < DYNAMICS_CACHE_SIZE)
+    {
+        i_slot = m_dynamicsCache.size();
+        m_dynamicsCache.push_back(CachedDynamics());
+        m_dynamicsCache.back().m_trans.resize(m_dimState, m_dimState);
+        m_dynamicsCache.back().m_cov.resize(m_dimState, m_dimState);
+    }
+
+    CachedDynamics & dynamics = m_dynamicsCache[i_slot];
+    dynamics.m_key = key;
+    dynamics.m_lastUse = m_dynamicsClock;
+
+    // Built for the quantized interval, so that a cached model does not depend on
+    // the first interval which filled it.
+    // Continuous white noise acceleration, q being the process noise intensity, per axis :
+    // F = [1 dt; 0 1], Q = q.[dt^3/3 dt^2/2; dt^2/2 dt]. Random walk without speeds : Q = q.dt
+    T const dt = T(key * m_timeQuantum);
+    T const q = m_processNoise * m_processNoise;
+
+    dynamics.m_trans.setIdentity();
+    dynamics.m_cov.setZero();
+
+    if (m_motionModel)
+    {
+        for (unsigned int i = 0; i < m_dimMeasures; ++i)
+        {
+            unsigned int const j = m_dimMeasures + i;
+
+            dynamics.m_trans(i, j) = dt;
+
+            dynamics.m_cov(i, i) = q * dt * dt * dt / 3;
+            dynamics.m_cov(i, j) = q * dt * dt / 2;
+            dynamics.m_cov(j, i) = q * dt * dt / 2;
+            dynamics.m_cov(j, j) = q * dt;
+        }
+    }
+    else
+    {
+        dynamics.m_cov.diagonal().setConstant(q * dt);
+    }
+
+    return dynamics;
+}
+
+template <typename T>
+void  GMPHDT<T>::predictWith (MatrixXT const & trans, MatrixXT const & cov)
+{
+    // Compact components are back in full precision for this frame, spawns included
+    m_compactTargets->expand(*m_currTargets);
+
+    // Spawns and survivals both start from the current targets
+    toLanes(m_currTargets->m_gaussians, m_laneMeans, m_laneCovs);
+
+    // Pending referential change (x -> B.x + b), composed with the motion models :
+    // F.(B.x + b) = (F.B).x + F.b
+    MatrixXT const * pred_trans = &trans;
+    T const * pred_offset = NULL;
+
+    if (m_pendingReferential)
+    {
+        referentialState(m_referential);
+
+        m_predTrans.noalias() = trans * m_refState;
+        m_predOffset.noalias() = trans * m_refOffset;
+
+        pred_trans = &m_predTrans;
+        pred_offset = m_predOffset.data();
+    }
+
+    // The smoother goes back through the same motion model
+    if (m_smoother)
+    {
+        m_smoother->addTransition(*pred_trans, pred_offset, cov, m_pSurvival);
+    }
+
+    // Births, spawns and survivals are independent, each writes its own mixture and lanes.
+    // They run concurrently when there is enough to share
+    if (m_threads > 1 && m_currTargets->m_gaussians.size () * (1 + m_spawnModels.size ()) >=
+            size_t(PARALLEL_MIN_COMPONENTS))
+    {
+        parallelFor(m_threads, 3, [&](int stage)
+        {
+            switch (stage)
+            {
+            case 0:
+                predictTargets(*pred_trans, pred_offset, cov);
+                break;
+            case 1:
+                predictSpawns();
+                break;
+            default:
+                predictBirth();
+            }
+        });
+    }
+    else
+    {
+        predictBirth();
+        predictSpawns();
+        predictTargets(*pred_trans, pred_offset, cov);
+    }
+
+    m_pendingReferential = false;
+
+    // All the predictions, births and spawns included
+    gatherPredictions();
+
+    if( m_bVerbose )
+    {
+        printf("\nGMPHD_propagate :--- Expected targets : %d ---\n", m_nPredTargets);
+        m_expTargets->print();
+    }
+
+    m_predicted = true;
+    m_nCorrections = 0;
+}
+
+template <typename T>
+void  GMPHDT<T>::correctWith (MatrixXT const & obs_cov, T p_detection, T background)
+{
+    if (m_nCorrections > 0)
+    {
+        // Sequential correction : the posterior of the previous sensor is the prediction
+        // of this one, births included. No weight threshold before the pruning of the frame,
+        // which merges the light components first : the empty slots (births without a
+        // measurement) are dropped, and only the heaviest candidates are kept, as the fused
+        // pruning does
+        std::swap(m_expTargets, m_currTargets);
+        m_iBirthTargets.clear();
+
+        if (!m_fusedPruning)
+        {
+            capPredictions();
+        }
+    }
+
+    // Predictions of other filters, for this correction only
+    size_t const n_pred = m_expTargets->m_gaussians.size ();
+    size_t const n_external = m_externalTargets->m_gaussians.size ();
+
+    if (n_external > 0)
+    {
+        m_expTargets->resize(n_pred + n_external);
+
+        for (size_t i = 0; i < n_external; ++i)
+        {
+            m_iBirthTargets.push_back( n_pred + i );
+            std::swap(m_expTargets->m_gaussians[n_pred + i], m_externalTargets->m_gaussians[i]);
+        }
+
+        m_externalTargets->resize(0);
+    }
+
+    // Mapped births, in the first correction only like the predicted births. The nonlinear
+    // update has nothing to cache, they join the predictions then
+    m_nGridBirths = 0;
+
+    if (m_birthGrid != NULL && m_nCorrections == 0)
+    {
+        if (m_nonlinear)
+        {
+            size_t const n_start = m_expTargets->m_gaussians.size ();
+
+            for (size_t i = 0; i < m_birthGrid->size(); ++i)
+            {
+                m_iBirthTargets.push_back( n_start + i );
+            }
+
+            appendGridBirths(*m_expTargets);
+        }
+        else
+        {
+            m_nGridBirths = m_birthGrid->size();
+        }
+    }
+
+    // Build the update components
+    buildUpdate (obs_cov);
+
+    // Update GMPHD
+    update(p_detection, background);
+
+    if (m_bVerbose)
+    {
+        printf("\nGMPHD_propagate :--- \n");
+        m_currTargets->print ();
+    }
+
+    ++m_nCorrections;
+}
+
+template <typename T>
+void  GMPHDT<T>::capPredictions()
+{
+    auto & predictions = m_expTargets->m_gaussians;
+    size_t n_kept = 0;
+
+    for (size_t i = 0; i < predictions.size(); ++i)
+    {
+        if (predictions[i].m_weight > 0)
+        {
+            std::swap(predictions[n_kept++], predictions[i]);
+        }
+    }
+
+    // Same bound as the candidates of the fused pruning
+    if (n_kept > m_maxCandidates)
+    {
+        auto heavier = [](GaussianModelT<T> const & lhs, GaussianModelT<T> const & rhs)
+        {
+            return lhs.m_weight > rhs.m_weight;
+        };
+
+        std::nth_element(predictions.begin(), predictions.begin() + m_maxCandidates,
+                         predictions.begin() + n_kept, heavier);
+        n_kept = m_maxCandidates;
+    }
+
+    m_expTargets->resize(n_kept);
+}
+
+template <typename T>
+void  GMPHDT<T>::finishFrame()
+{
+    if (m_predicted && m_nCorrections == 0)
+    {
+        // No sensor this frame : the prediction is the posterior, mapped births included
+        std::swap(m_expTargets, m_currTargets);
+
+        if (m_birthGrid != NULL)
+        {
+            appendGridBirths(*m_currTargets);
+        }
+    }
+
+    m_predicted = false;
+    m_nCorrections = 0;
+    m_externalTargets->resize(0);
+
+    // Prune gaussians (remove weakest, merge close enough gaussians)
+    pruneGaussians ();
+
+    // Smoothed estimate of the frame lag frames ago, with the compact components
+    if (m_smoother)
+    {
+        m_smoother->addPosterior(*m_currTargets, m_birthModel.get(), m_pruneTruncThld,
+                                 m_pruneMergeThld, m_nMaxPrune);
+    }
+
+    // Survivors too light to matter before the next measurement leave the posterior,
+    // the full precision prediction is not needed anymore either
+    if (m_compactThld > 0)
+    {
+        m_compactTargets->compact(*m_currTargets, m_compactThld);
+        m_expTargets->resize(0);
+    }
+
+    if (m_bVerbose)
+    {
+        printf("\nGMPHD_propagate :--- Pruned targets : ---\n");
+        m_currTargets->print();
+    }
+
+    // Clean vectors, unless they are kept for the next frame :
+    if (!m_bounded)
+    {
+        m_expMeasure.clear ();
+        m_expDisp.clear ();
+        m_uncertainty.clear ();
+    }
+}
+
+template <typename T>
+void  GMPHDT<T>::offerCandidate(T weight, uint i_meas, uint i_target)
+{
+    if (weight < m_pruneTruncThld)
+    {
+        return;
+    }
+
+    // Min-heap on the weights : the lightest candidate is always in front
+    auto heavier = [](UpdateCandidate const & lhs, UpdateCandidate const & rhs)
+    {
+        return lhs.m_weight > rhs.m_weight;
+    };
+
+    if (m_candidates.size() < m_maxCandidates)
+    {
+        m_candidates.push_back({weight, i_meas, i_target});
+        std::push_heap(m_candidates.begin(), m_candidates.end(), heavier);
+        return;
+    }
+
+    // Full : either this candidate or the lightest one is dropped
+    ++m_capacityStats.m_droppedCandidates;
+
+    if (weight > m_candidates.front().m_weight)
+    {
+        std::pop_heap(m_candidates.begin(), m_candidates.end(), heavier);
+        m_candidates.back() = {weight, i_meas, i_target};
+        std::push_heap(m_candidates.begin(), m_candidates.end(), heavier);
+    }
+}
+
+template <typename T>
+bool  GMPHDT<T>::isCluster(GaussianModel const & measure) const
+{
+    return m_clustering && measure.m_weight > 1;
+}
+
+template <typename T>
+bool  GMPHDT<T>::hasResidualHook() const
+{
+    return m_nonlinear && bool(m_measurementModel.m_difference);
+}
+
+template <typename T>
+void  GMPHDT<T>::residual(uint i_meas, uint i_target)
+{
+    int const dim_meas = m_expMeasure[i_target].rows();
+
+    if (hasResidualHook())
+    {
+        size_t const offset = (size_t(i_target) * m_measTargets->m_gaussians.size () + i_meas) * dim_meas;
+        m_innovation = Map<MatrixXT const>(m_residuals.data() + offset, dim_meas, 1);
+    }
+    else
+    {
+        m_innovation = m_measTargets->m_gaussians[i_meas].m_mean.topRows(dim_meas) - m_expMeasure[i_target];
+    }
+}
+
+template <typename T>
+void  GMPHDT<T>::updateWithCluster(uint i_target, uint i_meas, GaussianModel & updated)
+{
+    // The centroid adds its covariance C to the innovation of the prediction : with the
+    // cross covariance Pxz = K.S of the shared terms, K' = Pxz.(S + C)^-1 and P' = P - K'.Pxz^t
+    GaussianModel const & predicted = m_expTargets->m_gaussians[i_target];
+    GaussianModel const & measure = m_measTargets->m_gaussians[i_meas];
+    int const dim_meas = m_expDisp[i_target].rows();
+
+    m_clusterCross.noalias() = m_uncertainty[i_target] * m_expDisp[i_target];
+    m_clusterInnov = m_expDisp[i_target];
+    m_clusterInnov += measure.m_cov.corner(dim_meas);
+    m_clusterLLT.compute(m_clusterInnov);
+
+    m_clusterGainT = m_clusterCross.transpose();
+    m_clusterLLT.solveInPlace(m_clusterGainT);
+
+    residual(i_meas, i_target);
+    updated.m_mean = predicted.m_mean;
+    updated.m_mean.noalias() += m_clusterGainT.transpose() * m_innovation;
+
+    m_updatedCov = predicted.m_cov.dense();
+    m_updatedCov.noalias() -= m_clusterGainT.transpose() * m_clusterCross.transpose();
+    updated.m_cov = m_updatedCov;
+}
+
+template <typename T>
+void  GMPHDT<T>::pruneGaussians()
+{
+    m_currTargets->prune( m_pruneTruncThld, m_pruneMergeThld, m_nMaxPrune, m_dimMeasures, m_mergeThreads );
+}
+
+template <typename T>
+void  GMPHDT<T>::saveState(vector<char> & buffer) const
+{
+    SnapshotWriterT<T> writer;
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+
+    header.m_dimMeasures     = m_dimMeasures;
+    header.m_dimState        = m_dimState;
+    header.m_motionModel     = m_motionModel;
+    header.m_maxGaussians    = m_maxGaussians;
+
+    header.m_nMaxPrune       = m_nMaxPrune;
+    header.m_fusedPruning    = m_fusedPruning;
+    header.m_candidateFactor = m_candidateFactor;
+    header.m_pruneTruncThld  = m_pruneTruncThld;
+    header.m_pruneMergeThld  = m_pruneMergeThld;
+
+    header.m_pSurvival       = m_pSurvival;
+    header.m_pDetection      = m_pDetection;
+    header.m_samplingPeriod  = m_samplingPeriod;
+    header.m_processNoise    = m_processNoise;
+    header.m_measNoisePose   = m_measNoisePose;
+    header.m_measNoiseSpeed  = m_measNoiseSpeed;
+    header.m_measNoiseBackground = m_measNoiseBackground;
+
+    header.m_lastTimestamp   = m_lastTimestamp;
+    header.m_timeQuantum     = m_timeQuantum;
+    header.m_hasTimestamp    = m_hasTimestamp;
+
+    header.m_tgtDynTrans = writer.addMatrix(m_tgtDynTrans);
+    header.m_tgtDynCov   = writer.addMatrix(m_tgtDynCov);
+    header.m_obsMat      = writer.addMatrix(m_obsMat);
+    header.m_obsCov      = writer.addMatrix(m_obsCov);
+
+    if (m_compactTargets->size() > 0 || m_pendingReferential)
+    {
+        // Saved in the current referential, a pending change is not part of the snapshot
+        GaussianMixture all_targets(m_dimState);
+        all_targets.m_gaussians = m_currTargets->m_gaussians;
+        m_compactTargets->decode(all_targets);
+
+        if (m_pendingReferential)
+        {
+            all_targets.changeReferential(m_referential);
+        }
+
+        header.m_currTargets = writer.addMixture(all_targets);
+    }
+    else
+    {
+        header.m_currTargets = writer.addMixture(*m_currTargets);
+    }
+    header.m_birthModel  = writer.addMixture(m_birthModel ? *m_birthModel : GaussianMixture(m_dimState));
+    header.m_spawnModels = writer.addSpawnModels(m_spawnModels, m_dimState);
+
+    buffer = writer.finish(header);
+}
+
+template <typename T>
+bool  GMPHDT<T>::saveState(std::string const & path) const
+{
+    vector<char> buffer;
+    saveState(buffer);
+
+    // Write aside and rename, so that a concurrent reader never sees a partial snapshot
+    std::string const tmp_path = path + ".tmp";
+    FILE * file = fopen(tmp_path.c_str(), "wb");
+
+    if (file == NULL)
+    {
+        printf("[GMPHD] - Could not open %s\n", tmp_path.c_str());
+        return false;
+    }
+
+    bool const written = fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+
+    if (fclose(file) != 0 || !written || rename(tmp_path.c_str(), path.c_str()) != 0)
+    {
+        printf("[GMPHD] - Could not save state to %s\n", path.c_str());
+        remove(tmp_path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+template <typename T>
+void GMPHDT<T>::reset()
+{
+    m_currTargets->resize(0);
+    m_compactTargets->clear();
+    m_extractedTargets->resize(0);
+    m_predicted = false;
+    m_pendingReferential = false;
+    m_nCorrections = 0;
+
+    if (m_smoother)
+    {
+        m_smoother->clear();
+    }
+}
+
+
+template <typename T>
+void  GMPHDT<T>::setParallelMerging(uint n_threads)
+{
+    m_mergeThreads = std::max(1u, n_threads);
+
+    if (m_bounded)
+    {
+        // Both pools are pruned (see correct()), their scratch follows the merging threads
+        m_expTargets->reserve(m_expTargets->capacity(), m_mergeThreads);
+        m_currTargets->reserve(m_currTargets->capacity(), m_mergeThreads);
     }
 }
 
-bool GMPHD::isInitialized()
+template <typename T>
+void  GMPHDT<T>::setThreads(uint n_threads)
 {
-    if( m_tgtDynTrans.cols() != m_dimState)
+    m_threads = std::max(1u, n_threads);
+}
+
+template <typename T>
+void  GMPHDT<T>::setSmoothing(uint lag)
+{
+    if (lag == 0)
     {
-        printf("[GMPHD] - Motion model not set\n");
-        return false;
+        m_smoother.reset();
+        return;
     }
 
-    if( m_pruneTruncThld <= 0.f)
+    uint const capacity = m_bounded ? m_capacity.m_maxTargets : m_nMaxPrune;
+    m_smoother.reset(new Smoother(m_dimState, m_dimMeasures, lag, capacity));
+}
+
+template <typename T>
+void  GMPHDT<T>::setCompactStorage(T weight_threshold, CompactFormat format)
+{
+    if (m_bounded && weight_threshold > 0)
     {
-        printf("[GMPHD] - Pruning parameters not set\n");
-        return false;
+        THROW_ERR("Compact storage is not available in bounded mode");
     }
 
-    if( m_pDetection <= 0.f || m_pSurvival <= 0.f )
+    if (format != m_compactTargets->format())
     {
-        printf("[GMPHD] - Observation model not set\n");
-        return false;
+        m_compactTargets->expand(*m_currTargets);
+        m_compactTargets.reset( new CompactMixture(m_dimState, format) );
     }
 
-    return true;
+    m_compactThld = std::max(weight_threshold, T(0));
 }
 
-void    GMPHD::extractTargets(float threshold)
+template <typename T>
+typename GMPHDT<T>::CompactMixture const & GMPHDT<T>::compactTargets() const
 {
-    float const thld = std::max(threshold, 0.f);
+    return *m_compactTargets;
+}
 
-    // Get trough every target, keep the ones whose weight is above threshold
-    m_extractedTargets->m_gaussians.clear();
+template <typename T>
+void  GMPHDT<T>::setBirthModel(vector<GaussianModel> &birth_model)
+{
+    if (m_bounded && birth_model.size() + (m_birthGrid ? m_birthGrid->size() : 0) > m_capacity.m_maxBirths)
+    {
+        THROW_ERR("Birth model larger than the capacity of the filter");
+    }
 
-    for ( auto const & current_target : m_currTargets->m_gaussians)
+    if (birth_model.empty())
     {
-        if (current_target.m_weight >= thld)
-        {
-            m_extractedTargets->m_gaussians.push_back(current_target);
-        }
+        m_birthModel.reset();
+        return;
     }
+
+    m_birthModel.reset( new GaussianMixture( birth_model) );
 }
 
-void GMPHD::getTrackedTargets(vector<float> & position,
-                              vector<float> & speed,
-                              vector<float> & weight,
-                              float const & extract_thld)
+template <typename T>
+void  GMPHDT<T>::setBirthGrid(BirthGrid const * grid)
 {
-    // Fill in "extracted_targets" from the "current_targets"
-    extractTargets(extract_thld);
+    if (grid != NULL && (!grid->isOpen() || grid->dim() != int(m_dimState)))
+    {
+        THROW_ERR("Birth grid not mapped, or not matching the state dimension");
+    }
 
-    position.clear();
-    speed.clear();
-    weight.clear();
+    size_t const n_births = m_birthModel ? m_birthModel->m_gaussians.size() : 0;
 
-    for (auto const & gaussian : m_extractedTargets->m_gaussians)
+    if (m_bounded && grid != NULL && grid->size() + n_births > m_capacity.m_maxBirths)
     {
-        for (unsigned int j=0; j<m_dimMeasures; ++j)
-        {
-            position.push_back(gaussian.m_mean(j,0));
-            speed.push_back(gaussian.m_mean(m_dimMeasures + j,0));
-        }
-
-        weight.push_back(gaussian.m_weight);
+        THROW_ERR("Birth grid larger than the capacity of the filter");
     }
+
+    m_birthGrid = grid;
+    m_gridCached = false;
 }
 
-void  GMPHD::predictBirth()
+template <typename T>
+void  GMPHDT<T>::setDynamicsModel(T sampling, T processNoise)
 {
-    m_spawnTargets->m_gaussians.clear();
-    m_birthTargets->m_gaussians.clear();
-
-    // -----------------------------------------
-    // Compute spontaneous births
-    m_birthTargets->m_gaussians = m_birthModel->m_gaussians;
-    m_nPredTargets += m_birthTargets->m_gaussians.size ();
 
-    // -----------------------------------------
-    // Compute spawned targets
-    for( auto const & curr : m_currTargets->m_gaussians )
-    {
-        for( auto const & spawn : m_spawnModels )
-        {
-            GaussianModel new_spawn(m_dimState);
-
-            // Define a gaussian model from the existing target
-            // and spawning properties
-            new_spawn.m_weight = curr.m_weight * spawn.m_weight;
+    m_samplingPeriod  = sampling;
+    m_processNoise    = processNoise;
 
-            new_spawn.m_mean = spawn.m_offset + spawn.m_trans * curr.m_mean;
+    // Fill in propagation matrix :
+    m_tgtDynTrans = MatrixXT::Identity(m_dimState, m_dimState);
 
-            new_spawn.m_cov = spawn.m_cov + spawn.m_trans * curr.m_cov
-                    * spawn.m_trans.transpose();
+    for (unsigned int i = 0; i<m_dimMeasures; ++i)
+    {
+        m_tgtDynTrans(i,m_dimMeasures+i) = m_samplingPeriod;
+    }
 
-            // Add this new gaussian to the list of expected targets
-            m_spawnTargets->m_gaussians.push_back ( std::move(new_spawn) );
+    // Fill in covariance matrix
+    // Extra covariance added by the dynamics. Could be 0.
+    m_tgtDynCov = processNoise * processNoise *
+            MatrixXT::Identity(m_dimState, m_dimState);
 
-            // Update the number of expected targets
-            ++m_nPredTargets;
-        }
-    }
+    // The timestamped models follow the new noise
+    m_customDynamics = false;
+    m_dynamicsCache.clear();
 }
 
-void  GMPHD::predictTargets () {
-    GaussianModel new_target(m_dimState);
-
-    m_expTargets->m_gaussians.clear();
-    m_expTargets->m_gaussians.reserve( m_currTargets->m_gaussians.size () );
+template <typename T>
+void GMPHDT<T>::setDynamicsModel( MatrixXT const & tgt_dyn_transitions,
+                              MatrixXT const & tgt_dyn_covariance)
+{
+    m_tgtDynTrans = tgt_dyn_transitions;
+    m_tgtDynCov = tgt_dyn_covariance;
+    m_customDynamics = true;
+}
 
-    for (auto const & curr : m_currTargets->m_gaussians)
+template <typename T>
+void  GMPHDT<T>::setTimeQuantum(double quantum)
+{
+    if (!(quantum > 0))
     {
-        // Compute the new shape of the target
-        new_target.m_weight = m_pSurvival * curr.m_weight;
-
-        new_target.m_mean = m_tgtDynTrans * curr.m_mean;
+        THROW_ERR("Time quantum should be positive");
+    }
 
-        new_target.m_cov = m_tgtDynCov + m_tgtDynTrans
-                * curr.m_cov * m_tgtDynTrans.transpose();
+    m_timeQuantum = quantum;
+    m_dynamicsCache.clear();
+}
 
-        // Push back to the expected targets
-        m_expTargets->m_gaussians.push_back( new_target );
-        ++m_nPredTargets;
+template <typename T>
+void  GMPHDT<T>::setNewMeasurements(vector<T> const & position,
+                                vector<T> const & speed)
+{
+    if (m_recorder != NULL)
+    {
+        m_recorder->recordMeasurements(position, speed);
     }
+
+    loadMeasurements(position, speed);
 }
 
-void GMPHD::print() const
+template <typename T>
+void  GMPHDT<T>::loadMeasurements(vector<T> const & position,
+                                  vector<T> const & speed)
 {
-    printf("Current gaussian mixture : \n");
+    // Fill the gaussian mixture in place
+    size_t n_meas = position.size()/m_dimMeasures;
 
-    int i = 0;
-    for (auto const & gauss : m_currTargets->m_gaussians )
+    if (m_bounded && n_meas > m_capacity.m_maxMeasurements)
     {
-        printf("Gaussian %d - pos %.1f  %.1f %.1f - cov %.1f  %.1f %.1f - weight %.3f\n",
-               i++,
-               gauss.m_mean(0,0), gauss.m_mean(1,0), gauss.m_mean(2,0),
-               gauss.m_cov(0,0), gauss.m_cov(1,1), gauss.m_cov(2,2),
-               gauss.m_weight);
+        m_capacityStats.m_droppedMeasurements += n_meas - m_capacity.m_maxMeasurements;
+        n_meas = m_capacity.m_maxMeasurements;
     }
-    printf("\n");
-}
 
-void  GMPHD::propagate ()
-{
-    m_nPredTargets = 0;
+    m_measTargets->resize(n_meas);
 
-    // Predict new targets (spawns):
-    predictBirth();
+    for (unsigned int iTarget = 0; iTarget < n_meas; ++iTarget)
+    {
+        GaussianModel & new_obs = m_measTargets->m_gaussians[iTarget];
+        new_obs.m_mean.setZero();
 
-    // Predict propagation of expected targets :
-    predictTargets();
+        for (unsigned int i=0; i< m_dimMeasures; ++i) {
+            // Create new gaussian model according to measurement
+            new_obs.m_mean(i) = position[iTarget*m_dimMeasures + i];
 
-    // Build the update components
-    buildUpdate ();
+            if (m_motionModel)
+            {
+                new_obs.m_mean(i+m_dimMeasures) = speed[iTarget*m_dimMeasures + i];
+            }
+        }
 
-    if( m_bVerbose )
-    {
-        printf("\nGMPHD_propagate :--- Expected targets : %d ---\n", m_nPredTargets);
-        m_expTargets->print();
+        new_obs.m_cov = m_obsCov;
+        new_obs.m_weight = 1;
     }
 
-    // Update GMPHD
-    update();
+    if (m_clustering)
+    {
+        m_clustering->cluster(*m_measTargets);
+    }
+}
 
-    if (m_bVerbose)
+template <typename T>
+void  GMPHDT<T>::setMeasurementClustering(T voxel_size)
+{
+    if (voxel_size <= 0)
     {
-        printf("\nGMPHD_propagate :--- \n");
-        m_currTargets->print ();
+        m_clustering.reset();
+        return;
     }
 
-    // Prune gaussians (remove weakest, merge close enough gaussians)
-    pruneGaussians ();
+    m_clustering.reset(new MeasurementClustering(m_dimMeasures, m_dimState, voxel_size));
 
-    if (m_bVerbose)
+    if (m_bounded)
     {
-        printf("\nGMPHD_propagate :--- Pruned targets : ---\n");
-        m_currTargets->print();
+        m_clustering->reserve(m_capacity.m_maxMeasurements);
+        m_clusterRows.reserve(m_capacity.m_maxMeasurements);
     }
-
-    // Clean vectors :
-    m_expMeasure.clear ();
-    m_expDisp.clear ();
-    m_uncertainty.clear ();
-    m_covariance.clear ();
 }
 
-void  GMPHD::pruneGaussians()
+template <typename T>
+ClusteringStats  GMPHDT<T>::clusteringStats() const
 {
-    m_currTargets->prune( m_pruneTruncThld, m_pruneMergeThld, m_nMaxPrune );
+    return m_clustering ? m_clustering->stats() : ClusteringStats();
 }
 
-void GMPHD::reset()
+template <typename T>
+void  GMPHDT<T>::setNewReferential(const MatrixXT & transform)
 {
-    m_currTargets->m_gaussians.clear ();
-    m_extractedTargets->m_gaussians.clear ();
-}
+    if (m_recorder != NULL)
+    {
+        m_recorder->recordReferential(transform);
+    }
 
+    // Transform is homogeneous over the positions, see GaussianMixture::changeReferential()
+    int const dim_pos = transform.rows() - 1;
 
-void  GMPHD::setBirthModel(vector<GaussianModel> &birth_model)
-{
-    m_birthModel.reset( new GaussianMixture( birth_model) );
+    if (transform.cols() != transform.rows() || dim_pos <= 0 || (m_dimState % dim_pos) != 0)
+    {
+        THROW_ERR("Referential change does not match the state dimension");
+    }
+
+    if (m_predicted)
+    {
+        // Frame in progress : what the next correction starts from moves to the new referential.
+        // Before the first correction, the prediction (the births are drawn in the new referential
+        // already, and the update lanes are built from the prediction by the correction).
+        // Between two corrections, the posterior of the previous sensor (see correctWith())
+        if (m_nCorrections == 0)
+        {
+            changePredictionsReferential(transform);
+        }
+        else
+        {
+            m_currTargets->changeReferential(transform);
+        }
+
+        m_externalTargets->changeReferential(transform);
+        smootherReferential(transform);
+        return;
+    }
+
+    if (m_pendingReferential && m_referential.rows() != transform.rows())
+    {
+        // Different position dimension, no composition
+        applyReferential();
+        m_currTargets->changeReferential(transform);
+        smootherReferential(transform);
+        return;
+    }
+
+    // Deferred to the next prediction, which composes it with the motion model so that
+    // every component is only touched once. Successive changes compose as well
+    if (m_pendingReferential)
+    {
+        m_referentialScratch.noalias() = transform * m_referential;
+        m_referential.swap(m_referentialScratch);
+    }
+    else
+    {
+        m_referential = transform;
+        m_pendingReferential = true;
+    }
 }
 
-void  GMPHD::setDynamicsModel(float sampling, float processNoise)
+template <typename T>
+void  GMPHDT<T>::changePredictionsReferential(MatrixXT const & transform)
 {
+    // Survivors and spawns, on both sides of the births (see gatherPredictions())
+    size_t const n_pred = m_expTargets->m_gaussians.size ();
 
-    m_samplingPeriod  = sampling;
-    m_processNoise    = processNoise;
+    if (m_iBirthTargets.empty())
+    {
+        m_expTargets->changeReferential(transform, 0, n_pred);
+        return;
+    }
 
-    // Fill in propagation matrix :
-    m_tgtDynTrans = MatrixXf::Identity(m_dimState, m_dimState);
+    size_t const birth_start = m_iBirthTargets.front();
+    size_t const birth_end = m_iBirthTargets.back() + 1;
 
-    for (unsigned int i = 0; i<m_dimMeasures; ++i)
+    if (birth_end - birth_start != m_iBirthTargets.size())
     {
-        m_tgtDynTrans(i,m_dimMeasures+i) = m_samplingPeriod;
+        THROW_ERR("Births are not contiguous in the prediction, cannot change its referential");
     }
 
-    // Fill in covariance matrix
-    // Extra covariance added by the dynamics. Could be 0.
-    m_tgtDynCov = processNoise * processNoise *
-            MatrixXf::Identity(m_dimState, m_dimState);
+    m_expTargets->changeReferential(transform, 0, birth_start);
+    m_expTargets->changeReferential(transform, birth_end, n_pred);
 }
 
-void GMPHD::setDynamicsModel( MatrixXf const & tgt_dyn_transitions,
-                              MatrixXf const & tgt_dyn_covariance)
+template <typename T>
+void  GMPHDT<T>::applyReferential()
 {
-    m_tgtDynTrans = tgt_dyn_transitions;
-    m_tgtDynCov = tgt_dyn_covariance;
+    // Anything reading the current targets sees them in the new referential
+    if (!m_pendingReferential)
+    {
+        return;
+    }
+
+    m_pendingReferential = false;
+
+    // Compact ones included
+    m_compactTargets->expand(*m_currTargets);
+    m_currTargets->changeReferential(m_referential);
+    smootherReferential(m_referential);
 }
 
-void  GMPHD::setNewMeasurements(vector<float> const & position,
-                                vector<float> const & speed)
+template <typename T>
+void  GMPHDT<T>::referentialState(MatrixXT const & transform)
 {
-    // Clear the gaussian mixture
-    m_measTargets->m_gaussians.clear();
+    // [R t; 0 1] over the positions : x -> diag(R, .., R).x + [t; 0 ..]
+    int const dim_pos = transform.rows() - 1;
 
-    unsigned int iTarget = 0;
+    m_refState.setZero(m_dimState, m_dimState);
+    m_refOffset.setZero(m_dimState, 1);
 
-    while(iTarget < position.size()/m_dimMeasures)
+    for (uint k = 0; k < m_dimState; k += dim_pos)
     {
-        GaussianModel new_obs(m_dimState);
-
-        for (unsigned int i=0; i< m_dimMeasures; ++i) {
-            // Create new gaussian model according to measurement
-            new_obs.m_mean(i) = position[iTarget*m_dimMeasures + i];
-            new_obs.m_mean(i+m_dimMeasures) = speed[iTarget*m_dimMeasures + i];
-        }
-
-        new_obs.m_cov = m_obsCov;
-        new_obs.m_weight = 1.f;
+        m_refState.block(k, k, dim_pos, dim_pos) = transform.topLeftCorner(dim_pos, dim_pos);
+    }
 
-        m_measTargets->m_gaussians.push_back(std::move(new_obs));
+    m_refOffset.topRows(dim_pos) = transform.topRightCorner(dim_pos, 1);
+}
 
-        iTarget++;
+template <typename T>
+void  GMPHDT<T>::smootherReferential(MatrixXT const & transform)
+{
+    // The smoother goes back through every change the targets went through
+    if (m_smoother)
+    {
+        referentialState(transform);
+        m_smoother->addReferential(m_refState, m_refOffset);
     }
 }
 
-void  GMPHD::setNewReferential(const Matrix4f & transform)
+template <typename T>
+void  GMPHDT<T>::setRecorder(GMPHDRecorder * recorder)
 {
-    // Change referential for every gaussian in the gaussian mixture
-    m_currTargets->changeReferential(transform);
+    m_recorder = recorder;
 }
 
-void  GMPHD::setPruningParameters (float  prune_trunc_thld,
-                                   float  prune_merge_thld,
+template <typename T>
+void  GMPHDT<T>::setPruningParameters (T  prune_trunc_thld,
+                                   T  prune_merge_thld,
                                    int    prune_max_nb)
 {
 
     m_pruneTruncThld = prune_trunc_thld;
     m_pruneMergeThld = prune_merge_thld;
     m_nMaxPrune     = prune_max_nb;
+    m_maxCandidates = std::max(1u, m_candidateFactor * m_nMaxPrune);
+
+    if (m_bounded)
+    {
+        m_nMaxPrune     = std::min(m_nMaxPrune, m_capacity.m_maxTargets);
+        m_maxCandidates = std::min(m_maxCandidates, m_capacity.m_maxCandidates);
+    }
+}
+
+template <typename T>
+void  GMPHDT<T>::setFusedPruning(bool enable, uint candidate_factor)
+{
+    m_fusedPruning    = enable;
+    m_candidateFactor = std::max(1u, candidate_factor);
+    m_maxCandidates   = std::max(1u, m_candidateFactor * m_nMaxPrune);
+
+    // The bounded mode relies on the fused pruning, and its preallocated candidates
+    if (m_bounded)
+    {
+        m_fusedPruning  = true;
+        m_maxCandidates = std::min(m_maxCandidates, m_capacity.m_maxCandidates);
+    }
 }
 
 
-void  GMPHD::setObservationModel(float probDetectionOverall,
-                                 float measurement_noise_pose,
-                                 float measurement_noise_speed,
-                                 float measurement_background )
+template <typename T>
+void  GMPHDT<T>::setObservationModel(T probDetectionOverall,
+                                 T measurement_noise_pose,
+                                 T measurement_noise_speed,
+                                 T measurement_background )
 {
     m_pDetection      = probDetectionOverall;
     m_measNoisePose   = measurement_noise_pose;
@@ -373,62 +2500,115 @@ void  GMPHD::setObservationModel(float probDetectionOverall,
     m_measNoiseBackground   = measurement_background; // False detection probability
 
     // Set model matrices
-    m_obsMat  = MatrixXf::Identity(m_dimState, m_dimState);
+    m_obsMat  = MatrixXT::Identity(m_dimState, m_dimState);
     m_obsMatT = m_obsMat.transpose();
-    m_obsCov  = MatrixXf::Identity(m_dimState,m_dimState);
+    m_obsCov  = MatrixXT::Identity(m_dimState,m_dimState);
 
     // FIXME: deal with the _motion_model parameter !
     m_obsCov.block(0,0,m_dimMeasures, m_dimMeasures) *= m_measNoisePose * m_measNoisePose;
     m_obsCov.block(m_dimMeasures,m_dimMeasures,m_dimMeasures, m_dimMeasures) *= m_measNoiseSpeed * m_measNoiseSpeed;
 }
 
-void  GMPHD::setSpawnModel(vector <SpawningModel> & spawnModels)
+template <typename T>
+void  GMPHDT<T>::setMeasurementModel(MeasurementModel const & model, NonlinearUpdate update)
+{
+    if (!model.m_function)
+    {
+        THROW_ERR("The measurement model needs a function");
+    }
+
+    if (update == UPDATE_EXTENDED && !model.m_jacobian)
+    {
+        THROW_ERR("The extended update needs the Jacobian of the measurement function");
+    }
+
+    if (model.m_noise.size() > 0 && (model.m_noise.rows() != m_dimState || model.m_noise.cols() != m_dimState))
+    {
+        THROW_ERR("The measurement noise covariance should be (state size x state size)");
+    }
+
+    m_measurementModel = model;
+    m_nonlinearUpdate = update;
+    m_nonlinear = true;
+}
+
+template <typename T>
+void  GMPHDT<T>::clearMeasurementModel()
+{
+    m_measurementModel = MeasurementModel();
+    m_nonlinear = false;
+}
+
+template <typename T>
+void  GMPHDT<T>::setSpawnModel(vector <SpawningModel> & spawnModels)
 {
     // Stupid implementation, maybe to be improved..
     for (auto const & model : spawnModels)
     {
         m_spawnModels.push_back( model);
     }
+
+    // Spawn selection scratch, so that it is not allocated on the fly
+    m_spawnOrder.reserve(m_nMaxPrune * m_spawnModels.size());
+    m_spawnSlots.reserve(m_nMaxPrune * m_spawnModels.size());
 }
 
-void  GMPHD::setSurvivalProbability(float _prob_survival)
+template <typename T>
+void  GMPHDT<T>::setSurvivalProbability(T _prob_survival)
 {
     m_pSurvival = _prob_survival;
 }
 
-void  GMPHD::update()
+template <typename T>
+void  GMPHDT<T>::update(T p_detection, T background)
 {
+    m_nPredTargets = m_expTargets->m_gaussians.size ();
+    buildLikelihoods(p_detection);
+
+    if (m_fusedPruning)
+    {
+        updateBounded(p_detection, background);
+        return;
+    }
+
     unsigned int n_meas, n_targt, index;
-    m_currTargets->m_gaussians.clear();
+    unsigned int const n_total = m_nPredTargets + m_nGridBirths;
+    Map<MatrixXT> likelihoods(m_likelihoods.data(), m_measTargets->m_gaussians.size (), n_total);
 
-    // We'll consider every possible association : vector size is (expected targets)*(measured targets)
-    m_currTargets->m_gaussians.resize((m_measTargets->m_gaussians.size () + 1) *
-                                      m_expTargets->m_gaussians.size ());
+    // We'll consider every possible association : vector size is (expected targets)*(measured targets),
+    // the mapped births following the expected targets
+    m_currTargets->resize((m_measTargets->m_gaussians.size () + 1) * n_total);
 
     // First set of gaussians : mere propagation of existing ones
     // \warning : don't propagate the "birth" targets...
     // we set their weight to 0
 
     m_nPredTargets =  m_expTargets->m_gaussians.size ();
-    int i_birth_current = 0;
+    unsigned int i_birth_current = 0;
 
     for (unsigned int i=0; i<m_nPredTargets; ++i)
     {
-        if (i != m_iBirthTargets[i_birth_current])
+        if (i_birth_current >= m_iBirthTargets.size () || i != m_iBirthTargets[i_birth_current])
         {
-            m_currTargets->m_gaussians[i].m_weight = (1.f - m_pDetection) *
+            m_currTargets->m_gaussians[i].m_weight = (1 - p_detection) *
                     m_expTargets->m_gaussians[i].m_weight;
         }
         else
         {
-            i_birth_current = std::min(i_birth_current+1, (int) m_iBirthTargets.size ());
-            m_currTargets->m_gaussians[i].m_weight = 0.f;
+            ++i_birth_current;
+            m_currTargets->m_gaussians[i].m_weight = 0;
         }
 
         m_currTargets->m_gaussians[i].m_mean = m_expTargets->m_gaussians[i].m_mean;
         m_currTargets->m_gaussians[i].m_cov  = m_expTargets->m_gaussians[i].m_cov;
     }
 
+    // Nor the mapped ones, truncated by the pruning
+    for (unsigned int i=m_nPredTargets; i<n_total; ++i)
+    {
+        m_currTargets->m_gaussians[i].m_weight = 0;
+    }
+
 
     // Second set of gaussians : match observations and previsions
     if (m_measTargets->m_gaussians.size () == 0)
@@ -436,28 +2616,174 @@ void  GMPHD::update()
         return;
     }
 
-    for (n_meas=1; n_meas <= m_measTargets->m_gaussians.size (); ++n_meas)
+    // The gains of the degenerate lanes were computed out of the batch
+    for (n_targt = 0; n_targt < m_nPredTargets; ++n_targt)
     {
-        for (n_targt = 0; n_targt < m_nPredTargets; ++n_targt)
+        if (!m_laneValid[n_targt])
         {
-            index = n_meas * m_nPredTargets + n_targt;
+            m_laneGain.set(n_targt, m_uncertainty[n_targt]);
+        }
+    }
 
-            // Compute matching factor between predictions and measures.
-            m_currTargets->m_gaussians[index].m_weight =  m_pDetection * m_expTargets->m_gaussians[n_targt].m_weight /
-                    mahalanobis<2>( m_measTargets->m_gaussians[n_meas -1].m_mean.block(0,0,m_dimMeasures,1),
-                    m_expMeasure[n_targt].block(0,0,m_dimMeasures,1),
-                    m_expDisp[n_targt].block(0,0, m_dimMeasures, m_dimMeasures));
+    for (n_meas=1; n_meas <= m_measTargets->m_gaussians.size (); ++n_meas)
+    {
+        GaussianModel const & measure = m_measTargets->m_gaussians[n_meas -1];
+        bool const cluster = isCluster(measure);
+
+        // Updated means for all the predictions at once : x + K.(z - H.x), or x + K.(0 - (-r))
+        // with the residuals r of the measurement model
+        if (!cluster && hasResidualHook())
+        {
+            int const dim_meas = m_expMeasure[0].rows();
+            m_laneResiduals.resize(dim_meas, 1, m_nPredTargets);
+            m_zeroMeasure.setZero(dim_meas, 1);
+
+            for (n_targt = 0; n_targt < m_nPredTargets; ++n_targt)
+            {
+                residual(n_meas -1, n_targt);
+                m_laneResiduals.set(n_targt, -m_innovation);
+            }
+
+            batchKernels<T>().updateMeans(m_laneGain, m_laneMeans, m_laneResiduals,
+                                          m_zeroMeasure.data(), m_laneOutMeans);
+        }
+        else if (!cluster)
+        {
+            batchKernels<T>().updateMeans(m_laneGain, m_laneMeans, m_laneMeasures,
+                                          measure.m_mean.data(), m_laneOutMeans);
+        }
 
+        if (m_nGridBirths > 0)
+        {
+            batchKernels<T>().updateMeans(m_gridGain, m_gridMeans, m_gridMeasures,
+                                          measure.m_mean.data(), m_gridOutMeans);
+        }
 
-            m_currTargets->m_gaussians[index].m_mean =  m_expTargets->m_gaussians[n_targt].m_mean +
-                    m_uncertainty[n_targt] * (m_measTargets->m_gaussians[n_meas -1].m_mean - m_expMeasure[n_targt]);
+        for (n_targt = 0; n_targt < n_total; ++n_targt)
+        {
+            index = n_meas * n_total + n_targt;
 
-            m_currTargets->m_gaussians[index].m_cov = m_covariance[n_targt];
+            // Compute matching factor between predictions and measures.
+            m_currTargets->m_gaussians[index].m_weight = likelihoods(n_meas -1, n_targt);
+
+            if (n_targt < m_nPredTargets && cluster)
+            {
+                updateWithCluster(n_targt, n_meas -1, m_currTargets->m_gaussians[index]);
+            }
+            else if (n_targt < m_nPredTargets)
+            {
+                m_laneOutMeans.get(n_targt, m_currTargets->m_gaussians[index].m_mean);
+                m_laneCovUpdate.get(n_targt, m_currTargets->m_gaussians[index].m_cov);
+            }
+            else
+            {
+                m_gridOutMeans.get(n_targt - m_nPredTargets, m_currTargets->m_gaussians[index].m_mean);
+                m_gridCovUpdate.get(n_targt - m_nPredTargets, m_currTargets->m_gaussians[index].m_cov);
+            }
         }
 
         // Normalize weights in the same predicted set,
         // taking clutter into account
-        m_currTargets->normalize (m_measNoiseBackground, n_meas * m_nPredTargets,
-                                  (n_meas + 1) * m_nPredTargets, 1);
+        m_currTargets->normalize (background, n_meas * n_total,
+                                  (n_meas + 1) * n_total, 1);
+    }
+}
+
+template <typename T>
+void  GMPHDT<T>::updateBounded(T p_detection, T background)
+{
+    // Same associations as update(), but only the best candidates above the truncation
+    // threshold are kept while the weights are computed. Means and covariances are
+    // then only built for the survivors, so that the mixture handed to the pruning
+    // never exceeds m_maxCandidates, whatever the number of (false) detections
+    unsigned int const n_meas_total = m_measTargets->m_gaussians.size ();
+    m_nPredTargets = m_expTargets->m_gaussians.size ();
+    unsigned int const n_total = m_nPredTargets + m_nGridBirths;
+    Map<MatrixXT> likelihoods(m_likelihoods.data(), n_meas_total, n_total);
+
+    m_candidates.clear();
+    m_candidates.reserve(m_maxCandidates);
+
+    // First set of candidates : mere propagation of existing ones (not the birth targets)
+    unsigned int i_birth_current = 0;
+
+    for (unsigned int i=0; i<m_nPredTargets; ++i)
+    {
+        if (i_birth_current < m_iBirthTargets.size () && i == m_iBirthTargets[i_birth_current])
+        {
+            ++i_birth_current;
+            continue;
+        }
+
+        offerCandidate((1 - p_detection) * m_expTargets->m_gaussians[i].m_weight, 0, i);
+    }
+
+    // Second set of candidates : match observations and previsions
+    for (unsigned int n_meas=1; n_meas <= n_meas_total; ++n_meas)
+    {
+        T sum = 0;
+
+        for (unsigned int n_targt = 0; n_targt < n_total; ++n_targt)
+        {
+            sum += likelihoods(n_meas -1, n_targt);
+        }
+
+        // Normalize weights in the same predicted set, taking clutter into account
+        T const norm = (background + sum) != 0 ? background + sum : 1;
+
+        for (unsigned int n_targt = 0; n_targt < n_total; ++n_targt)
+        {
+            offerCandidate(likelihoods(n_meas -1, n_targt) / norm, n_meas, n_targt);
+        }
+    }
+
+    // Build the surviving gaussians
+    m_currTargets->resize(m_candidates.size ());
+
+    int i = 0;
+    for (auto const & candidate : m_candidates)
+    {
+        GaussianModel & gaussian = m_currTargets->m_gaussians[i++];
+        gaussian.m_weight = candidate.m_weight;
+
+        if (candidate.m_target >= m_nPredTargets)
+        {
+            // Mapped birth, always with a measurement
+            int const i_grid = candidate.m_target - m_nPredTargets;
+
+            m_gridMeasures.get(i_grid, m_gridMeasure);
+            m_gridGain.get(i_grid, m_gridGainMatrix);
+            m_innovation = m_measTargets->m_gaussians[candidate.m_meas -1].m_mean - m_gridMeasure;
+
+            m_gridMeans.get(i_grid, gaussian.m_mean);
+            gaussian.m_mean.noalias() += m_gridGainMatrix * m_innovation;
+
+            m_gridCovUpdate.get(i_grid, gaussian.m_cov);
+            continue;
+        }
+
+        GaussianModel const & predicted = m_expTargets->m_gaussians[candidate.m_target];
+
+        if (candidate.m_meas == 0)
+        {
+            gaussian.m_mean = predicted.m_mean;
+            gaussian.m_cov  = predicted.m_cov;
+        }
+        else if (isCluster(m_measTargets->m_gaussians[candidate.m_meas -1]))
+        {
+            updateWithCluster(candidate.m_target, candidate.m_meas -1, gaussian);
+        }
+        else
+        {
+            residual(candidate.m_meas -1, candidate.m_target);
+            gaussian.m_mean = predicted.m_mean;
+            gaussian.m_mean.noalias() += m_uncertainty[candidate.m_target] * m_innovation;
+
+            m_laneCovUpdate.get(candidate.m_target, gaussian.m_cov);
+        }
     }
 }
+
+// Explicit instantiations, for both supported precisions
+template class GMPHDT<float>;
+template class GMPHDT<double>;
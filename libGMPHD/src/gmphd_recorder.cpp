@@ -0,0 +1,356 @@
+#include "gmphd_recorder.h"
+#include <string.h>
+
+namespace {
+    size_t alignedSize(size_t bytes)
+    {
+        return (bytes + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+    }
+}
+
+template <typename T>
+GMPHDRecorderT<T>::GMPHDRecorderT():
+    m_file(NULL)
+{
+}
+
+template <typename T>
+GMPHDRecorderT<T>::~GMPHDRecorderT()
+{
+    close();
+}
+
+template <typename T>
+bool GMPHDRecorderT<T>::open(std::string const & path, GMPHDT<T> const & filter)
+{
+    close();
+
+    m_file = fopen(path.c_str(), "wb");
+    if (m_file == NULL)
+    {
+        printf("[GMPHDRecorder] - Could not open %s\n", path.c_str());
+        return false;
+    }
+
+    vector<char> snapshot;
+    filter.saveState(snapshot);
+
+    RecordHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.m_magic, RECORD_MAGIC, sizeof(header.m_magic));
+    header.m_version = RECORD_VERSION;
+    header.m_scalarSize = sizeof(T);
+    header.m_snapshotSize = snapshot.size();
+
+    // Header and snapshot are padded, so that the snapshot can be used in place once mapped
+    vector<char> head(alignedSize(sizeof(header)), 0);
+    memcpy(head.data(), &header, sizeof(header));
+    snapshot.resize(alignedSize(snapshot.size()), 0);
+
+    if (fwrite(head.data(), 1, head.size(), m_file) != head.size() ||
+            fwrite(snapshot.data(), 1, snapshot.size(), m_file) != snapshot.size())
+    {
+        printf("[GMPHDRecorder] - Could not write to %s\n", path.c_str());
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+template <typename T>
+void GMPHDRecorderT<T>::close()
+{
+    if (m_file != NULL)
+    {
+        fclose(m_file);
+        m_file = NULL;
+    }
+}
+
+template <typename T>
+bool GMPHDRecorderT<T>::isOpen() const
+{
+    return m_file != NULL;
+}
+
+template <typename T>
+void GMPHDRecorderT<T>::write(RecordType type, uint32_t rows, uint32_t cols,
+                          void const * payload, size_t payload_size)
+{
+    if (m_file == NULL)
+    {
+        return;
+    }
+
+    RecordEntry const entry = {static_cast<uint32_t>(type), rows, cols, 0};
+
+    if (fwrite(&entry, sizeof(entry), 1, m_file) != 1 ||
+            (payload_size > 0 && fwrite(payload, 1, payload_size, m_file) != payload_size))
+    {
+        printf("[GMPHDRecorder] - Write failed, recording stopped\n");
+        close();
+    }
+}
+
+template <typename T>
+void GMPHDRecorderT<T>::recordMeasurements(vector<T> const & position, vector<T> const & speed)
+{
+    if (m_file == NULL)
+    {
+        return;
+    }
+
+    write(RECORD_MEASUREMENTS, position.size(), speed.size(), position.data(), position.size() * sizeof(T));
+    append(speed.data(), speed.size() * sizeof(T));
+}
+
+template <typename T>
+void GMPHDRecorderT<T>::append(void const * payload, size_t payload_size)
+{
+    if (m_file != NULL && payload_size > 0 &&
+            fwrite(payload, 1, payload_size, m_file) != payload_size)
+    {
+        printf("[GMPHDRecorder] - Write failed, recording stopped\n");
+        close();
+    }
+}
+
+template <typename T>
+void GMPHDRecorderT<T>::recordReferential(MatrixXT const & transform)
+{
+    write(RECORD_REFERENTIAL, transform.rows(), transform.cols(), transform.data(), transform.size() * sizeof(T));
+}
+
+template <typename T>
+void GMPHDRecorderT<T>::recordPropagate()
+{
+    write(RECORD_PROPAGATE, 0, 0, NULL, 0);
+}
+
+template <typename T>
+void GMPHDRecorderT<T>::recordPropagate(double timestamp)
+{
+    write(RECORD_PROPAGATE_AT, 0, 0, &timestamp, sizeof(timestamp));
+}
+
+template <typename T>
+void GMPHDRecorderT<T>::recordPredict()
+{
+    write(RECORD_PREDICT, 0, 0, NULL, 0);
+}
+
+template <typename T>
+void GMPHDRecorderT<T>::recordPredict(double timestamp)
+{
+    write(RECORD_PREDICT_AT, 0, 0, &timestamp, sizeof(timestamp));
+}
+
+template <typename T>
+void GMPHDRecorderT<T>::recordCorrect(vector<T> const & position, vector<T> const & speed,
+                                      SensorModelT<T> const & sensor)
+{
+    T const model[4] = {sensor.m_pDetection, sensor.m_measNoisePose,
+                        sensor.m_measNoiseSpeed, sensor.m_measNoiseBackground};
+
+    write(RECORD_CORRECT, position.size(), speed.size(), position.data(), position.size() * sizeof(T));
+    append(speed.data(), speed.size() * sizeof(T));
+    append(model, sizeof(model));
+}
+
+template <typename T>
+void GMPHDRecorderT<T>::recordPrune()
+{
+    write(RECORD_PRUNE, 0, 0, NULL, 0);
+}
+
+
+template <typename T>
+GMPHDReplayerT<T>::GMPHDReplayerT():
+    m_begin(0),
+    m_position(0)
+{
+}
+
+template <typename T>
+bool GMPHDReplayerT<T>::open(std::string const & path)
+{
+    if (!m_file.open(path))
+    {
+        return false;
+    }
+
+    RecordHeader header;
+    if (m_file.size() < sizeof(header))
+    {
+        printf("[GMPHDReplayer] - %s is too small\n", path.c_str());
+        return false;
+    }
+
+    memcpy(&header, m_file.data(), sizeof(header));
+
+    if (memcmp(header.m_magic, RECORD_MAGIC, sizeof(header.m_magic)) != 0 ||
+            header.m_version != RECORD_VERSION || header.m_scalarSize != sizeof(T))
+    {
+        printf("[GMPHDReplayer] - %s is not a supported GMPHD log\n", path.c_str());
+        return false;
+    }
+
+    size_t const snapshot_start = alignedSize(sizeof(header));
+
+    if (header.m_snapshotSize > m_file.size() - snapshot_start ||
+            !m_snapshot.map(m_file.data() + snapshot_start, header.m_snapshotSize))
+    {
+        printf("[GMPHDReplayer] - Invalid initial state in %s\n", path.c_str());
+        return false;
+    }
+
+    m_begin = snapshot_start + alignedSize(header.m_snapshotSize);
+    m_position = m_begin;
+    return true;
+}
+
+template <typename T>
+GMPHDSnapshotT<T> const & GMPHDReplayerT<T>::initialState() const
+{
+    return m_snapshot;
+}
+
+template <typename T>
+void GMPHDReplayerT<T>::rewind()
+{
+    m_position = m_begin;
+}
+
+template <typename T>
+bool GMPHDReplayerT<T>::step(GMPHDT<T> & filter, RecordType & type)
+{
+    RecordEntry entry;
+
+    if (m_position + sizeof(entry) > m_file.size())
+    {
+        return false;
+    }
+
+    memcpy(&entry, m_file.data() + m_position, sizeof(entry));
+
+    size_t payload_size = 0;
+
+    switch (entry.m_type)
+    {
+        case RECORD_PROPAGATE_AT:
+        case RECORD_PREDICT_AT:
+            payload_size = sizeof(double);
+            break;
+
+        case RECORD_MEASUREMENTS:
+            payload_size = (size_t(entry.m_rows) + entry.m_cols) * sizeof(T);
+            break;
+
+        case RECORD_CORRECT:
+            payload_size = (size_t(entry.m_rows) + entry.m_cols + 4) * sizeof(T);
+            break;
+
+        case RECORD_REFERENTIAL:
+            payload_size = size_t(entry.m_rows) * entry.m_cols * sizeof(T);
+            break;
+
+        default:
+            break;
+    }
+
+    if (payload_size > m_file.size() - m_position - sizeof(entry))
+    {
+        printf("[GMPHDReplayer] - Truncated record, stopping\n");
+        return false;
+    }
+
+    T const * payload = reinterpret_cast<T const *>(m_file.data() + m_position + sizeof(entry));
+    m_position += sizeof(entry) + payload_size;
+
+    switch (entry.m_type)
+    {
+        case RECORD_MEASUREMENTS:
+            m_positionBuffer.assign(payload, payload + entry.m_rows);
+            m_speedBuffer.assign(payload + entry.m_rows, payload + entry.m_rows + entry.m_cols);
+            filter.setNewMeasurements(m_positionBuffer, m_speedBuffer);
+            break;
+
+        case RECORD_REFERENTIAL:
+            m_transform = Map<MatrixXT const>(payload, entry.m_rows, entry.m_cols);
+            filter.setNewReferential(m_transform);
+            break;
+
+        case RECORD_PROPAGATE:
+            filter.propagate();
+            break;
+
+        case RECORD_PROPAGATE_AT:
+        case RECORD_PREDICT_AT:
+        {
+            // Not necessarily aligned for a double
+            double timestamp;
+            memcpy(&timestamp, payload, sizeof(timestamp));
+
+            if (entry.m_type == RECORD_PREDICT_AT)
+            {
+                filter.predict(timestamp);
+            }
+            else
+            {
+                filter.propagate(timestamp);
+            }
+            break;
+        }
+
+        case RECORD_PREDICT:
+            filter.predict();
+            break;
+
+        case RECORD_CORRECT:
+        {
+            T const * model = payload + entry.m_rows + entry.m_cols;
+
+            m_positionBuffer.assign(payload, payload + entry.m_rows);
+            m_speedBuffer.assign(payload + entry.m_rows, model);
+            filter.correct(m_positionBuffer, m_speedBuffer,
+                           SensorModelT<T>(model[0], model[1], model[2], model[3]));
+            break;
+        }
+
+        case RECORD_PRUNE:
+            filter.prune();
+            break;
+
+        default:
+            printf("[GMPHDReplayer] - Unknown record type %u, stopping\n", entry.m_type);
+            return false;
+    }
+
+    type = static_cast<RecordType>(entry.m_type);
+    return true;
+}
+
+uint32_t recordScalarSize(std::string const & path)
+{
+    RecordHeader header;
+    FILE * file = fopen(path.c_str(), "rb");
+
+    if (file == NULL)
+    {
+        return 0;
+    }
+
+    bool const valid = fread(&header, sizeof(header), 1, file) == 1 &&
+            memcmp(header.m_magic, RECORD_MAGIC, sizeof(header.m_magic)) == 0;
+    fclose(file);
+
+    return valid ? header.m_scalarSize : 0;
+}
+
+// Explicit instantiations, for both supported precisions
+template class GMPHDRecorderT<float>;
+template class GMPHDRecorderT<double>;
+
+template class GMPHDReplayerT<float>;
+template class GMPHDReplayerT<double>;
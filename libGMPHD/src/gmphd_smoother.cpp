@@ -0,0 +1,384 @@
+#include "gmphd_smoother.h"
+#include <math.h>
+
+// Author : Benjamin Lefaudeux (blefaudeux@github)
+
+namespace {
+// Pairs lighter than this fraction of the truncation threshold are not built
+double const PAIR_THRESHOLD = 1e-2;
+}
+
+template <typename T>
+GMPHDSmootherT<T>::GMPHDSmootherT(int dim, int dim_pos, unsigned int lag, unsigned int capacity):
+    m_dim(dim),
+    m_dimPos(dim_pos),
+    m_lag(lag),
+    m_frames(lag + 1),
+    m_newest(lag),
+    m_nFrames(0),
+    m_delay(0)
+{
+    for (auto & frame : m_frames)
+    {
+        frame.m_posterior.reset(new GaussianMixture(dim));
+        frame.m_posterior->reserve(capacity);
+        frame.m_trans.setIdentity(dim, dim);
+        frame.m_offset.setZero(dim, 1);
+        frame.m_cov.setZero(dim, dim);
+        frame.m_pSurvival = 0;
+        frame.m_hasTransition = false;
+        frame.m_refState.setIdentity(dim, dim);
+        frame.m_refOffset.setZero(dim, 1);
+        frame.m_hasReferential = false;
+    }
+
+    m_composed.setZero(dim, dim);
+    m_composedOffset.setZero(dim, 1);
+
+    // Before pruning, a backward step holds a few candidates per forward component.
+    // The pools grow past that if needed, and keep their size
+    m_smoothed.reset(new GaussianMixture(dim));
+    m_work.reset(new GaussianMixture(dim));
+    m_smoothed->reserve(4 * capacity);
+    m_work->reserve(4 * capacity);
+
+    m_predMeans.resize(capacity, MatrixXT::Zero(dim, 1));
+    m_predCovs.resize(capacity, MatrixXT::Zero(dim, dim));
+    m_predLLT.resize(capacity, LLT<MatrixXT>(dim));
+    m_gains.resize(capacity, MatrixXT::Zero(dim, dim));
+    m_predNorms.reserve(capacity);
+    m_predValid.reserve(capacity);
+    m_likelihoods.reserve(size_t(capacity) * capacity);
+    m_denominators.reserve(capacity);
+}
+
+template <typename T>
+typename GMPHDSmootherT<T>::Frame & GMPHDSmootherT<T>::frame(unsigned int age)
+{
+    return m_frames[(m_newest + m_frames.size() - age) % m_frames.size()];
+}
+
+template <typename T>
+void GMPHDSmootherT<T>::addTransition(MatrixXT const & trans, T const * offset, MatrixXT const & cov,
+                                      T p_survival)
+{
+    if (m_nFrames == 0)
+    {
+        return;
+    }
+
+    Frame & newest = frame(0);
+
+    newest.m_cov = cov;
+    newest.m_pSurvival = p_survival;
+    newest.m_hasTransition = true;
+
+    if (offset != NULL)
+    {
+        newest.m_offset = Map<MatrixXT const>(offset, m_dim, 1);
+    }
+    else
+    {
+        newest.m_offset.setZero();
+    }
+
+    if (newest.m_hasReferential)
+    {
+        // F.(B.x + b) + o = (F.B).x + F.b + o
+        newest.m_trans.noalias() = trans * newest.m_refState;
+        newest.m_offset.noalias() += trans * newest.m_refOffset;
+        newest.m_hasReferential = false;
+    }
+    else
+    {
+        newest.m_trans = trans;
+    }
+}
+
+template <typename T>
+void GMPHDSmootherT<T>::addReferential(MatrixXT const & state, MatrixXT const & offset)
+{
+    if (m_nFrames == 0)
+    {
+        return;
+    }
+
+    Frame & newest = frame(0);
+
+    if (newest.m_hasTransition)
+    {
+        // B.(F.x + o) + b, with the noise B.Q.B^t
+        m_composed.noalias() = state * newest.m_trans;
+        newest.m_trans.swap(m_composed);
+
+        m_composed.noalias() = state * newest.m_cov;
+        newest.m_cov.noalias() = m_composed * state.transpose();
+
+        m_composedOffset.noalias() = state * newest.m_offset;
+        newest.m_offset = m_composedOffset + offset;
+    }
+    else if (newest.m_hasReferential)
+    {
+        // Successive changes compose
+        m_composed.noalias() = state * newest.m_refState;
+        newest.m_refState.swap(m_composed);
+
+        m_composedOffset.noalias() = state * newest.m_refOffset;
+        newest.m_refOffset = m_composedOffset + offset;
+    }
+    else
+    {
+        newest.m_refState = state;
+        newest.m_refOffset = offset;
+        newest.m_hasReferential = true;
+    }
+}
+
+template <typename T>
+void GMPHDSmootherT<T>::addPosterior(GaussianMixture const & posterior, GaussianMixture const * births,
+                                     T trunc_threshold, T merge_threshold, unsigned int max_gaussians)
+{
+    m_newest = (m_newest + 1) % m_frames.size();
+    m_nFrames = std::min<unsigned int>(m_nFrames + 1, m_frames.size());
+
+    Frame & newest = frame(0);
+    newest.m_hasTransition = false;
+    newest.m_hasReferential = false;
+
+    size_t const n = posterior.m_gaussians.size();
+    newest.m_posterior->resize(n);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        newest.m_posterior->m_gaussians[i] = posterior.m_gaussians[i];
+    }
+
+    // Backward pass, from the newest posterior to the oldest frame of the window
+    GaussianMixture const * next = newest.m_posterior.get();
+    m_delay = 0;
+
+    for (unsigned int age = 1; age < m_nFrames && frame(age).m_hasTransition; ++age)
+    {
+        backwardStep(frame(age), *next, births, trunc_threshold, *m_work);
+        m_work->prune(trunc_threshold, merge_threshold, max_gaussians, m_dimPos);
+
+        std::swap(m_work, m_smoothed);
+        next = m_smoothed.get();
+        m_delay = age;
+    }
+
+    if (m_delay == 0)
+    {
+        // Nothing to smooth yet, the estimate is the posterior
+        m_smoothed->resize(n);
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            m_smoothed->m_gaussians[i] = posterior.m_gaussians[i];
+        }
+    }
+}
+
+template <typename T>
+void GMPHDSmootherT<T>::backwardStep(Frame const & frame, GaussianMixture const & next,
+                                     GaussianMixture const * births, T trunc_threshold,
+                                     GaussianMixture & smoothed)
+{
+    vector<Model> const & forward = frame.m_posterior->m_gaussians;
+    int const n_forward = forward.size();
+    int const n_next = next.m_gaussians.size();
+    T const log_2pi = T(log(2 * M_PI));
+
+    if (int(m_predMeans.size()) < n_forward)
+    {
+        m_predMeans.resize(n_forward, MatrixXT::Zero(m_dim, 1));
+        m_predCovs.resize(n_forward, MatrixXT::Zero(m_dim, m_dim));
+        m_predLLT.resize(n_forward, LLT<MatrixXT>(m_dim));
+        m_gains.resize(n_forward, MatrixXT::Zero(m_dim, m_dim));
+    }
+
+    m_predNorms.resize(n_forward);
+    m_predValid.resize(n_forward);
+
+    // - Prediction of every forward component, and its smoothing gain P.F^t.Pp^-1
+    for (int i = 0; i < n_forward; ++i)
+    {
+        Model const & gaussian = forward[i];
+
+        m_predMeans[i] = frame.m_offset;
+        m_predMeans[i].noalias() += frame.m_trans * gaussian.m_mean;
+
+        m_denseCov = gaussian.m_cov.dense();
+        m_transCov.noalias() = frame.m_trans * m_denseCov;
+        m_predCovs[i] = frame.m_cov;
+        m_predCovs[i].noalias() += m_transCov * frame.m_trans.transpose();
+
+        m_predLLT[i].compute(m_predCovs[i]);
+        m_predValid[i] = m_predLLT[i].info() == Success;
+
+        if (!m_predValid[i])
+        {
+            continue;
+        }
+
+        m_solved = m_transCov;
+        m_predLLT[i].solveInPlace(m_solved);
+        m_gains[i] = m_solved.transpose();
+
+        T log_det = 0;
+        for (int d = 0; d < m_dim; ++d)
+        {
+            log_det += 2 * log(m_predLLT[i].matrixLLT()(d, d));
+        }
+
+        m_predNorms[i] = frame.m_pSurvival * gaussian.m_weight *
+                exp(T(-0.5) * (m_dim * log_2pi + log_det));
+    }
+
+    // - Predicted intensity at every smoothed mean : survivals and births
+    m_likelihoods.resize(size_t(n_forward) * n_next);
+    m_denominators.assign(n_next, T(0));
+
+    for (int j = 0; j < n_next; ++j)
+    {
+        MatrixXT const & mean = next.m_gaussians[j].m_mean;
+
+        for (int i = 0; i < n_forward; ++i)
+        {
+            T & likelihood = m_likelihoods[size_t(j) * n_forward + i];
+            likelihood = 0;
+
+            if (!m_predValid[i])
+            {
+                continue;
+            }
+
+            m_diff = mean - m_predMeans[i];
+            m_predLLT[i].matrixL().solveInPlace(m_diff);
+
+            likelihood = m_predNorms[i] * exp(T(-0.5) * m_diff.squaredNorm());
+            m_denominators[j] += likelihood;
+        }
+    }
+
+    for (size_t b = 0; births != NULL && b < births->m_gaussians.size(); ++b)
+    {
+        Model const & birth = births->m_gaussians[b];
+        m_birthLLT.compute(birth.m_cov.dense());
+
+        if (m_birthLLT.info() != Success)
+        {
+            continue;
+        }
+
+        T log_det = 0;
+        for (int d = 0; d < m_dim; ++d)
+        {
+            log_det += 2 * log(m_birthLLT.matrixLLT()(d, d));
+        }
+
+        T const norm = birth.m_weight * exp(T(-0.5) * (m_dim * log_2pi + log_det));
+
+        for (int j = 0; j < n_next; ++j)
+        {
+            m_diff = next.m_gaussians[j].m_mean - birth.m_mean;
+            m_birthLLT.matrixL().solveInPlace(m_diff);
+
+            m_denominators[j] += norm * exp(T(-0.5) * m_diff.squaredNorm());
+        }
+    }
+
+    // - Smoothed components : undetected deaths keep the forward estimate, every
+    //   (forward, smoothed) pair gives a Rauch-Tung-Striebel update. Grown one at a time,
+    //   the pool only has to hold the pairs which are kept
+    smoothed.resize(0);
+    size_t n_out = 0;
+
+    T const pair_threshold = T(PAIR_THRESHOLD) * trunc_threshold;
+
+    for (int i = 0; i < n_forward; ++i)
+    {
+        Model const & gaussian = forward[i];
+        T const missed = (1 - frame.m_pSurvival) * gaussian.m_weight;
+
+        if (missed > pair_threshold)
+        {
+            smoothed.resize(++n_out);
+            smoothed.m_gaussians.back() = gaussian;
+            smoothed.m_gaussians.back().m_weight = missed;
+        }
+
+        if (!m_predValid[i])
+        {
+            continue;
+        }
+
+        for (int j = 0; j < n_next; ++j)
+        {
+            T const likelihood = m_likelihoods[size_t(j) * n_forward + i];
+
+            if (!(m_denominators[j] > 0) || likelihood <= 0)
+            {
+                continue;
+            }
+
+            Model const & later = next.m_gaussians[j];
+            T const weight = later.m_weight * likelihood / m_denominators[j];
+
+            if (weight < pair_threshold)
+            {
+                continue;
+            }
+
+            smoothed.resize(++n_out);
+            Model & out = smoothed.m_gaussians.back();
+            out.m_weight = weight;
+
+            m_diff = later.m_mean - m_predMeans[i];
+            out.m_mean = gaussian.m_mean;
+            out.m_mean.noalias() += m_gains[i] * m_diff;
+
+            m_covDiff = later.m_cov.dense() - m_predCovs[i];
+            m_solved.noalias() = m_gains[i] * m_covDiff;
+            m_denseCov = gaussian.m_cov.dense();
+            m_denseCov.noalias() += m_solved * m_gains[i].transpose();
+            out.m_cov = m_denseCov;
+        }
+    }
+}
+
+template <typename T>
+GaussianMixtureT<T> const & GMPHDSmootherT<T>::smoothedTargets() const
+{
+    return *m_smoothed;
+}
+
+template <typename T>
+unsigned int GMPHDSmootherT<T>::delay() const
+{
+    return m_delay;
+}
+
+template <typename T>
+unsigned int GMPHDSmootherT<T>::lag() const
+{
+    return m_lag;
+}
+
+template <typename T>
+void GMPHDSmootherT<T>::clear()
+{
+    m_nFrames = 0;
+    m_delay = 0;
+    m_smoothed->resize(0);
+
+    for (auto & frame : m_frames)
+    {
+        frame.m_hasTransition = false;
+        frame.m_hasReferential = false;
+    }
+}
+
+// Explicit instantiations, for both supported precisions
+template class GMPHDSmootherT<float>;
+template class GMPHDSmootherT<double>;
@@ -0,0 +1,295 @@
+#include "gmphd_snapshot.h"
+#include <string.h>
+
+namespace {
+    uint64_t alignedSize(uint64_t bytes)
+    {
+        return (bytes + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+    }
+}
+
+template <typename T>
+SnapshotWriterT<T>::SnapshotWriterT()
+{
+    // The header goes first, sections follow
+    m_buffer.assign(alignedSize(sizeof(SnapshotHeader)), 0);
+}
+
+template <typename T>
+uint64_t SnapshotWriterT<T>::reserve(size_t bytes)
+{
+    uint64_t const offset = m_buffer.size();
+    m_buffer.resize(offset + alignedSize(bytes), 0);
+    return offset;
+}
+
+template <typename T>
+T * SnapshotWriterT<T>::scalars(uint64_t offset)
+{
+    return reinterpret_cast<T *>(&m_buffer[offset]);
+}
+
+template <typename T>
+SnapshotMatrix SnapshotWriterT<T>::addMatrix(MatrixXT const & mat)
+{
+    SnapshotMatrix section;
+    section.m_rows = mat.rows();
+    section.m_cols = mat.cols();
+    section.m_offset = reserve(mat.size() * sizeof(T));
+
+    Map<MatrixXT>(scalars(section.m_offset), mat.rows(), mat.cols()) = mat;
+    return section;
+}
+
+template <typename T>
+SnapshotMixture SnapshotWriterT<T>::addMixture(GaussianMixtureT<T> const & mixture)
+{
+    SnapshotMixture section;
+    size_t const n = mixture.m_gaussians.size();
+    size_t const dim = mixture.m_dim;
+    size_t const n_packed = SymmetricMatrixT<T>::packedSize(dim);
+
+    section.m_count = n;
+    section.m_dim = dim;
+    section.m_weights = reserve(n * sizeof(T));
+    section.m_means = reserve(n * dim * sizeof(T));
+    section.m_covariances = reserve(n * n_packed * sizeof(T));
+
+    int i = 0;
+    for (auto const & gaussian : mixture.m_gaussians)
+    {
+        if (gaussian.m_cov.rows() != int(dim))
+        {
+            THROW_ERR("Gaussian does not match the mixture dimension");
+        }
+
+        scalars(section.m_weights)[i] = gaussian.m_weight;
+        Map<MatrixXT>(scalars(section.m_means) + i * dim, dim, 1) = gaussian.m_mean;
+        std::copy(gaussian.m_cov.data(), gaussian.m_cov.data() + n_packed,
+                  scalars(section.m_covariances) + i * n_packed);
+        ++i;
+    }
+
+    return section;
+}
+
+template <typename T>
+SnapshotSpawn SnapshotWriterT<T>::addSpawnModels(vector<SpawningModelT<T>, aligned_allocator<SpawningModelT<T> > > const & models,
+                                                 int dim_state)
+{
+    SnapshotSpawn section;
+    size_t const n = models.size();
+    size_t const dim = dim_state;
+
+    section.m_count = n;
+    section.m_dim = dim;
+    section.m_weights = reserve(n * sizeof(T));
+    section.m_transitions = reserve(n * dim * dim * sizeof(T));
+    section.m_covariances = reserve(n * dim * dim * sizeof(T));
+    section.m_offsets = reserve(n * dim * sizeof(T));
+
+    int i = 0;
+    for (auto const & model : models)
+    {
+        if (model.m_state != dim_state)
+        {
+            THROW_ERR("Spawning model does not match the state dimension");
+        }
+
+        scalars(section.m_weights)[i] = model.m_weight;
+        Map<MatrixXT>(scalars(section.m_transitions) + i * dim * dim, dim, dim) = model.m_trans;
+        Map<MatrixXT>(scalars(section.m_covariances) + i * dim * dim, dim, dim) = model.m_cov;
+        Map<MatrixXT>(scalars(section.m_offsets) + i * dim, dim, 1) = model.m_offset;
+        ++i;
+    }
+
+    return section;
+}
+
+template <typename T>
+vector<char> const & SnapshotWriterT<T>::finish(SnapshotHeader & header)
+{
+    memcpy(header.m_magic, SNAPSHOT_MAGIC, sizeof(header.m_magic));
+    header.m_version = SNAPSHOT_VERSION;
+    header.m_scalarSize = sizeof(T);
+    header.m_fileSize = m_buffer.size();
+
+    memcpy(&m_buffer[0], &header, sizeof(SnapshotHeader));
+    return m_buffer;
+}
+
+
+template <typename T>
+GMPHDSnapshotT<T>::GMPHDSnapshotT():
+    m_data(NULL),
+    m_size(0)
+{
+}
+
+template <typename T>
+bool GMPHDSnapshotT<T>::open(std::string const & path)
+{
+    if (!m_file.open(path))
+    {
+        return false;
+    }
+
+    return map(m_file.data(), m_file.size());
+}
+
+template <typename T>
+bool GMPHDSnapshotT<T>::map(char const * data, size_t size)
+{
+    m_data = data;
+    m_size = size;
+
+    if (!validate())
+    {
+        m_data = NULL;
+        m_size = 0;
+        return false;
+    }
+
+    return true;
+}
+
+template <typename T>
+SnapshotHeader const & GMPHDSnapshotT<T>::header() const
+{
+    return *reinterpret_cast<SnapshotHeader const *>(m_data);
+}
+
+template <typename T>
+bool GMPHDSnapshotT<T>::inBounds(uint64_t offset, uint64_t n_scalars) const
+{
+    return (offset % SNAPSHOT_ALIGNMENT) == 0 &&
+            offset <= m_size && n_scalars * sizeof(T) <= m_size - offset;
+}
+
+template <typename T>
+bool GMPHDSnapshotT<T>::validate()
+{
+    if (m_data == NULL || m_size < sizeof(SnapshotHeader) ||
+            (reinterpret_cast<uintptr_t>(m_data) % sizeof(uint64_t)) != 0)
+    {
+        printf("[GMPHDSnapshot] - Buffer too small or misaligned\n");
+        return false;
+    }
+
+    SnapshotHeader const & head = header();
+
+    if (memcmp(head.m_magic, SNAPSHOT_MAGIC, sizeof(head.m_magic)) != 0)
+    {
+        printf("[GMPHDSnapshot] - Not a GMPHD snapshot\n");
+        return false;
+    }
+
+    if (head.m_version != SNAPSHOT_VERSION || head.m_scalarSize != sizeof(T))
+    {
+        printf("[GMPHDSnapshot] - Unsupported snapshot version %u (scalar size %u)\n",
+               head.m_version, head.m_scalarSize);
+        return false;
+    }
+
+    if (head.m_fileSize > m_size)
+    {
+        printf("[GMPHDSnapshot] - Truncated snapshot\n");
+        return false;
+    }
+
+    SnapshotMatrix const * matrices[] = {&head.m_tgtDynTrans, &head.m_tgtDynCov, &head.m_obsMat, &head.m_obsCov};
+    for (auto const * mat : matrices)
+    {
+        if (!inBounds(mat->m_offset, uint64_t(mat->m_rows) * mat->m_cols))
+        {
+            printf("[GMPHDSnapshot] - Corrupted matrix section\n");
+            return false;
+        }
+    }
+
+    SnapshotMixture const * mixtures[] = {&head.m_currTargets, &head.m_birthModel};
+    for (auto const * mixture : mixtures)
+    {
+        uint64_t const n = mixture->m_count, dim = mixture->m_dim;
+
+        if (dim != head.m_dimState ||
+                !inBounds(mixture->m_weights, n) ||
+                !inBounds(mixture->m_means, n * dim) ||
+                !inBounds(mixture->m_covariances, n * (dim * (dim + 1) / 2)))
+        {
+            printf("[GMPHDSnapshot] - Corrupted mixture section\n");
+            return false;
+        }
+    }
+
+    uint64_t const n = head.m_spawnModels.m_count, dim = head.m_spawnModels.m_dim;
+    if (dim != head.m_dimState ||
+            !inBounds(head.m_spawnModels.m_weights, n) ||
+            !inBounds(head.m_spawnModels.m_transitions, n * dim * dim) ||
+            !inBounds(head.m_spawnModels.m_covariances, n * dim * dim) ||
+            !inBounds(head.m_spawnModels.m_offsets, n * dim))
+    {
+        printf("[GMPHDSnapshot] - Corrupted spawn section\n");
+        return false;
+    }
+
+    return true;
+}
+
+template <typename T>
+T const * GMPHDSnapshotT<T>::scalars(uint64_t offset) const
+{
+    return reinterpret_cast<T const *>(m_data + offset);
+}
+
+template <typename T>
+Map<Matrix<T, Dynamic, Dynamic> const> GMPHDSnapshotT<T>::matrix(SnapshotMatrix const & mat) const
+{
+    return Map<MatrixXT const>(scalars(mat.m_offset), mat.m_rows, mat.m_cols);
+}
+
+template <typename T>
+Map<Matrix<T, Dynamic, 1> const> GMPHDSnapshotT<T>::weights(SnapshotMixture const & mixture) const
+{
+    return Map<VectorXT const>(scalars(mixture.m_weights), mixture.m_count);
+}
+
+template <typename T>
+Map<Matrix<T, Dynamic, Dynamic> const> GMPHDSnapshotT<T>::means(SnapshotMixture const & mixture) const
+{
+    return Map<MatrixXT const>(scalars(mixture.m_means), mixture.m_dim, mixture.m_count);
+}
+
+template <typename T>
+Map<Matrix<T, Dynamic, 1> const> GMPHDSnapshotT<T>::covariance(SnapshotMixture const & mixture, int i) const
+{
+    size_t const n_packed = SymmetricMatrixT<T>::packedSize(mixture.m_dim);
+    return Map<VectorXT const>(scalars(mixture.m_covariances) + i * n_packed, n_packed);
+}
+
+template <typename T>
+void GMPHDSnapshotT<T>::copyMixture(SnapshotMixture const & mixture, GaussianMixtureT<T> & out) const
+{
+    out.m_dim = mixture.m_dim;
+    out.resize(mixture.m_count);
+
+    Map<VectorXT const> const w = weights(mixture);
+    Map<MatrixXT const> const mu = means(mixture);
+
+    int i = 0;
+    for (auto & gaussian : out.m_gaussians)
+    {
+        gaussian.m_dim = mixture.m_dim;
+        gaussian.m_weight = w(i);
+        gaussian.m_mean = mu.col(i);
+        gaussian.m_cov.setPacked(mixture.m_dim, covariance(mixture, i).data());
+        ++i;
+    }
+}
+
+// Explicit instantiations, for both supported precisions
+template class SnapshotWriterT<float>;
+template class SnapshotWriterT<double>;
+
+template class GMPHDSnapshotT<float>;
+template class GMPHDSnapshotT<double>;
@@ -0,0 +1,495 @@
+#include "gmphd_tiled.h"
+#include "parallel_for.h"
+#include <cmath>
+
+// Author : Benjamin Lefaudeux (blefaudeux@github)
+
+namespace {
+// Positions are at most 3D : neighbours are the 3^3 tiles around
+int const MAX_TILE_DIM = 3;
+}
+
+template <typename T>
+GMPHDTiledT<T>::GMPHDTiledT(TileGrid const & grid, int max_gaussians, int dimension,
+                            bool motion_model, bool verbose):
+    m_grid(grid),
+    m_dimMeasures(dimension),
+    m_threads(1),
+    m_predicted(false),
+    m_nCorrections(0)
+{
+    if (dimension > MAX_TILE_DIM || int(m_grid.m_origin.size()) != dimension ||
+            int(m_grid.m_tiles.size()) != dimension || !(m_grid.m_tileSize > 0) || m_grid.m_overlap < 0)
+    {
+        THROW_ERR("Tile grid does not match the filter dimension");
+    }
+
+    int n_tiles = 1;
+    for (int const tiles : m_grid.m_tiles)
+    {
+        if (tiles < 1)
+        {
+            THROW_ERR("Tile grid needs at least one tile per axis");
+        }
+
+        n_tiles *= tiles;
+    }
+
+    for (int i = 0; i < n_tiles; ++i)
+    {
+        m_tiles.push_back(std::unique_ptr<GMPHD>(new GMPHD(max_gaussians, dimension, motion_model, verbose)));
+    }
+
+    m_tilePositions.resize(n_tiles);
+    m_tileSpeeds.resize(n_tiles);
+    m_shared.resize(n_tiles);
+    m_handed.resize(n_tiles);
+}
+
+template <typename T>
+int GMPHDTiledT<T>::tileOf(T const * position) const
+{
+    int index = 0;
+
+    for (int d = int(m_dimMeasures) - 1; d >= 0; --d)
+    {
+        int const n_axis = m_grid.m_tiles[d];
+        T const cell = std::floor((position[d] - m_grid.m_origin[d]) / m_grid.m_tileSize);
+
+        // The border tiles extend to infinity (NaN positions go to the first one)
+        int const coord = cell >= n_axis ? n_axis - 1 : (cell > 0 ? int(cell) : 0);
+        index = index * n_axis + coord;
+    }
+
+    return index;
+}
+
+template <typename T>
+void GMPHDTiledT<T>::tileCoordinates(int index, vector<int> & coords) const
+{
+    coords.resize(m_dimMeasures);
+
+    for (unsigned int d = 0; d < m_dimMeasures; ++d)
+    {
+        coords[d] = index % m_grid.m_tiles[d];
+        index /= m_grid.m_tiles[d];
+    }
+}
+
+template <typename T>
+bool GMPHDTiledT<T>::isNear(T const * position, int const * coords) const
+{
+    for (unsigned int d = 0; d < m_dimMeasures; ++d)
+    {
+        T const low  = m_grid.m_origin[d] + coords[d] * m_grid.m_tileSize;
+        T const high = low + m_grid.m_tileSize;
+
+        bool const open_low  = coords[d] == 0;
+        bool const open_high = coords[d] == m_grid.m_tiles[d] - 1;
+
+        if ((!open_low && position[d] < low - m_grid.m_overlap) ||
+                (!open_high && position[d] > high + m_grid.m_overlap))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+template <typename T>
+void GMPHDTiledT<T>::forEachTile(std::function<void(GMPHD &, int)> const & task)
+{
+    parallelFor(m_threads, m_tiles.size(), [&](int i)
+    {
+        task(*m_tiles[i], i);
+    });
+}
+
+template <typename T>
+bool GMPHDTiledT<T>::isInitialized()
+{
+    for (auto & tile : m_tiles)
+    {
+        if (!tile->isInitialized())
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+template <typename T>
+void GMPHDTiledT<T>::setNewReferential(MatrixXT const & transform)
+{
+    forEachTile([&](GMPHD & tile, int)
+    {
+        tile.setNewReferential(transform);
+    });
+
+    // The components may have changed tiles
+    handOff();
+}
+
+template <typename T>
+void GMPHDTiledT<T>::setNewMeasurements(vector<T> const & position, vector<T> const & speed)
+{
+    m_measPosition = position;
+    m_measSpeed = speed;
+}
+
+template <typename T>
+void GMPHDTiledT<T>::getTrackedTargets(vector<T> & position, vector<T> & speed, vector<T> & weight,
+                                       T const & extract_thld)
+{
+    position.clear();
+    speed.clear();
+    weight.clear();
+
+    // Every component is owned by one tile, no duplicates
+    for (auto & tile : m_tiles)
+    {
+        tile->getTrackedTargets(m_position, m_speed, m_weight, extract_thld);
+
+        position.insert(position.end(), m_position.begin(), m_position.end());
+        speed.insert(speed.end(), m_speed.begin(), m_speed.end());
+        weight.insert(weight.end(), m_weight.begin(), m_weight.end());
+    }
+}
+
+template <typename T>
+void GMPHDTiledT<T>::setDynamicsModel(T sampling, T processNoise)
+{
+    for (auto & tile : m_tiles)
+    {
+        tile->setDynamicsModel(sampling, processNoise);
+    }
+}
+
+template <typename T>
+void GMPHDTiledT<T>::setDynamicsModel(MatrixXT const & tgt_dyn_transitions,
+                                      MatrixXT const & tgt_dyn_covariance)
+{
+    for (auto & tile : m_tiles)
+    {
+        tile->setDynamicsModel(tgt_dyn_transitions, tgt_dyn_covariance);
+    }
+}
+
+template <typename T>
+void GMPHDTiledT<T>::setSurvivalProbability(T _prob_survival)
+{
+    for (auto & tile : m_tiles)
+    {
+        tile->setSurvivalProbability(_prob_survival);
+    }
+}
+
+template <typename T>
+void GMPHDTiledT<T>::setObservationModel(T probDetectionOverall, T measurement_noise_pose,
+                                         T measurement_noise_speed, T measurement_background)
+{
+    m_sensor = SensorModel(probDetectionOverall, measurement_noise_pose,
+                           measurement_noise_speed, measurement_background);
+
+    for (auto & tile : m_tiles)
+    {
+        tile->setObservationModel(probDetectionOverall, measurement_noise_pose,
+                                  measurement_noise_speed, measurement_background);
+    }
+}
+
+template <typename T>
+void GMPHDTiledT<T>::setPruningParameters(T prune_trunc_thld, T prune_merge_thld, int prune_max_nb)
+{
+    for (auto & tile : m_tiles)
+    {
+        tile->setPruningParameters(prune_trunc_thld, prune_merge_thld, prune_max_nb);
+    }
+}
+
+template <typename T>
+void GMPHDTiledT<T>::setFusedPruning(bool enable, uint candidate_factor)
+{
+    for (auto & tile : m_tiles)
+    {
+        tile->setFusedPruning(enable, candidate_factor);
+    }
+}
+
+template <typename T>
+void GMPHDTiledT<T>::setParallelMerging(uint n_threads)
+{
+    for (auto & tile : m_tiles)
+    {
+        tile->setParallelMerging(n_threads);
+    }
+}
+
+template <typename T>
+void GMPHDTiledT<T>::setBirthModel(vector<GaussianModel> & birth_model)
+{
+    vector< vector<GaussianModel> > tile_births(m_tiles.size());
+
+    for (auto const & birth : birth_model)
+    {
+        tile_births[tileOf(birth.m_mean.data())].push_back(birth);
+    }
+
+    for (size_t i = 0; i < m_tiles.size(); ++i)
+    {
+        m_tiles[i]->setBirthModel(tile_births[i]);
+    }
+}
+
+template <typename T>
+void GMPHDTiledT<T>::setSpawnModel(vector<SpawningModel> & spawnModels)
+{
+    for (auto & tile : m_tiles)
+    {
+        tile->setSpawnModel(spawnModels);
+    }
+}
+
+template <typename T>
+void GMPHDTiledT<T>::setThreads(uint n_threads)
+{
+    m_threads = std::max(1u, n_threads);
+}
+
+template <typename T>
+void GMPHDTiledT<T>::propagate()
+{
+    predict();
+    correct(m_measPosition, m_measSpeed, m_sensor);
+    prune();
+}
+
+template <typename T>
+void GMPHDTiledT<T>::propagate(double timestamp)
+{
+    predict(timestamp);
+    correct(m_measPosition, m_measSpeed, m_sensor);
+    prune();
+}
+
+template <typename T>
+void GMPHDTiledT<T>::predict()
+{
+    forEachTile([](GMPHD & tile, int)
+    {
+        tile.predict();
+    });
+
+    m_predicted = true;
+    m_nCorrections = 0;
+}
+
+template <typename T>
+void GMPHDTiledT<T>::predict(double timestamp)
+{
+    forEachTile([timestamp](GMPHD & tile, int)
+    {
+        tile.predict(timestamp);
+    });
+
+    m_predicted = true;
+    m_nCorrections = 0;
+}
+
+template <typename T>
+void GMPHDTiledT<T>::correct(vector<T> const & position, vector<T> const & speed,
+                             SensorModel const & sensor)
+{
+    if (!m_predicted)
+    {
+        THROW_ERR("Correction without a prediction, call predict() first");
+    }
+
+    routeMeasurements(position, speed);
+    shareBorders();
+
+    forEachTile([&](GMPHD & tile, int i)
+    {
+        tile.correct(m_tilePositions[i], m_tileSpeeds[i], sensor);
+    });
+
+    handOff();
+    ++m_nCorrections;
+}
+
+template <typename T>
+void GMPHDTiledT<T>::prune()
+{
+    forEachTile([](GMPHD & tile, int)
+    {
+        tile.prune();
+    });
+
+    m_predicted = false;
+    m_nCorrections = 0;
+}
+
+template <typename T>
+void GMPHDTiledT<T>::reset()
+{
+    for (auto & tile : m_tiles)
+    {
+        tile->reset();
+    }
+
+    m_predicted = false;
+    m_nCorrections = 0;
+}
+
+template <typename T>
+size_t GMPHDTiledT<T>::tileCount() const
+{
+    return m_tiles.size();
+}
+
+template <typename T>
+GMPHDT<T> & GMPHDTiledT<T>::tile(size_t index)
+{
+    return *m_tiles[index];
+}
+
+template <typename T>
+void GMPHDTiledT<T>::routeMeasurements(vector<T> const & position, vector<T> const & speed)
+{
+    for (size_t i = 0; i < m_tiles.size(); ++i)
+    {
+        m_tilePositions[i].clear();
+        m_tileSpeeds[i].clear();
+    }
+
+    size_t const n_meas = position.size() / m_dimMeasures;
+    bool const has_speed = speed.size() == position.size();
+
+    for (size_t m = 0; m < n_meas; ++m)
+    {
+        T const * meas = &position[m * m_dimMeasures];
+        int const i_tile = tileOf(meas);
+
+        m_tilePositions[i_tile].insert(m_tilePositions[i_tile].end(), meas, meas + m_dimMeasures);
+
+        for (unsigned int d = 0; d < m_dimMeasures; ++d)
+        {
+            m_tileSpeeds[i_tile].push_back(has_speed ? speed[m * m_dimMeasures + d] : T(0));
+        }
+    }
+}
+
+template <typename T>
+void GMPHDTiledT<T>::shareBorders()
+{
+    // The prediction of the next correction : the prediction of the frame, or
+    // the posterior of the previous sensor
+    bool const predicted = m_nCorrections == 0;
+
+    forEachTile([&](GMPHD & tile, int i)
+    {
+        vector<int> coords, neighbour;
+        tileCoordinates(i, coords);
+
+        vector<GaussianModel> & shared = m_shared[i];
+        shared.clear();
+
+        int n_offsets = 1;
+        for (unsigned int d = 0; d < m_dimMeasures; ++d)
+        {
+            n_offsets *= 3;
+        }
+
+        for (int offset = 0; offset < n_offsets; ++offset)
+        {
+            // Neighbour index, skipping the ones out of the grid
+            int code = offset;
+            int index = 0;
+            bool inside = true;
+
+            neighbour = coords;
+            for (unsigned int d = 0; d < m_dimMeasures; ++d)
+            {
+                neighbour[d] += code % 3 - 1;
+                code /= 3;
+                inside &= neighbour[d] >= 0 && neighbour[d] < m_grid.m_tiles[d];
+            }
+
+            if (!inside || neighbour == coords)
+            {
+                continue;
+            }
+
+            for (int d = int(m_dimMeasures) - 1; d >= 0; --d)
+            {
+                index = index * m_grid.m_tiles[d] + neighbour[d];
+            }
+
+            GMPHD & source = *m_tiles[index];
+            GaussianMixtureT<T> const & mixture = predicted ? source.predictedTargets() :
+                                                              source.currentTargets();
+
+            for (auto const & gaussian : mixture.m_gaussians)
+            {
+                if (isNear(gaussian.m_mean.data(), coords.data()))
+                {
+                    shared.push_back(gaussian);
+                }
+            }
+        }
+
+        if (!shared.empty())
+        {
+            tile.addExternalPredictions(shared);
+        }
+    });
+}
+
+template <typename T>
+void GMPHDTiledT<T>::handOff()
+{
+    // Take out the components which left their tile
+    for (size_t i = 0; i < m_tiles.size(); ++i)
+    {
+        GaussianMixtureT<T> & mixture = m_tiles[i]->currentTargets();
+        size_t n_kept = 0;
+
+        for (size_t g = 0; g < mixture.m_gaussians.size(); ++g)
+        {
+            int const owner = tileOf(mixture.m_gaussians[g].m_mean.data());
+
+            if (owner == int(i))
+            {
+                std::swap(mixture.m_gaussians[n_kept++], mixture.m_gaussians[g]);
+            }
+            else
+            {
+                m_handed[owner].push_back(mixture.m_gaussians[g]);
+            }
+        }
+
+        mixture.resize(n_kept);
+    }
+
+    // .. and hand them over to their new one
+    for (size_t i = 0; i < m_tiles.size(); ++i)
+    {
+        GaussianMixtureT<T> & mixture = m_tiles[i]->currentTargets();
+        size_t const n_current = mixture.m_gaussians.size();
+
+        mixture.resize(n_current + m_handed[i].size());
+
+        for (size_t g = 0; g < m_handed[i].size(); ++g)
+        {
+            std::swap(mixture.m_gaussians[n_current + g], m_handed[i][g]);
+        }
+
+        m_handed[i].clear();
+    }
+}
+
+// Explicit instantiations, for both supported precisions
+template class GMPHDTiledT<float>;
+template class GMPHDTiledT<double>;
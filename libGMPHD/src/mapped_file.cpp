@@ -0,0 +1,78 @@
+#include "mapped_file.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile():
+    m_data(NULL),
+    m_size(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(std::string const & path)
+{
+    close();
+
+    int const fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        printf("[MappedFile] - Could not open %s\n", path.c_str());
+        return false;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0)
+    {
+        printf("[MappedFile] - Could not stat %s, or empty file\n", path.c_str());
+        ::close(fd);
+        return false;
+    }
+
+    void * data = mmap(NULL, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+    // The mapping stays valid once the descriptor is closed
+    ::close(fd);
+
+    if (data == MAP_FAILED)
+    {
+        printf("[MappedFile] - Could not map %s\n", path.c_str());
+        return false;
+    }
+
+    m_data = data;
+    m_size = file_stat.st_size;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (m_data != NULL)
+    {
+        munmap(m_data, m_size);
+    }
+
+    m_data = NULL;
+    m_size = 0;
+}
+
+bool MappedFile::isOpen() const
+{
+    return m_data != NULL;
+}
+
+char const * MappedFile::data() const
+{
+    return static_cast<char const *>(m_data);
+}
+
+size_t MappedFile::size() const
+{
+    return m_size;
+}
@@ -0,0 +1,347 @@
+#include "measurement_clustering.h"
+#include <math.h>
+
+// Author : Benjamin Lefaudeux (blefaudeux@github)
+
+namespace {
+// Spatial hashing primes, one per axis
+uint64_t const HASH_PRIMES[3] = {73856093ULL, 19349663ULL, 83492791ULL};
+
+size_t const MIN_SLOTS = 16;
+}
+
+template <typename T>
+MeasurementClusteringT<T>::MeasurementClusteringT(int dim_measures, int dim_state, T voxel_size):
+    m_dimMeasures(dim_measures),
+    m_dimState(dim_state),
+    m_voxelSize(voxel_size),
+    m_slotMask(0),
+    m_hasSpread(false)
+{
+    m_voxel.resize(dim_measures);
+    m_deviation.setZero(dim_state, 1);
+    reserve(MIN_SLOTS / 2);
+}
+
+template <typename T>
+void MeasurementClusteringT<T>::reserve(size_t n_measurements)
+{
+    // Half full at most, the probes stay short
+    size_t n_slots = MIN_SLOTS;
+    while (n_slots < 2 * n_measurements)
+    {
+        n_slots *= 2;
+    }
+
+    if (n_slots > m_slotClusters.size())
+    {
+        m_slotClusters.resize(n_slots);
+        m_slotVoxels.resize(n_slots * m_dimMeasures);
+        m_slotMask = n_slots - 1;
+    }
+
+    m_assignment.reserve(n_measurements);
+    m_counts.reserve(n_measurements);
+    m_firsts.reserve(n_measurements);
+    m_sums.reserve(n_measurements * m_dimState);
+    m_voxels.reserve(n_measurements * m_dimMeasures);
+    m_parents.reserve(n_measurements);
+    m_lower.reserve(n_measurements * m_dimMeasures);
+    m_upper.reserve(n_measurements * m_dimMeasures);
+    m_labels.reserve(n_measurements);
+    m_clusterCounts.reserve(n_measurements);
+    m_clusterFirsts.reserve(n_measurements);
+    m_clusterSums.reserve(n_measurements * m_dimState);
+    m_clusterScatters.reserve(n_measurements * m_dimState * m_dimState);
+}
+
+template <typename T>
+size_t MeasurementClusteringT<T>::slot(int64_t const * voxel) const
+{
+    uint64_t hash = 0;
+    for (int d = 0; d < m_dimMeasures; ++d)
+    {
+        hash ^= uint64_t(voxel[d]) * HASH_PRIMES[d % 3];
+    }
+
+    // Linear probing, up to the voxel or an empty slot
+    size_t index = hash & m_slotMask;
+
+    while (m_slotClusters[index] >= 0 &&
+           !std::equal(voxel, voxel + m_dimMeasures, &m_slotVoxels[index * m_dimMeasures]))
+    {
+        index = (index + 1) & m_slotMask;
+    }
+
+    return index;
+}
+
+template <typename T>
+int MeasurementClusteringT<T>::root(int cluster)
+{
+    // Path halving
+    while (m_parents[cluster] != cluster)
+    {
+        m_parents[cluster] = m_parents[m_parents[cluster]];
+        cluster = m_parents[cluster];
+    }
+
+    return cluster;
+}
+
+template <typename T>
+void MeasurementClusteringT<T>::cluster(GaussianMixtureT<T> & measures)
+{
+    vector<Model> & gaussians = measures.m_gaussians;
+    size_t const n_meas = gaussians.size();
+
+    m_stats.m_measurements += n_meas;
+    m_hasSpread = false;
+
+    reserve(n_meas);
+    std::fill(m_slotClusters.begin(), m_slotClusters.end(), -1);
+
+    m_assignment.resize(n_meas);
+    m_counts.clear();
+    m_firsts.clear();
+    m_sums.clear();
+    m_voxels.clear();
+
+    // - Voxel of every measurement, and the centroids of the voxels
+    for (size_t m = 0; m < n_meas; ++m)
+    {
+        MatrixXT const & mean = gaussians[m].m_mean;
+
+        for (int d = 0; d < m_dimMeasures; ++d)
+        {
+            m_voxel[d] = int64_t(floor(mean(d, 0) / m_voxelSize));
+        }
+
+        size_t const index = slot(m_voxel.data());
+
+        if (m_slotClusters[index] < 0)
+        {
+            m_slotClusters[index] = m_counts.size();
+            std::copy(m_voxel.begin(), m_voxel.end(), &m_slotVoxels[index * m_dimMeasures]);
+
+            m_counts.push_back(0);
+            m_firsts.push_back(m);
+            m_sums.resize(m_sums.size() + m_dimState, T(0));
+            m_voxels.insert(m_voxels.end(), m_voxel.begin(), m_voxel.end());
+        }
+
+        int const v = m_slotClusters[index];
+        m_assignment[m] = v;
+        ++m_counts[v];
+
+        Map<MatrixXT>(&m_sums[v * m_dimState], m_dimState, 1) += mean;
+    }
+
+    int const n_voxels = m_counts.size();
+
+    for (int v = 0; v < n_voxels; ++v)
+    {
+        Map<MatrixXT>(&m_sums[v * m_dimState], m_dimState, 1) /= T(m_counts[v]);
+    }
+
+    // - Links between neighbouring voxels (3^d - 1 of them) whose centroids are closer
+    //   than the voxel size, as long as the cluster stays within CLUSTER_EXTENT
+    m_parents.resize(n_voxels);
+    m_lower.resize(n_voxels * m_dimMeasures);
+    m_upper.resize(n_voxels * m_dimMeasures);
+
+    for (int v = 0; v < n_voxels; ++v)
+    {
+        m_parents[v] = v;
+
+        for (int d = 0; d < m_dimMeasures; ++d)
+        {
+            m_lower[v * m_dimMeasures + d] = m_sums[v * m_dimState + d];
+            m_upper[v * m_dimMeasures + d] = m_sums[v * m_dimState + d];
+        }
+    }
+
+    int n_neighbours = 1;
+    for (int d = 0; d < m_dimMeasures; ++d)
+    {
+        n_neighbours *= 3;
+    }
+
+    T const radius2 = m_voxelSize * m_voxelSize;
+    T const max_extent = CLUSTER_EXTENT * m_voxelSize;
+
+    for (int v = 0; v < n_voxels; ++v)
+    {
+        T const * centroid = &m_sums[v * m_dimState];
+
+        for (int k = 0; k < n_neighbours; ++k)
+        {
+            int code = k;
+            for (int d = 0; d < m_dimMeasures; ++d)
+            {
+                m_voxel[d] = m_voxels[v * m_dimMeasures + d] + code % 3 - 1;
+                code /= 3;
+            }
+
+            int const w = m_slotClusters[slot(m_voxel.data())];
+
+            // Each pair once, the voxel itself included (w == v)
+            if (w <= v)
+            {
+                continue;
+            }
+
+            T const * other = &m_sums[w * m_dimState];
+            T distance2 = 0;
+
+            for (int d = 0; d < m_dimMeasures; ++d)
+            {
+                distance2 += (centroid[d] - other[d]) * (centroid[d] - other[d]);
+            }
+
+            if (distance2 >= radius2)
+            {
+                continue;
+            }
+
+            int const root_v = root(v);
+            int const root_w = root(w);
+
+            if (root_v == root_w)
+            {
+                continue;
+            }
+
+            // The lowest voxel stays the root : clusters keep the order of their first member
+            int const kept = std::min(root_v, root_w);
+            int const merged = std::max(root_v, root_w);
+            bool compact = true;
+
+            for (int d = 0; d < m_dimMeasures && compact; ++d)
+            {
+                T const lower = std::min(m_lower[kept * m_dimMeasures + d], m_lower[merged * m_dimMeasures + d]);
+                T const upper = std::max(m_upper[kept * m_dimMeasures + d], m_upper[merged * m_dimMeasures + d]);
+                compact = upper - lower <= max_extent;
+            }
+
+            if (!compact)
+            {
+                continue;
+            }
+
+            m_parents[merged] = kept;
+
+            for (int d = 0; d < m_dimMeasures; ++d)
+            {
+                T & lower = m_lower[kept * m_dimMeasures + d];
+                T & upper = m_upper[kept * m_dimMeasures + d];
+                lower = std::min(lower, m_lower[merged * m_dimMeasures + d]);
+                upper = std::max(upper, m_upper[merged * m_dimMeasures + d]);
+            }
+        }
+    }
+
+    // - Clusters : linked voxels, numbered in order
+    m_labels.resize(n_voxels);
+    m_clusterCounts.clear();
+    m_clusterFirsts.clear();
+    m_clusterSums.clear();
+
+    for (int v = 0; v < n_voxels; ++v)
+    {
+        int const r = root(v);
+
+        if (r == v)
+        {
+            m_labels[v] = m_clusterCounts.size();
+            m_clusterCounts.push_back(0);
+            m_clusterFirsts.push_back(m_firsts[v]);
+            m_clusterSums.resize(m_clusterSums.size() + m_dimState, T(0));
+        }
+        else
+        {
+            m_labels[v] = m_labels[r];
+        }
+
+        int const c = m_labels[v];
+        m_clusterCounts[c] += m_counts[v];
+        Map<MatrixXT>(&m_clusterSums[c * m_dimState], m_dimState, 1) +=
+                T(m_counts[v]) * Map<MatrixXT>(&m_sums[v * m_dimState], m_dimState, 1);
+    }
+
+    size_t const n_clusters = m_clusterCounts.size();
+
+    for (size_t c = 0; c < n_clusters; ++c)
+    {
+        Map<MatrixXT>(&m_clusterSums[c * m_dimState], m_dimState, 1) /= T(m_clusterCounts[c]);
+    }
+
+    // - Covariance of the centroids : scatter / (n.(n-1)), for the clusters of several
+    //   measurements
+    int const n_cov = m_dimState * m_dimState;
+    m_clusterScatters.assign(n_clusters * n_cov, T(0));
+
+    for (size_t m = 0; m < n_meas; ++m)
+    {
+        int const c = m_labels[m_assignment[m]];
+
+        if (m_clusterCounts[c] < 2)
+        {
+            continue;
+        }
+
+        m_deviation = gaussians[m].m_mean - Map<MatrixXT>(&m_clusterSums[c * m_dimState], m_dimState, 1);
+        Map<MatrixXT>(&m_clusterScatters[c * n_cov], m_dimState, m_dimState).noalias() +=
+                m_deviation * m_deviation.transpose();
+    }
+
+    // - Clusters in place : a cluster never comes after its first member, which is still
+    //   intact when the cluster is written
+    for (size_t c = 0; c < n_clusters; ++c)
+    {
+        Model & gaussian = gaussians[c];
+        int const count = m_clusterCounts[c];
+
+        if (count < 2)
+        {
+            // Single measurement : the centroid is the measurement, copied if it moved
+            if (m_clusterFirsts[c] != int(c))
+            {
+                gaussian = gaussians[m_clusterFirsts[c]];
+            }
+
+            continue;
+        }
+
+        gaussian.m_mean = Map<MatrixXT>(&m_clusterSums[c * m_dimState], m_dimState, 1);
+        gaussian.m_cov = Map<MatrixXT>(&m_clusterScatters[c * n_cov], m_dimState, m_dimState);
+        gaussian.m_cov *= T(1) / T(count * (count - 1));
+        gaussian.m_weight = T(count);
+        m_hasSpread = true;
+    }
+
+    measures.resize(n_clusters);
+    m_stats.m_clusters += n_clusters;
+}
+
+template <typename T>
+bool MeasurementClusteringT<T>::hasSpread() const
+{
+    return m_hasSpread;
+}
+
+template <typename T>
+T MeasurementClusteringT<T>::voxelSize() const
+{
+    return m_voxelSize;
+}
+
+template <typename T>
+ClusteringStats const & MeasurementClusteringT<T>::stats() const
+{
+    return m_stats;
+}
+
+// Explicit instantiations, for both supported precisions
+template class MeasurementClusteringT<float>;
+template class MeasurementClusteringT<double>;
@@ -0,0 +1,165 @@
+#include "parallel_for.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Author : Benjamin Lefaudeux (blefaudeux@github)
+
+namespace {
+
+// One parallelFor() call. Lives on the stack of its caller, which only returns
+// once every worker which joined it has left
+struct Job
+{
+    std::function<void(int)> const * m_task;
+    int               m_nTasks;
+    std::atomic<int>  m_next;
+    unsigned int      m_maxHelpers;
+    unsigned int      m_nJoined;
+    unsigned int      m_nActive;
+
+    void execute()
+    {
+        for (int i = m_next++; i < m_nTasks; i = m_next++)
+        {
+            (*m_task)(i);
+        }
+    }
+};
+
+/*!
+ * \brief Workers shared by all the parallelFor() calls of the process, spawned on demand.
+ * Nested calls are fine : the caller always works on its own job, the workers only help
+ */
+class ThreadPool
+{
+    public:
+        static ThreadPool & instance()
+        {
+            static ThreadPool pool;
+            return pool;
+        }
+
+        void run(unsigned int n_threads, int n_tasks, std::function<void(int)> const & task)
+        {
+            Job job;
+            job.m_task = &task;
+            job.m_nTasks = n_tasks;
+            job.m_next = 0;
+            job.m_maxHelpers = n_threads - 1;
+            job.m_nJoined = 0;
+            job.m_nActive = 0;
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+
+                while (m_workers.size() < job.m_maxHelpers)
+                {
+                    m_workers.push_back(std::thread(&ThreadPool::work, this));
+                }
+
+                m_jobs.push_back(&job);
+            }
+
+            m_wake.notify_all();
+
+            job.execute();
+
+            // Every task is claimed, wait for the helpers still running theirs
+            std::unique_lock<std::mutex> lock(m_mutex);
+            withdraw(&job);
+            m_done.wait(lock, [&job]() { return job.m_nActive == 0; });
+        }
+
+    private:
+        ThreadPool():
+            m_stop(false)
+        {
+        }
+
+        ~ThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+            }
+
+            m_wake.notify_all();
+
+            for (auto & worker : m_workers)
+            {
+                worker.join();
+            }
+        }
+
+        void withdraw(Job * job)
+        {
+            auto const it = std::find(m_jobs.begin(), m_jobs.end(), job);
+            if (it != m_jobs.end())
+            {
+                m_jobs.erase(it);
+            }
+        }
+
+        void work()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+
+            while (true)
+            {
+                m_wake.wait(lock, [this]() { return m_stop || !m_jobs.empty(); });
+
+                if (m_stop)
+                {
+                    return;
+                }
+
+                // Oldest job first, up to the number of threads it asked for
+                Job * job = m_jobs.front();
+                ++job->m_nJoined;
+                ++job->m_nActive;
+
+                if (job->m_nJoined >= job->m_maxHelpers)
+                {
+                    withdraw(job);
+                }
+
+                lock.unlock();
+                job->execute();
+                lock.lock();
+
+                if (--job->m_nActive == 0)
+                {
+                    m_done.notify_all();
+                }
+            }
+        }
+
+        std::mutex               m_mutex;
+        std::condition_variable  m_wake;
+        std::condition_variable  m_done;
+        std::vector<Job *>       m_jobs;
+        std::vector<std::thread> m_workers;
+        bool                     m_stop;
+};
+
+}
+
+void parallelFor(unsigned int n_threads, int n_tasks, std::function<void(int)> const & task)
+{
+    unsigned int const n_workers = std::min<unsigned int>(n_threads, std::max(n_tasks, 1));
+
+    if (n_workers <= 1)
+    {
+        for (int i = 0; i < n_tasks; ++i)
+        {
+            task(i);
+        }
+        return;
+    }
+
+    ThreadPool::instance().run(n_workers, n_tasks, task);
+}
@@ -0,0 +1,18 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <stddef.h>
+
+/*!
+ * \brief Counts the heap allocations (malloc and friends, so new as well) of the process,
+ * between startCounting() and stopCounting(). Only available with glibc, where the
+ * allocator can be interposed
+ */
+bool allocationCountSupported();
+
+void startCounting();
+
+// Returns the number of allocations since startCounting()
+size_t stopCounting();
+
+#endif // ALLOC_COUNTER_H
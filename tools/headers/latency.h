@@ -0,0 +1,55 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+#include <vector>
+
+using namespace std;
+
+/*!
+ * \brief Distribution of a set of latencies (any unit)
+ */
+struct LatencySummary {
+    size_t m_count;
+    double m_total;
+    double m_mean;
+    double m_p50;
+    double m_p90;
+    double m_p99;
+    double m_p999;
+    double m_max;
+};
+
+LatencySummary summarizeLatencies(vector<double> latencies);
+
+void printLatencies(LatencySummary const & summary, char const * unit);
+
+/*!
+ * \brief Distribution of an unbounded stream of latencies, in constant memory : logarithmic
+ * buckets (LATENCY_BUCKETS_PER_OCTAVE per power of two, about 2% apart) from
+ * 2^LATENCY_MIN_OCTAVE to 2^LATENCY_MAX_OCTAVE, the values out of it fall in the end buckets.
+ * Count, mean and max are exact, the percentiles are bucket centers
+ */
+int const LATENCY_BUCKETS_PER_OCTAVE = 32;
+int const LATENCY_MIN_OCTAVE = -10;
+int const LATENCY_MAX_OCTAVE = 40;
+
+class LatencyHistogram
+{
+    public:
+        LatencyHistogram();
+
+        void add(double latency);
+
+        LatencySummary summary() const;
+
+    private:
+        double percentile(double p) const;
+
+        vector<uint64_t> m_buckets;
+        size_t m_count;
+        double m_total;
+        double m_max;
+};
+
+#endif // LATENCY_H
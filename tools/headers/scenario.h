@@ -0,0 +1,110 @@
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+#include <random>
+#include <vector>
+
+using namespace std;
+
+/*!
+ * \brief Headless synthetic workloads for the GMPHD filter :
+ * moving targets, missed detections (or several per target), Poisson clutter and spawns,
+ * in 2D or 3D
+ */
+enum MotionType {
+    MOTION_CONSTANT_VELOCITY = 0,
+    MOTION_COORDINATED_TURN,
+    MOTION_RANDOM_WALK,
+    MOTION_MIXED            // Every target picks one of the above
+};
+
+struct ScenarioConfig {
+    ScenarioConfig();
+
+    int         m_dim;          // 2 or 3
+    int         m_nTargets;     // Targets alive at start
+    int         m_maxTargets;   // Spawns stop above this count
+
+    float       m_sampling;
+    float       m_jitter;       // The frame intervals vary by up to m_jitter * m_sampling
+    float       m_areaSize;     // Everything lives in [0, m_areaSize]^dim
+    float       m_maxSpeed;
+    float       m_turnRate;     // rad/s, for the coordinated turns
+    float       m_accelNoise;   // Random walk acceleration (std)
+
+    int         m_nSensors;     // Independent measurement sets per frame, same noise and clutter
+    float       m_pDetection;
+    float       m_clutterRate;  // Mean number of false detections per frame
+    float       m_measNoisePose;
+    float       m_measNoiseSpeed;
+    int         m_returns;      // Detections per detected target (dense sensors)
+    float       m_extent;       // Spread of these detections around the target (std)
+
+    float       m_spawnRate;    // Probability per frame for a target to spawn a new one
+    float       m_deathRate;    // Probability per frame for a target to disappear
+
+    MotionType  m_motion;
+    unsigned    m_seed;
+};
+
+class Scenario
+{
+    public:
+        Scenario(ScenarioConfig const & config);
+
+        // Move the ground truth one frame ahead, and draw the new measurements
+        void  step();
+
+        int   frame() const;
+
+        // Time of the current frame, in seconds
+        double time() const;
+
+        int   dim() const;
+
+        ScenarioConfig const & config() const;
+
+        // Flat [x0 y0 (z0) x1 y1 ..] vectors, as GMPHD::setNewMeasurements() expects them
+        vector<float> const & measuredPositions(int sensor = 0) const;
+
+        vector<float> const & measuredSpeeds(int sensor = 0) const;
+
+        vector<float> const & truePositions() const;
+
+    private:
+        struct Target {
+            vector<float> m_pos;
+            vector<float> m_speed;
+            MotionType    m_motion;
+            float         m_turnRate;
+        };
+
+        Target  newTarget();
+
+        void    move(Target & target);
+
+        void    measure();
+
+        ScenarioConfig  m_config;
+        int             m_frame;
+        double          m_time;
+        float           m_interval;
+        vector<Target>  m_targets;
+
+        vector< vector<float> > m_measPositions; // Per sensor
+        vector< vector<float> > m_measSpeeds;
+        vector<float>   m_truePositions;
+
+        std::mt19937                          m_rng;
+        std::uniform_real_distribution<float> m_uniform;
+        std::normal_distribution<float>       m_normal;
+};
+
+/*!
+ * \brief OSPA distance between two flat sets of points (order p, cutoff c)
+ * Optimal assignment up to exact_limit points per set, greedy (an upper bound) above
+ */
+float ospa(vector<float> const & truth, vector<float> const & estimates, int dim,
+           float cutoff, float order = 2.f, int exact_limit = 500);
+
+#endif // SCENARIO_H
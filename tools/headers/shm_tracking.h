@@ -0,0 +1,125 @@
+#ifndef SHM_TRACKING_H
+#define SHM_TRACKING_H
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+using namespace std;
+
+/*!
+ * \brief Shared memory segment between a tracking daemon, its producers and its consumers,
+ * all on the same host (POSIX shm_open + mmap).
+ *
+ * Layout : a header, one single producer / single consumer ring of measurement frames per
+ * producer, and an output region holding the last tracked targets. The rings are lock-free
+ * (head and tail counters), the output is a seqlock : consumers read it in place, and retry
+ * if the daemon published meanwhile.
+ * Everything is single precision, positions and speeds are flat [x0 y0 (z0) x1 ..] arrays
+ */
+struct SegmentConfig {
+    SegmentConfig();
+
+    uint32_t  m_dim;
+    uint32_t  m_nProducers;
+    uint32_t  m_nSlots;           // Frames per ring, power of two
+    uint32_t  m_maxMeasurements;  // Per frame
+    uint32_t  m_maxTargets;       // Published per frame
+};
+
+// A measurement frame, in place in a ring
+struct FrameView {
+    double        m_timestamp;
+    uint32_t      m_nMeasurements;
+    float const * m_positions;
+    float const * m_speeds;
+};
+
+class TrackingSegment
+{
+    public:
+        TrackingSegment();
+
+        ~TrackingSegment();
+
+        // Daemon side : creates (or replaces) the segment
+        bool  create(string const & name, SegmentConfig const & config);
+
+        // Producers and consumers : maps an existing segment
+        bool  open(string const & name);
+
+        // Unmaps, and removes the segment if it was created here
+        void  close();
+
+        SegmentConfig const & config() const;
+
+        // Daemon liveness, and stop request from any client
+        bool  daemonRunning() const;
+
+        void  setDaemonRunning(bool running);
+
+        bool  stopRequested() const;
+
+        void  requestStop();
+
+        // Producer side, false if the ring is full. Extra measurements are dropped
+        bool  push(uint32_t producer, double timestamp, float const * positions,
+                   float const * speeds, uint32_t n_measurements);
+
+        // Daemon side : oldest pending frame of a producer, valid until pop()
+        bool  front(uint32_t producer, FrameView & frame) const;
+
+        void  pop(uint32_t producer);
+
+        // Daemon side, the targets beyond m_maxTargets are dropped
+        void  publish(uint64_t frame, double timestamp, float const * positions,
+                      float const * speeds, float const * weights, uint32_t n_targets);
+
+        // Consumer side, zero-copy : read the output between beginRead() and endRead(),
+        // which is false if it changed meanwhile (read again then)
+        uint64_t  beginRead() const;
+
+        bool      endRead(uint64_t sequence) const;
+
+        uint64_t  outputFrame() const;
+
+        double    outputTimestamp() const;
+
+        uint32_t  outputCount() const;
+
+        float const * outputPositions() const;
+
+        float const * outputSpeeds() const;
+
+        float const * outputWeights() const;
+
+    private:
+        struct Header;
+        struct Ring;
+        struct Slot;
+        struct Output;
+
+        bool    map(int fd, size_t size);
+
+        Ring &  ring(uint32_t producer) const;
+
+        Slot &  slot(uint32_t producer, uint64_t index) const;
+
+        Output & output() const;
+
+        size_t  slotSize() const;
+
+        size_t  ringSize() const;
+
+        size_t  segmentSize() const;
+
+    private:
+        string        m_name;
+        bool          m_owner;
+        SegmentConfig m_config;
+
+        unsigned char * m_base;
+        size_t          m_size;
+};
+
+#endif // SHM_TRACKING_H
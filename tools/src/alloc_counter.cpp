@@ -0,0 +1,78 @@
+#include "alloc_counter.h"
+#include <atomic>
+#include <errno.h>
+#include <stdlib.h>
+
+// Interposes the glibc allocator : every entry point forwards to the __libc_ implementation,
+// and bumps the counter when counting is enabled. Linked in by any caller of this file
+
+namespace {
+std::atomic<bool>   counting(false);
+std::atomic<size_t> allocations(0);
+
+inline void count() {
+  if (counting.load(std::memory_order_relaxed)) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+}
+
+#if defined(__GLIBC__)
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+
+void *malloc(size_t size) {
+  count();
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t count_, size_t size) {
+  count();
+  return __libc_calloc(count_, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  count();
+  return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size) {
+  count();
+  return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+  count();
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) {
+  count();
+  void *const result = __libc_memalign(alignment, size);
+
+  if (result == NULL) {
+    return ENOMEM;
+  }
+
+  *ptr = result;
+  return 0;
+}
+}
+
+bool allocationCountSupported() { return true; }
+#else
+bool allocationCountSupported() { return false; }
+#endif
+
+void startCounting() {
+  allocations.store(0);
+  counting.store(true);
+}
+
+size_t stopCounting() {
+  counting.store(false);
+  return allocations.load();
+}
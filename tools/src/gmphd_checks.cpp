@@ -0,0 +1,1979 @@
+/*
+ * Behavioural checks of the library, on small deterministic scenarios (see scenario.h).
+ * ctest runs every check as its own test.
+ *
+ * Usage : gmphd_checks [check ..]
+ * Runs the given checks (all of them by default), returns 0 if they all pass.
+ */
+
+#include "birth_grid.h"
+#include "gmphd_filter.h"
+#include "gmphd_recorder.h"
+#include "gmphd_snapshot.h"
+#include "gmphd_tiled.h"
+#include "latency.h"
+#include "scenario.h"
+#include "shm_tracking.h"
+#include <algorithm>
+#include <math.h>
+#include <random>
+#include <string.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+// Failed expectations of the running check
+int g_failures = 0;
+
+void expect(bool condition, char const *what) {
+  if (!condition) {
+    printf("  FAILED : %s\n", what);
+    ++g_failures;
+  }
+}
+
+// Scenario used by the filter checks : a few targets, some clutter
+ScenarioConfig smallScenario(unsigned seed = 7) {
+  ScenarioConfig scenario;
+  scenario.m_dim = 2;
+  scenario.m_nTargets = 4;
+  scenario.m_areaSize = 200.f;
+  scenario.m_maxSpeed = 5.f;
+  scenario.m_clutterRate = 3.f;
+  scenario.m_measNoisePose = 1.f;
+  scenario.m_measNoiseSpeed = 0.5f;
+  scenario.m_seed = seed;
+  return scenario;
+}
+
+template <typename T> vector<T> converted(vector<float> const &values) {
+  return vector<T>(values.begin(), values.end());
+}
+
+// Births covering the area, on a grid
+template <typename T> vector<GaussianModelT<T> > areaBirths(ScenarioConfig const &scenario) {
+  int const dim = scenario.m_dim;
+  int const n_axis = 3;
+  float const cell = scenario.m_areaSize / n_axis;
+
+  int n_births = 1;
+  for (int d = 0; d < dim; ++d) {
+    n_births *= n_axis;
+  }
+
+  vector<GaussianModelT<T> > births;
+  for (int i = 0; i < n_births; ++i) {
+    GaussianModelT<T> birth(2 * dim);
+    birth.m_weight = T(0.1);
+
+    int index = i;
+    for (int d = 0; d < dim; ++d) {
+      birth.m_mean(d, 0) = (index % n_axis + 0.5f) * cell;
+      index /= n_axis;
+    }
+
+    for (int d = 0; d < dim; ++d) {
+      birth.m_cov(d, d) = cell * cell;
+      birth.m_cov(dim + d, dim + d) = scenario.m_maxSpeed * scenario.m_maxSpeed;
+    }
+    births.push_back(birth);
+  }
+
+  return births;
+}
+
+// Births covering the area, and the usual models (GMPHD or GMPHDTiled)
+template <typename T, template <typename> class Filter>
+void initFilter(Filter<T> &filter, ScenarioConfig const &scenario,
+                int max_gaussians) {
+  vector<GaussianModelT<T> > births = areaBirths<T>(scenario);
+  filter.setBirthModel(births);
+  filter.setDynamicsModel(scenario.m_sampling, scenario.m_accelNoise + 1.f);
+  filter.setObservationModel(scenario.m_pDetection, scenario.m_measNoisePose,
+                             scenario.m_measNoiseSpeed, T(0.5));
+  filter.setPruningParameters(T(0.1), T(3), max_gaussians);
+  filter.setSurvivalProbability(T(0.99));
+}
+
+// Extracted targets, heaviest first
+template <typename T> struct Targets {
+  vector<T> position, speed, weight;
+};
+
+template <typename T, template <typename> class Filter>
+Targets<T> trackedTargets(Filter<T> &filter, T threshold = T(0.2)) {
+  Targets<T> targets;
+  filter.getTrackedTargets(targets.position, targets.speed, targets.weight,
+                           threshold);
+  return targets;
+}
+
+// Same targets, up to the tolerances, whatever their order
+template <typename A, typename B>
+bool sameTargets(Targets<A> const &lhs, Targets<B> const &rhs, int dim,
+                 double pos_tolerance, double weight_tolerance) {
+  if (lhs.weight.size() != rhs.weight.size()) {
+    printf("  %zu targets vs %zu\n", lhs.weight.size(), rhs.weight.size());
+    return false;
+  }
+
+  vector<char> matched(rhs.weight.size(), 0);
+
+  for (size_t i = 0; i < lhs.weight.size(); ++i) {
+    bool found = false;
+
+    for (size_t j = 0; j < rhs.weight.size() && !found; ++j) {
+      if (matched[j] ||
+          fabs(double(lhs.weight[i]) - double(rhs.weight[j])) > weight_tolerance) {
+        continue;
+      }
+
+      bool close = true;
+      for (int d = 0; d < dim; ++d) {
+        close &= fabs(double(lhs.position[i * dim + d]) -
+                      double(rhs.position[j * dim + d])) <= pos_tolerance &&
+                 fabs(double(lhs.speed[i * dim + d]) -
+                      double(rhs.speed[j * dim + d])) <= pos_tolerance;
+      }
+
+      matched[j] = close;
+      found = close;
+    }
+
+    if (!found) {
+      printf("  target %zu (weight %f) has no match\n", i, double(lhs.weight[i]));
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// The fused update keeps the same components as the full update followed by the
+// truncation, as long as the candidates fit. The candidates below the truncation
+// threshold are dropped before the merging, which is disabled for the comparison
+void checkFusedUpdate() {
+  ScenarioConfig const scenario = smallScenario();
+  int const max_gaussians = 50;
+
+  GMPHD reference(max_gaussians, scenario.m_dim, true);
+  GMPHD fused(max_gaussians, scenario.m_dim, true);
+  GMPHD bounded(max_gaussians, scenario.m_dim, true);
+
+  for (GMPHD *filter : {&reference, &fused, &bounded}) {
+    initFilter(*filter, scenario, max_gaussians);
+    filter->setPruningParameters(0.1f, 1e-6f, max_gaussians);
+  }
+
+  fused.setFusedPruning(true, 100);
+
+  // .. and a tight bound keeps the heaviest ones
+  bounded.setFusedPruning(true, 1);
+
+  Scenario frames(scenario);
+  bool same = true;
+
+  for (int frame = 0; frame < 30; ++frame) {
+    frames.step();
+
+    for (GMPHD *filter : {&reference, &fused, &bounded}) {
+      filter->setNewMeasurements(frames.measuredPositions(), frames.measuredSpeeds());
+      filter->propagate();
+    }
+
+    same &= sameTargets(trackedTargets(reference), trackedTargets(fused),
+                        scenario.m_dim, 1e-3, 1e-4);
+  }
+
+  expect(same, "fused update matches the reference update");
+
+  expect(bounded.currentTargets().m_gaussians.size() <= size_t(max_gaussians),
+         "bounded candidates fit the pruning");
+  expect(sameTargets(trackedTargets(reference, 0.5f), trackedTargets(bounded, 0.5f),
+                     scenario.m_dim, 1e-3, 1e-4),
+         "bounded candidates keep the tracked targets");
+}
+
+// A filter restored from a snapshot carries on exactly like the original one
+void checkSnapshot() {
+  ScenarioConfig const scenario = smallScenario();
+  int const max_gaussians = 50;
+
+  GMPHD original(max_gaussians, scenario.m_dim, true);
+  initFilter(original, scenario, max_gaussians);
+
+  Scenario frames(scenario);
+  for (int frame = 0; frame < 15; ++frame) {
+    frames.step();
+    original.setNewMeasurements(frames.measuredPositions(), frames.measuredSpeeds());
+    original.propagate();
+  }
+
+  // From a buffer, and from a file
+  vector<char> buffer;
+  original.saveState(buffer);
+
+  GMPHDSnapshot snapshot;
+  GMPHD from_buffer(max_gaussians, scenario.m_dim, true);
+  expect(snapshot.map(buffer.data(), buffer.size()) && from_buffer.loadState(snapshot),
+         "snapshot loaded from a buffer");
+
+  char const *const path = "gmphd_checks_snapshot.bin";
+  GMPHD from_file(max_gaussians, scenario.m_dim, true);
+  expect(original.saveState(path) && from_file.loadState(path),
+         "snapshot loaded from a file");
+  remove(path);
+
+  GMPHD other_dimension(max_gaussians, 3, true);
+  expect(!other_dimension.loadState(snapshot), "snapshot of another dimension rejected");
+
+  // Bounded filters only take the snapshots which fit their capacity
+  size_t const n_saved = original.currentTargets().m_gaussians.size();
+  GMPHD bounded(GMPHDCapacity(max_gaussians), scenario.m_dim, true);
+  GMPHD too_small(GMPHDCapacity(n_saved - 1), scenario.m_dim, true);
+  expect(bounded.loadState(snapshot), "snapshot loaded by a bounded filter");
+  expect(n_saved > 1 && !too_small.loadState(snapshot),
+         "snapshot over the bounded capacity rejected");
+
+  expect(sameTargets(trackedTargets(original), trackedTargets(from_buffer),
+                     scenario.m_dim, 0., 0.),
+         "restored targets");
+
+  bool same = true;
+  for (int frame = 0; frame < 15; ++frame) {
+    frames.step();
+
+    for (GMPHD *filter : {&original, &from_buffer, &from_file}) {
+      filter->setNewMeasurements(frames.measuredPositions(), frames.measuredSpeeds());
+      filter->propagate();
+    }
+
+    Targets<float> const targets = trackedTargets(original);
+    same &= sameTargets(targets, trackedTargets(from_buffer), scenario.m_dim, 0., 0.) &&
+            sameTargets(targets, trackedTargets(from_file), scenario.m_dim, 0., 0.);
+  }
+
+  expect(same, "restored filters track like the original one");
+
+  // A timestamped filter carries on with the real interval since its last frame
+  GMPHD timed(max_gaussians, scenario.m_dim, true);
+  initFilter(timed, scenario, max_gaussians);
+  timed.setTimeQuantum(1e-2);
+
+  double timestamp = 0.;
+  for (int frame = 0; frame < 10; ++frame) {
+    frames.step();
+    timestamp += (frame % 3 + 1) * 0.5;
+    timed.setNewMeasurements(frames.measuredPositions(), frames.measuredSpeeds());
+    timed.propagate(timestamp);
+  }
+
+  timed.saveState(buffer);
+  GMPHD restored_timed(max_gaussians, scenario.m_dim, true);
+  expect(snapshot.map(buffer.data(), buffer.size()) && restored_timed.loadState(snapshot),
+         "timestamped snapshot loaded");
+
+  same = true;
+  for (int frame = 0; frame < 10; ++frame) {
+    frames.step();
+    timestamp += (frame % 3 + 1) * 0.5;
+
+    for (GMPHD *filter : {&timed, &restored_timed}) {
+      filter->setNewMeasurements(frames.measuredPositions(), frames.measuredSpeeds());
+      filter->propagate(timestamp);
+    }
+
+    same &= sameTargets(trackedTargets(timed), trackedTargets(restored_timed), scenario.m_dim,
+                        0., 0.);
+  }
+
+  expect(same, "restored timestamped filter keeps the clock");
+}
+
+// Single and double precision filters agree, up to the float rounding
+void checkPrecisions() {
+  ScenarioConfig const scenario = smallScenario();
+  int const max_gaussians = 50;
+
+  GMPHD single(max_gaussians, scenario.m_dim, true);
+  GMPHDd twice(max_gaussians, scenario.m_dim, true);
+  initFilter(single, scenario, max_gaussians);
+  initFilter(twice, scenario, max_gaussians);
+
+  Scenario frames(scenario);
+  bool same = true;
+
+  for (int frame = 0; frame < 30; ++frame) {
+    frames.step();
+
+    single.setNewMeasurements(frames.measuredPositions(), frames.measuredSpeeds());
+    single.propagate();
+
+    twice.setNewMeasurements(converted<double>(frames.measuredPositions()),
+                             converted<double>(frames.measuredSpeeds()));
+    twice.propagate();
+
+    same &= sameTargets(trackedTargets(single), trackedTargets(twice), scenario.m_dim,
+                        1e-2, 1e-3);
+  }
+
+  expect(same, "float and double filters track the same targets");
+}
+
+// Largest difference between two batches, relative to the magnitude of the first one
+template <typename T>
+double laneDifference(LaneMatrices<T> const &lhs, LaneMatrices<T> const &rhs) {
+  typedef Matrix<T, Dynamic, Dynamic> MatrixXT;
+  MatrixXT left, right;
+  double difference = 0.;
+
+  for (int k = 0; k < lhs.count(); ++k) {
+    lhs.get(k, left);
+    rhs.get(k, right);
+
+    double const scale = std::max(1., double(left.cwiseAbs().maxCoeff()));
+    difference = std::max(difference, double((left - right).cwiseAbs().maxCoeff()) / scale);
+  }
+
+  return difference;
+}
+
+// Every kernel of every instruction set against the scalar ones, on random covariances.
+// An odd number of lanes, so that the padding is used
+template <typename T> void compareKernels(double tolerance) {
+  typedef Matrix<T, Dynamic, Dynamic> MatrixXT;
+  int const n_lanes = 37;
+
+  vector<BatchKernels<T> > const kernels = availableBatchKernels<T>();
+  std::mt19937 rng(3);
+  std::uniform_real_distribution<double> uniform(-1., 1.);
+
+  auto random = [&](int rows, int cols) {
+    MatrixXT mat(rows, cols);
+    for (int i = 0; i < mat.size(); ++i) {
+      mat(i) = T(uniform(rng));
+    }
+    return mat;
+  };
+
+  for (int dim : {4, 6}) {
+    MatrixXT const A = random(dim, dim);
+    MatrixXT const offset = random(dim, 1);
+    MatrixXT const H = MatrixXT::Identity(dim, dim) + T(0.1) * random(dim, dim);
+    MatrixXT const z = random(dim, 1);
+    MatrixXT R = random(dim, dim);
+    R = R * R.transpose() + MatrixXT::Identity(dim, dim);
+
+    LaneMatrices<T> x, P;
+    vector<T> weights(n_lanes);
+    x.resize(dim, 1, n_lanes);
+    P.resizeSymmetric(dim, n_lanes);
+
+    for (int k = 0; k < n_lanes; ++k) {
+      MatrixXT const B = random(dim, dim);
+      x.set(k, random(dim, 1));
+      P.set(k, B * B.transpose() + T(0.1) * MatrixXT::Identity(dim, dim));
+      weights[k] = T(0.5 + 0.5 * uniform(rng));
+    }
+
+    // Outputs of every kernel set
+    struct Outputs {
+      LaneMatrices<T> affine, sandwich, innov, innov_inv, gain, cov_update, means, scratch;
+      vector<T> log_det;
+      vector<unsigned char> valid;
+      MatrixXT mean;
+      SymmetricMatrixT<T> cov;
+    };
+
+    vector<Outputs> outputs(kernels.size());
+
+    for (size_t i = 0; i < kernels.size(); ++i) {
+      BatchKernels<T> const &kernel = kernels[i];
+      Outputs &out = outputs[i];
+
+      kernel.affine(A.data(), dim, dim, offset.data(), x, out.affine);
+      kernel.sandwich(A.data(), dim, dim, NULL, P, out.scratch, out.sandwich);
+      kernel.sandwich(H.data(), dim, dim, R.data(), P, out.scratch, out.innov);
+
+      out.log_det.resize(P.stride());
+      out.valid.resize(P.stride());
+      kernel.gain(H.data(), dim, dim, P, out.innov, out.innov_inv, out.log_det.data(),
+                  out.valid.data(), out.gain, out.cov_update, out.scratch);
+
+      LaneMatrices<T> measures;
+      kernel.affine(H.data(), dim, dim, NULL, x, measures);
+      kernel.updateMeans(out.gain, x, measures, z.data(), out.means);
+
+      out.mean.resize(dim, 1);
+      out.cov.resize(dim);
+      kernel.momentMatch(x, P, weights.data(), out.mean.data(), out.cov.data());
+    }
+
+    Outputs const &scalar = outputs[0];
+
+    for (size_t i = 1; i < kernels.size(); ++i) {
+      Outputs const &out = outputs[i];
+      printf("  %s, %dD\n", kernels[i].m_isa, dim);
+
+      double log_det = 0.;
+      bool valid = true;
+      for (int k = 0; k < n_lanes; ++k) {
+        log_det = std::max(log_det, fabs(double(out.log_det[k] - scalar.log_det[k])));
+        valid &= out.valid[k] == scalar.valid[k];
+      }
+
+      expect(laneDifference(scalar.affine, out.affine) < tolerance, "affine");
+      expect(laneDifference(scalar.sandwich, out.sandwich) < tolerance, "sandwich");
+      expect(laneDifference(scalar.innov, out.innov) < tolerance, "sandwich with noise");
+      expect(laneDifference(scalar.innov_inv, out.innov_inv) < tolerance, "gain : inverse");
+      expect(laneDifference(scalar.gain, out.gain) < tolerance, "gain");
+      expect(laneDifference(scalar.cov_update, out.cov_update) < tolerance,
+             "gain : updated covariance");
+      expect(log_det < tolerance && valid, "gain : log determinant");
+      expect(laneDifference(scalar.means, out.means) < tolerance, "updated means");
+      expect((scalar.mean - out.mean).cwiseAbs().maxCoeff() < tolerance &&
+                 (scalar.cov.packed() - out.cov.packed()).cwiseAbs().maxCoeff() < tolerance,
+             "moment matching");
+    }
+  }
+}
+
+void checkKernels() {
+  printf("  dispatched : %s\n", batchKernels<float>().m_isa);
+  compareKernels<float>(1e-4);
+  compareKernels<double>(1e-10);
+}
+
+// Inverse, solve and log-determinant of covariances against the pseudo-inverse, for the
+// closed form sizes and the generic one. A singular matrix falls back on the pseudo-inverse
+template <typename T> void compareInverses(double tolerance) {
+  typedef Matrix<T, Dynamic, Dynamic> MatrixXT;
+  std::mt19937 rng(5);
+  std::uniform_real_distribution<double> uniform(-1., 1.);
+
+  for (int dim = 1; dim <= 6; ++dim) {
+    for (int trial = 0; trial < 20; ++trial) {
+      MatrixXT B(dim, dim), rhs(dim, 2);
+      for (int i = 0; i < B.size(); ++i) {
+        B(i) = T(uniform(rng));
+      }
+      for (int i = 0; i < rhs.size(); ++i) {
+        rhs(i) = T(uniform(rng));
+      }
+
+      MatrixXT const cov = B * B.transpose() + T(0.5) * MatrixXT::Identity(dim, dim);
+      MatrixXT inverse, pseudo_inverse, solution;
+      T log_det = 0, log_pdet = 0;
+
+      bool const factorized = spd_inverse(cov, inverse, &log_det);
+      pseudo_inv(cov, pseudo_inverse, &log_pdet);
+      bool const solved = spd_solve(cov, rhs, solution);
+
+      double const scale = std::max(1., double(pseudo_inverse.cwiseAbs().maxCoeff()));
+      expect(factorized && solved, "covariance factorized");
+      expect((inverse - pseudo_inverse).cwiseAbs().maxCoeff() < tolerance * scale,
+             "inverse");
+      expect(fabs(double(log_det - log_pdet)) < tolerance * std::max(1., fabs(double(log_pdet))),
+             "log determinant");
+      expect(fabs(double(spd_log_det(cov) - log_pdet)) <
+                 tolerance * std::max(1., fabs(double(log_pdet))),
+             "log determinant, without the inverse");
+      expect((solution - pseudo_inverse * rhs).cwiseAbs().maxCoeff() < tolerance * scale,
+             "solve");
+    }
+
+    if (dim > 1) {
+      // Rank deficient, exactly : a null last coordinate
+      MatrixXT B = MatrixXT::Zero(dim, dim);
+      for (int i = 0; i < dim - 1; ++i) {
+        for (int j = 0; j < dim - 1; ++j) {
+          B(i, j) = T(uniform(rng));
+        }
+      }
+
+      MatrixXT cov = B * B.transpose();
+      cov.topLeftCorner(dim - 1, dim - 1) += T(0.5) * MatrixXT::Identity(dim - 1, dim - 1);
+      MatrixXT inverse, pseudo_inverse;
+
+      bool const factorized = spd_inverse(cov, inverse);
+      pseudo_inv(cov, pseudo_inverse);
+
+      double const scale = std::max(1., double(pseudo_inverse.cwiseAbs().maxCoeff()));
+      expect(!factorized, "singular covariance detected");
+      expect((inverse - pseudo_inverse).cwiseAbs().maxCoeff() < tolerance * scale,
+             "singular covariance : pseudo-inverse");
+    }
+  }
+}
+
+void checkInverses() {
+  compareInverses<float>(1e-3);
+  compareInverses<double>(1e-9);
+}
+
+// The merging distance only looks at the positions : with 2D positions and speeds,
+// two components at the same place merge whatever their speeds
+void checkMergingPositions() {
+  for (unsigned int n_threads : {1u, 2u}) {
+    GaussianMixture mixture(4);
+    mixture.m_gaussians.assign(2, GaussianModel(4));
+    mixture.m_gaussians[0].m_weight = 0.6f;
+    mixture.m_gaussians[1].m_weight = 0.4f;
+    mixture.m_gaussians[1].m_mean(2, 0) = 10.f;
+
+    mixture.prune(0.1f, 3.f, 10, 2, n_threads);
+    expect(mixture.m_gaussians.size() == 1 &&
+               fabs(mixture.m_gaussians[0].m_weight - 1.f) < 1e-6f &&
+               fabs(mixture.m_gaussians[0].m_mean(2, 0) - 4.f) < 1e-5f,
+           n_threads > 1 ? "parallel merging on the positions" : "merging on the positions");
+  }
+}
+
+// The parallel merging gives the same mixture as the serial one, on random mixtures large
+// enough to spread over the grid cells, with clusters across the cell borders (halo) and
+// components claimed by several references (reconciliation)
+template <typename T> void compareParallelMerging(int n_trials, double tolerance) {
+  typedef Matrix<T, Dynamic, Dynamic> MatrixXT;
+  mt19937 rng(11);
+  uniform_real_distribution<T> uniform(0, 1);
+  normal_distribution<T> normal(0, 1);
+
+  int n_different = 0;
+  size_t n_in = 0, n_out = 0;
+
+  for (int trial = 0; trial < n_trials; ++trial) {
+    int const dim_pos = trial % 2 == 0 ? 2 : 3;
+    int const dim = 2 * dim_pos;
+    int const n_gaussians = 50 + rng() % 981;
+    int const n_clusters = std::max(1, n_gaussians / 8);
+    unsigned int const max_gaussians = trial % 3 == 0 ? 30 : 2000;
+
+    GaussianMixtureT<T> mixture(dim);
+    mixture.m_gaussians.assign(n_gaussians, GaussianModelT<T>(dim));
+
+    MatrixXT centres(dim_pos, n_clusters);
+    for (int c = 0; c < n_clusters; ++c) {
+      for (int d = 0; d < dim_pos; ++d) {
+        centres(d, c) = 200 * uniform(rng);
+      }
+    }
+
+    for (auto &gaussian : mixture.m_gaussians) {
+      int const c = rng() % n_clusters;
+      T const spread = T(0.5) + 3 * uniform(rng);
+
+      for (int d = 0; d < dim; ++d) {
+        gaussian.m_mean(d, 0) = d < dim_pos ? centres(d, c) + spread * normal(rng) : normal(rng);
+      }
+
+      MatrixXT const factor = MatrixXT::NullaryExpr(dim, dim, [&]() { return normal(rng); });
+      gaussian.m_cov = factor * factor.transpose() + (1 + 4 * uniform(rng)) * MatrixXT::Identity(dim, dim);
+      gaussian.m_weight = T(0.01) + uniform(rng);
+    }
+
+    GaussianMixtureT<T> parallel = mixture;
+    mixture.prune(T(0.05), T(3), max_gaussians, dim_pos, 1);
+    parallel.prune(T(0.05), T(3), max_gaussians, dim_pos, 4);
+
+    bool same = mixture.m_gaussians.size() == parallel.m_gaussians.size();
+    n_in += n_gaussians;
+    n_out += mixture.m_gaussians.size();
+
+    for (size_t i = 0; same && i < mixture.m_gaussians.size(); ++i) {
+      GaussianModelT<T> const &lhs = mixture.m_gaussians[i];
+      GaussianModelT<T> const &rhs = parallel.m_gaussians[i];
+
+      same = fabs(double(lhs.m_weight - rhs.m_weight)) <= tolerance * lhs.m_weight &&
+             (lhs.m_mean - rhs.m_mean).norm() <= tolerance * (1 + lhs.m_mean.norm()) &&
+             (lhs.m_cov.dense() - rhs.m_cov.dense()).norm() <=
+                 tolerance * (1 + lhs.m_cov.dense().norm());
+    }
+
+    if (!same) {
+      printf("  %zu components (%d merged to %zu) differ\n", parallel.m_gaussians.size(),
+             n_gaussians, mixture.m_gaussians.size());
+      ++n_different;
+    }
+  }
+
+  printf("  %d mixtures, %zu components merged to %zu\n", n_trials, n_in, n_out);
+  expect(n_different == 0, "parallel merging matches the serial merging");
+}
+
+void checkParallelMerging() {
+  compareParallelMerging<float>(50, 1e-5);
+  compareParallelMerging<double>(20, 1e-12);
+}
+
+// Rigid change of the 2D referential, homogeneous [R t; 0 1]
+MatrixXf rigidTransform(float angle, float tx, float ty) {
+  MatrixXf transform = MatrixXf::Identity(3, 3);
+  transform(0, 0) = cos(angle);
+  transform(0, 1) = -sin(angle);
+  transform(1, 0) = sin(angle);
+  transform(1, 1) = cos(angle);
+  transform(0, 2) = tx;
+  transform(1, 2) = ty;
+  return transform;
+}
+
+// Positions are moved, speeds only rotated
+void transformPoints(MatrixXf const &transform, vector<float> &positions,
+                     vector<float> &speeds) {
+  for (size_t i = 0; i + 1 < positions.size(); i += 2) {
+    Vector2f const pos = transform.topLeftCorner(2, 2) *
+                             Vector2f(positions[i], positions[i + 1]) +
+                         transform.topRightCorner(2, 1);
+    Vector2f const speed =
+        transform.topLeftCorner(2, 2) * Vector2f(speeds[i], speeds[i + 1]);
+
+    positions[i] = pos(0);
+    positions[i + 1] = pos(1);
+    speeds[i] = speed(0);
+    speeds[i + 1] = speed(1);
+  }
+}
+
+// A referential change waiting for the next prediction gives the same targets as one
+// applied right away (reading the current targets forces it)
+void checkReferential() {
+  ScenarioConfig const scenario = smallScenario();
+  int const max_gaussians = 50;
+
+  GMPHD deferred(max_gaussians, scenario.m_dim, true);
+  GMPHD eager(max_gaussians, scenario.m_dim, true);
+  initFilter(deferred, scenario, max_gaussians);
+  initFilter(eager, scenario, max_gaussians);
+
+  Scenario frames(scenario);
+  MatrixXf world_to_sensor = MatrixXf::Identity(3, 3);
+  bool same_extracted = true, same_tracked = true;
+
+  for (int frame = 0; frame < 30; ++frame) {
+    frames.step();
+
+    if (frame % 5 == 4) {
+      MatrixXf const transform = rigidTransform(0.05f, 1.f, -2.f);
+      world_to_sensor = transform * world_to_sensor;
+
+      deferred.setNewReferential(transform);
+      eager.setNewReferential(transform);
+      eager.currentTargets();
+
+      // The extracted targets are a transformed copy, the change stays deferred
+      same_extracted &= sameTargets(trackedTargets(deferred), trackedTargets(eager),
+                                    scenario.m_dim, 1e-3, 1e-5);
+    }
+
+    vector<float> positions = frames.measuredPositions();
+    vector<float> speeds = frames.measuredSpeeds();
+    transformPoints(world_to_sensor, positions, speeds);
+
+    for (GMPHD *filter : {&deferred, &eager}) {
+      filter->setNewMeasurements(positions, speeds);
+      filter->propagate();
+    }
+
+    same_tracked &= sameTargets(trackedTargets(deferred), trackedTargets(eager),
+                                scenario.m_dim, 1e-2, 1e-4);
+  }
+
+  expect(same_extracted, "pending change applied to the extracted targets");
+  expect(same_tracked, "deferred and eager changes track alike");
+}
+
+// Within a frame, the referential change applies to what the next correction starts from
+void checkReferentialInFrame() {
+  ScenarioConfig scenario = smallScenario();
+  scenario.m_nSensors = 2;
+  int const max_gaussians = 50;
+
+  GMPHD::SensorModel const sensor(scenario.m_pDetection, scenario.m_measNoisePose,
+                                  scenario.m_measNoiseSpeed, 0.5f);
+  MatrixXf const transform = rigidTransform(0.3f, 5.f, -3.f);
+
+  // Before the first correction : same as a change before the prediction
+  {
+    GMPHD before(max_gaussians, scenario.m_dim, true);
+    GMPHD within(max_gaussians, scenario.m_dim, true);
+    initFilter(before, scenario, max_gaussians);
+    initFilter(within, scenario, max_gaussians);
+
+    Scenario frames(scenario);
+    for (int frame = 0; frame < 10; ++frame) {
+      frames.step();
+
+      for (GMPHD *filter : {&before, &within}) {
+        filter->setNewMeasurements(frames.measuredPositions(), frames.measuredSpeeds());
+        filter->propagate();
+      }
+    }
+
+    frames.step();
+    vector<float> positions = frames.measuredPositions();
+    vector<float> speeds = frames.measuredSpeeds();
+    transformPoints(transform, positions, speeds);
+
+    before.setNewReferential(transform);
+    before.predict();
+    within.predict();
+    within.setNewReferential(transform);
+
+    for (GMPHD *filter : {&before, &within}) {
+      filter->correct(positions, speeds, sensor);
+      filter->prune();
+    }
+
+    expect(sameTargets(trackedTargets(before), trackedTargets(within), scenario.m_dim,
+                       1e-2, 1e-4),
+           "change before the first correction");
+  }
+
+  // Between two corrections : the posterior of the first sensor is transformed, the
+  // result is the one of a filter which never changed, transformed afterwards
+  {
+    GMPHD changed(max_gaussians, scenario.m_dim, true);
+    GMPHD unchanged(max_gaussians, scenario.m_dim, true);
+    initFilter(changed, scenario, max_gaussians);
+    initFilter(unchanged, scenario, max_gaussians);
+
+    Scenario frames(scenario);
+    for (int frame = 0; frame < 10; ++frame) {
+      frames.step();
+
+      for (GMPHD *filter : {&changed, &unchanged}) {
+        filter->setNewMeasurements(frames.measuredPositions(), frames.measuredSpeeds());
+        filter->propagate();
+      }
+    }
+
+    frames.step();
+    vector<float> positions = frames.measuredPositions(1);
+    vector<float> speeds = frames.measuredSpeeds(1);
+    transformPoints(transform, positions, speeds);
+
+    for (GMPHD *filter : {&changed, &unchanged}) {
+      filter->predict();
+      filter->correct(frames.measuredPositions(0), frames.measuredSpeeds(0), sensor);
+    }
+
+    changed.setNewReferential(transform);
+    changed.correct(positions, speeds, sensor);
+    changed.prune();
+
+    unchanged.correct(frames.measuredPositions(1), frames.measuredSpeeds(1), sensor);
+    unchanged.prune();
+
+    Targets<float> expected = trackedTargets(unchanged);
+    transformPoints(transform, expected.position, expected.speed);
+
+    Targets<float> const tracked = trackedTargets(changed);
+    expect(!tracked.weight.empty() &&
+               sameTargets(tracked, expected, scenario.m_dim, 1e-2, 1e-3),
+           "change between two corrections");
+  }
+}
+
+// The smoothed targets are closer to the truth than the filtered ones, referential changes
+// included : deferred, applied by reading the targets, or within a frame. The smoother
+// follows the changes, wherever they are applied
+void checkSmoother() {
+  enum ChangeMode { NO_CHANGE, DEFERRED, READ, IN_FRAME };
+  char const *const names[] = {"smoothing", "smoothing with deferred changes",
+                               "smoothing with changes read right away",
+                               "smoothing with changes within a frame"};
+
+  ScenarioConfig const scenario = smallScenario();
+  int const max_gaussians = 50;
+  int const lag = 3;
+  int const n_frames = 60;
+  float const cutoff = 20.f;
+
+  GMPHD::SensorModel const sensor(scenario.m_pDetection, scenario.m_measNoisePose,
+                                  scenario.m_measNoiseSpeed, 0.5f);
+
+  double deferred_sum = 0.;
+
+  for (int mode = NO_CHANGE; mode <= IN_FRAME; ++mode) {
+    GMPHD filter(max_gaussians, scenario.m_dim, true);
+    initFilter(filter, scenario, max_gaussians);
+    filter.setSmoothing(lag);
+
+    Scenario frames(scenario);
+    MatrixXf world_to_sensor = MatrixXf::Identity(3, 3);
+
+    // Truth of every frame, in the referential of its posterior
+    vector<vector<float> > truths(n_frames);
+    vector<float> filtered_ospa(n_frames, 0.f);
+    double filtered_sum = 0., smoothed_sum = 0.;
+
+    for (int frame = 0; frame < n_frames; ++frame) {
+      frames.step();
+
+      MatrixXf const transform = rigidTransform(0.05f, 1.f, -2.f);
+      bool const change = mode != NO_CHANGE && frame % 4 == 3;
+
+      if (change) {
+        world_to_sensor = transform * world_to_sensor;
+
+        if (mode != IN_FRAME) {
+          filter.setNewReferential(transform);
+
+          if (mode == READ) {
+            filter.currentTargets();
+          }
+        }
+      }
+
+      vector<float> positions = frames.measuredPositions();
+      vector<float> speeds = frames.measuredSpeeds();
+      transformPoints(world_to_sensor, positions, speeds);
+
+      filter.predict();
+      if (change && mode == IN_FRAME) {
+        filter.setNewReferential(transform);
+      }
+      filter.correct(positions, speeds, sensor);
+      filter.prune();
+
+      truths[frame] = frames.truePositions();
+      vector<float> no_speeds(truths[frame].size(), 0.f);
+      transformPoints(world_to_sensor, truths[frame], no_speeds);
+
+      Targets<float> const tracked = trackedTargets(filter, 0.5f);
+      filtered_ospa[frame] = ospa(truths[frame], tracked.position, scenario.m_dim, cutoff);
+
+      // Once the window is full, the smoothed frame against its filtered estimate
+      int const delay = filter.smoothingDelay();
+      if (frame >= 10 && delay == lag) {
+        Targets<float> smoothed;
+        filter.getSmoothedTargets(smoothed.position, smoothed.speed, smoothed.weight, 0.5f);
+
+        smoothed_sum += ospa(truths[frame - delay], smoothed.position, scenario.m_dim, cutoff);
+        filtered_sum += filtered_ospa[frame - delay];
+      }
+    }
+
+    printf("  %s : OSPA %.3f filtered, %.3f smoothed\n", names[mode], filtered_sum,
+           smoothed_sum);
+    expect(filtered_sum > 0. && smoothed_sum < filtered_sum, names[mode]);
+
+    if (mode == DEFERRED) {
+      deferred_sum = smoothed_sum;
+    } else if (mode != NO_CHANGE) {
+      expect(fabs(smoothed_sum - deferred_sum) <= 1e-2 * deferred_sum,
+             "smoother follows the changes applied right away");
+    }
+  }
+}
+
+// Measurement at (x, y), speed (vx, vy), with a marker covariance
+GaussianModel measurement(float x, float y, float vx, float vy) {
+  GaussianModel measure(4);
+  measure.m_mean << x, y, vx, vy;
+  measure.m_cov *= 7.f;
+  measure.m_weight = 1.f;
+  return measure;
+}
+
+// Dense groups of returns become their centroid, with the number of returns as weight and
+// the covariance of the centroid. Single returns are left alone, and a long line of returns
+// is split instead of chained into one cluster
+void checkClustering() {
+  float const voxel = 10.f;
+  MeasurementClustering clustering(2, 4, voxel);
+
+  // Groups A, B, C of 4 returns, single returns S and R, interleaved
+  float const centres[3][2] = {{15.f, 15.f}, {65.f, 15.f}, {15.f, 65.f}};
+  float const offsets[4][2] = {{-2.f, -1.f}, {1.f, 2.f}, {3.f, -2.f}, {-1.f, 1.f}};
+
+  GaussianMixture measures(4);
+  vector<vector<GaussianModel> > groups(3);
+
+  for (int k = 0; k < 4; ++k) {
+    for (int g = 0; g < 3; ++g) {
+      groups[g].push_back(measurement(centres[g][0] + offsets[k][0],
+                                      centres[g][1] + offsets[k][1], float(g + k), -float(k)));
+      measures.m_gaussians.push_back(groups[g].back());
+    }
+
+    if (k == 0) {
+      measures.m_gaussians.insert(measures.m_gaussians.begin() + 2,
+                                  measurement(105.f, 105.f, 1.f, 2.f));
+    } else if (k == 1) {
+      measures.m_gaussians.push_back(measurement(155.f, 35.f, -1.f, 0.f));
+    }
+  }
+
+  clustering.cluster(measures);
+  vector<GaussianModel> const &clusters = measures.m_gaussians;
+
+  // In the order of their first member : A, B, S, C, R
+  expect(clusters.size() == 5, "one cluster per group of returns");
+  expect(clustering.hasSpread(), "clusters of several returns");
+
+  if (clusters.size() == 5) {
+    int const group_slots[3] = {0, 1, 3};
+
+    for (int g = 0; g < 3; ++g) {
+      MatrixXf centroid = MatrixXf::Zero(4, 1);
+      for (auto const &member : groups[g]) {
+        centroid += member.m_mean;
+      }
+      centroid /= 4.f;
+
+      MatrixXf scatter = MatrixXf::Zero(4, 4);
+      for (auto const &member : groups[g]) {
+        scatter += (member.m_mean - centroid) * (member.m_mean - centroid).transpose();
+      }
+
+      GaussianModel const &cluster = clusters[group_slots[g]];
+      expect((cluster.m_mean - centroid).norm() < 1e-4f, "centroid of the returns");
+      expect((cluster.m_cov.dense() - scatter / 12.f).norm() < 1e-4f, "covariance of the centroid");
+      expect(cluster.m_weight == 4.f, "number of returns as weight");
+    }
+
+    GaussianModel const single = measurement(105.f, 105.f, 1.f, 2.f);
+    expect(clusters[2].m_mean == single.m_mean && clusters[2].m_cov == single.m_cov &&
+               clusters[2].m_weight == 1.f,
+           "single return left alone");
+    expect(clusters[4].m_mean(0, 0) == 155.f && clusters[4].m_cov == single.m_cov,
+           "single return moved to its slot");
+  }
+
+  // A line of returns, one per voxel, closer than the voxel size : every link passes,
+  // the extent splits it
+  int const n_line = 41;
+  float const step = 0.99f * voxel;
+  float const max_span = (MeasurementClustering::CLUSTER_EXTENT + 1) * voxel;
+
+  measures.m_gaussians.clear();
+  for (int i = 0; i < n_line; ++i) {
+    measures.m_gaussians.push_back(measurement(0.5f * voxel + step * i, 5.f, 0.f, 0.f));
+  }
+
+  clustering.cluster(measures);
+
+  float returns = 0.f;
+  for (auto const &cluster : measures.m_gaussians) {
+    returns += cluster.m_weight;
+  }
+
+  expect(measures.m_gaussians.size() >= size_t(ceil(step * (n_line - 1) / max_span)),
+         "line of returns split by the cluster extent");
+  expect(returns == float(n_line), "every return in one cluster");
+
+  // In the filter, on a dense sensor : fewer measurements, the fused update matches the
+  // full one with the clusters, and the targets are tracked better than from the raw returns
+  ScenarioConfig scenario = smallScenario();
+  scenario.m_returns = 5;
+  scenario.m_extent = 1.5f;
+
+  int const max_gaussians = 50;
+  float const cutoff = 20.f;
+
+  GMPHD reference(max_gaussians, scenario.m_dim, true);
+  GMPHD fused(max_gaussians, scenario.m_dim, true);
+  GMPHD raw(max_gaussians, scenario.m_dim, true);
+
+  for (GMPHD *filter : {&reference, &fused, &raw}) {
+    initFilter(*filter, scenario, max_gaussians);
+    filter->setPruningParameters(0.1f, 1e-6f, max_gaussians);
+  }
+
+  reference.setMeasurementClustering(voxel);
+  fused.setMeasurementClustering(voxel);
+  fused.setFusedPruning(true, 100);
+
+  Scenario frames(scenario);
+  bool same = true;
+  double clustered_sum = 0., raw_sum = 0.;
+  int const n_frames = 40;
+
+  for (int frame = 0; frame < n_frames; ++frame) {
+    frames.step();
+
+    for (GMPHD *filter : {&reference, &fused, &raw}) {
+      filter->setNewMeasurements(frames.measuredPositions(), frames.measuredSpeeds());
+      filter->propagate();
+    }
+
+    same &= sameTargets(trackedTargets(reference), trackedTargets(fused), scenario.m_dim,
+                        1e-3, 1e-4);
+
+    if (frame >= 10) {
+      clustered_sum += ospa(frames.truePositions(), trackedTargets(reference, 0.5f).position,
+                            scenario.m_dim, cutoff);
+      raw_sum += ospa(frames.truePositions(), trackedTargets(raw, 0.5f).position,
+                      scenario.m_dim, cutoff);
+    }
+  }
+
+  ClusteringStats const stats = reference.clusteringStats();
+
+  printf("  %zu measurements, %zu clusters, OSPA %.3f clustered, %.3f raw\n",
+         stats.m_measurements, stats.m_clusters, clustered_sum, raw_sum);
+  expect(stats.m_clusters > 0 && 3 * stats.m_clusters < stats.m_measurements,
+         "clustering reduces the measurements");
+  expect(same, "fused update matches the reference update with clusters");
+  expect(clustered_sum < raw_sum, "targets tracked better from the clusters");
+}
+
+// A recorded log, replayed from its initial snapshot, ends on the targets of the live run.
+// The recording starts on a running timestamped filter, with referential changes and
+// sequential corrections on the way
+void checkReplay() {
+  ScenarioConfig const scenario = smallScenario();
+  int const max_gaussians = 50;
+  char const *const path = "gmphd_checks_record.bin";
+
+  GMPHD::SensorModel const sensor(scenario.m_pDetection, scenario.m_measNoisePose,
+                                  scenario.m_measNoiseSpeed, 0.5f);
+
+  GMPHD live(max_gaussians, scenario.m_dim, true);
+  initFilter(live, scenario, max_gaussians);
+  live.setTimeQuantum(1e-2);
+
+  Scenario frames(scenario);
+  double timestamp = 0.;
+
+  for (int frame = 0; frame < 5; ++frame) {
+    frames.step();
+    timestamp += 1.;
+    live.setNewMeasurements(frames.measuredPositions(), frames.measuredSpeeds());
+    live.propagate(timestamp);
+  }
+
+  GMPHDRecorder recorder;
+  expect(recorder.open(path, live), "recording opened");
+  live.setRecorder(&recorder);
+
+  MatrixXf const transform = rigidTransform(0.05f, 1.f, -2.f);
+  MatrixXf world_to_sensor = MatrixXf::Identity(3, 3);
+  vector<Targets<float> > live_frames;
+
+  for (int frame = 0; frame < 20; ++frame) {
+    frames.step();
+    timestamp += (frame % 3 + 1) * 0.5;
+
+    if (frame % 4 == 1) {
+      world_to_sensor = transform * world_to_sensor;
+      live.setNewReferential(transform);
+    }
+
+    vector<float> positions = frames.measuredPositions();
+    vector<float> speeds = frames.measuredSpeeds();
+    transformPoints(world_to_sensor, positions, speeds);
+
+    if (frame % 3 == 2) {
+      live.predict(timestamp);
+      live.correct(positions, speeds, sensor);
+      live.prune();
+    } else {
+      live.setNewMeasurements(positions, speeds);
+      live.propagate(timestamp);
+    }
+
+    live_frames.push_back(trackedTargets(live));
+  }
+
+  live.setRecorder(NULL);
+  recorder.close();
+
+  GMPHDReplayer replayer;
+  expect(replayer.open(path), "recording opened for replay");
+
+  SnapshotHeader const &init = replayer.initialState().header();
+  GMPHD replayed(init.m_maxGaussians, init.m_dimMeasures, init.m_motionModel != 0);
+  expect(replayed.loadState(replayer.initialState()), "recorded state loaded");
+
+  RecordType type;
+  size_t n_frames = 0;
+  bool same = true, timestamped = false, referential = false;
+
+  // Frame after frame
+  while (replayer.step(replayed, type)) {
+    timestamped |= type == RECORD_PROPAGATE_AT || type == RECORD_PREDICT_AT;
+    referential |= type == RECORD_REFERENTIAL;
+
+    if (type == RECORD_PROPAGATE_AT || type == RECORD_PRUNE) {
+      same &= n_frames < live_frames.size() &&
+              sameTargets(live_frames[n_frames], trackedTargets(replayed), scenario.m_dim, 0., 0.);
+      ++n_frames;
+    }
+  }
+
+  remove(path);
+
+  expect(timestamped && referential, "timestamped and referential records");
+  expect(n_frames == live_frames.size(), "every frame recorded");
+  expect(!live_frames.back().weight.empty(), "targets tracked in the live run");
+  expect(same, "replayed targets match the live run");
+}
+
+
+// Sequential corrections : a single correct() is propagate(), and an empty correction which
+// detects nothing (pD = 0) changes nothing, with and without the fused pruning
+void checkCorrections() {
+  ScenarioConfig const scenario = smallScenario();
+  int const max_gaussians = 50;
+
+  GMPHD::SensorModel const sensor(scenario.m_pDetection, scenario.m_measNoisePose,
+                                  scenario.m_measNoiseSpeed, 0.5f);
+  GMPHD::SensorModel const blind(0.f, scenario.m_measNoisePose, scenario.m_measNoiseSpeed, 0.5f);
+  vector<float> const nothing;
+
+  for (bool fused : {false, true}) {
+    GMPHD propagated(max_gaussians, scenario.m_dim, true);
+    GMPHD corrected(max_gaussians, scenario.m_dim, true);
+    GMPHD blinded(max_gaussians, scenario.m_dim, true);
+
+    for (GMPHD *filter : {&propagated, &corrected, &blinded}) {
+      initFilter(*filter, scenario, max_gaussians);
+      filter->setFusedPruning(fused, 10);
+    }
+
+    Scenario frames(scenario);
+    bool same_single = true, same_blind = true;
+    double weight_sum = 0.;
+
+    for (int frame = 0; frame < 30; ++frame) {
+      frames.step();
+
+      propagated.setNewMeasurements(frames.measuredPositions(), frames.measuredSpeeds());
+      propagated.propagate();
+
+      corrected.predict();
+      corrected.correct(frames.measuredPositions(), frames.measuredSpeeds(), sensor);
+      corrected.prune();
+
+      blinded.predict();
+      blinded.correct(frames.measuredPositions(), frames.measuredSpeeds(), sensor);
+      blinded.correct(nothing, nothing, blind);
+      blinded.prune();
+
+      Targets<float> const targets = trackedTargets(propagated);
+      same_single &= sameTargets(targets, trackedTargets(corrected), scenario.m_dim, 0., 0.);
+      same_blind &= sameTargets(targets, trackedTargets(blinded), scenario.m_dim, 1e-5, 1e-6);
+
+      for (float weight : targets.weight) {
+        weight_sum += weight;
+      }
+    }
+
+    expect(weight_sum > 0., "targets tracked");
+    expect(same_single, fused ? "fused correct() matches propagate()"
+                              : "correct() matches propagate()");
+    expect(same_blind, fused ? "fused empty correction without detection changes nothing"
+                             : "empty correction without detection changes nothing");
+  }
+}
+
+// With an overlap wider than the area, every tile corrects with all the components : the
+// tiled filter is the single one, as long as the merging (within a tile only) is disabled.
+// In double precision, the likelihoods of each tile being centered on its own measurements
+void checkTiledOverlap() {
+  ScenarioConfig const scenario = smallScenario();
+  int const max_gaussians = 400;
+
+  TileGridd const grid(scenario.m_dim, 2, scenario.m_areaSize / 2, 10 * scenario.m_areaSize);
+
+  GMPHDd single(max_gaussians, scenario.m_dim, true);
+  GMPHDTiledd tiled(grid, max_gaussians, scenario.m_dim, true);
+
+  initFilter(single, scenario, max_gaussians);
+  initFilter(tiled, scenario, max_gaussians);
+  single.setPruningParameters(0.1, 1e-6, max_gaussians);
+  tiled.setPruningParameters(0.1, 1e-6, max_gaussians);
+  tiled.setThreads(2);
+
+  Scenario frames(scenario);
+  bool same = true;
+  double weight_sum = 0.;
+
+  for (int frame = 0; frame < 40; ++frame) {
+    frames.step();
+
+    vector<double> const position = converted<double>(frames.measuredPositions());
+    vector<double> const speed = converted<double>(frames.measuredSpeeds());
+
+    single.setNewMeasurements(position, speed);
+    single.propagate();
+    tiled.setNewMeasurements(position, speed);
+    tiled.propagate();
+
+    Targets<double> const targets = trackedTargets(single);
+    same &= sameTargets(targets, trackedTargets(tiled), scenario.m_dim, 1e-8, 1e-10);
+
+    for (double weight : targets.weight) {
+      weight_sum += weight;
+    }
+  }
+
+  expect(weight_sum > 0., "targets tracked");
+  expect(same, "tiled filter with a wide overlap matches the single filter");
+}
+
+// A target crossing the border between two tiles is handed over and keeps being tracked,
+// once, with the usual overlap
+void checkTiledBorder() {
+  ScenarioConfig scenario = smallScenario();
+  scenario.m_clutterRate = 0.f;
+  int const max_gaussians = 50;
+  float const tile_size = scenario.m_areaSize / 2;
+
+  GMPHDTiled tiled(TileGrid(scenario.m_dim, 2, tile_size, 10.f), max_gaussians,
+                   scenario.m_dim, true);
+  initFilter(tiled, scenario, max_gaussians);
+
+  // Straight along x, over the border x = tile_size at the 15th frame
+  float const speed = 2.f / scenario.m_sampling;
+  float x = tile_size - 15 * speed * scenario.m_sampling, y = 0.25f * scenario.m_areaSize;
+
+  bool tracked = true;
+  size_t first_owner = 0, last_owner = 0;
+
+  for (int frame = 0; frame < 30; ++frame) {
+    x += speed * scenario.m_sampling;
+
+    vector<float> const position = {x, y}, velocity = {speed, 0.f};
+    tiled.setNewMeasurements(position, velocity);
+    tiled.propagate();
+
+    if (frame < 3) {
+      continue;
+    }
+
+    Targets<float> const targets = trackedTargets(tiled, 0.5f);
+    bool const single_target = targets.weight.size() == 1 &&
+                               fabs(targets.position[0] - x) < 3.f &&
+                               fabs(targets.position[1] - y) < 3.f;
+    if (!single_target) {
+      printf("  frame %d (x = %.1f) : %zu targets\n", frame, x, targets.weight.size());
+    }
+    tracked &= single_target;
+
+    // Tile of the target : the one with the heaviest component
+    size_t owner = 0;
+    float heaviest = 0.f;
+    for (size_t i = 0; i < tiled.tileCount(); ++i) {
+      Targets<float> const tile_targets = trackedTargets(tiled.tile(i), 0.5f);
+      if (!tile_targets.weight.empty() && tile_targets.weight[0] > heaviest) {
+        heaviest = tile_targets.weight[0];
+        owner = i;
+      }
+    }
+
+    first_owner = frame == 3 ? owner : first_owner;
+    last_owner = owner;
+  }
+
+  expect(tracked, "target tracked once across the tile border");
+  expect(first_owner == 0 && last_owner == 1, "target handed over to the next tile");
+}
+
+// Frame budget below the cost, with a given cost per association (the budget is then
+// counted in associations) : the levers are pulled in order, each as far as possible before
+// the next one. The spawns, then the measurements out of every gate, then the survivors (never
+// above 0.5), then the measurements are subsampled. The targets, within their gates, are kept
+void checkFrameBudget() {
+  ScenarioConfig scenario = smallScenario();
+  scenario.m_clutterRate = 10.f;
+  int const max_gaussians = 50;
+  int const n_warm = 20;
+
+  SpawningModel spawn(scenario.m_dim);
+  spawn.m_weight = 0.05f;
+  spawn.m_trans = MatrixXf::Identity(2 * scenario.m_dim, 2 * scenario.m_dim);
+  spawn.m_cov = MatrixXf::Identity(2 * scenario.m_dim, 2 * scenario.m_dim);
+  vector<SpawningModel> spawns(1, spawn);
+
+  // Same frames for every budget, the last one is budgeted
+  vector<float> truth;
+  auto run = [&](GMPHD &filter, double budget) {
+    initFilter(filter, scenario, max_gaussians);
+    filter.setSpawnModel(spawns);
+
+    Scenario frames(scenario);
+    for (int frame = 0; frame <= n_warm; ++frame) {
+      frames.step();
+
+      if (frame == n_warm) {
+        filter.setFrameBudget(budget, 1.);
+      }
+
+      filter.setNewMeasurements(frames.measuredPositions(), frames.measuredSpeeds());
+      filter.propagate();
+    }
+    truth = frames.truePositions();
+  };
+
+  // True targets with an estimate close by
+  auto tracked = [&](GMPHD &filter) {
+    Targets<float> const targets = trackedTargets(filter, 0.5f);
+    vector<bool> found(truth.size() / scenario.m_dim, false);
+
+    for (size_t t = 0; t < found.size(); ++t) {
+      for (size_t i = 0; i < targets.weight.size() && !found[t]; ++i) {
+        found[t] = fabs(targets.position[i * 2] - truth[t * 2]) < 3.f &&
+                   fabs(targets.position[i * 2 + 1] - truth[t * 2 + 1]) < 3.f;
+      }
+    }
+    return found;
+  };
+
+  GMPHD reference(max_gaussians, scenario.m_dim, true);
+  run(reference, 1e30);
+
+  double const cost = reference.frameStats().m_estimated;
+  vector<bool> const targets = tracked(reference);
+
+  expect(cost > 0. && reference.frameStats().m_degradedFrames == 0,
+         "frame within the budget left alone");
+  expect(std::count(targets.begin(), targets.end(), true) > 0, "targets tracked");
+
+  // From just below the cost down to a few associations
+  vector<FrameStats> levels;
+  vector<bool> kept;
+
+  for (double budget = 0.999 * cost; budget > 1e-4 * cost; budget *= 0.9) {
+    GMPHD filter(max_gaussians, scenario.m_dim, true);
+    run(filter, budget);
+
+    levels.push_back(filter.frameStats());
+    vector<bool> const found = tracked(filter);
+    bool all_found = true;
+    for (size_t t = 0; t < targets.size(); ++t) {
+      all_found &= !targets[t] || found[t];
+    }
+    kept.push_back(all_found);
+  }
+
+  // The tightest budget pulls every lever as far as it goes
+  FrameStats const &last = levels.back();
+  bool ordered = true, counted = true, targets_kept = true;
+  bool spawns_first = false, gate_next = false, survivors_next = false, subsampled_last = false;
+
+  for (size_t l = 0; l < levels.size(); ++l) {
+    FrameStats const &stats = levels[l];
+
+    ordered &= stats.m_gatedMeasurements == 0 || stats.m_droppedSpawns == last.m_droppedSpawns;
+    ordered &= stats.m_truncatedTargets == 0 ||
+               stats.m_gatedMeasurements == last.m_gatedMeasurements;
+    ordered &= stats.m_subsampledMeasurements == 0 ||
+               stats.m_truncatedTargets == last.m_truncatedTargets;
+    ordered &= stats.m_truncationThreshold <= 0.5;
+
+    counted &= stats.m_estimated == cost && stats.m_degradedFrames == 1 &&
+               stats.m_budget < cost;
+
+    spawns_first |= stats.m_droppedSpawns > 0 && stats.m_gatedMeasurements == 0;
+    gate_next |= stats.m_gatedMeasurements > 0 && stats.m_truncatedTargets == 0;
+    survivors_next |= stats.m_truncatedTargets > 0 && stats.m_subsampledMeasurements == 0;
+    subsampled_last |= stats.m_subsampledMeasurements > 0;
+
+    // The measurements of the targets are within the gate
+    if (stats.m_subsampledMeasurements == 0) {
+      targets_kept &= kept[l];
+    }
+  }
+
+  expect(ordered, "levers pulled in order, survivors truncated up to 0.5");
+  expect(counted, "frame statistics count the estimate and the degraded frame");
+  expect(spawns_first && gate_next && survivors_next && subsampled_last,
+         "every lever pulled, one after the other");
+  expect(targets_kept, "targets within the gate kept");
+}
+
+// Identity measurement function : the nonlinear update of linear measurements
+template <typename T> MeasurementModelT<T> identityModel(int n_state) {
+  typedef Matrix<T, Dynamic, Dynamic> MatrixXT;
+
+  auto function = [](Map<MatrixXT const> const &states, Map<MatrixXT> measures) {
+    measures = states;
+  };
+  auto jacobian = [n_state](Map<MatrixXT const> const &states, Map<MatrixXT> jacobians) {
+    for (int i = 0; i < states.cols(); ++i) {
+      jacobians.block(0, i * n_state, n_state, n_state).setIdentity();
+    }
+  };
+  return MeasurementModelT<T>(function, jacobian);
+}
+
+// Identity measurement model, with the residual hooks doing what the filter does without them
+MeasurementModeld hookedIdentityModel(int n_state) {
+  MeasurementModeld model = identityModel<double>(n_state);
+  model.m_difference = [](Map<MatrixXd const> const &lhs, Map<MatrixXd const> const &rhs,
+                          Map<MatrixXd> difference) { difference = lhs - rhs; };
+  model.m_mean = [](Map<MatrixXd const> const &points, Map<MatrixXd const> const &weights,
+                    Map<MatrixXd> mean) { mean = points * weights; };
+  return model;
+}
+
+// Range and bearing of the positions, the speeds as they are. The bearings wrap around at +/- pi
+MeasurementModel rangeBearingModel(bool hooks) {
+  auto function = [](Map<MatrixXf const> const &states, Map<MatrixXf> measures) {
+    measures = states;
+    for (int i = 0; i < states.cols(); ++i) {
+      measures(0, i) = hypot(states(0, i), states(1, i));
+      measures(1, i) = atan2(states(1, i), states(0, i));
+    }
+  };
+  auto jacobian = [](Map<MatrixXf const> const &states, Map<MatrixXf> jacobians) {
+    for (int i = 0; i < states.cols(); ++i) {
+      float const x = states(0, i), y = states(1, i);
+      float const range2 = x * x + y * y, range = sqrt(range2);
+
+      auto block = jacobians.block(0, 4 * i, 4, 4);
+      block.setIdentity();
+      block.topLeftCorner(2, 2) << x / range, y / range, -y / range2, x / range2;
+    }
+  };
+
+  MeasurementModel model(function, jacobian);
+  model.m_noise = Vector4f(1.f, 1e-4f, 0.25f, 0.25f).asDiagonal();
+
+  if (hooks) {
+    model.m_difference = [](Map<MatrixXf const> const &lhs, Map<MatrixXf const> const &rhs,
+                            Map<MatrixXf> difference) {
+      difference = lhs - rhs;
+      for (int i = 0; i < difference.cols(); ++i) {
+        difference(1, i) = remainder(difference(1, i), float(2. * M_PI));
+      }
+    };
+    model.m_mean = [](Map<MatrixXf const> const &points, Map<MatrixXf const> const &weights,
+                      Map<MatrixXf> mean) {
+      mean = points * weights;
+      mean(1, 0) = atan2(points.row(1).array().sin().matrix().dot(weights.col(0)),
+                         points.row(1).array().cos().matrix().dot(weights.col(0)));
+    };
+  }
+
+  return model;
+}
+
+// An identity measurement model is the linear filter, with or without the residual hooks, in
+// both nonlinear updates (in double precision : in float, the rounding of the sigma points
+// builds up through the merged components). A range / bearing sensor follows a target across
+// the +/- pi bearing cut with the hooks, even though it reports its bearings in [0, 2.pi) :
+// without them, the target is lost where both conventions differ
+void checkMeasurementModel() {
+  ScenarioConfig const scenario = smallScenario();
+  int const max_gaussians = 50;
+  int const n_state = 2 * scenario.m_dim;
+  char const *const updates[] = {"unscented", "extended"};
+
+  for (NonlinearUpdate update : {UPDATE_UNSCENTED, UPDATE_EXTENDED}) {
+    for (bool hooks : {false, true}) {
+      GMPHDd linear(max_gaussians, scenario.m_dim, true);
+      GMPHDd modelled(max_gaussians, scenario.m_dim, true);
+      initFilter(linear, scenario, max_gaussians);
+      initFilter(modelled, scenario, max_gaussians);
+      modelled.setMeasurementModel(hooks ? hookedIdentityModel(n_state)
+                                         : identityModel<double>(n_state),
+                                   update);
+
+      Scenario frames(scenario);
+      bool same = true;
+      double weight_sum = 0.;
+
+      for (int frame = 0; frame < 30; ++frame) {
+        frames.step();
+
+        vector<double> const positions = converted<double>(frames.measuredPositions());
+        vector<double> const speeds = converted<double>(frames.measuredSpeeds());
+
+        for (GMPHDd *filter : {&linear, &modelled}) {
+          filter->setNewMeasurements(positions, speeds);
+          filter->propagate();
+        }
+
+        Targets<double> const targets = trackedTargets(linear);
+        same &= sameTargets(targets, trackedTargets(modelled), scenario.m_dim, 3e-4, 3e-4);
+
+        for (double weight : targets.weight) {
+          weight_sum += weight;
+        }
+      }
+
+      printf("  %s%s\n", updates[update], hooks ? ", hooks" : "");
+      expect(weight_sum > 0., "targets tracked");
+      expect(same, "identity measurement model matches the linear filter");
+    }
+  }
+
+  // Target going up at x = -100 : its predicted bearing jumps from -pi to pi halfway, the
+  // measured one is 2.pi away until then
+  for (NonlinearUpdate update : {UPDATE_UNSCENTED, UPDATE_EXTENDED}) {
+    for (bool hooks : {true, false}) {
+      GMPHD filter(max_gaussians, 2, true);
+
+      vector<GaussianModel> births(1, GaussianModel(4));
+      births[0].m_weight = 0.1f;
+      births[0].m_mean << -100.f, -40.f, 0.f, 4.f;
+      births[0].m_cov = Vector4f(100.f, 100.f, 4.f, 4.f).asDiagonal().toDenseMatrix();
+
+      filter.setBirthModel(births);
+      filter.setDynamicsModel(1.f, 0.5f);
+      filter.setObservationModel(0.95f, 1.f, 0.5f, 0.01f);
+      filter.setPruningParameters(0.1f, 3.f, max_gaussians);
+      filter.setSurvivalProbability(0.99f);
+      filter.setMeasurementModel(rangeBearingModel(hooks), update);
+
+      int n_tracked = 0, n_tracked_before = 0;
+
+      for (int frame = 0; frame < 20; ++frame) {
+        float const x = -100.f, y = -40.f + 4.f * frame;
+        float const bearing = atan2(y, x);
+        vector<float> const positions = {hypot(x, y), bearing < 0.f ? bearing + float(2. * M_PI) : bearing};
+        vector<float> const speeds = {0.f, 4.f};
+
+        filter.setNewMeasurements(positions, speeds);
+        filter.propagate();
+
+        Targets<float> const targets = trackedTargets(filter, 0.5f);
+        bool const tracked = targets.weight.size() == 1 &&
+                             hypot(targets.position[0] - x, targets.position[1] - y) < 3.f;
+
+        if (frame >= 3) {
+          n_tracked += tracked;
+          n_tracked_before += tracked && y < 0.f;
+        }
+      }
+
+      printf("  range / bearing, %s%s : tracked %d frames, %d before the cut\n", updates[update],
+             hooks ? ", hooks" : "", n_tracked, n_tracked_before);
+
+      if (hooks) {
+        expect(n_tracked == 17, "target tracked across the bearing cut");
+      } else {
+        expect(n_tracked_before == 0, "target lost without the hooks");
+      }
+    }
+  }
+}
+
+// The births of a mapped file (setBirthGrid()) are the same births as with setBirthModel(),
+// with a single correction, sequential ones, and the nonlinear updates. A header whose sizes
+// overflow is rejected
+void checkBirthGrid() {
+  ScenarioConfig const scenario = smallScenario();
+  int const max_gaussians = 50;
+  int const n_state = 2 * scenario.m_dim;
+  char const *const path = "gmphd_checks_births.bin";
+
+  expect(BirthGrid::save(path, areaBirths<float>(scenario)), "birth grid saved");
+
+  BirthGrid grid;
+  expect(grid.open(path), "birth grid mapped");
+
+  GMPHD::SensorModel const first(scenario.m_pDetection, scenario.m_measNoisePose,
+                                 scenario.m_measNoiseSpeed, 0.5f);
+  GMPHD::SensorModel const second(0.7f, 2.f * scenario.m_measNoisePose,
+                                  scenario.m_measNoiseSpeed, 0.5f);
+  char const *const modes[] = {"single", "sequential", "unscented", "extended"};
+
+  for (int mode = 0; mode < 4 && grid.isOpen(); ++mode) {
+    GMPHD modelled(max_gaussians, scenario.m_dim, true);
+    GMPHD mapped(max_gaussians, scenario.m_dim, true);
+    initFilter(modelled, scenario, max_gaussians);
+    initFilter(mapped, scenario, max_gaussians);
+
+    vector<GaussianModel> no_births;
+    mapped.setBirthModel(no_births);
+    mapped.setBirthGrid(&grid);
+
+    if (mode >= 2) {
+      NonlinearUpdate const update = mode == 2 ? UPDATE_UNSCENTED : UPDATE_EXTENDED;
+      modelled.setMeasurementModel(identityModel<float>(n_state), update);
+      mapped.setMeasurementModel(identityModel<float>(n_state), update);
+    }
+
+    Scenario frames(scenario);
+    bool same = true;
+    double weight_sum = 0.;
+
+    for (int frame = 0; frame < 30; ++frame) {
+      frames.step();
+
+      for (GMPHD *filter : {&modelled, &mapped}) {
+        if (mode == 1) {
+          // The same measurements seen twice, by two sensors
+          filter->predict();
+          filter->correct(frames.measuredPositions(), frames.measuredSpeeds(), first);
+          filter->correct(frames.measuredPositions(), frames.measuredSpeeds(), second);
+          filter->prune();
+        } else {
+          filter->setNewMeasurements(frames.measuredPositions(), frames.measuredSpeeds());
+          filter->propagate();
+        }
+      }
+
+      Targets<float> const targets = trackedTargets(modelled);
+      same &= sameTargets(targets, trackedTargets(mapped), scenario.m_dim, 1e-3, 1e-4);
+
+      for (float weight : targets.weight) {
+        weight_sum += weight;
+      }
+    }
+
+    printf("  %s\n", modes[mode]);
+    expect(weight_sum > 0., "targets tracked");
+    expect(same, "mapped births match the birth model");
+  }
+
+  // Dimension and count which would wrap n.dim^2 around
+  vector<uint64_t> buffer(sizeof(BirthGridHeader) / sizeof(uint64_t) + 64, 0);
+  BirthGridHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.m_magic, BIRTH_GRID_MAGIC, sizeof(header.m_magic));
+  header.m_version = BIRTH_GRID_VERSION;
+  header.m_scalarSize = sizeof(float);
+  header.m_fileSize = buffer.size() * sizeof(uint64_t);
+  header.m_weights = header.m_means = header.m_covariances = BIRTH_GRID_ALIGNMENT;
+  header.m_count = 1u << 31;
+  header.m_dim = 1u << 31;
+  memcpy(buffer.data(), &header, sizeof(header));
+
+  BirthGrid corrupted;
+  expect(!corrupted.map(reinterpret_cast<char const *>(buffer.data()),
+                        buffer.size() * sizeof(uint64_t)),
+         "overflowing birth grid rejected");
+
+  grid.close();
+  remove(path);
+}
+
+// Factor stored by a 1D compact mixture for a variance of factor^2, -1 if it stays out
+double compactFactor(double factor, CompactFormat format) {
+  CompactMixtured compact(1, format);
+  GaussianMixtured mixture(1);
+
+  mixture.m_gaussians.assign(1, GaussianModeld(1));
+  mixture.m_gaussians[0].m_weight = 0.01;
+  mixture.m_gaussians[0].m_cov(0, 0) = factor * factor;
+
+  compact.compact(mixture, 1.);
+  if (compact.size() != 1 || !mixture.m_gaussians.empty()) {
+    return -1.;
+  }
+
+  compact.expand(mixture);
+  return sqrt(mixture.m_gaussians[0].m_cov(0, 0));
+}
+
+// The 16 bits factors round to nearest even, keep the subnormal halves, reject what does not
+// fit (or is not positive definite), and decode back exactly as L.L^T
+void checkCompactEncoding() {
+  double const half_ulp = ldexp(1., -11), bf16_half_ulp = ldexp(1., -8);
+
+  // Ties to even, and just above a tie
+  expect(compactFactor(1. + half_ulp, COMPACT_FLOAT16) == 1. &&
+             compactFactor(1. + 3 * half_ulp, COMPACT_FLOAT16) == 1. + 4 * half_ulp &&
+             compactFactor(1. + 1.5 * half_ulp, COMPACT_FLOAT16) == 1. + 2 * half_ulp,
+         "half precision rounds to nearest even");
+  expect(compactFactor(1. + bf16_half_ulp, COMPACT_BFLOAT16) == 1. &&
+             compactFactor(1. + 3 * bf16_half_ulp, COMPACT_BFLOAT16) == 1. + 4 * bf16_half_ulp,
+         "bfloat16 rounds to nearest even");
+
+  // Half subnormals : multiples of 2^-24 below 2^-14, rounded as well
+  double const subnormal = ldexp(1., -24);
+  expect(compactFactor(5 * subnormal, COMPACT_FLOAT16) == 5 * subnormal &&
+             compactFactor(1000.5 * subnormal, COMPACT_FLOAT16) == 1000 * subnormal &&
+             compactFactor(1001.5 * subnormal, COMPACT_FLOAT16) == 1002 * subnormal,
+         "half precision subnormals");
+
+  // Largest half is 65504, 65520 and above round to infinity
+  expect(compactFactor(65504., COMPACT_FLOAT16) == 65504. &&
+             compactFactor(65520., COMPACT_FLOAT16) < 0. &&
+             compactFactor(1e6, COMPACT_FLOAT16) < 0.,
+         "out of the half range stays in the mixture");
+  expect(compactFactor(1e6, COMPACT_BFLOAT16) > 0.99e6 &&
+             compactFactor(1e6, COMPACT_BFLOAT16) < 1.01e6,
+         "bfloat16 keeps the single precision range");
+
+  // Not positive definite
+  CompactMixture compact(2);
+  GaussianMixture mixture(2);
+  mixture.m_gaussians.assign(1, GaussianModel(2));
+  mixture.m_gaussians[0].m_weight = 0.01f;
+  mixture.m_gaussians[0].m_cov(0, 1) = 2.f;
+  compact.compact(mixture, 1.f);
+  expect(compact.size() == 0 && mixture.m_gaussians.size() == 1,
+         "not positive definite stays in the mixture");
+
+  // A factor exact in 16 bits comes back as L.L^T, in both formats
+  int const dim = 4;
+  MatrixXd factor = MatrixXd::Zero(dim, dim);
+  for (int j = 0; j < dim; ++j) {
+    for (int i = j; i < dim; ++i) {
+      factor(i, j) = i == j ? 2. + 0.25 * i : 0.125 * (i - j) - 0.5;
+    }
+  }
+
+  MatrixXd const cov = factor * factor.transpose();
+
+  for (CompactFormat format : {COMPACT_FLOAT16, COMPACT_BFLOAT16}) {
+    CompactMixtured compact(dim, format);
+    GaussianMixtured mixture(dim);
+
+    mixture.m_gaussians.assign(3, GaussianModeld(dim));
+    for (int g = 0; g < 3; ++g) {
+      mixture.m_gaussians[g].m_weight = 0.01 * (g + 1);
+      mixture.m_gaussians[g].m_mean.setConstant(1000. + g);
+      mixture.m_gaussians[g].m_cov = cov;
+    }
+
+    compact.compact(mixture, 1.);
+    expect(compact.size() == 3 && compact.memoryUsage() == 3 * (5 * sizeof(double) + 10 * 2),
+           "compact components stored packed");
+
+    compact.expand(mixture);
+    bool same = mixture.m_gaussians.size() == 3;
+
+    for (int g = 0; g < 3 && same; ++g) {
+      GaussianModeld const &model = mixture.m_gaussians[g];
+      same &= model.m_weight == 0.01 * (g + 1) && model.m_mean.isConstant(1000. + g) &&
+              (model.m_cov.dense() - cov).cwiseAbs().maxCoeff() < 1e-12;
+    }
+
+    expect(same && compact.size() == 0, format == COMPACT_FLOAT16
+                                            ? "half precision factor decoded as L.L^T"
+                                            : "bfloat16 factor decoded as L.L^T");
+  }
+}
+
+// The compact tier only holds components below the extraction threshold : the tracked targets
+// are the same as without it, up to the rounding of the light components merged into them
+void checkCompactStorage() {
+  ScenarioConfig const scenario = smallScenario();
+  int const max_gaussians = 50;
+
+  for (CompactFormat format : {COMPACT_FLOAT16, COMPACT_BFLOAT16}) {
+    GMPHD plain(max_gaussians, scenario.m_dim, true);
+    GMPHD compacted(max_gaussians, scenario.m_dim, true);
+
+    for (GMPHD *filter : {&plain, &compacted}) {
+      initFilter(*filter, scenario, max_gaussians);
+      filter->setPruningParameters(0.01f, 3.f, max_gaussians);
+    }
+
+    compacted.setCompactStorage(0.1f, format);
+
+    Scenario frames(scenario);
+    bool same = true;
+    size_t n_compact = 0;
+
+    for (int frame = 0; frame < 30; ++frame) {
+      frames.step();
+
+      for (GMPHD *filter : {&plain, &compacted}) {
+        filter->setNewMeasurements(frames.measuredPositions(), frames.measuredSpeeds());
+        filter->propagate();
+      }
+
+      same &= sameTargets(trackedTargets(plain), trackedTargets(compacted), scenario.m_dim,
+                          1e-3, 1e-4);
+      n_compact += compacted.compactTargets().size();
+    }
+
+    expect(n_compact > 0, "components compacted");
+    expect(same, format == COMPACT_FLOAT16 ? "half precision storage keeps the targets"
+                                           : "bfloat16 storage keeps the targets");
+  }
+}
+
+// The histogram of the daemon gives the percentiles of the sorted latencies, within a bucket
+void checkLatencyHistogram() {
+  std::mt19937 generator(7);
+  std::lognormal_distribution<double> distribution(4., 1.);
+
+  vector<double> latencies;
+  LatencyHistogram histogram;
+
+  for (int i = 0; i < 100000; ++i) {
+    latencies.push_back(distribution(generator));
+    histogram.add(latencies.back());
+  }
+  histogram.add(0.);
+  latencies.push_back(0.);
+
+  LatencySummary const exact = summarizeLatencies(latencies);
+  LatencySummary const streamed = histogram.summary();
+
+  // Bucket centers are at most half a bucket away
+  double const tolerance = exp2(0.5 / LATENCY_BUCKETS_PER_OCTAVE) - 1. + 1e-9;
+  auto close = [&](double lhs, double rhs) { return fabs(lhs - rhs) <= tolerance * rhs; };
+
+  expect(streamed.m_count == exact.m_count && streamed.m_max == exact.m_max &&
+             fabs(streamed.m_mean - exact.m_mean) < 1e-9 * exact.m_mean,
+         "count, mean and max are exact");
+  expect(close(streamed.m_p50, exact.m_p50) && close(streamed.m_p90, exact.m_p90) &&
+             close(streamed.m_p99, exact.m_p99) && close(streamed.m_p999, exact.m_p999),
+         "percentiles within a bucket");
+}
+
+// Shared memory segment, both ends in this process : the rings wrap around and refuse a frame
+// when full, the seqlock tells a consistent read from one overlapping a publication
+void checkSharedMemory() {
+  string const name = "gmphd_checks_" + to_string(getpid());
+
+  SegmentConfig config;
+  config.m_dim = 2;
+  config.m_nProducers = 2;
+  config.m_nSlots = 4;
+  config.m_maxMeasurements = 3;
+  config.m_maxTargets = 2;
+
+  TrackingSegment daemon, client;
+  if (!daemon.create(name, config) || !client.open(name)) {
+    expect(false, "segment created and opened");
+    return;
+  }
+
+  expect(client.config().m_nSlots == 4 && client.config().m_maxTargets == 2,
+         "configuration shared");
+
+  // Frame f : measurement m at (f, m), speed (-f, m), f + 1 measurements (3 kept)
+  auto push = [&](int f) {
+    vector<float> positions, speeds;
+    for (int m = 0; m <= f; ++m) {
+      positions.insert(positions.end(), {float(f), float(m)});
+      speeds.insert(speeds.end(), {float(-f), float(m)});
+    }
+    return client.push(0, 0.1 * f, positions.data(), f % 2 ? speeds.data() : NULL, f + 1);
+  };
+
+  auto popped = [&](int f) {
+    FrameView frame;
+    if (!daemon.front(0, frame)) {
+      return false;
+    }
+
+    bool same = frame.m_timestamp == 0.1 * f && frame.m_nMeasurements == uint32_t(std::min(f + 1, 3));
+    for (uint32_t m = 0; m < frame.m_nMeasurements; ++m) {
+      same &= frame.m_positions[2 * m] == f && frame.m_positions[2 * m + 1] == m;
+      same &= f % 2 ? (frame.m_speeds[2 * m] == -f && frame.m_speeds[2 * m + 1] == m)
+                    : (frame.m_speeds[2 * m] == 0.f && frame.m_speeds[2 * m + 1] == 0.f);
+    }
+
+    daemon.pop(0);
+    return same;
+  };
+
+  bool ring = push(0) && push(1) && push(2) && push(3);
+  expect(ring && !push(4), "full ring refuses a frame");
+
+  FrameView frame;
+  expect(!daemon.front(1, frame), "other producer ring empty");
+
+  // Two out, four in : the last two wrap around
+  ring = popped(0) && popped(1) && push(4) && push(5) && !push(6);
+  ring &= popped(2) && popped(3) && popped(4) && popped(5);
+  expect(ring, "frames read in order through the wrap around, extra measurements dropped");
+  expect(!daemon.front(0, frame), "ring empty once read");
+
+  // Output : 3 targets published, 2 kept
+  float const positions[] = {1.f, 2.f, 3.f, 4.f, 5.f, 6.f};
+  float const speeds[] = {0.f, 1.f, 0.f, 1.f, 0.f, 1.f};
+  float const weights[] = {0.9f, 0.8f, 0.7f};
+  daemon.publish(7, 0.7, positions, speeds, weights, 3);
+
+  uint64_t sequence = client.beginRead();
+  bool const read = client.outputFrame() == 7 && client.outputTimestamp() == 0.7 &&
+                    client.outputCount() == 2 && client.outputPositions()[3] == 4.f &&
+                    client.outputSpeeds()[3] == 1.f && client.outputWeights()[1] == 0.8f;
+  expect(sequence % 2 == 0 && read && client.endRead(sequence), "consistent read");
+
+  sequence = client.beginRead();
+  daemon.publish(8, 0.8, positions, speeds, weights, 1);
+  expect(!client.endRead(sequence), "read overlapping a publication retried");
+
+  sequence = client.beginRead();
+  expect(client.outputFrame() == 8 && client.outputCount() == 1 && client.endRead(sequence),
+         "read again");
+
+  daemon.setDaemonRunning(true);
+  client.requestStop();
+  expect(client.daemonRunning() && daemon.stopRequested(), "liveness and stop request");
+
+  client.close();
+  daemon.close();
+
+  TrackingSegment late;
+  expect(!late.open(name), "segment removed by its creator");
+}
+
+struct Check {
+  char const *name;
+  void (*run)();
+};
+
+Check const CHECKS[] = {
+    {"fused_update", &checkFusedUpdate},
+    {"snapshot", &checkSnapshot},
+    {"precisions", &checkPrecisions},
+    {"kernels", &checkKernels},
+    {"inverses", &checkInverses},
+    {"merging_positions", &checkMergingPositions},
+    {"parallel_merging", &checkParallelMerging},
+    {"referential", &checkReferential},
+    {"referential_in_frame", &checkReferentialInFrame},
+    {"smoother", &checkSmoother},
+    {"clustering", &checkClustering},
+    {"replay", &checkReplay},
+    {"corrections", &checkCorrections},
+    {"tiled_overlap", &checkTiledOverlap},
+    {"tiled_border", &checkTiledBorder},
+    {"frame_budget", &checkFrameBudget},
+    {"measurement_model", &checkMeasurementModel},
+    {"birth_grid", &checkBirthGrid},
+    {"compact_encoding", &checkCompactEncoding},
+    {"compact_storage", &checkCompactStorage},
+    {"latency_histogram", &checkLatencyHistogram},
+    {"shared_memory", &checkSharedMemory},
+};
+
+int const N_CHECKS = sizeof(CHECKS) / sizeof(CHECKS[0]);
+
+bool runCheck(Check const &check) {
+  printf("%s\n", check.name);
+  g_failures = 0;
+
+  check.run();
+  bool const passed = g_failures == 0;
+
+  printf("%s : %s\n", check.name, passed ? "passed" : "FAILED");
+  return passed;
+}
+}
+
+int main(int argc, char **argv) {
+  int n_failed = 0;
+
+  if (argc < 2) {
+    for (int c = 0; c < N_CHECKS; ++c) {
+      n_failed += runCheck(CHECKS[c]) ? 0 : 1;
+    }
+    return n_failed > 0 ? 1 : 0;
+  }
+
+  for (int i = 1; i < argc; ++i) {
+    bool found = false;
+
+    for (int c = 0; c < N_CHECKS && !found; ++c) {
+      if (strcmp(argv[i], CHECKS[c].name) == 0) {
+        n_failed += runCheck(CHECKS[c]) ? 0 : 1;
+        found = true;
+      }
+    }
+
+    if (!found) {
+      printf("Unknown check %s\n", argv[i]);
+      ++n_failed;
+    }
+  }
+
+  return n_failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,328 @@
+/*
+ * Tracking daemon : hosts GMPHD filters for several processes on the same host.
+ * Each channel is a shared memory segment (see shm_tracking.h) with its own filter :
+ * producers push measurement frames through their lock-free ring, the daemon predicts
+ * to the oldest pending timestamp, corrects with every frame at that timestamp (one per
+ * producer, as separate sensors), prunes, and publishes the tracked targets to the
+ * output region which consumers read in place.
+ *
+ * Usage : gmphd_daemon [--name name] [--channels n] [--producers n] [--dim 2|3]
+ *                      [--slots n] [--max-measurements n] [--max-targets n]
+ *                      [--area size] [--births n_per_axis] [--sampling s]
+ *                      [--process-noise q] [--pd p] [--noise pose] [--speed-noise s]
+ *                      [--background b] [--max-gaussians n] [--extract thld]
+ *                      [--bounded] [--idle-us n]
+ * Runs until SIGINT / SIGTERM, or a stop request from a client (gmphd_shm_client --stop).
+ */
+
+#include "gmphd_filter.h"
+#include "latency.h"
+#include "shm_tracking.h"
+#include <chrono>
+#include <memory>
+#include <signal.h>
+#include <stdlib.h>
+#include <thread>
+
+using namespace std;
+
+namespace {
+struct DaemonConfig {
+  string name = "gmphd";
+  int n_channels = 1;
+  SegmentConfig segment;
+  float area = 1000.f;
+  int births_per_axis = 4;
+  float sampling = 1.f;
+  float process_noise = 1.5f;
+  float max_speed = 10.f;
+  float p_detection = 0.9f;
+  float noise_pose = 2.f;
+  float noise_speed = 1.f;
+  float background = 0.5f;
+  int max_gaussians = 200;
+  float extract_thld = 0.5f;
+  bool bounded = false;
+  int idle_us = 100;
+};
+
+volatile sig_atomic_t interrupted = 0;
+
+void onSignal(int) { interrupted = 1; }
+
+void printUsage(char const *name) {
+  printf("Usage : %s [--name name] [--channels n] [--producers n] [--dim 2|3]\n"
+         "          [--slots n] [--max-measurements n] [--max-targets n]\n"
+         "          [--area size] [--births n_per_axis] [--sampling s]\n"
+         "          [--process-noise q] [--pd p] [--noise pose] [--speed-noise s]\n"
+         "          [--background b] [--max-gaussians n] [--extract thld]\n"
+         "          [--bounded] [--idle-us n]\n",
+         name);
+}
+
+bool parseArguments(int argc, char **argv, DaemonConfig &config) {
+  for (int i = 1; i < argc; ++i) {
+    string const arg = argv[i];
+    bool const has_value = i + 1 < argc;
+
+    if (arg == "--help") {
+      printUsage(argv[0]);
+      return false;
+    } else if (arg == "--bounded") {
+      config.bounded = true;
+    } else if (!has_value) {
+      printf("Missing value for %s\n", arg.c_str());
+      return false;
+    } else if (arg == "--name") {
+      config.name = argv[++i];
+    } else if (arg == "--channels") {
+      config.n_channels = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--producers") {
+      config.segment.m_nProducers = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--dim") {
+      config.segment.m_dim = atoi(argv[++i]);
+    } else if (arg == "--slots") {
+      config.segment.m_nSlots = atoi(argv[++i]);
+    } else if (arg == "--max-measurements") {
+      config.segment.m_maxMeasurements = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--max-targets") {
+      config.segment.m_maxTargets = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--area") {
+      config.area = atof(argv[++i]);
+    } else if (arg == "--births") {
+      config.births_per_axis = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--sampling") {
+      config.sampling = atof(argv[++i]);
+    } else if (arg == "--process-noise") {
+      config.process_noise = atof(argv[++i]);
+    } else if (arg == "--pd") {
+      config.p_detection = atof(argv[++i]);
+    } else if (arg == "--noise") {
+      config.noise_pose = atof(argv[++i]);
+    } else if (arg == "--speed-noise") {
+      config.noise_speed = atof(argv[++i]);
+    } else if (arg == "--background") {
+      config.background = atof(argv[++i]);
+    } else if (arg == "--max-gaussians") {
+      config.max_gaussians = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--extract") {
+      config.extract_thld = atof(argv[++i]);
+    } else if (arg == "--idle-us") {
+      config.idle_us = std::max(0, atoi(argv[++i]));
+    } else {
+      printf("Unknown argument %s\n", arg.c_str());
+      return false;
+    }
+  }
+
+  if (config.segment.m_dim != 2 && config.segment.m_dim != 3) {
+    printf("Only 2D and 3D tracking is supported\n");
+    return false;
+  }
+
+  return true;
+}
+
+// One segment, and the filter fed by its producers
+struct Channel {
+  TrackingSegment segment;
+  unique_ptr<GMPHD> filter;
+  GMPHD::SensorModel sensor;
+  uint64_t n_frames = 0;
+
+  vector<FrameView> frames;
+  vector<bool> pending;
+  vector<float> position;
+  vector<float> speed;
+  vector<float> tracked_position;
+  vector<float> tracked_speed;
+  vector<float> tracked_weight;
+};
+
+string channelName(DaemonConfig const &config, int channel) {
+  return config.n_channels == 1 ? config.name
+                                : config.name + "." + to_string(channel);
+}
+
+void initFilter(GMPHD &filter, DaemonConfig const &config) {
+  int const dim = config.segment.m_dim;
+  int const n_axis = config.births_per_axis;
+  float const cell = config.area / n_axis;
+
+  int n_births = 1;
+  for (int d = 0; d < dim; ++d) {
+    n_births *= n_axis;
+  }
+
+  // A regular grid of wide births over the area, as gmphd_loadtest does
+  vector<GaussianModel> births;
+  for (int i = 0; i < n_births; ++i) {
+    GaussianModel birth(2 * dim);
+    birth.m_weight = 0.1f;
+
+    int index = i;
+    for (int d = 0; d < dim; ++d) {
+      birth.m_mean(d, 0) = (index % n_axis + 0.5f) * cell;
+      index /= n_axis;
+    }
+
+    for (int d = 0; d < dim; ++d) {
+      birth.m_cov(d, d) = cell * cell;
+      birth.m_cov(dim + d, dim + d) = config.max_speed * config.max_speed;
+    }
+    births.push_back(birth);
+  }
+
+  filter.setBirthModel(births);
+  filter.setDynamicsModel(config.sampling, config.process_noise);
+  filter.setObservationModel(config.p_detection, config.noise_pose,
+                             config.noise_speed, config.background);
+  filter.setPruningParameters(0.1f, 3.f, config.max_gaussians);
+}
+
+bool openChannel(Channel &channel, DaemonConfig const &config, int index) {
+  if (!channel.segment.create(channelName(config, index), config.segment)) {
+    return false;
+  }
+
+  SegmentConfig const &segment = config.segment;
+  int const dim = segment.m_dim;
+
+  if (config.bounded) {
+    int n_births = 1;
+    for (int d = 0; d < dim; ++d) {
+      n_births *= config.births_per_axis;
+    }
+
+    channel.filter.reset(new GMPHD(
+        GMPHDCapacity(config.max_gaussians, segment.m_maxMeasurements, n_births, 0),
+        dim, true));
+  } else {
+    channel.filter.reset(new GMPHD(config.max_gaussians, dim, true));
+  }
+
+  initFilter(*channel.filter, config);
+
+  channel.sensor = GMPHD::SensorModel(config.p_detection, config.noise_pose,
+                                      config.noise_speed, config.background);
+
+  channel.frames.resize(segment.m_nProducers);
+  channel.pending.resize(segment.m_nProducers);
+  channel.position.reserve(segment.m_maxMeasurements * dim);
+  channel.speed.reserve(segment.m_maxMeasurements * dim);
+
+  channel.segment.setDaemonRunning(true);
+  printf("Channel %s : %u producer(s), %u slots, up to %u measurements per frame\n",
+         channelName(config, index).c_str(), segment.m_nProducers,
+         segment.m_nSlots, segment.m_maxMeasurements);
+  return true;
+}
+
+// Processes the oldest pending timestamp of the channel, false if there was none
+bool processFrame(Channel &channel, DaemonConfig const &config) {
+  uint32_t const n_producers = config.segment.m_nProducers;
+  uint32_t const dim = config.segment.m_dim;
+
+  bool any = false;
+  double timestamp = 0.;
+  for (uint32_t p = 0; p < n_producers; ++p) {
+    channel.pending[p] = channel.segment.front(p, channel.frames[p]);
+
+    if (channel.pending[p] && (!any || channel.frames[p].m_timestamp < timestamp)) {
+      timestamp = channel.frames[p].m_timestamp;
+      any = true;
+    }
+  }
+
+  if (!any) {
+    return false;
+  }
+
+  // Producers sharing the timestamp are fused as several sensors, the later
+  // frames wait for the next round
+  GMPHD &filter = *channel.filter;
+  filter.predict(timestamp);
+
+  for (uint32_t p = 0; p < n_producers; ++p) {
+    FrameView const &frame = channel.frames[p];
+    if (!channel.pending[p] || frame.m_timestamp != timestamp) {
+      continue;
+    }
+
+    size_t const n_values = size_t(frame.m_nMeasurements) * dim;
+    channel.position.assign(frame.m_positions, frame.m_positions + n_values);
+    channel.speed.assign(frame.m_speeds, frame.m_speeds + n_values);
+    channel.segment.pop(p);
+
+    filter.correct(channel.position, channel.speed, channel.sensor);
+  }
+
+  filter.prune();
+
+  filter.getTrackedTargets(channel.tracked_position, channel.tracked_speed,
+                           channel.tracked_weight, config.extract_thld);
+
+  channel.segment.publish(++channel.n_frames, timestamp,
+                          channel.tracked_position.data(),
+                          channel.tracked_speed.data(),
+                          channel.tracked_weight.data(),
+                          channel.tracked_weight.size());
+  return true;
+}
+}
+
+int main(int argc, char **argv) {
+  DaemonConfig config;
+  if (!parseArguments(argc, argv, config)) {
+    return 1;
+  }
+
+  vector<unique_ptr<Channel> > channels;
+  for (int c = 0; c < config.n_channels; ++c) {
+    channels.push_back(unique_ptr<Channel>(new Channel));
+    if (!openChannel(*channels.back(), config, c)) {
+      return 1;
+    }
+  }
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+
+  // Runs for as long as it is fed : the latencies go to a histogram, not a list
+  LatencyHistogram latencies;
+  bool stop = false;
+
+  while (!stop && !interrupted) {
+    bool busy = false;
+
+    for (auto &channel : channels) {
+      auto const start = chrono::steady_clock::now();
+
+      if (processFrame(*channel, config)) {
+        latencies.add(chrono::duration<double, micro>(
+                          chrono::steady_clock::now() - start)
+                          .count());
+        busy = true;
+      }
+
+      stop = stop || channel->segment.stopRequested();
+    }
+
+    if (!busy && config.idle_us > 0) {
+      this_thread::sleep_for(chrono::microseconds(config.idle_us));
+    }
+  }
+
+  for (auto &channel : channels) {
+    channel->segment.setDaemonRunning(false);
+    channel->segment.close();
+  }
+
+  LatencySummary const summary = latencies.summary();
+  if (summary.m_count > 0) {
+    printf("Processed %zu frames\n", summary.m_count);
+    printLatencies(summary, "us");
+  }
+
+  return 0;
+}
@@ -0,0 +1,624 @@
+/*
+ * Headless load test : drives a GMPHD filter with a synthetic scenario
+ * (see scenario.h) and reports throughput, latencies and tracking quality (OSPA).
+ *
+ * Usage : gmphd_loadtest [--dim 2|3] [--targets n] [--clutter rate] [--frames n]
+ *                        [--pd p] [--motion cv|ct|rw|mixed] [--spawn p] [--death p]
+ *                        [--jitter j] [--sensors n] [--tiles n_per_axis]
+ *                        [--returns n] [--extent e] [--cluster voxel]
+ *                        [--overlap d] [--tile-threads n]
+ *                        [--area size] [--births n_per_axis] [--birth-file path]
+ *                        [--trunc thld]
+ *                        [--max-gaussians n] [--fused] [--merge-threads n] [--threads n]
+ *                        [--compact thld] [--bf16] [--bounded] [--max-measurements n] [--check-allocations]
+ *                        [--budget us] [--smooth lag] [--ospa-cutoff c] [--ospa-every n] [--record log]
+ *                        [--seed s] [--double]
+ */
+
+#include "alloc_counter.h"
+#include "gmphd_recorder.h"
+#include "gmphd_tiled.h"
+#include "latency.h"
+#include "scenario.h"
+#include <chrono>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace std;
+
+namespace {
+struct LoadTestConfig {
+  ScenarioConfig scenario;
+  int n_frames = 100;
+  int births_per_axis = 4;
+  int max_gaussians = 0;
+  float trunc_thld = 0.1f;
+  float merge_thld = 3.f;
+  float background = 0.5f;
+  float extract_thld = 0.5f;
+  float ospa_cutoff = 20.f;
+  int ospa_every = 1;
+  int smoothing_lag = 0;
+  float budget = 0.f;
+  float voxel = 0.f;
+  int merge_threads = 1;
+  int threads = 1;
+  int max_measurements = 0;
+  int tiles = 1;
+  int tile_threads = 1;
+  float overlap = -1.f;
+  float compact_thld = 0.f;
+  bool bf16 = false;
+  bool fused = false;
+  bool bounded = false;
+  bool check_allocations = false;
+  bool double_precision = false;
+  string record;
+  string birth_file;
+};
+
+void printUsage(char const *name) {
+  printf("Usage : %s [--dim 2|3] [--targets n] [--clutter rate] [--frames n]\n"
+         "          [--pd p] [--motion cv|ct|rw|mixed] [--spawn p] [--death p]\n"
+         "          [--jitter j] [--sensors n] [--tiles n_per_axis]\n"
+         "          [--returns n] [--extent e] [--cluster voxel]\n"
+         "          [--overlap d] [--tile-threads n]\n"
+         "          [--area size] [--births n_per_axis] [--birth-file path]\n"
+         "          [--trunc thld]\n"
+         "          [--max-gaussians n] [--fused] [--merge-threads n] [--threads n]\n"
+         "          [--compact thld] [--bf16] [--bounded] [--max-measurements n] [--check-allocations]\n"
+         "          [--budget us] [--smooth lag] [--ospa-cutoff c] [--ospa-every n] [--record log]\n"
+         "          [--seed s] [--double]\n",
+         name);
+}
+
+bool parseArguments(int argc, char **argv, LoadTestConfig &config) {
+  for (int i = 1; i < argc; ++i) {
+    string const arg = argv[i];
+    bool const has_value = i + 1 < argc;
+
+    if (arg == "--help") {
+      printUsage(argv[0]);
+      return false;
+    } else if (arg == "--fused") {
+      config.fused = true;
+    } else if (arg == "--double") {
+      config.double_precision = true;
+    } else if (arg == "--bounded") {
+      config.bounded = true;
+    } else if (arg == "--bf16") {
+      config.bf16 = true;
+    } else if (arg == "--check-allocations") {
+      config.check_allocations = true;
+    } else if (!has_value) {
+      printf("Missing value for %s\n", arg.c_str());
+      return false;
+    } else if (arg == "--dim") {
+      config.scenario.m_dim = atoi(argv[++i]);
+    } else if (arg == "--targets") {
+      config.scenario.m_nTargets = atoi(argv[++i]);
+    } else if (arg == "--clutter") {
+      config.scenario.m_clutterRate = atof(argv[++i]);
+    } else if (arg == "--frames") {
+      config.n_frames = atoi(argv[++i]);
+    } else if (arg == "--pd") {
+      config.scenario.m_pDetection = atof(argv[++i]);
+    } else if (arg == "--spawn") {
+      config.scenario.m_spawnRate = atof(argv[++i]);
+    } else if (arg == "--death") {
+      config.scenario.m_deathRate = atof(argv[++i]);
+    } else if (arg == "--jitter") {
+      config.scenario.m_jitter = atof(argv[++i]);
+    } else if (arg == "--sensors") {
+      config.scenario.m_nSensors = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--tiles") {
+      config.tiles = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--overlap") {
+      config.overlap = atof(argv[++i]);
+    } else if (arg == "--tile-threads") {
+      config.tile_threads = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--area") {
+      config.scenario.m_areaSize = atof(argv[++i]);
+    } else if (arg == "--seed") {
+      config.scenario.m_seed = atoi(argv[++i]);
+    } else if (arg == "--births") {
+      config.births_per_axis = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--trunc") {
+      config.trunc_thld = atof(argv[++i]);
+    } else if (arg == "--max-gaussians") {
+      config.max_gaussians = atoi(argv[++i]);
+    } else if (arg == "--max-measurements") {
+      config.max_measurements = atoi(argv[++i]);
+    } else if (arg == "--compact") {
+      config.compact_thld = atof(argv[++i]);
+    } else if (arg == "--merge-threads") {
+      config.merge_threads = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--threads") {
+      config.threads = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--ospa-cutoff") {
+      config.ospa_cutoff = atof(argv[++i]);
+    } else if (arg == "--ospa-every") {
+      config.ospa_every = atoi(argv[++i]);
+    } else if (arg == "--returns") {
+      config.scenario.m_returns = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--extent") {
+      config.scenario.m_extent = atof(argv[++i]);
+    } else if (arg == "--cluster") {
+      config.voxel = atof(argv[++i]);
+    } else if (arg == "--budget") {
+      config.budget = atof(argv[++i]);
+    } else if (arg == "--smooth") {
+      config.smoothing_lag = std::max(0, atoi(argv[++i]));
+    } else if (arg == "--record") {
+      config.record = argv[++i];
+    } else if (arg == "--birth-file") {
+      config.birth_file = argv[++i];
+    } else if (arg == "--motion") {
+      string const motion = argv[++i];
+      if (motion == "cv") {
+        config.scenario.m_motion = MOTION_CONSTANT_VELOCITY;
+      } else if (motion == "ct") {
+        config.scenario.m_motion = MOTION_COORDINATED_TURN;
+      } else if (motion == "rw") {
+        config.scenario.m_motion = MOTION_RANDOM_WALK;
+      } else if (motion == "mixed") {
+        config.scenario.m_motion = MOTION_MIXED;
+      } else {
+        printf("Unknown motion type %s\n", motion.c_str());
+        return false;
+      }
+    } else {
+      printf("Unknown argument %s\n", arg.c_str());
+      return false;
+    }
+  }
+
+  if (config.scenario.m_dim != 2 && config.scenario.m_dim != 3) {
+    printf("Only 2D and 3D scenarios are supported\n");
+    return false;
+  }
+
+  if (config.max_gaussians <= 0) {
+    config.max_gaussians = 2 * config.scenario.m_nTargets + 10;
+  }
+
+  if (config.max_measurements <= 0) {
+    config.max_measurements =
+        2 * (config.scenario.m_nTargets * config.scenario.m_returns +
+             int(config.scenario.m_clutterRate)) + 50;
+  }
+
+  if (config.overlap < 0.f) {
+    // Measurement noise, and the motion over a frame
+    config.overlap = 5.f * config.scenario.m_measNoisePose +
+                     2.f * config.scenario.m_maxSpeed * config.scenario.m_sampling;
+  }
+
+  if (config.tiles > 1 && (config.bounded || !config.record.empty())) {
+    printf("The tiled filter can neither be bounded nor recorded\n");
+    return false;
+  }
+
+  if (!config.birth_file.empty() && (config.tiles > 1 || !config.record.empty())) {
+    printf("The mapped births are neither tiled nor recorded\n");
+    return false;
+  }
+
+  if (config.compact_thld > 0.f && (config.bounded || config.tiles > 1)) {
+    printf("The compact storage is neither bounded nor tiled\n");
+    return false;
+  }
+
+  if (config.budget > 0.f && (config.tiles > 1 || config.scenario.m_nSensors > 1)) {
+    printf("The time budget only applies to a single filter with a single sensor\n");
+    return false;
+  }
+
+  if (config.voxel > 0.f && config.tiles > 1) {
+    printf("The tiled filter does not cluster the measurements\n");
+    return false;
+  }
+
+  if (config.smoothing_lag > 0 && config.tiles > 1) {
+    printf("The tiled filter is not smoothed\n");
+    return false;
+  }
+
+  if (config.check_allocations && !allocationCountSupported()) {
+    printf("Allocation counting is not supported on this platform\n");
+    return false;
+  }
+
+  return true;
+}
+
+// Birth model : a regular grid of wide gaussians covering the whole area
+template <typename T>
+vector<GaussianModelT<T> > birthGrid(LoadTestConfig const &config) {
+  ScenarioConfig const &scenario = config.scenario;
+  int const dim = scenario.m_dim;
+  int const n_axis = config.births_per_axis;
+  float const cell = scenario.m_areaSize / n_axis;
+
+  int n_births = 1;
+  for (int d = 0; d < dim; ++d) {
+    n_births *= n_axis;
+  }
+
+  vector<GaussianModelT<T> > births;
+  for (int i = 0; i < n_births; ++i) {
+    GaussianModelT<T> birth(2 * dim);
+    birth.m_weight = 0.1f;
+
+    int index = i;
+    for (int d = 0; d < dim; ++d) {
+      birth.m_mean(d, 0) = (index % n_axis + 0.5f) * cell;
+      index /= n_axis;
+    }
+
+    for (int d = 0; d < dim; ++d) {
+      birth.m_cov(d, d) = cell * cell;
+      birth.m_cov(dim + d, dim + d) = scenario.m_maxSpeed * scenario.m_maxSpeed;
+    }
+    births.push_back(birth);
+  }
+
+  return births;
+}
+
+template <typename T, typename Filter>
+void initFilter(Filter &filter, LoadTestConfig const &config) {
+  typedef Matrix<T, Dynamic, Dynamic> MatrixXT;
+  ScenarioConfig const &scenario = config.scenario;
+  int const dim = scenario.m_dim;
+
+  vector<GaussianModelT<T> > births = birthGrid<T>(config);
+  filter.setBirthModel(births);
+
+  filter.setDynamicsModel(scenario.m_sampling, scenario.m_accelNoise + 1.f);
+  filter.setObservationModel(scenario.m_pDetection, scenario.m_measNoisePose,
+                             scenario.m_measNoiseSpeed, config.background);
+  filter.setPruningParameters(config.trunc_thld, config.merge_thld,
+                              config.max_gaussians);
+  filter.setFusedPruning(config.fused);
+  filter.setParallelMerging(config.merge_threads);
+  filter.setThreads(config.threads);
+  filter.setSurvivalProbability(std::min(0.99f, 1.f - scenario.m_deathRate));
+
+  if (scenario.m_spawnRate > 0.f) {
+    SpawningModelT<T> spawn(dim);
+    spawn.m_weight = scenario.m_spawnRate;
+    spawn.m_trans = MatrixXT::Identity(2 * dim, 2 * dim);
+    spawn.m_cov = MatrixXT::Identity(2 * dim, 2 * dim);
+    spawn.m_cov.topLeftCorner(dim, dim) *=
+        scenario.m_measNoisePose * scenario.m_measNoisePose;
+    spawn.m_cov.bottomRightCorner(dim, dim) *=
+        scenario.m_maxSpeed * scenario.m_maxSpeed;
+
+    vector<SpawningModelT<T> > spawns(1, spawn);
+    filter.setSpawnModel(spawns);
+  }
+}
+
+// Bounded mode : the filter keeps max_gaussians targets, and every other stage is
+// sized after the scenario
+GMPHDCapacity capacity(LoadTestConfig const &config) {
+  int n_births = 1;
+  for (int d = 0; d < config.scenario.m_dim; ++d) {
+    n_births *= config.births_per_axis;
+  }
+
+  return GMPHDCapacity(config.max_gaussians, config.max_measurements, n_births,
+                       config.max_gaussians);
+}
+
+template <typename T> void printCapacity(GMPHDT<T> const &filter) {
+  if (filter.isBounded()) {
+    CapacityStats const &stats = filter.capacityStats();
+    printf("Capacity : dropped %zu measurements, %zu spawns, %zu candidates\n",
+           stats.m_droppedMeasurements, stats.m_droppedSpawns,
+           stats.m_droppedCandidates);
+  }
+
+  // Full precision footprint of the same components, heap blocks of the matrices included
+  CompactMixtureT<T> const &compact = filter.compactTargets();
+  if (compact.size() > 0) {
+    size_t const n = compact.m_dim;
+    size_t const full =
+        compact.size() * (sizeof(GaussianModelT<T>) + (n + n * n) * sizeof(T));
+    printf("Compact : %zu components at the end, %zu bytes (%zu in full precision)\n",
+           compact.size(), compact.memoryUsage(), full);
+  }
+}
+
+template <typename T> void printCapacity(GMPHDTiledT<T> const &) {}
+
+// What the time budget degraded, summed over the frames
+struct BudgetTotals {
+  size_t gated = 0;
+  size_t spawns = 0;
+  size_t truncated = 0;
+  size_t subsampled = 0;
+};
+
+template <typename T>
+void addBudgetStats(GMPHDT<T> const &filter, BudgetTotals &totals) {
+  FrameStats const &stats = filter.frameStats();
+  totals.gated += stats.m_gatedMeasurements;
+  totals.spawns += stats.m_droppedSpawns;
+  totals.truncated += stats.m_truncatedTargets;
+  totals.subsampled += stats.m_subsampledMeasurements;
+}
+
+template <typename T> void addBudgetStats(GMPHDTiledT<T> const &, BudgetTotals &) {}
+
+template <typename T>
+void printBudget(GMPHDT<T> const &filter, BudgetTotals const &totals) {
+  FrameStats const &stats = filter.frameStats();
+  if (stats.m_budget > 0) {
+    printf("Budget : %.0f us, %zu frames degraded, %zu over budget, %zu measurements "
+           "gated, %zu spawns dropped, %zu targets truncated, %zu measurements "
+           "subsampled\n",
+           1e6 * stats.m_budget, stats.m_degradedFrames, stats.m_overruns,
+           totals.gated, totals.spawns, totals.truncated, totals.subsampled);
+  }
+}
+
+template <typename T> void printBudget(GMPHDTiledT<T> const &, BudgetTotals const &) {}
+
+template <typename T> void printClustering(GMPHDT<T> const &filter) {
+  ClusteringStats const stats = filter.clusteringStats();
+  if (stats.m_measurements > 0) {
+    printf("Clustering : %zu measurements, %zu clusters (%.1fx fewer)\n",
+           stats.m_measurements, stats.m_clusters,
+           double(stats.m_measurements) / std::max<size_t>(1, stats.m_clusters));
+  }
+}
+
+template <typename T> void printClustering(GMPHDTiledT<T> const &) {}
+
+// Smoothed targets, and how many frames ago they are
+template <typename T>
+unsigned int getSmoothedTargets(GMPHDT<T> const &filter, vector<T> &position,
+                                vector<T> &speed, vector<T> &weight,
+                                float extract_thld) {
+  filter.getSmoothedTargets(position, speed, weight, extract_thld);
+  return filter.smoothingDelay();
+}
+
+template <typename T>
+unsigned int getSmoothedTargets(GMPHDTiledT<T> const &, vector<T> &position,
+                                vector<T> &speed, vector<T> &weight, float) {
+  position.clear();
+  speed.clear();
+  weight.clear();
+  return 0;
+}
+
+// Run the scenario, GMPHD or GMPHDTiled
+template <typename T, typename Filter>
+int runScenario(Filter &filter, LoadTestConfig const &config) {
+  ScenarioConfig const &scenario = config.scenario;
+  int const dim = scenario.m_dim;
+
+  Scenario workload(scenario);
+
+  vector<double> latencies;
+  int const n_sensors = scenario.m_nSensors;
+  vector<vector<T> > meas_position(n_sensors), meas_speed(n_sensors);
+  vector<T> position, speed, weight;
+  SensorModelT<T> const sensor(scenario.m_pDetection, scenario.m_measNoisePose,
+                               scenario.m_measNoiseSpeed, config.background);
+  vector<float> estimates;
+  size_t n_measurements = 0, n_allocations = 0;
+  double ospa_sum = 0., cardinality_error = 0.;
+  int n_ospa = 0;
+
+  // Smoothed estimates are compared with the ground truth of their own frame
+  int const n_history = config.smoothing_lag + 1;
+  vector<vector<float> > true_history(n_history);
+  double smoothed_ospa_sum = 0.;
+  int n_smoothed_ospa = 0;
+  BudgetTotals budget_totals;
+
+  // Nothing on the caller side should allocate while counting
+  int const warm_up = config.n_frames / 5;
+  latencies.reserve(config.n_frames);
+  position.reserve(dim * config.max_gaussians * 4);
+  speed.reserve(dim * config.max_gaussians * 4);
+  weight.reserve(config.max_gaussians * 4);
+
+  for (int frame = 0; frame < config.n_frames; ++frame) {
+    workload.step();
+
+    if (config.smoothing_lag > 0) {
+      true_history[frame % n_history] = workload.truePositions();
+    }
+
+    for (int s = 0; s < n_sensors; ++s) {
+      n_measurements += workload.measuredPositions(s).size() / dim;
+
+      meas_position[s].assign(workload.measuredPositions(s).begin(),
+                              workload.measuredPositions(s).end());
+      meas_speed[s].assign(workload.measuredSpeeds(s).begin(),
+                           workload.measuredSpeeds(s).end());
+    }
+
+    bool const counting = config.check_allocations && frame >= warm_up;
+    if (counting) {
+      startCounting();
+    }
+
+    auto const start = chrono::steady_clock::now();
+    if (n_sensors > 1) {
+      // One prediction, a correction per sensor, one pruning
+      if (scenario.m_jitter > 0.f) {
+        filter.predict(workload.time());
+      } else {
+        filter.predict();
+      }
+
+      for (int s = 0; s < n_sensors; ++s) {
+        filter.correct(meas_position[s], meas_speed[s], sensor);
+      }
+
+      filter.prune();
+    } else {
+      filter.setNewMeasurements(meas_position[0], meas_speed[0]);
+      if (scenario.m_jitter > 0.f) {
+        filter.propagate(workload.time());
+      } else {
+        filter.propagate();
+      }
+    }
+    latencies.push_back(chrono::duration<double, micro>(
+                            chrono::steady_clock::now() - start)
+                            .count());
+
+    if (counting) {
+      n_allocations += stopCounting();
+    }
+
+    addBudgetStats<T>(filter, budget_totals);
+
+    // Tracking quality, once the filter had some time to converge
+    if (frame >= warm_up && config.ospa_every > 0 &&
+        frame % config.ospa_every == 0) {
+      if (counting) {
+        startCounting();
+      }
+
+      filter.getTrackedTargets(position, speed, weight, config.extract_thld);
+
+      if (counting) {
+        n_allocations += stopCounting();
+      }
+
+      estimates.assign(position.begin(), position.end());
+      ospa_sum += ospa(workload.truePositions(), estimates, dim,
+                       config.ospa_cutoff);
+      cardinality_error +=
+          fabs(float(weight.size()) -
+               float(workload.truePositions().size() / dim));
+      ++n_ospa;
+
+      if (config.smoothing_lag > 0) {
+        if (counting) {
+          startCounting();
+        }
+
+        int const delay = getSmoothedTargets<T>(filter, position, speed, weight,
+                                                config.extract_thld);
+
+        if (counting) {
+          n_allocations += stopCounting();
+        }
+
+        if (delay > 0 && frame - delay >= warm_up) {
+          estimates.assign(position.begin(), position.end());
+          smoothed_ospa_sum += ospa(true_history[(frame - delay) % n_history],
+                                    estimates, dim, config.ospa_cutoff);
+          ++n_smoothed_ospa;
+        }
+      }
+    }
+  }
+
+  LatencySummary const summary = summarizeLatencies(latencies);
+
+  printf("Scenario : %dD, %d targets at start (%zu at the end), clutter "
+         "%.1f/frame, pD %.2f, %d sensor(s), %d frames, %s precision\n",
+         dim, scenario.m_nTargets, workload.truePositions().size() / dim,
+         scenario.m_clutterRate, scenario.m_pDetection, n_sensors, config.n_frames,
+         sizeof(T) == sizeof(double) ? "double" : "single");
+  printf("Kernels : %s\n", batchKernels<T>().m_isa);
+  printLatencies(summary, "us");
+  printf("Throughput : %.1f frames/s, %.0f measurements/s\n",
+         1e6 * summary.m_count / summary.m_total,
+         1e6 * n_measurements / summary.m_total);
+
+  if (n_ospa > 0) {
+    printf("Tracking : mean OSPA %.2f (cutoff %.1f), mean cardinality error "
+           "%.2f\n",
+           ospa_sum / n_ospa, config.ospa_cutoff, cardinality_error / n_ospa);
+  }
+
+  if (n_smoothed_ospa > 0) {
+    printf("Smoothing : mean OSPA %.2f with a lag of %d frames\n",
+           smoothed_ospa_sum / n_smoothed_ospa, config.smoothing_lag);
+  }
+
+  printCapacity<T>(filter);
+  printBudget<T>(filter, budget_totals);
+  printClustering<T>(filter);
+
+  if (config.check_allocations) {
+    printf("Allocations : %zu over the last %d frames\n", n_allocations,
+           config.n_frames - warm_up);
+    return n_allocations == 0 ? 0 : 1;
+  }
+
+  return 0;
+}
+
+template <typename T> int run(LoadTestConfig const &config) {
+  ScenarioConfig const &scenario = config.scenario;
+  int const dim = scenario.m_dim;
+
+  if (config.tiles > 1) {
+    TileGridT<T> const grid(dim, config.tiles,
+                            scenario.m_areaSize / config.tiles, config.overlap);
+
+    GMPHDTiledT<T> filter(grid, config.max_gaussians, dim, true);
+    filter.setThreads(config.tile_threads);
+    initFilter<T>(filter, config);
+
+    printf("Tiles : %d per axis, overlap %.1f, %d threads\n", config.tiles,
+           config.overlap, config.tile_threads);
+    return runScenario<T>(filter, config);
+  }
+
+  std::unique_ptr<GMPHDT<T> > filter_ptr(
+      config.bounded ? new GMPHDT<T>(capacity(config), dim, true)
+                     : new GMPHDT<T>(config.max_gaussians, dim, true));
+  GMPHDT<T> &filter = *filter_ptr;
+  initFilter<T>(filter, config);
+  filter.setCompactStorage(config.compact_thld,
+                           config.bf16 ? COMPACT_BFLOAT16 : COMPACT_FLOAT16);
+  filter.setSmoothing(config.smoothing_lag);
+  filter.setFrameBudget(1e-6 * config.budget);
+  filter.setMeasurementClustering(config.voxel);
+
+  // Same births, written to a file and used in place
+  BirthGridT<T> birth_grid;
+  if (!config.birth_file.empty()) {
+    if (!BirthGridT<T>::save(config.birth_file, birthGrid<T>(config)) ||
+        !birth_grid.open(config.birth_file)) {
+      return 1;
+    }
+
+    vector<GaussianModelT<T> > no_births;
+    filter.setBirthModel(no_births);
+    filter.setBirthGrid(&birth_grid);
+  }
+
+  GMPHDRecorderT<T> recorder;
+  if (!config.record.empty()) {
+    if (!recorder.open(config.record, filter)) {
+      return 1;
+    }
+    filter.setRecorder(&recorder);
+  }
+
+  return runScenario<T>(filter, config);
+}
+}
+
+int main(int argc, char **argv) {
+  LoadTestConfig config;
+  if (!parseArguments(argc, argv, config)) {
+    return 1;
+  }
+
+  return config.double_precision ? run<double>(config) : run<float>(config);
+}
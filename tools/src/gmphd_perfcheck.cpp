@@ -0,0 +1,569 @@
+/*
+ * Performance regression check : runs a fixed set of deterministic scenarios through
+ * GMPHD, measures the cost of each stage (predict, correct, prune) and compares it to
+ * a baseline file. Fails when a stage costs more than the baseline plus the tolerance.
+ *
+ * The cost is the instruction count when the hardware counters are available (Linux
+ * perf events), else the best of a few timed runs normalised by a fixed reference
+ * workload, so that the baseline holds on a faster or slower machine. The baseline
+ * keeps one entry per build type, kernel instruction set and metric, the instruction
+ * counts also per compiler (and major version) : without them, the timings are checked.
+ *
+ * Usage : gmphd_perfcheck --baseline file [--update] [--tolerance t] [--repeat n]
+ *                         [--timing]
+ * Returns 0 if within tolerance, 1 on a regression or if the baseline has no entry for
+ * this configuration. --update writes the current costs to the baseline.
+ */
+
+#include "gmphd_filter.h"
+#include "scenario.h"
+#include <chrono>
+#include <ctype.h>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifndef GMPHD_BUILD_TYPE
+#define GMPHD_BUILD_TYPE "default"
+#endif
+
+using namespace std;
+
+namespace {
+struct CheckConfig {
+  string baseline;
+  bool update = false;
+  bool force_timing = false;
+  float tolerance = -1.f; // Per metric default below
+  int repeat = 5;
+};
+
+struct Workload {
+  char const *name;
+  int dim;
+  int n_targets;
+  float clutter;
+  MotionType motion;
+  int n_frames;
+  bool fused;
+};
+
+// Kept small, so that the check stays fast in unoptimised builds
+Workload const WORKLOADS[] = {
+    {"cv_2d", 2, 10, 5.f, MOTION_CONSTANT_VELOCITY, 30, false},
+    {"mixed_3d", 3, 8, 5.f, MOTION_MIXED, 30, false},
+    {"clutter_2d_fused", 2, 10, 20.f, MOTION_COORDINATED_TURN, 30, true},
+};
+
+char const *const STAGES[] = {"predict", "correct", "prune"};
+int const N_STAGES = 3;
+
+// Instruction counter of the calling thread, or wall clock time
+class StageMeter {
+public:
+  explicit StageMeter(bool force_timing) : m_fd(-1) {
+#if defined(__linux__)
+    if (!force_timing) {
+      struct perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.size = sizeof(attr);
+      attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+      attr.disabled = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      m_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+#else
+    (void)force_timing;
+#endif
+  }
+
+  ~StageMeter() {
+#if defined(__linux__)
+    if (m_fd >= 0) {
+      close(m_fd);
+    }
+#endif
+  }
+
+  bool countsInstructions() const { return m_fd >= 0; }
+
+  void start() {
+#if defined(__linux__)
+    if (m_fd >= 0) {
+      ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+      return;
+    }
+#endif
+    m_start = chrono::steady_clock::now();
+  }
+
+  double stop() {
+#if defined(__linux__)
+    if (m_fd >= 0) {
+      ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+      long long count = 0;
+      if (read(m_fd, &count, sizeof(count)) != sizeof(count)) {
+        return 0.;
+      }
+      return double(count);
+    }
+#endif
+    return chrono::duration<double>(chrono::steady_clock::now() - m_start).count();
+  }
+
+private:
+  int m_fd;
+  chrono::steady_clock::time_point m_start;
+};
+
+// Fixed small dense algebra, the time unit of the normalised timings
+double referenceCost(StageMeter &meter) {
+  Matrix<float, 6, 6> a = Matrix<float, 6, 6>::Identity();
+  Matrix<float, 6, 6> b;
+  for (int i = 0; i < 36; ++i) {
+    b(i) = 0.01f * (i % 7);
+  }
+
+  meter.start();
+  for (int i = 0; i < 5000; ++i) {
+    a = (a * b + Matrix<float, 6, 6>::Identity()).inverse();
+  }
+  double const cost = meter.stop();
+
+  // Keep the loop alive
+  if (a(0, 0) == 12345.f) {
+    printf(" ");
+  }
+  return cost;
+}
+
+void initFilter(GMPHD &filter, ScenarioConfig const &scenario, bool fused) {
+  int const dim = scenario.m_dim;
+  int const n_axis = 3;
+  float const cell = scenario.m_areaSize / n_axis;
+
+  int n_births = 1;
+  for (int d = 0; d < dim; ++d) {
+    n_births *= n_axis;
+  }
+
+  vector<GaussianModel> births;
+  for (int i = 0; i < n_births; ++i) {
+    GaussianModel birth(2 * dim);
+    birth.m_weight = 0.1f;
+
+    int index = i;
+    for (int d = 0; d < dim; ++d) {
+      birth.m_mean(d, 0) = (index % n_axis + 0.5f) * cell;
+      index /= n_axis;
+    }
+
+    for (int d = 0; d < dim; ++d) {
+      birth.m_cov(d, d) = cell * cell;
+      birth.m_cov(dim + d, dim + d) = scenario.m_maxSpeed * scenario.m_maxSpeed;
+    }
+    births.push_back(birth);
+  }
+
+  filter.setBirthModel(births);
+  filter.setDynamicsModel(scenario.m_sampling, scenario.m_accelNoise + 1.f);
+  filter.setObservationModel(scenario.m_pDetection, scenario.m_measNoisePose,
+                             scenario.m_measNoiseSpeed, 0.5f);
+  filter.setPruningParameters(0.1f, 3.f, 2 * scenario.m_nTargets + 10);
+  filter.setFusedPruning(fused);
+}
+
+// Cost of each stage, summed over the frames of the workload
+void runWorkload(Workload const &workload, StageMeter &meter, double costs[N_STAGES]) {
+  ScenarioConfig scenario;
+  scenario.m_dim = workload.dim;
+  scenario.m_nTargets = workload.n_targets;
+  scenario.m_clutterRate = workload.clutter;
+  scenario.m_motion = workload.motion;
+  scenario.m_seed = 1234;
+
+  GMPHD filter(2 * workload.n_targets + 10, workload.dim, true);
+  initFilter(filter, scenario, workload.fused);
+
+  GMPHD::SensorModel const sensor(scenario.m_pDetection, scenario.m_measNoisePose,
+                                  scenario.m_measNoiseSpeed, 0.5f);
+  vector<float> position, speed;
+  Scenario frames(scenario);
+
+  for (int s = 0; s < N_STAGES; ++s) {
+    costs[s] = 0.;
+  }
+
+  for (int frame = 0; frame < workload.n_frames; ++frame) {
+    frames.step();
+    position = frames.measuredPositions();
+    speed = frames.measuredSpeeds();
+
+    meter.start();
+    filter.predict();
+    costs[0] += meter.stop();
+
+    meter.start();
+    filter.correct(position, speed, sensor);
+    costs[1] += meter.stop();
+
+    meter.start();
+    filter.prune();
+    costs[2] += meter.stop();
+  }
+}
+
+// Baselines, flattened : "configurations|<configuration>|<workload>/<stage>" -> cost
+typedef map<string, double> FlatJson;
+
+void skipSpaces(string const &text, size_t &pos) {
+  while (pos < text.size() && isspace((unsigned char)text[pos])) {
+    ++pos;
+  }
+}
+
+bool parseString(string const &text, size_t &pos, string &out) {
+  skipSpaces(text, pos);
+  if (pos >= text.size() || text[pos] != '"') {
+    return false;
+  }
+
+  size_t const end = text.find('"', pos + 1);
+  if (end == string::npos) {
+    return false;
+  }
+
+  out = text.substr(pos + 1, end - pos - 1);
+  pos = end + 1;
+  return true;
+}
+
+// Objects and numbers only, which is all the baseline holds
+bool parseValue(string const &text, size_t &pos, string const &path, FlatJson &out) {
+  skipSpaces(text, pos);
+  if (pos >= text.size()) {
+    return false;
+  }
+
+  if (text[pos] != '{') {
+    char *end = NULL;
+    double const value = strtod(text.c_str() + pos, &end);
+    if (end == text.c_str() + pos) {
+      return false;
+    }
+    out[path] = value;
+    pos = end - text.c_str();
+    return true;
+  }
+
+  ++pos;
+  skipSpaces(text, pos);
+  if (pos < text.size() && text[pos] == '}') {
+    ++pos;
+    return true;
+  }
+
+  for (;;) {
+    string key;
+    if (!parseString(text, pos, key)) {
+      return false;
+    }
+
+    skipSpaces(text, pos);
+    if (pos >= text.size() || text[pos++] != ':') {
+      return false;
+    }
+
+    if (!parseValue(text, pos, path.empty() ? key : path + "|" + key, out)) {
+      return false;
+    }
+
+    skipSpaces(text, pos);
+    if (pos < text.size() && text[pos] == ',') {
+      ++pos;
+    } else if (pos < text.size() && text[pos] == '}') {
+      ++pos;
+      return true;
+    } else {
+      return false;
+    }
+  }
+}
+
+bool loadBaseline(string const &path, FlatJson &baseline) {
+  ifstream file(path.c_str());
+  if (!file) {
+    return true; // No baseline yet
+  }
+
+  stringstream content;
+  content << file.rdbuf();
+  string const text = content.str();
+
+  size_t pos = 0;
+  if (!parseValue(text, pos, "", baseline)) {
+    printf("Could not parse the baseline %s\n", path.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool saveBaseline(string const &path, FlatJson const &baseline) {
+  // Regroup by configuration
+  map<string, map<string, double> > configurations;
+  string const prefix = "configurations|";
+
+  for (auto const &entry : baseline) {
+    if (entry.first.compare(0, prefix.size(), prefix) != 0) {
+      continue;
+    }
+
+    string const rest = entry.first.substr(prefix.size());
+    size_t const split = rest.find('|');
+    if (split != string::npos) {
+      configurations[rest.substr(0, split)][rest.substr(split + 1)] = entry.second;
+    }
+  }
+
+  ofstream file(path.c_str());
+  if (!file) {
+    printf("Could not write the baseline %s\n", path.c_str());
+    return false;
+  }
+
+  file << "{\n  \"version\": 1,\n  \"configurations\": {";
+  bool first_configuration = true;
+  for (auto const &configuration : configurations) {
+    file << (first_configuration ? "\n" : ",\n") << "    \"" << configuration.first
+         << "\": {";
+    first_configuration = false;
+
+    bool first_cost = true;
+    for (auto const &cost : configuration.second) {
+      char value[64];
+      snprintf(value, sizeof(value), "%.6g", cost.second);
+      file << (first_cost ? "\n" : ",\n") << "      \"" << cost.first << "\": " << value;
+      first_cost = false;
+    }
+    file << "\n    }";
+  }
+  file << "\n  }\n}\n";
+  return true;
+}
+
+void printUsage(char const *name) {
+  printf("Usage : %s --baseline file [--update] [--tolerance t] [--repeat n]\n"
+         "          [--timing]\n",
+         name);
+}
+
+bool parseArguments(int argc, char **argv, CheckConfig &config) {
+  for (int i = 1; i < argc; ++i) {
+    string const arg = argv[i];
+    bool const has_value = i + 1 < argc;
+
+    if (arg == "--help") {
+      printUsage(argv[0]);
+      return false;
+    } else if (arg == "--update") {
+      config.update = true;
+    } else if (arg == "--timing") {
+      config.force_timing = true;
+    } else if (!has_value) {
+      printf("Missing value for %s\n", arg.c_str());
+      return false;
+    } else if (arg == "--baseline") {
+      config.baseline = argv[++i];
+    } else if (arg == "--tolerance") {
+      config.tolerance = atof(argv[++i]);
+    } else if (arg == "--repeat") {
+      config.repeat = std::max(1, atoi(argv[++i]));
+    } else {
+      printf("Unknown argument %s\n", arg.c_str());
+      return false;
+    }
+  }
+
+  if (config.baseline.empty()) {
+    printUsage(argv[0]);
+    return false;
+  }
+
+  return true;
+}
+
+int const N_WORKLOADS = sizeof(WORKLOADS) / sizeof(WORKLOADS[0]);
+
+// Best of the repetitions, for every workload and stage, and for the reference :
+// the least disturbed runs are the most comparable. Accumulates over the calls
+void measure(StageMeter &meter, int repeat, vector<double> &best, double &unit) {
+  bool const instructions = meter.countsInstructions();
+
+  for (int rep = 0; rep < (instructions ? 1 : repeat); ++rep) {
+    for (int w = 0; w < N_WORKLOADS; ++w) {
+      double const reference = instructions ? 1. : referenceCost(meter);
+      unit = (unit < 0. || reference < unit) ? reference : unit;
+
+      double costs[N_STAGES];
+      runWorkload(WORKLOADS[w], meter, costs);
+
+      for (int s = 0; s < N_STAGES; ++s) {
+        double &slot = best[w * N_STAGES + s];
+        slot = (slot < 0. || costs[s] < slot) ? costs[s] : slot;
+      }
+    }
+  }
+}
+
+// Compiler and major version, as in the instruction counts of the baseline
+string compilerId() {
+#if defined(__clang__)
+  return "clang" + to_string(__clang_major__);
+#elif defined(__GNUC__)
+  return "gcc" + to_string(__GNUC__);
+#elif defined(_MSC_VER)
+  return "msvc" + to_string(_MSC_VER / 100);
+#else
+  return "unknown";
+#endif
+}
+
+bool hasConfiguration(FlatJson const &baseline, string const &configuration) {
+  string const prefix = "configurations|" + configuration + "|";
+  FlatJson::const_iterator const entry = baseline.lower_bound(prefix);
+  return entry != baseline.end() && entry->first.compare(0, prefix.size(), prefix) == 0;
+}
+
+string costKey(int workload, int stage) {
+  return string(WORKLOADS[workload].name) + "/" + STAGES[stage];
+}
+
+// Number of regressed stages, -1 if the baseline misses some
+int compare(vector<double> const &best, double unit, FlatJson const &baseline,
+            string const &prefix, float tolerance) {
+  int n_regressions = 0, n_missing = 0;
+
+  for (int w = 0; w < N_WORKLOADS; ++w) {
+    for (int s = 0; s < N_STAGES; ++s) {
+      string const key = costKey(w, s);
+      double const cost = best[w * N_STAGES + s] / unit;
+      FlatJson::const_iterator const reference = baseline.find(prefix + key);
+
+      if (reference == baseline.end()) {
+        printf("  %-26s %12.4g (no baseline)\n", key.c_str(), cost);
+        ++n_missing;
+        continue;
+      }
+
+      double const ratio = reference->second > 0. ? cost / reference->second : 1.;
+      bool const regressed = ratio > 1. + tolerance;
+      n_regressions += regressed ? 1 : 0;
+
+      printf("  %-26s %12.4g vs %12.4g  %+6.1f%%%s\n", key.c_str(), cost,
+             reference->second, 100. * (ratio - 1.), regressed ? "  REGRESSION" : "");
+    }
+  }
+
+  return n_missing > 0 ? -1 : n_regressions;
+}
+}
+
+int main(int argc, char **argv) {
+  CheckConfig config;
+  if (!parseArguments(argc, argv, config)) {
+    return 1;
+  }
+
+  FlatJson baseline;
+  if (!loadBaseline(config.baseline, baseline)) {
+    return 1;
+  }
+
+  StageMeter counter(config.force_timing);
+  StageMeter timer(true);
+
+  // Instruction counts are only comparable with the same code generation, the
+  // timings are normalised by a reference built by the same compiler
+  string const build = string(GMPHD_BUILD_TYPE) + "/" + batchKernels<float>().m_isa + "/";
+  string configuration = build + compilerId() + "/instructions";
+
+  if (counter.countsInstructions() && !config.update &&
+      !hasConfiguration(baseline, configuration)) {
+    printf("No instruction counts for %s in the baseline, timing instead\n",
+           configuration.c_str());
+  }
+
+  bool const instructions = counter.countsInstructions() &&
+                            (config.update || hasConfiguration(baseline, configuration));
+  StageMeter &meter = instructions ? counter : timer;
+
+  if (!instructions) {
+    configuration = build + "normalised";
+  }
+  string const prefix = "configurations|" + configuration + "|";
+
+  // Instruction counts barely move between runs, timings do
+  float const tolerance =
+      config.tolerance >= 0.f ? config.tolerance : (instructions ? 0.05f : 0.3f);
+
+  vector<double> best(N_WORKLOADS * N_STAGES, -1.);
+  double unit = -1.;
+  measure(meter, config.repeat, best, unit);
+
+  printf("Configuration : %s, tolerance %.0f%%\n", configuration.c_str(),
+         100.f * tolerance);
+
+  if (config.update) {
+    for (int w = 0; w < N_WORKLOADS; ++w) {
+      for (int s = 0; s < N_STAGES; ++s) {
+        string const key = costKey(w, s);
+        baseline[prefix + key] = best[w * N_STAGES + s] / unit;
+        printf("  %-26s %12.4g\n", key.c_str(), baseline[prefix + key]);
+      }
+    }
+
+    if (!saveBaseline(config.baseline, baseline)) {
+      return 1;
+    }
+    printf("Baseline %s updated\n", config.baseline.c_str());
+    return 0;
+  }
+
+  int n_regressions = compare(best, unit, baseline, prefix, tolerance);
+
+  // A loaded machine makes a timing look like a regression : measure again, a real
+  // regression survives the extra runs
+  for (int retry = 0; retry < 2 && n_regressions > 0 && !instructions; ++retry) {
+    printf("Measuring again\n");
+    measure(meter, config.repeat, best, unit);
+    n_regressions = compare(best, unit, baseline, prefix, tolerance);
+  }
+
+  // An unchecked configuration would pass silently, commit its baseline instead
+  if (n_regressions < 0) {
+    printf("No baseline for this configuration, run gmphd_perfcheck --update "
+           "(or build the perf_baseline target) and commit the baseline\n");
+    return 1;
+  }
+
+  if (n_regressions > 0) {
+    printf("%d stage(s) regressed beyond the tolerance. If the slowdown is intended, "
+           "update the baseline (perf_baseline target)\n",
+           n_regressions);
+    return 1;
+  }
+
+  return 0;
+}
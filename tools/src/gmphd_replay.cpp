@@ -0,0 +1,87 @@
+/*
+ * Replays a log written by GMPHDRecorder as fast as possible, and reports
+ * the per-frame latency distribution. A frame is everything up to, and including,
+ * a propagate() (or prune()) call.
+ *
+ * Usage : gmphd_replay <log> [repetitions]
+ * Single and double precision logs are both supported.
+ */
+
+#include "gmphd_recorder.h"
+#include "latency.h"
+#include <chrono>
+#include <stdlib.h>
+
+using namespace std;
+
+namespace {
+template <typename T> int replay(char const *path, int repetitions) {
+  GMPHDReplayerT<T> replayer;
+  if (!replayer.open(path)) {
+    return 1;
+  }
+
+  SnapshotHeader const &init = replayer.initialState().header();
+
+  vector<double> latencies;
+  size_t n_records = 0;
+
+  for (int rep = 0; rep < repetitions; ++rep) {
+    // Every repetition starts again from the recorded state
+    GMPHDT<T> filter(init.m_maxGaussians, init.m_dimMeasures, init.m_motionModel != 0);
+    if (!filter.loadState(replayer.initialState())) {
+      return 1;
+    }
+
+    replayer.rewind();
+
+    RecordType type;
+    auto frame_start = chrono::steady_clock::now();
+
+    while (replayer.step(filter, type)) {
+      ++n_records;
+
+      if (type == RECORD_PROPAGATE || type == RECORD_PROPAGATE_AT ||
+          type == RECORD_PRUNE) {
+        auto const now = chrono::steady_clock::now();
+        latencies.push_back(
+            chrono::duration<double, micro>(now - frame_start).count());
+        frame_start = now;
+      }
+    }
+  }
+
+  if (latencies.empty()) {
+    printf("No frame in %s\n", path);
+    return 1;
+  }
+
+  LatencySummary const summary = summarizeLatencies(latencies);
+
+  printf("%zu records, %zu frames (%d repetitions)\n", n_records,
+         summary.m_count, repetitions);
+  printLatencies(summary, "us");
+  printf("Throughput : %.1f frames/s\n", 1e6 * summary.m_count / summary.m_total);
+
+  return 0;
+}
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    printf("Usage : %s <log> [repetitions]\n", argv[0]);
+    return 1;
+  }
+
+  int const repetitions = argc > 2 ? std::max(1, atoi(argv[2])) : 1;
+
+  switch (recordScalarSize(argv[1])) {
+  case sizeof(float):
+    return replay<float>(argv[1], repetitions);
+  case sizeof(double):
+    return replay<double>(argv[1], repetitions);
+  default:
+    printf("%s is not a GMPHD log\n", argv[1]);
+    return 1;
+  }
+}
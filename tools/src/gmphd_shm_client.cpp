@@ -0,0 +1,241 @@
+/*
+ * Test client for gmphd_daemon, on the same host.
+ *
+ * Default mode : producer and consumer at once. Pushes the measurements of a synthetic
+ * scenario (see scenario.h), one ring per sensor starting at --producer, waits for the
+ * daemon to publish each frame, reads the tracked targets in place and reports the
+ * round trip latencies and the tracking quality (OSPA).
+ * --watch n : consumer only, prints the next n published frames.
+ * --stop : asks the daemon to exit.
+ *
+ * Usage : gmphd_shm_client [--name name] [--producer first_ring] [--sensors n]
+ *                          [--frames n] [--targets n] [--clutter rate] [--pd p]
+ *                          [--seed s] [--timeout s] [--watch n] [--stop]
+ */
+
+#include "latency.h"
+#include "scenario.h"
+#include "shm_tracking.h"
+#include <chrono>
+#include <math.h>
+#include <stdlib.h>
+#include <thread>
+
+using namespace std;
+
+namespace {
+struct ClientConfig {
+  ScenarioConfig scenario;
+  string name = "gmphd";
+  int producer = 0;
+  int n_frames = 100;
+  float timeout = 2.f;
+  int watch = 0;
+  bool stop = false;
+  float ospa_cutoff = 20.f;
+};
+
+void printUsage(char const *name) {
+  printf("Usage : %s [--name name] [--producer first_ring] [--sensors n]\n"
+         "          [--frames n] [--targets n] [--clutter rate] [--pd p]\n"
+         "          [--seed s] [--timeout s] [--watch n] [--stop]\n",
+         name);
+}
+
+bool parseArguments(int argc, char **argv, ClientConfig &config) {
+  for (int i = 1; i < argc; ++i) {
+    string const arg = argv[i];
+    bool const has_value = i + 1 < argc;
+
+    if (arg == "--help") {
+      printUsage(argv[0]);
+      return false;
+    } else if (arg == "--stop") {
+      config.stop = true;
+    } else if (!has_value) {
+      printf("Missing value for %s\n", arg.c_str());
+      return false;
+    } else if (arg == "--name") {
+      config.name = argv[++i];
+    } else if (arg == "--producer") {
+      config.producer = std::max(0, atoi(argv[++i]));
+    } else if (arg == "--sensors") {
+      config.scenario.m_nSensors = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--frames") {
+      config.n_frames = atoi(argv[++i]);
+    } else if (arg == "--targets") {
+      config.scenario.m_nTargets = atoi(argv[++i]);
+    } else if (arg == "--clutter") {
+      config.scenario.m_clutterRate = atof(argv[++i]);
+    } else if (arg == "--pd") {
+      config.scenario.m_pDetection = atof(argv[++i]);
+    } else if (arg == "--seed") {
+      config.scenario.m_seed = atoi(argv[++i]);
+    } else if (arg == "--timeout") {
+      config.timeout = atof(argv[++i]);
+    } else if (arg == "--watch") {
+      config.watch = atoi(argv[++i]);
+    } else {
+      printf("Unknown argument %s\n", arg.c_str());
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Copies the published targets out, once consistent. False if the frame is not there yet
+bool readFrame(TrackingSegment const &segment, double timestamp,
+               vector<float> &positions, uint32_t &n_targets) {
+  for (;;) {
+    uint64_t const sequence = segment.beginRead();
+
+    if (sequence == 0 || segment.outputTimestamp() < timestamp) {
+      return false;
+    }
+
+    n_targets = segment.outputCount();
+    float const *data = segment.outputPositions();
+    positions.assign(data, data + n_targets * segment.config().m_dim);
+
+    if (segment.endRead(sequence)) {
+      return true;
+    }
+  }
+}
+
+int watch(TrackingSegment const &segment, ClientConfig const &config) {
+  uint32_t const dim = segment.config().m_dim;
+  uint64_t last_frame = 0;
+
+  for (int seen = 0; seen < config.watch;) {
+    // In place : nothing is copied, the values are only valid until endRead()
+    uint64_t const sequence = segment.beginRead();
+    uint64_t const frame = segment.outputFrame();
+    double const timestamp = segment.outputTimestamp();
+    uint32_t const n_targets = segment.outputCount();
+    float const *positions = segment.outputPositions();
+    float first[3] = {0.f, 0.f, 0.f};
+    for (uint32_t d = 0; n_targets > 0 && d < dim; ++d) {
+      first[d] = positions[d];
+    }
+
+    if (!segment.endRead(sequence) || sequence == 0 || frame == last_frame) {
+      this_thread::sleep_for(chrono::microseconds(100));
+      continue;
+    }
+
+    printf("Frame %llu at %.3f : %u target(s)", (unsigned long long)frame,
+           timestamp, n_targets);
+    if (n_targets > 0) {
+      printf(", first at (");
+      for (uint32_t d = 0; d < dim; ++d) {
+        printf(d > 0 ? " %.1f" : "%.1f", first[d]);
+      }
+      printf(")");
+    }
+    printf("\n");
+
+    last_frame = frame;
+    ++seen;
+  }
+
+  return 0;
+}
+
+int produce(TrackingSegment &segment, ClientConfig const &config) {
+  SegmentConfig const &layout = segment.config();
+  ScenarioConfig scenario = config.scenario;
+  scenario.m_dim = layout.m_dim;
+
+  int const n_sensors = scenario.m_nSensors;
+  if (config.producer + n_sensors > int(layout.m_nProducers)) {
+    printf("The daemon only has %u producer ring(s)\n", layout.m_nProducers);
+    return 1;
+  }
+
+  Scenario workload(scenario);
+  vector<double> latencies;
+  vector<float> estimates;
+  double ospa_sum = 0., cardinality_error = 0.;
+  int n_ospa = 0;
+  int const warm_up = config.n_frames / 5;
+
+  for (int frame = 0; frame < config.n_frames; ++frame) {
+    workload.step();
+    double const timestamp = workload.time();
+
+    auto const start = chrono::steady_clock::now();
+    auto const deadline = start + chrono::duration<double>(config.timeout);
+
+    for (int s = 0; s < n_sensors; ++s) {
+      vector<float> const &positions = workload.measuredPositions(s);
+
+      while (!segment.push(config.producer + s, timestamp, positions.data(),
+                           workload.measuredSpeeds(s).data(),
+                           positions.size() / layout.m_dim)) {
+        this_thread::yield();
+      }
+    }
+
+    uint32_t n_targets = 0;
+    while (!readFrame(segment, timestamp, estimates, n_targets)) {
+      if (chrono::steady_clock::now() > deadline || !segment.daemonRunning()) {
+        printf("No answer from the daemon for frame %d\n", frame);
+        return 1;
+      }
+      this_thread::yield();
+    }
+
+    latencies.push_back(chrono::duration<double, micro>(
+                            chrono::steady_clock::now() - start)
+                            .count());
+
+    if (frame >= warm_up) {
+      ospa_sum += ospa(workload.truePositions(), estimates, layout.m_dim,
+                       config.ospa_cutoff);
+      cardinality_error += fabs(float(n_targets) - float(workload.truePositions().size() /
+                                                         layout.m_dim));
+      ++n_ospa;
+    }
+  }
+
+  printf("Round trip, push to publication :\n");
+  printLatencies(summarizeLatencies(latencies), "us");
+
+  if (n_ospa > 0) {
+    printf("Tracking : mean OSPA %.2f (cutoff %.1f), mean cardinality error %.2f\n",
+           ospa_sum / n_ospa, config.ospa_cutoff, cardinality_error / n_ospa);
+  }
+
+  return 0;
+}
+}
+
+int main(int argc, char **argv) {
+  ClientConfig config;
+  if (!parseArguments(argc, argv, config)) {
+    return 1;
+  }
+
+  TrackingSegment segment;
+  if (!segment.open(config.name)) {
+    return 1;
+  }
+
+  if (config.stop) {
+    segment.requestStop();
+    return 0;
+  }
+
+  if (!segment.daemonRunning()) {
+    printf("The daemon of %s is not running\n", config.name.c_str());
+    return 1;
+  }
+
+  if (config.watch > 0) {
+    return watch(segment, config);
+  }
+
+  return produce(segment, config);
+}
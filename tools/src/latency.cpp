@@ -0,0 +1,105 @@
+#include "latency.h"
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+
+namespace {
+    double percentile(vector<double> const & sorted, double p)
+    {
+        size_t const index = std::min(sorted.size() - 1, size_t(p * (sorted.size() - 1) + 0.5));
+        return sorted[index];
+    }
+}
+
+LatencySummary summarizeLatencies(vector<double> latencies)
+{
+    LatencySummary summary = {0, 0., 0., 0., 0., 0., 0., 0.};
+
+    if (latencies.empty())
+    {
+        return summary;
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+
+    summary.m_count = latencies.size();
+    for (auto const latency : latencies)
+    {
+        summary.m_total += latency;
+    }
+
+    summary.m_mean = summary.m_total / summary.m_count;
+    summary.m_p50  = percentile(latencies, 0.5);
+    summary.m_p90  = percentile(latencies, 0.9);
+    summary.m_p99  = percentile(latencies, 0.99);
+    summary.m_p999 = percentile(latencies, 0.999);
+    summary.m_max  = latencies.back();
+    return summary;
+}
+
+void printLatencies(LatencySummary const & summary, char const * unit)
+{
+    printf("Latency per frame (%s) : mean %.1f | p50 %.1f | p90 %.1f | p99 %.1f | p99.9 %.1f | max %.1f\n",
+           unit, summary.m_mean, summary.m_p50, summary.m_p90, summary.m_p99, summary.m_p999, summary.m_max);
+}
+
+LatencyHistogram::LatencyHistogram():
+    m_buckets((LATENCY_MAX_OCTAVE - LATENCY_MIN_OCTAVE) * LATENCY_BUCKETS_PER_OCTAVE, 0),
+    m_count(0),
+    m_total(0.),
+    m_max(0.)
+{
+}
+
+void LatencyHistogram::add(double latency)
+{
+    double const position = (log2(std::max(latency, 0.)) - LATENCY_MIN_OCTAVE) * LATENCY_BUCKETS_PER_OCTAVE;
+    double const last = double(m_buckets.size() - 1);
+
+    // log2(0) is -inf, the first bucket
+    ++m_buckets[size_t(std::min(std::max(position, 0.), last))];
+
+    m_max = m_count == 0 ? latency : std::max(m_max, latency);
+    m_total += latency;
+    ++m_count;
+}
+
+double LatencyHistogram::percentile(double p) const
+{
+    // Same rank as on the sorted latencies
+    uint64_t const rank = std::min(m_count - 1, size_t(p * (m_count - 1) + 0.5));
+    uint64_t seen = 0;
+
+    for (size_t b = 0; b < m_buckets.size(); ++b)
+    {
+        seen += m_buckets[b];
+
+        if (seen > rank)
+        {
+            double const center = exp2((b + 0.5) / LATENCY_BUCKETS_PER_OCTAVE + LATENCY_MIN_OCTAVE);
+            return std::min(center, m_max);
+        }
+    }
+
+    return m_max;
+}
+
+LatencySummary LatencyHistogram::summary() const
+{
+    LatencySummary summary = {0, 0., 0., 0., 0., 0., 0., 0.};
+
+    if (m_count == 0)
+    {
+        return summary;
+    }
+
+    summary.m_count = m_count;
+    summary.m_total = m_total;
+    summary.m_mean = m_total / m_count;
+    summary.m_p50  = percentile(0.5);
+    summary.m_p90  = percentile(0.9);
+    summary.m_p99  = percentile(0.99);
+    summary.m_p999 = percentile(0.999);
+    summary.m_max  = m_max;
+    return summary;
+}
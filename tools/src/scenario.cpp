@@ -0,0 +1,440 @@
+#include "scenario.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+
+ScenarioConfig::ScenarioConfig():
+    m_dim(2),
+    m_nTargets(5),
+    m_maxTargets(100000),
+    m_sampling(1.f),
+    m_jitter(0.f),
+    m_areaSize(1000.f),
+    m_maxSpeed(10.f),
+    m_turnRate(0.05f),
+    m_accelNoise(0.5f),
+    m_nSensors(1),
+    m_pDetection(0.9f),
+    m_clutterRate(10.f),
+    m_measNoisePose(2.f),
+    m_measNoiseSpeed(1.f),
+    m_returns(1),
+    m_extent(0.f),
+    m_spawnRate(0.f),
+    m_deathRate(0.f),
+    m_motion(MOTION_CONSTANT_VELOCITY),
+    m_seed(42)
+{
+}
+
+Scenario::Scenario(ScenarioConfig const & config):
+    m_config(config),
+    m_frame(0),
+    m_time(0.),
+    m_interval(config.m_sampling),
+    m_measPositions(std::max(1, config.m_nSensors)),
+    m_measSpeeds(std::max(1, config.m_nSensors)),
+    m_rng(config.m_seed),
+    m_uniform(0.f, 1.f),
+    m_normal(0.f, 1.f)
+{
+    m_targets.reserve(m_config.m_nTargets);
+
+    for (int i = 0; i < m_config.m_nTargets; ++i)
+    {
+        m_targets.push_back(newTarget());
+    }
+}
+
+Scenario::Target Scenario::newTarget()
+{
+    Target target;
+    target.m_pos.resize(m_config.m_dim);
+    target.m_speed.resize(m_config.m_dim);
+
+    for (int d = 0; d < m_config.m_dim; ++d)
+    {
+        target.m_pos[d] = m_uniform(m_rng) * m_config.m_areaSize;
+        target.m_speed[d] = (2.f * m_uniform(m_rng) - 1.f) * m_config.m_maxSpeed;
+    }
+
+    target.m_motion = m_config.m_motion;
+    if (target.m_motion == MOTION_MIXED)
+    {
+        target.m_motion = static_cast<MotionType>(m_rng() % MOTION_MIXED);
+    }
+
+    target.m_turnRate = (m_uniform(m_rng) > 0.5f ? 1.f : -1.f) * m_config.m_turnRate;
+    return target;
+}
+
+void Scenario::move(Target & target)
+{
+    float const dt = m_interval;
+
+    switch (target.m_motion)
+    {
+        case MOTION_COORDINATED_TURN:
+        {
+            // Turn in the horizontal plane
+            float const angle = target.m_turnRate * dt;
+            float const vx = target.m_speed[0], vy = target.m_speed[1];
+            target.m_speed[0] = cos(angle) * vx - sin(angle) * vy;
+            target.m_speed[1] = sin(angle) * vx + cos(angle) * vy;
+            break;
+        }
+
+        case MOTION_RANDOM_WALK:
+            for (auto & speed : target.m_speed)
+            {
+                speed += m_config.m_accelNoise * dt * m_normal(m_rng);
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    // Move, and bounce on the borders of the area
+    for (int d = 0; d < m_config.m_dim; ++d)
+    {
+        target.m_pos[d] += target.m_speed[d] * dt;
+
+        if (target.m_pos[d] < 0.f || target.m_pos[d] > m_config.m_areaSize)
+        {
+            target.m_speed[d] = -target.m_speed[d];
+            target.m_pos[d] = std::min(std::max(target.m_pos[d], 0.f), m_config.m_areaSize);
+        }
+    }
+}
+
+void Scenario::step()
+{
+    ++m_frame;
+
+    // Irregular sampling
+    if (m_config.m_jitter > 0.f)
+    {
+        m_interval = m_config.m_sampling * (1.f + m_config.m_jitter * (2.f * m_uniform(m_rng) - 1.f));
+    }
+
+    m_time += m_interval;
+
+    // Deaths and spawns
+    if (m_config.m_deathRate > 0.f)
+    {
+        m_targets.erase(std::remove_if(m_targets.begin(), m_targets.end(), [this](Target const &)
+        {
+            return m_uniform(m_rng) < m_config.m_deathRate;
+        }), m_targets.end());
+    }
+
+    if (m_config.m_spawnRate > 0.f)
+    {
+        size_t const n_parents = m_targets.size();
+
+        for (size_t i = 0; i < n_parents && int(m_targets.size()) < m_config.m_maxTargets; ++i)
+        {
+            if (m_uniform(m_rng) < m_config.m_spawnRate)
+            {
+                // The child starts from its parent, with a different heading
+                Target child = newTarget();
+                child.m_pos = m_targets[i].m_pos;
+                m_targets.push_back(child);
+            }
+        }
+    }
+
+    for (auto & target : m_targets)
+    {
+        move(target);
+    }
+
+    measure();
+}
+
+void Scenario::measure()
+{
+    int const dim = m_config.m_dim;
+
+    m_truePositions.clear();
+
+    for (auto const & target : m_targets)
+    {
+        m_truePositions.insert(m_truePositions.end(), target.m_pos.begin(), target.m_pos.end());
+    }
+
+    for (size_t s = 0; s < m_measPositions.size(); ++s)
+    {
+        vector<float> & positions = m_measPositions[s];
+        vector<float> & speeds = m_measSpeeds[s];
+
+        positions.clear();
+        speeds.clear();
+
+        for (auto const & target : m_targets)
+        {
+            if (m_uniform(m_rng) < m_config.m_pDetection)
+            {
+                for (int r = 0; r < m_config.m_returns; ++r)
+                {
+                    for (int d = 0; d < dim; ++d)
+                    {
+                        float const offset = m_config.m_extent > 0.f ? m_config.m_extent * m_normal(m_rng) : 0.f;
+
+                        positions.push_back(target.m_pos[d] + offset + m_config.m_measNoisePose * m_normal(m_rng));
+                        speeds.push_back(target.m_speed[d] + m_config.m_measNoiseSpeed * m_normal(m_rng));
+                    }
+                }
+            }
+        }
+
+        // False detections, uniform over the area
+        std::poisson_distribution<int> clutter(m_config.m_clutterRate);
+        int const n_clutter = m_config.m_clutterRate > 0.f ? clutter(m_rng) : 0;
+
+        for (int i = 0; i < n_clutter; ++i)
+        {
+            for (int d = 0; d < dim; ++d)
+            {
+                positions.push_back(m_uniform(m_rng) * m_config.m_areaSize);
+                speeds.push_back((2.f * m_uniform(m_rng) - 1.f) * m_config.m_maxSpeed);
+            }
+        }
+    }
+}
+
+int Scenario::frame() const
+{
+    return m_frame;
+}
+
+double Scenario::time() const
+{
+    return m_time;
+}
+
+int Scenario::dim() const
+{
+    return m_config.m_dim;
+}
+
+ScenarioConfig const & Scenario::config() const
+{
+    return m_config;
+}
+
+vector<float> const & Scenario::measuredPositions(int sensor) const
+{
+    return m_measPositions[sensor];
+}
+
+vector<float> const & Scenario::measuredSpeeds(int sensor) const
+{
+    return m_measSpeeds[sensor];
+}
+
+vector<float> const & Scenario::truePositions() const
+{
+    return m_truePositions;
+}
+
+
+namespace {
+    float distance(float const * a, float const * b, int dim)
+    {
+        float sum = 0.f;
+        for (int d = 0; d < dim; ++d)
+        {
+            sum += (a[d] - b[d]) * (a[d] - b[d]);
+        }
+        return sqrt(sum);
+    }
+
+    // Minimum cost assignment of every row (rows <= cols), shortest augmenting paths, O(rows^2.cols)
+    double hungarian(vector<double> const & cost, int rows, int cols)
+    {
+        double const inf = std::numeric_limits<double>::infinity();
+        vector<double> u(rows + 1, 0.), v(cols + 1, 0.);
+        vector<int> match(cols + 1, 0), way(cols + 1, 0);
+
+        for (int i = 1; i <= rows; ++i)
+        {
+            match[0] = i;
+            int j0 = 0;
+            vector<double> min_v(cols + 1, inf);
+            vector<char> used(cols + 1, 0);
+
+            do
+            {
+                used[j0] = 1;
+                int const i0 = match[j0];
+                double delta = inf;
+                int j1 = 0;
+
+                for (int j = 1; j <= cols; ++j)
+                {
+                    if (!used[j])
+                    {
+                        double const cur = cost[(i0 - 1) * cols + (j - 1)] - u[i0] - v[j];
+                        if (cur < min_v[j])
+                        {
+                            min_v[j] = cur;
+                            way[j] = j0;
+                        }
+                        if (min_v[j] < delta)
+                        {
+                            delta = min_v[j];
+                            j1 = j;
+                        }
+                    }
+                }
+
+                for (int j = 0; j <= cols; ++j)
+                {
+                    if (used[j])
+                    {
+                        u[match[j]] += delta;
+                        v[j] -= delta;
+                    }
+                    else
+                    {
+                        min_v[j] -= delta;
+                    }
+                }
+
+                j0 = j1;
+            } while (match[j0] != 0);
+
+            do
+            {
+                int const j1 = way[j0];
+                match[j0] = match[j1];
+                j0 = j1;
+            } while (j0 != 0);
+        }
+
+        double total = 0.;
+        for (int j = 1; j <= cols; ++j)
+        {
+            if (match[j] != 0)
+            {
+                total += cost[(match[j] - 1) * cols + (j - 1)];
+            }
+        }
+        return total;
+    }
+
+    // Greedy assignment of the closest pairs, bucketed on a grid of the cutoff size
+    double greedy(vector<float> const & small, vector<float> const & large, int dim,
+                  float cutoff, float order)
+    {
+        int const n_small = small.size() / dim, n_large = large.size() / dim;
+
+        auto cell_key = [&](float const * p, int offset_x, int offset_y) -> long long
+        {
+            long long const x = (long long) floor(p[0] / cutoff) + offset_x;
+            long long const y = (long long) floor(p[1] / cutoff) + offset_y;
+            return (x << 32) ^ (y & 0xffffffffLL);
+        };
+
+        unordered_map<long long, vector<int> > grid;
+        for (int j = 0; j < n_large; ++j)
+        {
+            grid[cell_key(&large[j * dim], 0, 0)].push_back(j);
+        }
+
+        struct Pair { float m_dist; int m_i; int m_j; };
+        vector<Pair> pairs;
+
+        for (int i = 0; i < n_small; ++i)
+        {
+            for (int dx = -1; dx <= 1; ++dx)
+            {
+                for (int dy = -1; dy <= 1; ++dy)
+                {
+                    auto const cell = grid.find(cell_key(&small[i * dim], dx, dy));
+                    if (cell == grid.end())
+                    {
+                        continue;
+                    }
+
+                    for (int const j : cell->second)
+                    {
+                        float const dist = distance(&small[i * dim], &large[j * dim], dim);
+                        if (dist < cutoff)
+                        {
+                            pairs.push_back({dist, i, j});
+                        }
+                    }
+                }
+            }
+        }
+
+        std::sort(pairs.begin(), pairs.end(), [](Pair const & lhs, Pair const & rhs)
+        {
+            return lhs.m_dist < rhs.m_dist;
+        });
+
+        vector<char> used_small(n_small, 0), used_large(n_large, 0);
+        double total = 0.;
+        int n_matched = 0;
+
+        for (auto const & pair : pairs)
+        {
+            if (!used_small[pair.m_i] && !used_large[pair.m_j])
+            {
+                used_small[pair.m_i] = used_large[pair.m_j] = 1;
+                total += pow(pair.m_dist, order);
+                ++n_matched;
+            }
+        }
+
+        return total + (n_small - n_matched) * pow(cutoff, order);
+    }
+}
+
+float ospa(vector<float> const & truth, vector<float> const & estimates, int dim,
+           float cutoff, float order, int exact_limit)
+{
+    bool const truth_smaller = truth.size() <= estimates.size();
+    vector<float> const & small = truth_smaller ? truth : estimates;
+    vector<float> const & large = truth_smaller ? estimates : truth;
+
+    int const n_small = small.size() / dim, n_large = large.size() / dim;
+
+    if (n_large == 0)
+    {
+        return 0.f;
+    }
+
+    if (n_small == 0)
+    {
+        return cutoff;
+    }
+
+    double assignment = 0.;
+
+    if (n_large <= exact_limit)
+    {
+        vector<double> cost(size_t(n_small) * n_large);
+        for (int i = 0; i < n_small; ++i)
+        {
+            for (int j = 0; j < n_large; ++j)
+            {
+                float const dist = std::min(cutoff, distance(&small[i * dim], &large[j * dim], dim));
+                cost[size_t(i) * n_large + j] = pow(dist, order);
+            }
+        }
+
+        assignment = hungarian(cost, n_small, n_large);
+    }
+    else
+    {
+        assignment = greedy(small, large, dim, cutoff, order);
+    }
+
+    double const cardinality = pow(cutoff, order) * (n_large - n_small);
+    return pow((assignment + cardinality) / n_large, 1. / order);
+}
@@ -0,0 +1,360 @@
+#include "shm_tracking.h"
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <new>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The counters live in shared memory, they have to work across processes
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+              "Lock-free atomics are required for the shared memory rings");
+
+namespace {
+uint32_t const SEGMENT_MAGIC   = 0x47504844; // "GPHD"
+uint32_t const SEGMENT_VERSION = 1;
+size_t const   CACHE_LINE      = 64;
+
+inline size_t alignUp(size_t size) {
+  return (size + CACHE_LINE - 1) & ~(CACHE_LINE - 1);
+}
+
+string shmName(string const &name) {
+  return (!name.empty() && name[0] == '/') ? name : "/" + name;
+}
+}
+
+struct TrackingSegment::Header {
+  std::atomic<uint32_t> m_magic; // Set last, once the segment is ready
+  uint32_t m_version;
+  SegmentConfig m_config;
+  std::atomic<uint32_t> m_running;
+  std::atomic<uint32_t> m_stop;
+};
+
+// Producer owns the head, the daemon the tail, on separate cache lines
+struct TrackingSegment::Ring {
+  alignas(64) std::atomic<uint64_t> m_head;
+  alignas(64) std::atomic<uint64_t> m_tail;
+};
+
+// Followed by the positions and the speeds
+struct TrackingSegment::Slot {
+  double m_timestamp;
+  uint32_t m_nMeasurements;
+  uint32_t m_padding;
+};
+
+// Followed by the positions, speeds and weights
+struct TrackingSegment::Output {
+  alignas(64) std::atomic<uint64_t> m_sequence; // Odd while publishing
+  uint64_t m_frame;
+  double m_timestamp;
+  uint32_t m_nTargets;
+};
+
+SegmentConfig::SegmentConfig()
+    : m_dim(2), m_nProducers(1), m_nSlots(64), m_maxMeasurements(1024),
+      m_maxTargets(1024) {}
+
+TrackingSegment::TrackingSegment() : m_owner(false), m_base(NULL), m_size(0) {}
+
+TrackingSegment::~TrackingSegment() { close(); }
+
+size_t TrackingSegment::slotSize() const {
+  return alignUp(sizeof(Slot) + 2 * sizeof(float) * m_config.m_maxMeasurements *
+                                    m_config.m_dim);
+}
+
+size_t TrackingSegment::ringSize() const {
+  return alignUp(sizeof(Ring)) + m_config.m_nSlots * slotSize();
+}
+
+size_t TrackingSegment::segmentSize() const {
+  return alignUp(sizeof(Header)) + m_config.m_nProducers * ringSize() +
+         alignUp(sizeof(Output)) +
+         alignUp(3 * sizeof(float) * m_config.m_maxTargets * m_config.m_dim);
+}
+
+bool TrackingSegment::map(int fd, size_t size) {
+  void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+
+  if (base == MAP_FAILED) {
+    printf("[TrackingSegment] - Could not map %s : %s\n", m_name.c_str(),
+           strerror(errno));
+    return false;
+  }
+
+  m_base = static_cast<unsigned char *>(base);
+  m_size = size;
+  return true;
+}
+
+bool TrackingSegment::create(string const &name, SegmentConfig const &config) {
+  close();
+
+  if (config.m_dim < 2 || config.m_dim > 3 || config.m_nProducers == 0 ||
+      config.m_nSlots == 0 || (config.m_nSlots & (config.m_nSlots - 1)) != 0) {
+    printf("[TrackingSegment] - Invalid configuration (2D/3D, at least one "
+           "producer, power of two slots)\n");
+    return false;
+  }
+
+  m_name = shmName(name);
+  m_config = config;
+
+  size_t const size = segmentSize();
+
+  // A stale segment from a previous run would have the wrong layout
+  shm_unlink(m_name.c_str());
+
+  int fd = shm_open(m_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0660);
+  if (fd < 0) {
+    printf("[TrackingSegment] - Could not create %s : %s\n", m_name.c_str(),
+           strerror(errno));
+    return false;
+  }
+
+  if (ftruncate(fd, size) != 0) {
+    printf("[TrackingSegment] - Could not size %s : %s\n", m_name.c_str(),
+           strerror(errno));
+    ::close(fd);
+    shm_unlink(m_name.c_str());
+    return false;
+  }
+
+  if (!map(fd, size)) {
+    shm_unlink(m_name.c_str());
+    return false;
+  }
+
+  m_owner = true;
+
+  // The memory is zeroed, the atomics only need constructing
+  Header *header = new (m_base) Header;
+  header->m_version = SEGMENT_VERSION;
+  header->m_config = m_config;
+  header->m_running.store(0);
+  header->m_stop.store(0);
+
+  for (uint32_t p = 0; p < m_config.m_nProducers; ++p) {
+    Ring *r = new (&ring(p)) Ring;
+    r->m_head.store(0);
+    r->m_tail.store(0);
+  }
+
+  Output *out = new (&output()) Output;
+  out->m_sequence.store(0);
+
+  header->m_magic.store(SEGMENT_MAGIC, std::memory_order_release);
+  return true;
+}
+
+bool TrackingSegment::open(string const &name) {
+  close();
+  m_name = shmName(name);
+
+  int fd = shm_open(m_name.c_str(), O_RDWR, 0);
+  if (fd < 0) {
+    printf("[TrackingSegment] - Could not open %s : %s\n", m_name.c_str(),
+           strerror(errno));
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(Header)) {
+    printf("[TrackingSegment] - %s is not a tracking segment\n", m_name.c_str());
+    ::close(fd);
+    return false;
+  }
+
+  if (!map(fd, info.st_size)) {
+    return false;
+  }
+
+  Header const *header = reinterpret_cast<Header const *>(m_base);
+  if (header->m_magic.load(std::memory_order_acquire) != SEGMENT_MAGIC ||
+      header->m_version != SEGMENT_VERSION) {
+    printf("[TrackingSegment] - %s is not a tracking segment, or not ready\n",
+           m_name.c_str());
+    close();
+    return false;
+  }
+
+  m_config = header->m_config;
+  if (segmentSize() > m_size) {
+    printf("[TrackingSegment] - %s is truncated\n", m_name.c_str());
+    close();
+    return false;
+  }
+  return true;
+}
+
+void TrackingSegment::close() {
+  if (m_base) {
+    munmap(m_base, m_size);
+    m_base = NULL;
+    m_size = 0;
+  }
+
+  if (m_owner) {
+    shm_unlink(m_name.c_str());
+    m_owner = false;
+  }
+}
+
+SegmentConfig const &TrackingSegment::config() const { return m_config; }
+
+bool TrackingSegment::daemonRunning() const {
+  return reinterpret_cast<Header const *>(m_base)->m_running.load(
+             std::memory_order_acquire) != 0;
+}
+
+void TrackingSegment::setDaemonRunning(bool running) {
+  reinterpret_cast<Header *>(m_base)->m_running.store(running ? 1 : 0,
+                                                      std::memory_order_release);
+}
+
+bool TrackingSegment::stopRequested() const {
+  return reinterpret_cast<Header const *>(m_base)->m_stop.load(
+             std::memory_order_acquire) != 0;
+}
+
+void TrackingSegment::requestStop() {
+  reinterpret_cast<Header *>(m_base)->m_stop.store(1, std::memory_order_release);
+}
+
+TrackingSegment::Ring &TrackingSegment::ring(uint32_t producer) const {
+  return *reinterpret_cast<Ring *>(m_base + alignUp(sizeof(Header)) +
+                                   producer * ringSize());
+}
+
+TrackingSegment::Slot &TrackingSegment::slot(uint32_t producer,
+                                             uint64_t index) const {
+  unsigned char *slots =
+      reinterpret_cast<unsigned char *>(&ring(producer)) + alignUp(sizeof(Ring));
+  return *reinterpret_cast<Slot *>(slots + (index & (m_config.m_nSlots - 1)) *
+                                               slotSize());
+}
+
+TrackingSegment::Output &TrackingSegment::output() const {
+  return *reinterpret_cast<Output *>(m_base + alignUp(sizeof(Header)) +
+                                     m_config.m_nProducers * ringSize());
+}
+
+bool TrackingSegment::push(uint32_t producer, double timestamp,
+                           float const *positions, float const *speeds,
+                           uint32_t n_measurements) {
+  Ring &r = ring(producer);
+  uint64_t const head = r.m_head.load(std::memory_order_relaxed);
+
+  if (head - r.m_tail.load(std::memory_order_acquire) >= m_config.m_nSlots) {
+    return false;
+  }
+
+  Slot &s = slot(producer, head);
+  uint32_t const n = std::min(n_measurements, m_config.m_maxMeasurements);
+  size_t const n_values = size_t(n) * m_config.m_dim;
+
+  float *data = reinterpret_cast<float *>(&s + 1);
+  memcpy(data, positions, n_values * sizeof(float));
+
+  // Frames without speeds read as zero speeds
+  float *speed_data = data + m_config.m_maxMeasurements * m_config.m_dim;
+  if (speeds) {
+    memcpy(speed_data, speeds, n_values * sizeof(float));
+  } else {
+    memset(speed_data, 0, n_values * sizeof(float));
+  }
+
+  s.m_timestamp = timestamp;
+  s.m_nMeasurements = n;
+
+  r.m_head.store(head + 1, std::memory_order_release);
+  return true;
+}
+
+bool TrackingSegment::front(uint32_t producer, FrameView &frame) const {
+  Ring &r = ring(producer);
+  uint64_t const tail = r.m_tail.load(std::memory_order_relaxed);
+
+  if (tail == r.m_head.load(std::memory_order_acquire)) {
+    return false;
+  }
+
+  Slot const &s = slot(producer, tail);
+  float const *data = reinterpret_cast<float const *>(&s + 1);
+
+  frame.m_timestamp = s.m_timestamp;
+  frame.m_nMeasurements = s.m_nMeasurements;
+  frame.m_positions = data;
+  frame.m_speeds = data + m_config.m_maxMeasurements * m_config.m_dim;
+  return true;
+}
+
+void TrackingSegment::pop(uint32_t producer) {
+  Ring &r = ring(producer);
+  r.m_tail.store(r.m_tail.load(std::memory_order_relaxed) + 1,
+                 std::memory_order_release);
+}
+
+void TrackingSegment::publish(uint64_t frame, double timestamp,
+                              float const *positions, float const *speeds,
+                              float const *weights, uint32_t n_targets) {
+  Output &out = output();
+  uint64_t const sequence = out.m_sequence.load(std::memory_order_relaxed);
+
+  out.m_sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  uint32_t const n = std::min(n_targets, m_config.m_maxTargets);
+  size_t const n_values = size_t(n) * m_config.m_dim;
+  size_t const stride = size_t(m_config.m_maxTargets) * m_config.m_dim;
+  float *data = reinterpret_cast<float *>(&out + 1);
+
+  out.m_frame = frame;
+  out.m_timestamp = timestamp;
+  out.m_nTargets = n;
+  memcpy(data, positions, n_values * sizeof(float));
+  memcpy(data + stride, speeds, n_values * sizeof(float));
+  memcpy(data + 2 * stride, weights, n * sizeof(float));
+
+  out.m_sequence.store(sequence + 2, std::memory_order_release);
+}
+
+uint64_t TrackingSegment::beginRead() const {
+  Output const &out = output();
+  uint64_t sequence;
+  while ((sequence = out.m_sequence.load(std::memory_order_acquire)) & 1) {
+  }
+  return sequence;
+}
+
+bool TrackingSegment::endRead(uint64_t sequence) const {
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return output().m_sequence.load(std::memory_order_relaxed) == sequence;
+}
+
+uint64_t TrackingSegment::outputFrame() const { return output().m_frame; }
+
+double TrackingSegment::outputTimestamp() const { return output().m_timestamp; }
+
+uint32_t TrackingSegment::outputCount() const {
+  return std::min(output().m_nTargets, m_config.m_maxTargets);
+}
+
+float const *TrackingSegment::outputPositions() const {
+  return reinterpret_cast<float const *>(&output() + 1);
+}
+
+float const *TrackingSegment::outputSpeeds() const {
+  return outputPositions() + size_t(m_config.m_maxTargets) * m_config.m_dim;
+}
+
+float const *TrackingSegment::outputWeights() const {
+  return outputPositions() + 2 * size_t(m_config.m_maxTargets) * m_config.m_dim;
+}